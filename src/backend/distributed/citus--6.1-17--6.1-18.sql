@@ -0,0 +1,13 @@
+/* citus--6.1-17--6.1-18.sql */
+
+SET search_path = 'pg_catalog';
+
+CREATE FUNCTION task_tracker_task_statuses(job_ids bigint[], task_ids integer[],
+										   wait_time integer)
+    RETURNS SETOF integer
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$task_tracker_task_statuses$$;
+COMMENT ON FUNCTION task_tracker_task_statuses(bigint[], integer[], integer)
+    IS 'wait for one of the given tasks to finish and return the tasks'' execution statuses';
+
+RESET search_path;
@@ -0,0 +1,56 @@
+/* citus--6.1-18--6.1-19.sql */
+
+SET search_path = 'pg_catalog';
+
+CREATE FUNCTION worker_partial_agg_sfunc(internal, oid, anyelement)
+    RETURNS internal
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', $$worker_partial_agg_sfunc$$;
+COMMENT ON FUNCTION worker_partial_agg_sfunc(internal, oid, anyelement)
+    IS 'transition function for worker_partial_agg';
+
+CREATE FUNCTION worker_partial_agg_ffunc(internal)
+    RETURNS bytea
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', $$worker_partial_agg_ffunc$$;
+COMMENT ON FUNCTION worker_partial_agg_ffunc(internal)
+    IS 'finalizer for worker_partial_agg';
+
+CREATE AGGREGATE worker_partial_agg(oid, anyelement) (
+    STYPE = internal,
+    SFUNC = worker_partial_agg_sfunc,
+    FINALFUNC = worker_partial_agg_ffunc
+);
+COMMENT ON AGGREGATE worker_partial_agg(oid, anyelement)
+    IS 'compute the serialized transition state of the given aggregate';
+
+CREATE FUNCTION master_combine_agg_sfunc(internal, oid, bytea, anyelement)
+    RETURNS internal
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', $$master_combine_agg_sfunc$$;
+COMMENT ON FUNCTION master_combine_agg_sfunc(internal, oid, bytea, anyelement)
+    IS 'transition function for master_combine_agg';
+
+CREATE FUNCTION master_combine_agg_ffunc(internal, oid, bytea, anyelement)
+    RETURNS anyelement
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', $$master_combine_agg_ffunc$$;
+COMMENT ON FUNCTION master_combine_agg_ffunc(internal, oid, bytea, anyelement)
+    IS 'finalizer for master_combine_agg';
+
+CREATE AGGREGATE master_combine_agg(oid, bytea, anyelement) (
+    STYPE = internal,
+    SFUNC = master_combine_agg_sfunc,
+    FINALFUNC = master_combine_agg_ffunc,
+    FINALFUNC_EXTRA
+);
+COMMENT ON AGGREGATE master_combine_agg(oid, bytea, anyelement)
+    IS 'combine serialized transition states of the given aggregate and compute its result';
+
+-- the aggregates check their arguments, but nobody needs to call these directly
+REVOKE ALL ON FUNCTION worker_partial_agg_sfunc(internal, oid, anyelement) FROM PUBLIC;
+REVOKE ALL ON FUNCTION worker_partial_agg_ffunc(internal) FROM PUBLIC;
+REVOKE ALL ON FUNCTION master_combine_agg_sfunc(internal, oid, bytea, anyelement) FROM PUBLIC;
+REVOKE ALL ON FUNCTION master_combine_agg_ffunc(internal, oid, bytea, anyelement) FROM PUBLIC;
+
+RESET search_path;
@@ -0,0 +1,98 @@
+/* citus--6.1-19--6.1-20.sql */
+
+SET search_path = 'pg_catalog';
+
+CREATE FUNCTION tdigest_add_sfunc(internal, double precision)
+    RETURNS internal
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', $$tdigest_add_sfunc$$;
+COMMENT ON FUNCTION tdigest_add_sfunc(internal, double precision)
+    IS 'transition function for tdigest_add_agg';
+
+CREATE FUNCTION tdigest_union_sfunc(internal, double precision[])
+    RETURNS internal
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', $$tdigest_union_sfunc$$;
+COMMENT ON FUNCTION tdigest_union_sfunc(internal, double precision[])
+    IS 'transition function for tdigest_union_agg';
+
+CREATE FUNCTION tdigest_ffunc(internal)
+    RETURNS double precision[]
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', $$tdigest_ffunc$$;
+COMMENT ON FUNCTION tdigest_ffunc(internal)
+    IS 'finalizer for t-digest aggregates';
+
+CREATE AGGREGATE tdigest_add_agg(double precision) (
+    STYPE = internal,
+    SFUNC = tdigest_add_sfunc,
+    FINALFUNC = tdigest_ffunc
+);
+COMMENT ON AGGREGATE tdigest_add_agg(double precision)
+    IS 'summarize input values into a t-digest';
+
+CREATE AGGREGATE tdigest_union_agg(double precision[]) (
+    STYPE = internal,
+    SFUNC = tdigest_union_sfunc,
+    FINALFUNC = tdigest_ffunc
+);
+COMMENT ON AGGREGATE tdigest_union_agg(double precision[])
+    IS 'merge input t-digests into a single t-digest';
+
+CREATE FUNCTION tdigest_percentile(double precision[], double precision)
+    RETURNS double precision
+    LANGUAGE C IMMUTABLE STRICT
+    AS 'MODULE_PATHNAME', $$tdigest_percentile$$;
+COMMENT ON FUNCTION tdigest_percentile(double precision[], double precision)
+    IS 'estimate a percentile of the values summarized in a t-digest';
+
+CREATE FUNCTION topn_add_sfunc(internal, text)
+    RETURNS internal
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', $$topn_add_sfunc$$;
+COMMENT ON FUNCTION topn_add_sfunc(internal, text)
+    IS 'transition function for topn_add_agg';
+
+CREATE FUNCTION topn_union_sfunc(internal, text[])
+    RETURNS internal
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', $$topn_union_sfunc$$;
+COMMENT ON FUNCTION topn_union_sfunc(internal, text[])
+    IS 'transition function for topn_union_agg';
+
+CREATE FUNCTION topn_ffunc(internal)
+    RETURNS text[]
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', $$topn_ffunc$$;
+COMMENT ON FUNCTION topn_ffunc(internal)
+    IS 'finalizer for top-n aggregates';
+
+CREATE AGGREGATE topn_add_agg(text) (
+    STYPE = internal,
+    SFUNC = topn_add_sfunc,
+    FINALFUNC = topn_ffunc
+);
+COMMENT ON AGGREGATE topn_add_agg(text)
+    IS 'summarize the most frequent input values and their frequencies';
+
+CREATE AGGREGATE topn_union_agg(text[]) (
+    STYPE = internal,
+    SFUNC = topn_union_sfunc,
+    FINALFUNC = topn_ffunc
+);
+COMMENT ON AGGREGATE topn_union_agg(text[])
+    IS 'merge input top-n summaries into a single summary';
+
+CREATE FUNCTION topn(summary text[], n integer, OUT item text, OUT frequency bigint)
+    RETURNS SETOF record
+    LANGUAGE SQL IMMUTABLE STRICT
+    AS $$
+    SELECT summary[i][1], summary[i][2]::bigint
+    FROM generate_subscripts(summary, 1) AS i
+    ORDER BY i
+    LIMIT n
+    $$;
+COMMENT ON FUNCTION topn(text[], integer)
+    IS 'return the n most frequent values and their frequencies in a top-n summary';
+
+RESET search_path;
@@ -50,6 +50,7 @@
 
 #include <arpa/inet.h> /* for htons */
 #include <netinet/in.h> /* for htons */
+#include <poll.h>
 #include <string.h>
 
 #include "access/htup_details.h"
@@ -70,17 +71,116 @@
 #include "executor/executor.h"
 #include "tsearch/ts_locale.h"
 #include "utils/builtins.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "utils/memutils.h"
+#include "utils/syscache.h"
+#include "utils/timestamp.h"
+#include "utils/typcache.h"
 
 
 /* constant used in binary protocol */
 static const char BinarySignature[11] = "PGCOPY\n\377\r\n\0";
 
+/* number of rows whose partition column values are routed to shards at once */
+#define COPY_ROUTING_BATCH_SIZE 256
+
 /* use a global connection to the master node in order to skip passing it around */
 static MultiConnection *masterConnection = NULL;
 
+/* size of the per-shard buffers used by COPY, in kilobytes (0 disables batching) */
+int CopyBatchSize = 0;
+
+
+/*
+ * ShardCopyBuffer holds the copy data for rows that were routed to a shard,
+ * but not yet sent to the shard's placements.
+ */
+typedef struct ShardCopyBuffer
+{
+	int64 shardId; /* hash key */
+	StringInfo copyData;
+	List *connectionList;
+} ShardCopyBuffer;
+
+
+/*
+ * CopyTypeOidRemapping keeps the state needed to rewrite the OIDs that binary
+ * COPY data embeds as array element types and composite column types. These
+ * OIDs generally differ between nodes for user-defined types, so we resolve
+ * them once on each placement connection, and rewrite them in the copy data
+ * before sending it over that connection.
+ */
+typedef struct CopyTypeOidRemapping
+{
+	TupleDesc tupleDescriptor;
+
+	/* whether each column's values embed type OIDs */
+	bool *columnEmbedsTypeOids;
+
+	/* local OIDs of the user-defined types embedded in copy data */
+	Oid *localTypeIdArray;
+	int typeCount;
+
+	/* maps connections to the remote OIDs of the types above */
+	HTAB *remoteTypeIdHash;
+
+	/* buffer to hold the rewritten copy data */
+	StringInfo remapBuffer;
+} CopyTypeOidRemapping;
+
+
+/*
+ * CopyRowErrorContext identifies the input line of the row that is being routed
+ * or sent to shard placements. Rows are parsed in batches, so copy.c's own line
+ * number already points at the last row of the batch by the time we send rows.
+ */
+typedef struct CopyRowErrorContext
+{
+	char *relationName;
+	int lineNumber;
+} CopyRowErrorContext;
+
+
+/* RemoteTypeIdEntry holds the type OIDs resolved on a placement connection */
+typedef struct RemoteTypeIdEntry
+{
+	MultiConnection *connection; /* hash key */
+
+	/* remote type OIDs, or NULL if they are the same as the local OIDs */
+	Oid *remoteTypeIdArray;
+} RemoteTypeIdEntry;
+
+
+/*
+ * RemoteTypeIdCacheKey identifies a user-defined type on the node and database
+ * that a connection is made to. Type OIDs do not depend on the connecting
+ * user, so the user is not part of the key.
+ */
+typedef struct RemoteTypeIdCacheKey
+{
+	char hostname[MAX_NODE_LENGTH];
+	int32 port;
+	char database[NAMEDATALEN];
+	Oid localTypeId;
+} RemoteTypeIdCacheKey;
+
+
+/* RemoteTypeIdCacheEntry holds the OID of a type on a remote node */
+typedef struct RemoteTypeIdCacheEntry
+{
+	RemoteTypeIdCacheKey key; /* hash key, must be first */
+	Oid remoteTypeId;
+} RemoteTypeIdCacheEntry;
+
+
+/* type OID remapping for the COPY in progress, or NULL if it is not needed */
+static CopyTypeOidRemapping *copyTypeOidRemapping = NULL;
+
+/* remote OIDs of user-defined types, kept across COPY commands and connections */
+static HTAB *RemoteTypeIdCache = NULL;
+
 
 /* Local functions forward declarations */
 static void CopyFromWorkerNode(CopyStmt *copyStatement, char *completionTag);
@@ -94,6 +194,28 @@ static void OpenCopyConnections(CopyStmt *copyStatement,
 
 static bool CanUseBinaryCopyFormat(TupleDesc tupleDescription,
 								   CopyOutState rowOutputState);
+static bool CanUseBinaryCopyFormatForType(Oid typeId);
+static CopyTypeOidRemapping * CreateCopyTypeOidRemapping(TupleDesc tupleDescriptor,
+														 bool useBinaryCopyFormat);
+static void CollectEmbeddedTypeIds(Oid typeId, List **typeIdList);
+static bool TypeEmbedsTypeOids(Oid typeId);
+static void ResolveRemoteTypeOids(MultiConnection *connection);
+static void ResetCopyTypeOidRemapping(void *argument);
+static void InitializeRemoteTypeIdCache(void);
+static void InvalidateRemoteTypeIdCacheCallback(Datum argument, int cacheId,
+												uint32 hashValue);
+static void ForgetRemoteTypeIds(MultiConnection *connection);
+static RemoteTypeIdCacheEntry * LookupRemoteTypeIdCacheEntry(MultiConnection *connection,
+															 Oid localTypeId,
+															 HASHACTION action,
+															 bool *found);
+static StringInfo RemapCopyDataTypeOids(StringInfo copyData,
+										MultiConnection *connection);
+static void RemapBinaryValueTypeOids(char *valueData, Oid typeId,
+									 Oid *remoteTypeIdArray);
+static Oid RemoteTypeId(Oid localTypeId, Oid *remoteTypeIdArray);
+static inline uint32 ReadNetworkUInt32(char *data);
+static inline void WriteNetworkUInt32(char *data, uint32 value);
 static List * MasterShardPlacementList(uint64 shardId);
 static List * RemoteFinalizedShardPlacementList(uint64 shardId);
 
@@ -108,6 +230,12 @@ static void SendCopyDataToAll(StringInfo dataBuffer, int64 shardId, List *connec
 static void SendCopyDataToPlacement(StringInfo dataBuffer, int64 shardId,
 									MultiConnection *connection);
 static void EndRemoteCopy(int64 shardId, List *connectionList, bool stopOnFailure);
+static bool CopyHasHeaderLine(CopyStmt *copyStatement);
+static void CopyRowErrorCallback(void *arg);
+static HTAB * CreateShardCopyBufferHash(MemoryContext memoryContext);
+static void SetCopyConnectionsNonblocking(List *connectionList, bool nonblocking);
+static void FlushShardCopyBuffer(ShardCopyBuffer *copyBuffer, List *copyConnectionList);
+static void WaitForCopyConnections(List *waitConnectionList, List *copyConnectionList);
 static void ReportCopyError(MultiConnection *connection, PGresult *result);
 static uint32 AvailableColumnCount(TupleDesc tupleDescriptor);
 static int64 StartCopyToNewShard(ShardConnections *shardConnections,
@@ -277,8 +405,13 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 	Relation distributedRelation = NULL;
 	TupleDesc tupleDescriptor = NULL;
 	uint32 columnCount = 0;
-	Datum *columnValues = NULL;
-	bool *columnNulls = NULL;
+	Datum **batchColumnValues = NULL;
+	bool **batchColumnNulls = NULL;
+	Datum *partitionValueArray = NULL;
+	int *shardIndexArray = NULL;
+	int *batchLineNumbers = NULL;
+	int batchRowIndex = 0;
+	int lineNumber = 0;
 	FmgrInfo *hashFunction = NULL;
 	FmgrInfo *compareFunction = NULL;
 	bool hasUniformHashDistribution = false;
@@ -305,10 +438,17 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 	FmgrInfo *columnOutputFunctions = NULL;
 	uint64 processedRowCount = 0;
 
+	bool useCopyBuffers = (CopyBatchSize > 0);
+	int copyBufferSize = CopyBatchSize * 1024;
+	HTAB *copyBufferHash = NULL;
+	List *copyConnectionList = NIL;
+	TimestampTz copyStartTime = 0;
+
 	Var *partitionColumn = PartitionColumn(tableId, 0);
 	char partitionMethod = PartitionMethod(tableId);
 
 	ErrorContextCallback errorCallback;
+	CopyRowErrorContext rowErrorContext;
 
 	/* get hash function for partition column */
 	hashFunction = cacheEntry->hashFunction;
@@ -316,12 +456,25 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 	/* get compare function for shard intervals */
 	compareFunction = cacheEntry->shardIntervalCompareFunction;
 
-	/* allocate column values and nulls arrays */
+	/*
+	 * Allocate column values and nulls arrays for a batch of rows. We parse a
+	 * batch of rows before routing them, so that the partition column values
+	 * of all rows in the batch can be routed to shards at once.
+	 */
 	distributedRelation = heap_open(tableId, RowExclusiveLock);
 	tupleDescriptor = RelationGetDescr(distributedRelation);
 	columnCount = tupleDescriptor->natts;
-	columnValues = palloc0(columnCount * sizeof(Datum));
-	columnNulls = palloc0(columnCount * sizeof(bool));
+	batchColumnValues = palloc0(COPY_ROUTING_BATCH_SIZE * sizeof(Datum *));
+	batchColumnNulls = palloc0(COPY_ROUTING_BATCH_SIZE * sizeof(bool *));
+	for (batchRowIndex = 0; batchRowIndex < COPY_ROUTING_BATCH_SIZE; batchRowIndex++)
+	{
+		batchColumnValues[batchRowIndex] = palloc0(columnCount * sizeof(Datum));
+		batchColumnNulls[batchRowIndex] = palloc0(columnCount * sizeof(bool));
+	}
+
+	partitionValueArray = palloc0(COPY_ROUTING_BATCH_SIZE * sizeof(Datum));
+	shardIndexArray = palloc0(COPY_ROUTING_BATCH_SIZE * sizeof(int));
+	batchLineNumbers = palloc0(COPY_ROUTING_BATCH_SIZE * sizeof(int));
 
 	/* we don't support copy to reference tables from workers */
 	if (partitionMethod == DISTRIBUTE_BY_NONE)
@@ -403,119 +556,255 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 
 	columnOutputFunctions = ColumnOutputFunctions(tupleDescriptor, copyOutState->binary);
 
+	/* prepare to rewrite OIDs of user-defined types embedded in binary data */
+	copyTypeOidRemapping = CreateCopyTypeOidRemapping(tupleDescriptor,
+													  copyOutState->binary);
+
 	/* create a mapping of shard id to a connection for each of its placements */
 	shardConnectionHash = CreateShardConnectionHash(TopTransactionContext);
 
+	/* create a mapping of shard id to the rows not yet sent to its placements */
+	if (useCopyBuffers)
+	{
+		copyBufferHash = CreateShardCopyBufferHash(CurrentMemoryContext);
+		copyStartTime = GetCurrentTimestamp();
+	}
+
+	/*
+	 * copy.c counts the header line, if any, and then one line per row. We
+	 * count rows the same way, so that errors raised while routing or sending
+	 * a row of a batch report that row's line number.
+	 */
+	if (CopyHasHeaderLine(copyStatement))
+	{
+		lineNumber = 1;
+	}
+
+	rowErrorContext.relationName = relationName;
+	rowErrorContext.lineNumber = 0;
+
 	/* set up callback to identify error line number */
-	errorCallback.callback = CopyFromErrorCallback;
-	errorCallback.arg = (void *) copyState;
 	errorCallback.previous = error_context_stack;
 	error_context_stack = &errorCallback;
 
 	while (true)
 	{
-		bool nextRowFound = false;
-		Datum partitionColumnValue = 0;
-		ShardInterval *shardInterval = NULL;
-		int64 shardId = 0;
-		bool shardConnectionsFound = false;
+		int batchRowCount = 0;
+		bool endOfInput = false;
 		MemoryContext oldContext = NULL;
 
+		/* rows of the previous batch have been sent or copied into buffers */
 		ResetPerTupleExprContext(executorState);
 
 		oldContext = MemoryContextSwitchTo(executorTupleContext);
 
-		/* parse a row from the input */
-		nextRowFound = NextCopyFrom(copyState, executorExpressionContext,
-									columnValues, columnNulls, NULL);
+		/* copy.c reports the line and column of errors while parsing rows */
+		errorCallback.callback = CopyFromErrorCallback;
+		errorCallback.arg = (void *) copyState;
 
-		if (!nextRowFound)
+		/* parse a batch of rows from the input */
+		while (batchRowCount < COPY_ROUTING_BATCH_SIZE)
 		{
-			MemoryContextSwitchTo(oldContext);
-			break;
-		}
+			Datum *columnValues = batchColumnValues[batchRowCount];
+			bool *columnNulls = batchColumnNulls[batchRowCount];
+			bool nextRowFound = NextCopyFrom(copyState, executorExpressionContext,
+											 columnValues, columnNulls, NULL);
 
-		CHECK_FOR_INTERRUPTS();
+			if (!nextRowFound)
+			{
+				endOfInput = true;
+				break;
+			}
 
-		/*
-		 * Find the partition column value and corresponding shard interval
-		 * for non-reference tables.
-		 * Get the existing (and only a single) shard interval for the reference
-		 * tables. Note that, reference tables has NULL partition column values so
-		 * skip the check.
-		 */
-		if (partitionColumn != NULL)
-		{
-			if (columnNulls[partitionColumn->varattno - 1])
+			CHECK_FOR_INTERRUPTS();
+
+			/*
+			 * Find the partition column value for non-reference tables. Note
+			 * that, reference tables has NULL partition column values so skip
+			 * the check.
+			 */
+			if (partitionColumn != NULL)
 			{
-				ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
-								errmsg("cannot copy row with NULL value "
-									   "in partition column")));
+				if (columnNulls[partitionColumn->varattno - 1])
+				{
+					ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+									errmsg("cannot copy row with NULL value "
+										   "in partition column")));
+				}
+
+				partitionValueArray[batchRowCount] =
+					columnValues[partitionColumn->varattno - 1];
 			}
 
-			partitionColumnValue = columnValues[partitionColumn->varattno - 1];
+			lineNumber++;
+			batchLineNumbers[batchRowCount] = lineNumber;
+			batchRowCount++;
 		}
 
+		/* from here on, errors refer to the row being routed or sent */
+		errorCallback.callback = CopyRowErrorCallback;
+		errorCallback.arg = (void *) &rowErrorContext;
+		rowErrorContext.lineNumber = 0;
+
 		/*
-		 * Find the shard interval and id for the partition column value for
-		 * non-reference tables.
-		 * For reference table, this function blindly returns the tables single
-		 * shard.
+		 * Find the shard intervals for the partition column values of the batch
+		 * for non-reference tables. For reference tables, all rows are routed
+		 * to the table's single shard.
 		 */
-		shardInterval = FindShardInterval(partitionColumnValue,
-										  shardIntervalCache,
-										  shardCount, partitionMethod,
-										  compareFunction, hashFunction,
-										  useBinarySearch);
-
-		if (shardInterval == NULL)
+		if (batchRowCount > 0)
 		{
-			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
-							errmsg("could not find shard for partition column "
-								   "value")));
+			FindShardIntervalIndexes(partitionValueArray, batchRowCount,
+									 shardIntervalCache, shardCount, partitionMethod,
+									 compareFunction, hashFunction, useBinarySearch,
+									 shardIndexArray);
 		}
 
-		shardId = shardInterval->shardId;
-
 		MemoryContextSwitchTo(oldContext);
 
-		/* get existing connections to the shard placements, if any */
-		shardConnections = GetShardHashConnections(shardConnectionHash, shardId,
-												   &shardConnectionsFound);
-		if (!shardConnectionsFound)
+		for (batchRowIndex = 0; batchRowIndex < batchRowCount; batchRowIndex++)
 		{
-			bool stopOnFailure = false;
+			Datum *columnValues = batchColumnValues[batchRowIndex];
+			bool *columnNulls = batchColumnNulls[batchRowIndex];
+			int shardIndex = shardIndexArray[batchRowIndex];
+			ShardInterval *shardInterval = NULL;
+			int64 shardId = 0;
+			bool shardConnectionsFound = false;
+			ShardCopyBuffer *copyBuffer = NULL;
+
+			rowErrorContext.lineNumber = batchLineNumbers[batchRowIndex];
 
-			if (cacheEntry->partitionMethod == DISTRIBUTE_BY_NONE)
+			if (shardIndex == INVALID_SHARD_INDEX)
 			{
-				stopOnFailure = true;
+				ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+								errmsg("could not find shard for partition column "
+									   "value")));
 			}
 
-			/* open connections and initiate COPY on shard placements */
-			OpenCopyConnections(copyStatement, shardConnections, stopOnFailure,
-								copyOutState->binary);
+			shardInterval = shardIntervalCache[shardIndex];
+			shardId = shardInterval->shardId;
 
-			/* send copy binary headers to shard placements */
-			if (copyOutState->binary)
+			/* get existing connections to the shard placements, if any */
+			shardConnections = GetShardHashConnections(shardConnectionHash, shardId,
+													   &shardConnectionsFound);
+			if (!shardConnectionsFound)
 			{
-				SendCopyBinaryHeaders(copyOutState, shardId,
-									  shardConnections->connectionList);
+				bool stopOnFailure = false;
+
+				if (cacheEntry->partitionMethod == DISTRIBUTE_BY_NONE)
+				{
+					stopOnFailure = true;
+				}
+
+				/* open connections and initiate COPY on shard placements */
+				OpenCopyConnections(copyStatement, shardConnections, stopOnFailure,
+									copyOutState->binary);
+
+				if (useCopyBuffers)
+				{
+					/*
+					 * Buffered rows are sent without blocking, so that all shard
+					 * placements can ingest data while we parse the next rows.
+					 */
+					copyBuffer = (ShardCopyBuffer *) hash_search(copyBufferHash, &shardId,
+																 HASH_ENTER, NULL);
+					copyBuffer->copyData = makeStringInfo();
+					copyBuffer->connectionList = shardConnections->connectionList;
+
+					SetCopyConnectionsNonblocking(shardConnections->connectionList, true);
+					copyConnectionList = list_concat(copyConnectionList,
+													 list_copy(shardConnections->
+															   connectionList));
+
+					/* copy binary headers are sent along with the first rows */
+					if (copyOutState->binary)
+					{
+						copyOutState->fe_msgbuf = copyBuffer->copyData;
+						AppendCopyBinaryHeaders(copyOutState);
+					}
+				}
+				else if (copyOutState->binary)
+				{
+					/* send copy binary headers to shard placements */
+					SendCopyBinaryHeaders(copyOutState, shardId,
+										  shardConnections->connectionList);
+				}
 			}
-		}
 
-		/* replicate row to shard placements */
-		resetStringInfo(copyOutState->fe_msgbuf);
-		AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-						  copyOutState, columnOutputFunctions);
-		SendCopyDataToAll(copyOutState->fe_msgbuf, shardId,
-						  shardConnections->connectionList);
+			if (useCopyBuffers)
+			{
+				/* add row to the shard's buffer, and send the buffer once it is full */
+				if (copyBuffer == NULL)
+				{
+					copyBuffer = (ShardCopyBuffer *) hash_search(copyBufferHash, &shardId,
+																 HASH_FIND, NULL);
+				}
+
+				copyOutState->fe_msgbuf = copyBuffer->copyData;
+				AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
+								  copyOutState, columnOutputFunctions);
+
+				if (copyBuffer->copyData->len >= copyBufferSize)
+				{
+					FlushShardCopyBuffer(copyBuffer, copyConnectionList);
+				}
+			}
+			else
+			{
+				/* replicate row to shard placements */
+				resetStringInfo(copyOutState->fe_msgbuf);
+				AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
+								  copyOutState, columnOutputFunctions);
+				SendCopyDataToAll(copyOutState->fe_msgbuf, shardId,
+								  shardConnections->connectionList);
+			}
 
-		processedRowCount += 1;
+			processedRowCount += 1;
+		}
+
+		if (endOfInput)
+		{
+			break;
+		}
 	}
 
 	/* all lines have been copied, stop showing line number in errors */
 	error_context_stack = errorCallback.previous;
 
+	if (useCopyBuffers)
+	{
+		HASH_SEQ_STATUS status;
+		ShardCopyBuffer *copyBuffer = NULL;
+		long copySeconds = 0;
+		int copyMicroseconds = 0;
+		double copyDuration = 0.0;
+
+		/* send remaining rows, and copy binary footers, to all shard placements */
+		hash_seq_init(&status, copyBufferHash);
+		while ((copyBuffer = (ShardCopyBuffer *) hash_seq_search(&status)) != NULL)
+		{
+			if (copyOutState->binary)
+			{
+				copyOutState->fe_msgbuf = copyBuffer->copyData;
+				AppendCopyBinaryFooters(copyOutState);
+			}
+
+			FlushShardCopyBuffer(copyBuffer, copyConnectionList);
+		}
+
+		/* wait until all placements received their data before ending the copy */
+		WaitForCopyConnections(copyConnectionList, copyConnectionList);
+		SetCopyConnectionsNonblocking(copyConnectionList, false);
+
+		TimestampDifference(copyStartTime, GetCurrentTimestamp(), &copySeconds,
+							&copyMicroseconds);
+		copyDuration = copySeconds + copyMicroseconds / 1000000.0;
+
+		ereport(DEBUG1, (errmsg("copied " UINT64_FORMAT " rows in %.3f seconds "
+								"(%.0f rows/s)", processedRowCount, copyDuration,
+								copyDuration > 0.0 ?
+								processedRowCount / copyDuration : 0.0)));
+	}
+
 	shardConnectionsList = ShardConnectionList(shardConnectionHash);
 	foreach(shardConnectionsCell, shardConnectionsList)
 	{
@@ -523,7 +812,7 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 			shardConnectionsCell);
 
 		/* send copy binary footers to all shard placements */
-		if (copyOutState->binary)
+		if (copyOutState->binary && !useCopyBuffers)
 		{
 			SendCopyBinaryFooters(copyOutState, shardConnections->shardId,
 								  shardConnections->connectionList);
@@ -536,6 +825,8 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 	EndCopyFrom(copyState);
 	heap_close(distributedRelation, NoLock);
 
+	copyTypeOidRemapping = NULL;
+
 	/* mark failed placements as inactive */
 	MarkFailedShardPlacements();
 
@@ -599,6 +890,10 @@ CopyToNewShards(CopyStmt *copyStatement, char *completionTag, Oid relationId)
 
 	columnOutputFunctions = ColumnOutputFunctions(tupleDescriptor, copyOutState->binary);
 
+	/* prepare to rewrite OIDs of user-defined types embedded in binary data */
+	copyTypeOidRemapping = CreateCopyTypeOidRemapping(tupleDescriptor,
+													  copyOutState->binary);
+
 	/* set up callback to identify error line number */
 	errorCallback.callback = CopyFromErrorCallback;
 	errorCallback.arg = (void *) copyState;
@@ -709,6 +1004,8 @@ CopyToNewShards(CopyStmt *copyStatement, char *completionTag, Oid relationId)
 	EndCopyFrom(copyState);
 	heap_close(distributedRelation, NoLock);
 
+	copyTypeOidRemapping = NULL;
+
 	/* check for cancellation one last time before returning */
 	CHECK_FOR_INTERRUPTS();
 
@@ -898,6 +1195,12 @@ OpenCopyConnections(CopyStmt *copyStatement, ShardConnections *shardConnections,
 		MarkRemoteTransactionCritical(connection);
 		ClaimConnectionExclusively(connection);
 		RemoteTransactionBeginIfNecessary(connection);
+
+		if (useBinaryCopyFormat)
+		{
+			ResolveRemoteTypeOids(connection);
+		}
+
 		copyCommand = ConstructCopyStatement(copyStatement, shardConnections->shardId,
 											 useBinaryCopyFormat);
 		result = PQexec(connection->pgConn, copyCommand->data);
@@ -932,10 +1235,11 @@ OpenCopyConnections(CopyStmt *copyStatement, ShardConnections *shardConnections,
 
 /*
  * CanUseBinaryCopyFormat iterates over columns of the relation given in rowOutputState
- * and looks for a column whose type is array of user-defined type or composite type.
- * If it finds such column, that means we cannot use binary format for COPY, because
- * binary format sends Oid of the types, which are generally not same in master and
- * worker nodes for user-defined types.
+ * and checks whether all of their types can be sent and received in binary format.
+ * Binary format embeds the OIDs of array element types and composite column types
+ * in the data. For user-defined types, these OIDs generally differ between master
+ * and worker nodes, so we rewrite them for each worker before sending the data
+ * (see RemapCopyDataTypeOids).
  */
 static bool
 CanUseBinaryCopyFormat(TupleDesc tupleDescription, CopyOutState rowOutputState)
@@ -947,25 +1251,16 @@ CanUseBinaryCopyFormat(TupleDesc tupleDescription, CopyOutState rowOutputState)
 	for (columnIndex = 0; columnIndex < totalColumnCount; columnIndex++)
 	{
 		Form_pg_attribute currentColumn = tupleDescription->attrs[columnIndex];
-		Oid typeId = InvalidOid;
-		char typeCategory = '\0';
-		bool typePreferred = false;
 
 		if (currentColumn->attisdropped)
 		{
 			continue;
 		}
 
-		typeId = currentColumn->atttypid;
-		if (typeId >= FirstNormalObjectId)
+		if (!CanUseBinaryCopyFormatForType(currentColumn->atttypid))
 		{
-			get_type_category_preferred(typeId, &typeCategory, &typePreferred);
-			if (typeCategory == TYPCATEGORY_ARRAY ||
-				typeCategory == TYPCATEGORY_COMPOSITE)
-			{
-				useBinaryCopyFormat = false;
-				break;
-			}
+			useBinaryCopyFormat = false;
+			break;
 		}
 	}
 
@@ -974,132 +1269,790 @@ CanUseBinaryCopyFormat(TupleDesc tupleDescription, CopyOutState rowOutputState)
 
 
 /*
- * MasterShardPlacementList dispatches the finalized shard placements call
- * between local or remote master node according to the master connection state.
+ * CanUseBinaryCopyFormatForType determines whether values of the given type can
+ * be sent and received in binary format, which requires the type, and the types
+ * of any array elements and composite columns, to have send and receive
+ * functions.
  */
-static List *
-MasterShardPlacementList(uint64 shardId)
+static bool
+CanUseBinaryCopyFormatForType(Oid typeId)
 {
-	List *finalizedPlacementList = NIL;
-	if (masterConnection == NULL)
+	HeapTuple typeTuple = NULL;
+	Form_pg_type typeForm = NULL;
+	bool hasBinaryFunctions = false;
+	char typeType = '\0';
+	Oid elementTypeId = InvalidOid;
+	Oid baseTypeId = getBaseType(typeId);
+
+	typeTuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(baseTypeId));
+	if (!HeapTupleIsValid(typeTuple))
 	{
-		finalizedPlacementList = FinalizedShardPlacementList(shardId);
+		elog(ERROR, "cache lookup failed for type %u", baseTypeId);
 	}
-	else
+
+	typeForm = (Form_pg_type) GETSTRUCT(typeTuple);
+	hasBinaryFunctions = OidIsValid(typeForm->typsend) && OidIsValid(typeForm->typreceive);
+	typeType = typeForm->typtype;
+	elementTypeId = get_element_type(baseTypeId);
+
+	ReleaseSysCache(typeTuple);
+
+	if (!hasBinaryFunctions)
 	{
-		finalizedPlacementList = RemoteFinalizedShardPlacementList(shardId);
+		return false;
 	}
 
-	return finalizedPlacementList;
+	if (OidIsValid(elementTypeId))
+	{
+		return CanUseBinaryCopyFormatForType(elementTypeId);
+	}
+
+	if (typeType == TYPTYPE_COMPOSITE)
+	{
+		TupleDesc rowTupleDesc = lookup_rowtype_tupdesc(baseTypeId, -1);
+		bool canUseBinaryCopyFormat = true;
+		int columnIndex = 0;
+
+		for (columnIndex = 0; columnIndex < rowTupleDesc->natts; columnIndex++)
+		{
+			Form_pg_attribute column = rowTupleDesc->attrs[columnIndex];
+
+			if (!column->attisdropped && !CanUseBinaryCopyFormatForType(column->atttypid))
+			{
+				canUseBinaryCopyFormat = false;
+				break;
+			}
+		}
+
+		ReleaseTupleDesc(rowTupleDesc);
+
+		return canUseBinaryCopyFormat;
+	}
+
+	return true;
 }
 
 
 /*
- * RemoteFinalizedShardPlacementList gets the finalized shard placement list
- * for the given shard id from the remote master node.
+ * CreateCopyTypeOidRemapping collects the user-defined types whose OIDs appear
+ * in the binary copy data of the given relation, and returns the state needed
+ * to rewrite these OIDs for each placement. If the data does not embed any
+ * such OIDs, or if text format is used, the function returns NULL.
  */
-static List *
-RemoteFinalizedShardPlacementList(uint64 shardId)
+static CopyTypeOidRemapping *
+CreateCopyTypeOidRemapping(TupleDesc tupleDescriptor, bool useBinaryCopyFormat)
 {
-	List *finalizedPlacementList = NIL;
-	PGresult *queryResult = NULL;
+	CopyTypeOidRemapping *typeOidRemapping = NULL;
+	MemoryContextCallback *resetCallback = NULL;
+	List *typeIdList = NIL;
+	ListCell *typeIdCell = NULL;
+	int columnCount = tupleDescriptor->natts;
+	int columnIndex = 0;
+	int typeIndex = 0;
+	HASHCTL info;
 
-	StringInfo shardPlacementsCommand = makeStringInfo();
-	appendStringInfo(shardPlacementsCommand, FINALIZED_SHARD_PLACEMENTS_QUERY, shardId);
+	if (!useBinaryCopyFormat)
+	{
+		return NULL;
+	}
 
-	queryResult = PQexec(masterConnection->pgConn, shardPlacementsCommand->data);
-	if (PQresultStatus(queryResult) == PGRES_TUPLES_OK)
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
 	{
-		int rowCount = PQntuples(queryResult);
-		int rowIndex = 0;
+		Form_pg_attribute currentColumn = tupleDescriptor->attrs[columnIndex];
 
-		for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		if (!currentColumn->attisdropped)
 		{
-			char *placementIdString = PQgetvalue(queryResult, rowIndex, 0);
-			char *nodeName = PQgetvalue(queryResult, rowIndex, 1);
-			char *nodePortString = PQgetvalue(queryResult, rowIndex, 2);
-			uint32 nodePort = atoi(nodePortString);
-			uint64 placementId = atoll(placementIdString);
+			CollectEmbeddedTypeIds(currentColumn->atttypid, &typeIdList);
+		}
+	}
 
-			ShardPlacement *shardPlacement =
-				(ShardPlacement *) palloc0(sizeof(ShardPlacement));
+	if (typeIdList == NIL)
+	{
+		return NULL;
+	}
 
-			shardPlacement->placementId = placementId;
-			shardPlacement->nodeName = nodeName;
-			shardPlacement->nodePort = nodePort;
+	typeOidRemapping = palloc0(sizeof(CopyTypeOidRemapping));
+	typeOidRemapping->tupleDescriptor = tupleDescriptor;
+	typeOidRemapping->columnEmbedsTypeOids = palloc0(columnCount * sizeof(bool));
+	typeOidRemapping->typeCount = list_length(typeIdList);
+	typeOidRemapping->localTypeIdArray = palloc0(list_length(typeIdList) * sizeof(Oid));
+	typeOidRemapping->remapBuffer = makeStringInfo();
 
-			finalizedPlacementList = lappend(finalizedPlacementList, shardPlacement);
-		}
-	}
-	else
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
 	{
-		ereport(ERROR, (errmsg("could not get shard placements from the master node")));
+		Form_pg_attribute currentColumn = tupleDescriptor->attrs[columnIndex];
+
+		typeOidRemapping->columnEmbedsTypeOids[columnIndex] =
+			!currentColumn->attisdropped && TypeEmbedsTypeOids(currentColumn->atttypid);
 	}
 
-	return finalizedPlacementList;
-}
+	foreach(typeIdCell, typeIdList)
+	{
+		typeOidRemapping->localTypeIdArray[typeIndex] = lfirst_oid(typeIdCell);
+		typeIndex++;
+	}
 
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(MultiConnection *);
+	info.entrysize = sizeof(RemoteTypeIdEntry);
+	info.hcxt = CurrentMemoryContext;
 
-/* Send copy binary headers to given connections */
-static void
-SendCopyBinaryHeaders(CopyOutState copyOutState, int64 shardId, List *connectionList)
-{
-	resetStringInfo(copyOutState->fe_msgbuf);
-	AppendCopyBinaryHeaders(copyOutState);
-	SendCopyDataToAll(copyOutState->fe_msgbuf, shardId, connectionList);
-}
+	typeOidRemapping->remoteTypeIdHash = hash_create("Copy Remote Type Id Hash", 32,
+													 &info, HASH_ELEM | HASH_BLOBS |
+													 HASH_CONTEXT);
 
+	/*
+	 * The remapping is referenced through a static variable while the COPY is
+	 * in progress. Forget about it once its memory goes away, which happens at
+	 * the end of the statement as well as when the COPY errors out.
+	 */
+	resetCallback = palloc0(sizeof(MemoryContextCallback));
+	resetCallback->func = ResetCopyTypeOidRemapping;
+	resetCallback->arg = (void *) typeOidRemapping;
+	MemoryContextRegisterResetCallback(CurrentMemoryContext, resetCallback);
 
-/* Send copy binary footers to given connections */
-static void
-SendCopyBinaryFooters(CopyOutState copyOutState, int64 shardId, List *connectionList)
-{
-	resetStringInfo(copyOutState->fe_msgbuf);
-	AppendCopyBinaryFooters(copyOutState);
-	SendCopyDataToAll(copyOutState->fe_msgbuf, shardId, connectionList);
+	return typeOidRemapping;
 }
 
 
 /*
- * ConstructCopyStatement constructs the text of a COPY statement for a particular
- * shard.
+ * CollectEmbeddedTypeIds appends the user-defined types whose OIDs appear in the
+ * binary representation of the given type to typeIdList. These are the element
+ * types of arrays and the column types of composite types, searched recursively.
  */
-static StringInfo
-ConstructCopyStatement(CopyStmt *copyStatement, int64 shardId, bool useBinaryCopyFormat)
+static void
+CollectEmbeddedTypeIds(Oid typeId, List **typeIdList)
 {
-	StringInfo command = makeStringInfo();
+	Oid baseTypeId = getBaseType(typeId);
+	Oid elementTypeId = get_element_type(baseTypeId);
 
-	char *schemaName = copyStatement->relation->schemaname;
-	char *relationName = copyStatement->relation->relname;
+	if (OidIsValid(elementTypeId))
+	{
+		if (elementTypeId >= FirstNormalObjectId)
+		{
+			*typeIdList = list_append_unique_oid(*typeIdList, elementTypeId);
+		}
 
-	char *shardName = pstrdup(relationName);
-	char *shardQualifiedName = NULL;
-	const char *copyFormat = NULL;
+		CollectEmbeddedTypeIds(elementTypeId, typeIdList);
+	}
+	else if (get_typtype(baseTypeId) == TYPTYPE_COMPOSITE)
+	{
+		TupleDesc rowTupleDesc = lookup_rowtype_tupdesc(baseTypeId, -1);
+		int columnIndex = 0;
 
-	AppendShardIdToName(&shardName, shardId);
+		for (columnIndex = 0; columnIndex < rowTupleDesc->natts; columnIndex++)
+		{
+			Form_pg_attribute column = rowTupleDesc->attrs[columnIndex];
 
-	shardQualifiedName = quote_qualified_identifier(schemaName, shardName);
+			if (column->attisdropped)
+			{
+				continue;
+			}
 
-	if (useBinaryCopyFormat)
-	{
-		copyFormat = "BINARY";
-	}
-	else
-	{
-		copyFormat = "TEXT";
-	}
-	appendStringInfo(command, "COPY %s FROM STDIN WITH (FORMAT %s)", shardQualifiedName,
-					 copyFormat);
+			if (column->atttypid >= FirstNormalObjectId)
+			{
+				*typeIdList = list_append_unique_oid(*typeIdList, column->atttypid);
+			}
 
-	return command;
+			CollectEmbeddedTypeIds(column->atttypid, typeIdList);
+		}
+
+		ReleaseTupleDesc(rowTupleDesc);
+	}
 }
 
 
 /*
- * SendCopyDataToAll sends copy data to all connections in a list.
+ * TypeEmbedsTypeOids returns whether the binary representation of the given
+ * type contains type OIDs, which is the case for arrays and composite types.
  */
-static void
-SendCopyDataToAll(StringInfo dataBuffer, int64 shardId, List *connectionList)
+static bool
+TypeEmbedsTypeOids(Oid typeId)
+{
+	Oid baseTypeId = getBaseType(typeId);
+
+	return OidIsValid(get_element_type(baseTypeId)) ||
+		   get_typtype(baseTypeId) == TYPTYPE_COMPOSITE;
+}
+
+
+/*
+ * ResolveRemoteTypeOids looks up the OIDs of the user-defined types embedded in
+ * the copy data on the node of the given connection, and remembers them for the
+ * connection. OIDs are cached across COPY commands and connections, keyed by
+ * the node and database of the connection, so that the catalog lookup on the
+ * node only happens when one of the types was not seen before, or after the
+ * node rejected the cached OIDs. The connection must not be in COPY mode yet.
+ */
+static void
+ResolveRemoteTypeOids(MultiConnection *connection)
+{
+	CopyTypeOidRemapping *typeOidRemapping = copyTypeOidRemapping;
+	RemoteTypeIdEntry *remoteTypeIdEntry = NULL;
+	StringInfo typeQuery = NULL;
+	PGresult *result = NULL;
+	Oid *remoteTypeIdArray = NULL;
+	bool remoteTypeIdsCached = true;
+	bool remoteTypeIdsDiffer = false;
+	bool entryFound = false;
+	int typeIndex = 0;
+
+	if (typeOidRemapping == NULL)
+	{
+		return;
+	}
+
+	remoteTypeIdEntry = hash_search(typeOidRemapping->remoteTypeIdHash, &connection,
+									HASH_ENTER, &entryFound);
+	if (entryFound)
+	{
+		return;
+	}
+
+	remoteTypeIdEntry->remoteTypeIdArray = NULL;
+	remoteTypeIdArray = palloc0(typeOidRemapping->typeCount * sizeof(Oid));
+
+	/* first try to find the remote OIDs of all types in the cache */
+	for (typeIndex = 0; typeIndex < typeOidRemapping->typeCount; typeIndex++)
+	{
+		Oid localTypeId = typeOidRemapping->localTypeIdArray[typeIndex];
+		RemoteTypeIdCacheEntry *cacheEntry = NULL;
+		bool cacheEntryFound = false;
+
+		cacheEntry = LookupRemoteTypeIdCacheEntry(connection, localTypeId, HASH_FIND,
+												  &cacheEntryFound);
+		if (!cacheEntryFound)
+		{
+			remoteTypeIdsCached = false;
+			break;
+		}
+
+		remoteTypeIdArray[typeIndex] = cacheEntry->remoteTypeId;
+	}
+
+	if (!remoteTypeIdsCached)
+	{
+		/* types are looked up by name, since that is what identifies them across nodes */
+		typeQuery = makeStringInfo();
+		appendStringInfoString(typeQuery, "SELECT ");
+
+		for (typeIndex = 0; typeIndex < typeOidRemapping->typeCount; typeIndex++)
+		{
+			Oid typeId = typeOidRemapping->localTypeIdArray[typeIndex];
+			char *typeName = format_type_be_qualified(typeId);
+
+			if (typeIndex > 0)
+			{
+				appendStringInfoString(typeQuery, ", ");
+			}
+
+			appendStringInfo(typeQuery, "%s::regtype::oid",
+							 quote_literal_cstr(typeName));
+		}
+
+		result = PQexec(connection->pgConn, typeQuery->data);
+		if (PQresultStatus(result) != PGRES_TUPLES_OK)
+		{
+			ReportResultError(connection, result, ERROR);
+		}
+
+		for (typeIndex = 0; typeIndex < typeOidRemapping->typeCount; typeIndex++)
+		{
+			Oid localTypeId = typeOidRemapping->localTypeIdArray[typeIndex];
+			char *remoteTypeIdString = PQgetvalue(result, 0, typeIndex);
+			Oid remoteTypeId = (Oid) strtoul(remoteTypeIdString, NULL, 10);
+			RemoteTypeIdCacheEntry *cacheEntry = NULL;
+			bool cacheEntryFound = false;
+
+			cacheEntry = LookupRemoteTypeIdCacheEntry(connection, localTypeId,
+													  HASH_ENTER, &cacheEntryFound);
+			cacheEntry->remoteTypeId = remoteTypeId;
+
+			remoteTypeIdArray[typeIndex] = remoteTypeId;
+		}
+
+		PQclear(result);
+	}
+
+	for (typeIndex = 0; typeIndex < typeOidRemapping->typeCount; typeIndex++)
+	{
+		if (remoteTypeIdArray[typeIndex] != typeOidRemapping->localTypeIdArray[typeIndex])
+		{
+			remoteTypeIdsDiffer = true;
+		}
+	}
+
+	if (remoteTypeIdsDiffer)
+	{
+		remoteTypeIdEntry->remoteTypeIdArray = remoteTypeIdArray;
+	}
+}
+
+
+/*
+ * ResetCopyTypeOidRemapping is called when the memory of a type OID remapping is
+ * reset or deleted, and clears the reference to it if it is still in use.
+ */
+static void
+ResetCopyTypeOidRemapping(void *argument)
+{
+	if (copyTypeOidRemapping == (CopyTypeOidRemapping *) argument)
+	{
+		copyTypeOidRemapping = NULL;
+	}
+}
+
+
+/*
+ * LookupRemoteTypeIdCacheEntry looks up the cached remote OID of the given local
+ * type on the node and database of the given connection, using the given hash
+ * action. The cache is created on first use.
+ */
+static RemoteTypeIdCacheEntry *
+LookupRemoteTypeIdCacheEntry(MultiConnection *connection, Oid localTypeId,
+							 HASHACTION action, bool *found)
+{
+	RemoteTypeIdCacheKey key;
+
+	if (RemoteTypeIdCache == NULL)
+	{
+		InitializeRemoteTypeIdCache();
+	}
+
+	memset(&key, 0, sizeof(key));
+	strlcpy(key.hostname, connection->hostname, MAX_NODE_LENGTH);
+	key.port = connection->port;
+	strlcpy(key.database, connection->database, NAMEDATALEN);
+	key.localTypeId = localTypeId;
+
+	return (RemoteTypeIdCacheEntry *) hash_search(RemoteTypeIdCache, &key, action,
+												  found);
+}
+
+
+/*
+ * InitializeRemoteTypeIdCache creates the cache of remote type OIDs, and
+ * registers a callback that clears it whenever a type changes locally.
+ */
+static void
+InitializeRemoteTypeIdCache(void)
+{
+	HASHCTL info;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(RemoteTypeIdCacheKey);
+	info.entrysize = sizeof(RemoteTypeIdCacheEntry);
+	info.hcxt = CacheMemoryContext;
+
+	RemoteTypeIdCache = hash_create("Remote Type Id Cache", 32, &info,
+									HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	CacheRegisterSyscacheCallback(TYPEOID, InvalidateRemoteTypeIdCacheCallback,
+								  (Datum) 0);
+}
+
+
+/*
+ * InvalidateRemoteTypeIdCacheCallback clears the cache of remote type OIDs. A
+ * type that is dropped and created again gets new OIDs on all nodes, so any
+ * change to a local type may leave cached remote OIDs stale.
+ */
+static void
+InvalidateRemoteTypeIdCacheCallback(Datum argument, int cacheId, uint32 hashValue)
+{
+	HASH_SEQ_STATUS status;
+	RemoteTypeIdCacheEntry *cacheEntry = NULL;
+
+	hash_seq_init(&status, RemoteTypeIdCache);
+	while ((cacheEntry = (RemoteTypeIdCacheEntry *) hash_seq_search(&status)) != NULL)
+	{
+		hash_search(RemoteTypeIdCache, &cacheEntry->key, HASH_REMOVE, NULL);
+	}
+}
+
+
+/*
+ * ForgetRemoteTypeIds removes the cached remote OIDs of all types on the node
+ * and database of the given connection.
+ */
+static void
+ForgetRemoteTypeIds(MultiConnection *connection)
+{
+	HASH_SEQ_STATUS status;
+	RemoteTypeIdCacheEntry *cacheEntry = NULL;
+
+	if (RemoteTypeIdCache == NULL)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, RemoteTypeIdCache);
+	while ((cacheEntry = (RemoteTypeIdCacheEntry *) hash_seq_search(&status)) != NULL)
+	{
+		RemoteTypeIdCacheKey *key = &cacheEntry->key;
+
+		if (strncmp(key->hostname, connection->hostname, MAX_NODE_LENGTH) == 0 &&
+			key->port == connection->port &&
+			strncmp(key->database, connection->database, NAMEDATALEN) == 0)
+		{
+			hash_search(RemoteTypeIdCache, key, HASH_REMOVE, NULL);
+		}
+	}
+}
+
+
+/*
+ * RemapCopyDataTypeOids returns the given binary copy data with the embedded
+ * OIDs of user-defined types replaced by their OIDs on the node of the given
+ * connection. The data may contain the binary header, any number of rows, and
+ * the binary trailer. If no OIDs need to be replaced, the function returns the
+ * original data. Otherwise, it returns a buffer that is reused on the next call.
+ */
+static StringInfo
+RemapCopyDataTypeOids(StringInfo copyData, MultiConnection *connection)
+{
+	CopyTypeOidRemapping *typeOidRemapping = copyTypeOidRemapping;
+	RemoteTypeIdEntry *remoteTypeIdEntry = NULL;
+	TupleDesc tupleDescriptor = NULL;
+	StringInfo remapBuffer = NULL;
+	char *data = NULL;
+	int offset = 0;
+
+	if (typeOidRemapping == NULL)
+	{
+		return copyData;
+	}
+
+	remoteTypeIdEntry = hash_search(typeOidRemapping->remoteTypeIdHash, &connection,
+									HASH_FIND, NULL);
+	if (remoteTypeIdEntry == NULL || remoteTypeIdEntry->remoteTypeIdArray == NULL)
+	{
+		return copyData;
+	}
+
+	tupleDescriptor = typeOidRemapping->tupleDescriptor;
+	remapBuffer = typeOidRemapping->remapBuffer;
+	resetStringInfo(remapBuffer);
+	appendBinaryStringInfo(remapBuffer, copyData->data, copyData->len);
+	data = remapBuffer->data;
+
+	/* skip the signature, flags field, and header extension */
+	if (remapBuffer->len >= (int) sizeof(BinarySignature) &&
+		memcmp(data, BinarySignature, sizeof(BinarySignature)) == 0)
+	{
+		uint32 headerExtensionLength = ReadNetworkUInt32(data + 15);
+
+		offset = sizeof(BinarySignature) + 8 + headerExtensionLength;
+	}
+
+	while (offset < remapBuffer->len)
+	{
+		int16 fieldCount = 0;
+		uint16 networkFieldCount = 0;
+		int columnIndex = 0;
+
+		memcpy(&networkFieldCount, data + offset, sizeof(uint16));
+		fieldCount = (int16) ntohs(networkFieldCount);
+		offset += sizeof(uint16);
+
+		/* a field count of -1 marks the binary trailer */
+		if (fieldCount == -1)
+		{
+			break;
+		}
+
+		for (columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+		{
+			Form_pg_attribute currentColumn = tupleDescriptor->attrs[columnIndex];
+			int32 fieldLength = 0;
+
+			if (currentColumn->attisdropped)
+			{
+				continue;
+			}
+
+			fieldLength = (int32) ReadNetworkUInt32(data + offset);
+			offset += sizeof(uint32);
+
+			/* NULL values have a field length of -1 and no data */
+			if (fieldLength < 0)
+			{
+				continue;
+			}
+
+			if (typeOidRemapping->columnEmbedsTypeOids[columnIndex])
+			{
+				RemapBinaryValueTypeOids(data + offset, currentColumn->atttypid,
+										 remoteTypeIdEntry->remoteTypeIdArray);
+			}
+
+			offset += fieldLength;
+		}
+	}
+
+	return remapBuffer;
+}
+
+
+/*
+ * RemapBinaryValueTypeOids replaces the type OIDs embedded in the binary
+ * representation of a value of the given type, as produced by array_send() and
+ * record_send(), and descends into array elements and composite columns that
+ * embed type OIDs themselves.
+ */
+static void
+RemapBinaryValueTypeOids(char *valueData, Oid typeId, Oid *remoteTypeIdArray)
+{
+	Oid baseTypeId = getBaseType(typeId);
+	Oid elementTypeId = get_element_type(baseTypeId);
+
+	if (OidIsValid(elementTypeId))
+	{
+		/* array header: dimension count, flags, element type, (size, lower bound)* */
+		int32 dimensionCount = (int32) ReadNetworkUInt32(valueData);
+		Oid localElementTypeId = (Oid) ReadNetworkUInt32(valueData + 8);
+		int offset = 12 + dimensionCount * 8;
+		int elementCount = (dimensionCount > 0) ? 1 : 0;
+		int dimensionIndex = 0;
+		int elementIndex = 0;
+
+		WriteNetworkUInt32(valueData + 8, RemoteTypeId(localElementTypeId,
+													   remoteTypeIdArray));
+
+		if (!TypeEmbedsTypeOids(elementTypeId))
+		{
+			return;
+		}
+
+		for (dimensionIndex = 0; dimensionIndex < dimensionCount; dimensionIndex++)
+		{
+			char *dimensionData = valueData + 12 + dimensionIndex * 8;
+
+			elementCount *= (int32) ReadNetworkUInt32(dimensionData);
+		}
+
+		for (elementIndex = 0; elementIndex < elementCount; elementIndex++)
+		{
+			int32 elementLength = (int32) ReadNetworkUInt32(valueData + offset);
+			offset += sizeof(uint32);
+
+			if (elementLength < 0)
+			{
+				continue;
+			}
+
+			RemapBinaryValueTypeOids(valueData + offset, elementTypeId,
+									 remoteTypeIdArray);
+			offset += elementLength;
+		}
+	}
+	else if (get_typtype(baseTypeId) == TYPTYPE_COMPOSITE)
+	{
+		/* composite: column count, then (type OID, length, data)* */
+		int32 columnCount = (int32) ReadNetworkUInt32(valueData);
+		int offset = sizeof(uint32);
+		int columnIndex = 0;
+
+		for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			Oid columnTypeId = (Oid) ReadNetworkUInt32(valueData + offset);
+			int32 columnLength = 0;
+
+			WriteNetworkUInt32(valueData + offset, RemoteTypeId(columnTypeId,
+																remoteTypeIdArray));
+			offset += sizeof(uint32);
+
+			columnLength = (int32) ReadNetworkUInt32(valueData + offset);
+			offset += sizeof(uint32);
+
+			if (columnLength < 0)
+			{
+				continue;
+			}
+
+			if (TypeEmbedsTypeOids(columnTypeId))
+			{
+				RemapBinaryValueTypeOids(valueData + offset, columnTypeId,
+										 remoteTypeIdArray);
+			}
+
+			offset += columnLength;
+		}
+	}
+}
+
+
+/*
+ * RemoteTypeId returns the OID a remote node uses for the given local type. OIDs
+ * of built-in types are the same on all nodes.
+ */
+static Oid
+RemoteTypeId(Oid localTypeId, Oid *remoteTypeIdArray)
+{
+	CopyTypeOidRemapping *typeOidRemapping = copyTypeOidRemapping;
+	int typeIndex = 0;
+
+	for (typeIndex = 0; typeIndex < typeOidRemapping->typeCount; typeIndex++)
+	{
+		if (typeOidRemapping->localTypeIdArray[typeIndex] == localTypeId)
+		{
+			return remoteTypeIdArray[typeIndex];
+		}
+	}
+
+	return localTypeId;
+}
+
+
+/* ReadNetworkUInt32 reads an unsigned 32-bit integer in network byte order. */
+static inline uint32
+ReadNetworkUInt32(char *data)
+{
+	uint32 networkValue = 0;
+
+	memcpy(&networkValue, data, sizeof(uint32));
+
+	return ntohl(networkValue);
+}
+
+
+/* WriteNetworkUInt32 writes an unsigned 32-bit integer in network byte order. */
+static inline void
+WriteNetworkUInt32(char *data, uint32 value)
+{
+	uint32 networkValue = htonl(value);
+
+	memcpy(data, &networkValue, sizeof(uint32));
+}
+
+
+/*
+ * MasterShardPlacementList dispatches the finalized shard placements call
+ * between local or remote master node according to the master connection state.
+ */
+static List *
+MasterShardPlacementList(uint64 shardId)
+{
+	List *finalizedPlacementList = NIL;
+	if (masterConnection == NULL)
+	{
+		finalizedPlacementList = FinalizedShardPlacementList(shardId);
+	}
+	else
+	{
+		finalizedPlacementList = RemoteFinalizedShardPlacementList(shardId);
+	}
+
+	return finalizedPlacementList;
+}
+
+
+/*
+ * RemoteFinalizedShardPlacementList gets the finalized shard placement list
+ * for the given shard id from the remote master node.
+ */
+static List *
+RemoteFinalizedShardPlacementList(uint64 shardId)
+{
+	List *finalizedPlacementList = NIL;
+	PGresult *queryResult = NULL;
+
+	StringInfo shardPlacementsCommand = makeStringInfo();
+	appendStringInfo(shardPlacementsCommand, FINALIZED_SHARD_PLACEMENTS_QUERY, shardId);
+
+	queryResult = PQexec(masterConnection->pgConn, shardPlacementsCommand->data);
+	if (PQresultStatus(queryResult) == PGRES_TUPLES_OK)
+	{
+		int rowCount = PQntuples(queryResult);
+		int rowIndex = 0;
+
+		for (rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			char *placementIdString = PQgetvalue(queryResult, rowIndex, 0);
+			char *nodeName = PQgetvalue(queryResult, rowIndex, 1);
+			char *nodePortString = PQgetvalue(queryResult, rowIndex, 2);
+			uint32 nodePort = atoi(nodePortString);
+			uint64 placementId = atoll(placementIdString);
+
+			ShardPlacement *shardPlacement =
+				(ShardPlacement *) palloc0(sizeof(ShardPlacement));
+
+			shardPlacement->placementId = placementId;
+			shardPlacement->nodeName = nodeName;
+			shardPlacement->nodePort = nodePort;
+
+			finalizedPlacementList = lappend(finalizedPlacementList, shardPlacement);
+		}
+	}
+	else
+	{
+		ereport(ERROR, (errmsg("could not get shard placements from the master node")));
+	}
+
+	return finalizedPlacementList;
+}
+
+
+/* Send copy binary headers to given connections */
+static void
+SendCopyBinaryHeaders(CopyOutState copyOutState, int64 shardId, List *connectionList)
+{
+	resetStringInfo(copyOutState->fe_msgbuf);
+	AppendCopyBinaryHeaders(copyOutState);
+	SendCopyDataToAll(copyOutState->fe_msgbuf, shardId, connectionList);
+}
+
+
+/* Send copy binary footers to given connections */
+static void
+SendCopyBinaryFooters(CopyOutState copyOutState, int64 shardId, List *connectionList)
+{
+	resetStringInfo(copyOutState->fe_msgbuf);
+	AppendCopyBinaryFooters(copyOutState);
+	SendCopyDataToAll(copyOutState->fe_msgbuf, shardId, connectionList);
+}
+
+
+/*
+ * ConstructCopyStatement constructs the text of a COPY statement for a particular
+ * shard.
+ */
+static StringInfo
+ConstructCopyStatement(CopyStmt *copyStatement, int64 shardId, bool useBinaryCopyFormat)
+{
+	StringInfo command = makeStringInfo();
+
+	char *schemaName = copyStatement->relation->schemaname;
+	char *relationName = copyStatement->relation->relname;
+
+	char *shardName = pstrdup(relationName);
+	char *shardQualifiedName = NULL;
+	const char *copyFormat = NULL;
+
+	AppendShardIdToName(&shardName, shardId);
+
+	shardQualifiedName = quote_qualified_identifier(schemaName, shardName);
+
+	if (useBinaryCopyFormat)
+	{
+		copyFormat = "BINARY";
+	}
+	else
+	{
+		copyFormat = "TEXT";
+	}
+	appendStringInfo(command, "COPY %s FROM STDIN WITH (FORMAT %s)", shardQualifiedName,
+					 copyFormat);
+
+	return command;
+}
+
+
+/*
+ * SendCopyDataToAll sends copy data to all connections in a list.
+ */
+static void
+SendCopyDataToAll(StringInfo dataBuffer, int64 shardId, List *connectionList)
 {
 	ListCell *connectionCell = NULL;
 	foreach(connectionCell, connectionList)
@@ -1117,7 +2070,9 @@ SendCopyDataToAll(StringInfo dataBuffer, int64 shardId, List *connectionList)
 static void
 SendCopyDataToPlacement(StringInfo dataBuffer, int64 shardId, MultiConnection *connection)
 {
-	int copyResult = PQputCopyData(connection->pgConn, dataBuffer->data, dataBuffer->len);
+	StringInfo connectionData = RemapCopyDataTypeOids(dataBuffer, connection);
+	int copyResult = PQputCopyData(connection->pgConn, connectionData->data,
+								   connectionData->len);
 	if (copyResult != 1)
 	{
 		ereport(ERROR, (errcode(ERRCODE_IO_ERROR),
@@ -1174,6 +2129,258 @@ EndRemoteCopy(int64 shardId, List *connectionList, bool stopOnFailure)
 }
 
 
+/*
+ * CopyHasHeaderLine returns whether the COPY options include a header line,
+ * which copy.c skips before reading rows.
+ */
+static bool
+CopyHasHeaderLine(CopyStmt *copyStatement)
+{
+	bool hasHeaderLine = false;
+	ListCell *optionCell = NULL;
+
+	foreach(optionCell, copyStatement->options)
+	{
+		DefElem *option = (DefElem *) lfirst(optionCell);
+
+		if (strncmp(option->defname, "header", NAMEDATALEN) == 0)
+		{
+			hasHeaderLine = defGetBoolean(option);
+		}
+	}
+
+	return hasHeaderLine;
+}
+
+
+/*
+ * CopyRowErrorCallback adds the input line of the row that is being routed or
+ * sent to shard placements to error messages. The line is not known while the
+ * rows of a batch are routed together, in which case only the relation is
+ * reported.
+ */
+static void
+CopyRowErrorCallback(void *arg)
+{
+	CopyRowErrorContext *rowErrorContext = (CopyRowErrorContext *) arg;
+
+	if (rowErrorContext->lineNumber > 0)
+	{
+		errcontext("COPY %s, line %d", rowErrorContext->relationName,
+				   rowErrorContext->lineNumber);
+	}
+	else
+	{
+		errcontext("COPY %s", rowErrorContext->relationName);
+	}
+}
+
+
+/*
+ * CreateShardCopyBufferHash constructs a hash table which maps from shard
+ * identifier to the buffer of rows that are waiting to be sent to the shard's
+ * placements.
+ */
+static HTAB *
+CreateShardCopyBufferHash(MemoryContext memoryContext)
+{
+	HTAB *copyBufferHash = NULL;
+	int hashFlags = 0;
+	HASHCTL info;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(int64);
+	info.entrysize = sizeof(ShardCopyBuffer);
+	info.hcxt = memoryContext;
+	hashFlags = (HASH_ELEM | HASH_CONTEXT | HASH_BLOBS);
+
+	copyBufferHash = hash_create("Shard Copy Buffer Hash", 128, &info, hashFlags);
+
+	return copyBufferHash;
+}
+
+
+/*
+ * SetCopyConnectionsNonblocking puts all connections in the given list into
+ * nonblocking mode, or back into blocking mode. Connections need to have sent
+ * all pending data before they can be put back into blocking mode.
+ */
+static void
+SetCopyConnectionsNonblocking(List *connectionList, bool nonblocking)
+{
+	ListCell *connectionCell = NULL;
+
+	foreach(connectionCell, connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+		if (PQsetnonblocking(connection->pgConn, nonblocking) != 0)
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+	}
+}
+
+
+/*
+ * FlushShardCopyBuffer sends the rows in the given shard copy buffer to all
+ * placements of the shard, and resets the buffer. Since connections are in
+ * nonblocking mode, the data is only queued in libpq and is transmitted in
+ * the background while we prepare further buffers. To keep the amount of
+ * queued data bounded, the function first waits until the shard's placements
+ * have sent their previous buffer. While waiting, it keeps making progress on
+ * all other copy connections.
+ */
+static void
+FlushShardCopyBuffer(ShardCopyBuffer *copyBuffer, List *copyConnectionList)
+{
+	StringInfo copyData = copyBuffer->copyData;
+	ListCell *connectionCell = NULL;
+
+	if (copyData->len == 0)
+	{
+		return;
+	}
+
+	WaitForCopyConnections(copyBuffer->connectionList, copyConnectionList);
+
+	foreach(connectionCell, copyBuffer->connectionList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+		PGconn *pgConn = connection->pgConn;
+		StringInfo connectionCopyData = RemapCopyDataTypeOids(copyData, connection);
+		int copyResult = PQputCopyData(pgConn, connectionCopyData->data,
+									   connectionCopyData->len);
+
+		if (copyResult == 1)
+		{
+			copyResult = (PQflush(pgConn) >= 0) ? 1 : -1;
+		}
+
+		if (copyResult != 1)
+		{
+			/* the placement may have ended the COPY due to an error */
+			PGresult *result = PQgetResult(pgConn);
+			if (result != NULL && PQresultStatus(result) == PGRES_FATAL_ERROR)
+			{
+				ReportCopyError(connection, result);
+			}
+
+			ereport(ERROR, (errcode(ERRCODE_IO_ERROR),
+							errmsg("failed to COPY to shard %ld on %s:%d",
+								   copyBuffer->shardId, connection->hostname,
+								   connection->port),
+							errdetail("failed to send %d bytes", copyData->len)));
+		}
+	}
+
+	resetStringInfo(copyData);
+}
+
+
+/*
+ * WaitForCopyConnections waits until all connections in waitConnectionList
+ * have sent their pending data. While waiting, the function also sends the
+ * pending data of the other connections in copyConnectionList, and consumes
+ * any input they receive, such that no placement stalls on a full socket.
+ */
+static void
+WaitForCopyConnections(List *waitConnectionList, List *copyConnectionList)
+{
+	static int checkIntervalMS = 200;
+	int connectionCount = list_length(copyConnectionList);
+	struct pollfd *pollDescriptorArray = NULL;
+	MultiConnection **pollConnectionArray = NULL;
+
+	if (connectionCount == 0)
+	{
+		return;
+	}
+
+	pollDescriptorArray = palloc0(connectionCount * sizeof(struct pollfd));
+	pollConnectionArray = palloc0(connectionCount * sizeof(MultiConnection *));
+
+	while (true)
+	{
+		ListCell *connectionCell = NULL;
+		int pollDescriptorCount = 0;
+		bool waitConnectionsPending = false;
+		int pollResult = 0;
+		int pollIndex = 0;
+
+		foreach(connectionCell, copyConnectionList)
+		{
+			MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+			int flushResult = PQflush(connection->pgConn);
+
+			if (flushResult == -1)
+			{
+				ReportConnectionError(connection, ERROR);
+			}
+			else if (flushResult == 1)
+			{
+				struct pollfd *pollDescriptor = &pollDescriptorArray[pollDescriptorCount];
+
+				pollDescriptor->fd = PQsocket(connection->pgConn);
+				pollDescriptor->events = POLLOUT | POLLIN;
+				pollDescriptor->revents = 0;
+
+				pollConnectionArray[pollDescriptorCount] = connection;
+				pollDescriptorCount++;
+
+				if (list_member_ptr(waitConnectionList, connection))
+				{
+					waitConnectionsPending = true;
+				}
+			}
+		}
+
+		if (!waitConnectionsPending)
+		{
+			break;
+		}
+
+		/*
+		 * Only sleep for a limited amount of time, so we can react to
+		 * interrupts in time, even if the platform doesn't interrupt
+		 * poll() after signal arrival.
+		 */
+		pollResult = poll(pollDescriptorArray, pollDescriptorCount, checkIntervalMS);
+		if (pollResult == 0)
+		{
+			CHECK_FOR_INTERRUPTS();
+			continue;
+		}
+		else if (pollResult < 0)
+		{
+			if (errno == EINTR)
+			{
+				CHECK_FOR_INTERRUPTS();
+				continue;
+			}
+
+			ereport(ERROR, (errcode_for_socket_access(),
+							errmsg("poll() failed: %m")));
+		}
+
+		/* consume input (e.g. notices or errors) so the placements don't stall */
+		for (pollIndex = 0; pollIndex < pollDescriptorCount; pollIndex++)
+		{
+			MultiConnection *connection = pollConnectionArray[pollIndex];
+
+			if ((pollDescriptorArray[pollIndex].revents & POLLIN) &&
+				PQconsumeInput(connection->pgConn) == 0)
+			{
+				ReportConnectionError(connection, ERROR);
+			}
+		}
+	}
+
+	pfree(pollDescriptorArray);
+	pfree(pollConnectionArray);
+}
+
+
 /*
  * ReportCopyError tries to report a useful error message for the user from
  * the remote COPY error messages.
@@ -1187,9 +2394,24 @@ ReportCopyError(MultiConnection *connection, PGresult *result)
 	{
 		/* probably a constraint violation, show remote message and detail */
 		char *remoteDetail = PQresultErrorField(result, PG_DIAG_MESSAGE_DETAIL);
+		char *remoteSqlState = PQresultErrorField(result, PG_DIAG_SQLSTATE);
+
+		/*
+		 * A node rejects the type OIDs in binary copy data if the type was
+		 * dropped and created again on that node only, which our syscache
+		 * callback can't notice. We then forget the node's cached type OIDs,
+		 * so that the next COPY looks them up again.
+		 */
+		if (copyTypeOidRemapping != NULL && remoteSqlState != NULL &&
+			MAKE_SQLSTATE(remoteSqlState[0], remoteSqlState[1], remoteSqlState[2],
+						  remoteSqlState[3], remoteSqlState[4]) ==
+			ERRCODE_DATATYPE_MISMATCH)
+		{
+			ForgetRemoteTypeIds(connection);
+		}
 
 		ereport(ERROR, (errmsg("%s", remoteMessage),
-						errdetail("%s", remoteDetail)));
+						remoteDetail ? errdetail("%s", remoteDetail) : 0));
 	}
 	else
 	{
@@ -24,6 +24,8 @@
 #include "distributed/metadata_cache.h"
 #include "distributed/hash_helpers.h"
 #include "distributed/placement_connection.h"
+#include "distributed/remote_commands.h"
+#include "distributed/shared_connection_pool.h"
 #include "mb/pg_wchar.h"
 #include "utils/hsearch.h"
 #include "utils/memutils.h"
@@ -230,8 +232,14 @@ StartNodeUserDatabaseConnection(uint32 flags, const char *hostname, int32 port,
 
 	/*
 	 * Either no caching desired, or no pre-established, non-claimed,
-	 * connection present. Initiate connection establishment.
+	 * connection present. Initiate connection establishment, once the shared
+	 * connection pool has room for another connection to the node.
 	 */
+	if (!(flags & SHARED_CONNECTION_RESERVED))
+	{
+		WaitForSharedConnection(key.hostname, key.port);
+	}
+
 	connection = StartConnectionEstablishment(&key);
 
 	dlist_push_tail(entry->connections, &connection->connectionNode);
@@ -367,6 +375,10 @@ CloseConnection(MultiConnection *connection)
 		/* same for transaction state and shard/placement machinery */
 		CloseRemoteTransaction(connection);
 		CloseShardPlacementAssociation(connection);
+		FreePreparedStatementCache(connection);
+
+		/* give the connection back to the shared pool */
+		ReleaseSharedConnection(connection->hostname, connection->port);
 
 		/* we leave the per-host entry alive */
 		pfree(connection);
@@ -673,11 +685,16 @@ AfterXactHostConnectionHandling(ConnectionHashEntry *entry, bool isCommit)
 		}
 
 		/*
-		 * Preserve session lifespan connections if they are still healthy.
+		 * Preserve session lifespan connections if they are still healthy,
+		 * unless the number of connections to each node is limited. An idle
+		 * session doesn't run any code that could give its connections back,
+		 * so cached connections would keep other backends from connecting for
+		 * as long as the session stays open.
 		 */
 		if (!connection->sessionLifespan ||
 			PQstatus(connection->pgConn) != CONNECTION_OK ||
-			PQtransactionStatus(connection->pgConn) != PQTRANS_IDLE)
+			PQtransactionStatus(connection->pgConn) != PQTRANS_IDLE ||
+			MaxSharedPoolSize > 0)
 		{
 			PQfinish(connection->pgConn);
 			connection->pgConn = NULL;
@@ -685,6 +702,8 @@ AfterXactHostConnectionHandling(ConnectionHashEntry *entry, bool isCommit)
 			/* unlink from list */
 			dlist_delete(iter.cur);
 
+			FreePreparedStatementCache(connection);
+			ReleaseSharedConnection(connection->hostname, connection->port);
 			pfree(connection);
 		}
 		else
@@ -10,17 +10,68 @@
 
 #include "postgres.h"
 
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
 #include "libpq-fe.h"
 
+#include "access/hash.h"
 #include "distributed/connection_management.h"
 #include "distributed/remote_commands.h"
+#include "lib/ilist.h"
 #include "miscadmin.h"
 #include "storage/latch.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
 
 
 /* GUC, determining whether statements sent to remote nodes are logged */
 bool LogRemoteCommands = false;
 
+/* GUC, maximum number of statements prepared on each remote connection */
+int MaxCachedStatementsPerConnection = 0;
+
+
+/*
+ * PreparedStatementCache keeps track of the statements that were prepared on a
+ * connection, so they can be executed again without being parsed and planned
+ * on the remote node. Statements are evicted in least recently used order.
+ */
+typedef struct PreparedStatementCache
+{
+	MemoryContext context;
+	HTAB *statementHash;
+
+	/* statements ordered by last use, most recently used first */
+	dlist_head statementList;
+
+	/* used to generate unique statement names */
+	uint64 statementCounter;
+} PreparedStatementCache;
+
+
+/* PreparedStatement describes a statement prepared on a remote connection */
+typedef struct PreparedStatement
+{
+	char *queryString; /* hash key, must be first */
+	char statementName[NAMEDATALEN];
+	int parameterCount;
+	Oid *parameterTypes;
+	dlist_node statementNode;
+} PreparedStatement;
+
+
+static PreparedStatement * GetPreparedStatement(MultiConnection *connection,
+												const char *command,
+												int parameterCount,
+												const Oid *parameterTypes);
+static PreparedStatementCache * CreatePreparedStatementCache(void);
+static void EvictPreparedStatement(MultiConnection *connection,
+								   PreparedStatement *statement);
+static uint32 PreparedStatementHashHash(const void *key, Size keysize);
+static int PreparedStatementHashCompare(const void *a, const void *b, Size keysize);
+
 
 /* simple helpers */
 
@@ -472,3 +523,387 @@ GetRemoteCommandResult(MultiConnection *connection, bool raiseInterrupts)
 
 	return result;
 }
+
+
+/*
+ * RemoteCommandResultAvailable returns true if GetRemoteCommandResult() can
+ * return the next result of the command in progress on the connection without
+ * waiting. That's also the case if reading from the connection failed, as
+ * GetRemoteCommandResult() then immediately notices the failure.
+ */
+bool
+RemoteCommandResultAvailable(MultiConnection *connection)
+{
+	PGconn *pgConn = connection->pgConn;
+
+	if (PQconsumeInput(pgConn) == 0)
+	{
+		return true;
+	}
+
+	return !PQisBusy(pgConn);
+}
+
+
+/*
+ * WaitForAnyRemoteCommandResult waits until the result of the command in
+ * progress on at least one of the given connections is available, see
+ * RemoteCommandResultAvailable(). The commands are expected to be fully sent
+ * already, as is the case for connections in blocking mode.
+ */
+void
+WaitForAnyRemoteCommandResult(List *connectionList)
+{
+	static int checkIntervalMS = 200;
+	int connectionCount = list_length(connectionList);
+	struct pollfd *pollFileDescriptors = NULL;
+
+	if (connectionCount == 0)
+	{
+		return;
+	}
+
+	pollFileDescriptors = palloc0(connectionCount * sizeof(struct pollfd));
+
+	while (true)
+	{
+		ListCell *connectionCell = NULL;
+		int connectionIndex = 0;
+		int pollResult = 0;
+
+		foreach(connectionCell, connectionList)
+		{
+			MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+			if (RemoteCommandResultAvailable(connection))
+			{
+				pfree(pollFileDescriptors);
+				return;
+			}
+
+			pollFileDescriptors[connectionIndex].fd = PQsocket(connection->pgConn);
+			pollFileDescriptors[connectionIndex].events = POLLIN;
+			pollFileDescriptors[connectionIndex].revents = 0;
+			connectionIndex++;
+		}
+
+		/*
+		 * Only sleep for a limited amount of time, so we can react to
+		 * interrupts in time, even if the platform doesn't interrupt poll()
+		 * after signal arrival.
+		 */
+		pollResult = poll(pollFileDescriptors, connectionCount, checkIntervalMS);
+
+		if (pollResult == 0 || (pollResult < 0 && errno == EINTR))
+		{
+			/* timeout exceeded, or interrupted by a signal, so check */
+			CHECK_FOR_INTERRUPTS();
+		}
+		else if (pollResult < 0)
+		{
+			ereport(ERROR, (errcode_for_socket_access(),
+							errmsg("poll() failed: %m")));
+		}
+	}
+}
+
+
+/* prepared statement caching */
+
+
+/*
+ * SendRemoteCachedCommandParams is a variant of SendRemoteCommandParams which
+ * executes the command as a prepared statement on the remote node, preparing it
+ * first if this connection hasn't done so yet. Up to
+ * citus.max_cached_statements_per_connection statements are kept prepared per
+ * connection.
+ *
+ * Statements are only prepared on connections which are not in a transaction
+ * block, so that a failing prepare can't abort a remote transaction. If the
+ * statement can't be prepared, the command is sent as with
+ * SendRemoteCommandParams, so that errors are reported the usual way.
+ */
+int
+SendRemoteCachedCommandParams(MultiConnection *connection, const char *command,
+							  int parameterCount, const Oid *parameterTypes,
+							  const char *const *parameterValues)
+{
+	PGconn *pgConn = connection->pgConn;
+	PreparedStatement *statement = NULL;
+	bool wasNonblocking = false;
+	int rc = 0;
+
+	if (MaxCachedStatementsPerConnection <= 0)
+	{
+		return SendRemoteCommandParams(connection, command, parameterCount,
+									   parameterTypes, parameterValues);
+	}
+
+	statement = GetPreparedStatement(connection, command, parameterCount,
+									 parameterTypes);
+	if (statement == NULL)
+	{
+		return SendRemoteCommandParams(connection, command, parameterCount,
+									   parameterTypes, parameterValues);
+	}
+
+	LogRemoteCommand(connection, command);
+
+	/* make sure not to block anywhere */
+	wasNonblocking = PQisnonblocking(pgConn);
+	if (!wasNonblocking)
+	{
+		PQsetnonblocking(pgConn, true);
+	}
+
+	rc = PQsendQueryPrepared(pgConn, statement->statementName, parameterCount,
+							 parameterValues, NULL, NULL, 0);
+
+	/* reset nonblocking connection to its original state */
+	if (!wasNonblocking)
+	{
+		PQsetnonblocking(pgConn, false);
+	}
+
+	return rc;
+}
+
+
+/*
+ * FreePreparedStatementCache forgets about the statements prepared on the given
+ * connection. It is called when the connection is closed.
+ */
+void
+FreePreparedStatementCache(MultiConnection *connection)
+{
+	PreparedStatementCache *cache = connection->preparedStatementCache;
+
+	if (cache == NULL)
+	{
+		return;
+	}
+
+	MemoryContextDelete(cache->context);
+	connection->preparedStatementCache = NULL;
+}
+
+
+/*
+ * GetPreparedStatement returns the statement prepared for the given command
+ * and parameter types on the connection, and marks it as most recently used.
+ * If there is no such statement and the connection is idle, the function
+ * prepares one, evicting the least recently used statement if the cache is
+ * full. Otherwise, or if preparing fails, the function returns NULL.
+ */
+static PreparedStatement *
+GetPreparedStatement(MultiConnection *connection, const char *command,
+					 int parameterCount, const Oid *parameterTypes)
+{
+	PGconn *pgConn = connection->pgConn;
+	PreparedStatementCache *cache = connection->preparedStatementCache;
+	PreparedStatement *statement = NULL;
+	PGresult *result = NULL;
+	bool statementFound = false;
+	bool prepared = false;
+	bool wasNonblocking = false;
+	bool raiseInterrupts = true;
+	int parameterTypesSize = parameterCount * sizeof(Oid);
+	int querySent = 0;
+
+	if (cache == NULL)
+	{
+		cache = CreatePreparedStatementCache();
+		connection->preparedStatementCache = cache;
+	}
+
+	statement = (PreparedStatement *) hash_search(cache->statementHash, &command,
+												  HASH_FIND, NULL);
+	if (statement != NULL)
+	{
+		if (statement->parameterCount == parameterCount &&
+			(parameterCount == 0 ||
+			 memcmp(statement->parameterTypes, parameterTypes, parameterTypesSize) == 0))
+		{
+			dlist_move_head(&cache->statementList, &statement->statementNode);
+
+			ereport(DEBUG1, (errmsg("using prepared statement %s",
+									statement->statementName)));
+
+			return statement;
+		}
+
+		/* parameter types changed, prepare the statement again below */
+		if (PQtransactionStatus(pgConn) != PQTRANS_IDLE)
+		{
+			return NULL;
+		}
+
+		EvictPreparedStatement(connection, statement);
+	}
+
+	if (PQtransactionStatus(pgConn) != PQTRANS_IDLE)
+	{
+		return NULL;
+	}
+
+	/* make room for the new statement */
+	while (hash_get_num_entries(cache->statementHash) >= MaxCachedStatementsPerConnection)
+	{
+		dlist_node *leastRecentlyUsedNode = dlist_tail_node(&cache->statementList);
+
+		EvictPreparedStatement(connection,
+							   dlist_container(PreparedStatement, statementNode,
+											   leastRecentlyUsedNode));
+	}
+
+	statement = (PreparedStatement *) hash_search(cache->statementHash, &command,
+												  HASH_ENTER, &statementFound);
+	Assert(!statementFound);
+
+	statement->queryString = MemoryContextStrdup(cache->context, command);
+	snprintf(statement->statementName, NAMEDATALEN, "citus_statement_" UINT64_FORMAT,
+			 cache->statementCounter++);
+	statement->parameterCount = parameterCount;
+	statement->parameterTypes = MemoryContextAlloc(cache->context,
+												   parameterTypesSize + 1);
+	if (parameterCount > 0)
+	{
+		memcpy(statement->parameterTypes, parameterTypes, parameterTypesSize);
+	}
+	dlist_push_head(&cache->statementList, &statement->statementNode);
+
+	wasNonblocking = PQisnonblocking(pgConn);
+	if (!wasNonblocking)
+	{
+		PQsetnonblocking(pgConn, true);
+	}
+
+	querySent = PQsendPrepare(pgConn, statement->statementName, command,
+							  parameterCount, parameterTypes);
+
+	if (!wasNonblocking)
+	{
+		PQsetnonblocking(pgConn, false);
+	}
+
+	if (querySent != 0)
+	{
+		result = GetRemoteCommandResult(connection, raiseInterrupts);
+		prepared = (PQresultStatus(result) == PGRES_COMMAND_OK);
+
+		PQclear(result);
+		ForgetResults(connection);
+	}
+
+	if (!prepared)
+	{
+		char *queryString = statement->queryString;
+
+		/* nothing to deallocate on the remote node */
+		dlist_delete(&statement->statementNode);
+		pfree(statement->parameterTypes);
+		hash_search(cache->statementHash, &queryString, HASH_REMOVE, NULL);
+		pfree(queryString);
+
+		return NULL;
+	}
+
+	ereport(DEBUG1, (errmsg("prepared statement %s", statement->statementName)));
+
+	return statement;
+}
+
+
+/*
+ * CreatePreparedStatementCache creates an empty prepared statement cache in its
+ * own memory context, which lives as long as the connection.
+ */
+static PreparedStatementCache *
+CreatePreparedStatementCache(void)
+{
+	PreparedStatementCache *cache = NULL;
+	MemoryContext cacheContext = AllocSetContextCreate(ConnectionContext,
+													   "Prepared Statement Cache",
+													   ALLOCSET_SMALL_MINSIZE,
+													   ALLOCSET_SMALL_INITSIZE,
+													   ALLOCSET_DEFAULT_MAXSIZE);
+	HASHCTL info;
+	int hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_CONTEXT);
+
+	cache = MemoryContextAllocZero(cacheContext, sizeof(PreparedStatementCache));
+	cache->context = cacheContext;
+	dlist_init(&cache->statementList);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(char *);
+	info.entrysize = sizeof(PreparedStatement);
+	info.hash = PreparedStatementHashHash;
+	info.match = PreparedStatementHashCompare;
+	info.hcxt = cacheContext;
+
+	cache->statementHash = hash_create("Prepared Statement Hash", 32, &info, hashFlags);
+
+	return cache;
+}
+
+
+/*
+ * EvictPreparedStatement deallocates the given statement on the remote node and
+ * removes it from the connection's cache. If deallocating fails, the statement
+ * is left on the remote node until the connection is closed.
+ */
+static void
+EvictPreparedStatement(MultiConnection *connection, PreparedStatement *statement)
+{
+	PreparedStatementCache *cache = connection->preparedStatementCache;
+	StringInfo deallocateCommand = makeStringInfo();
+	char *queryString = statement->queryString;
+	PGresult *result = NULL;
+	int queryResult = 0;
+
+	ereport(DEBUG1, (errmsg("deallocating prepared statement %s",
+							statement->statementName)));
+
+	appendStringInfo(deallocateCommand, "DEALLOCATE %s", statement->statementName);
+
+	queryResult = ExecuteOptionalRemoteCommand(connection, deallocateCommand->data,
+											   &result);
+	if (queryResult == 0)
+	{
+		PQclear(result);
+		ForgetResults(connection);
+	}
+
+	dlist_delete(&statement->statementNode);
+	pfree(statement->parameterTypes);
+	hash_search(cache->statementHash, &queryString, HASH_REMOVE, NULL);
+	pfree(queryString);
+}
+
+
+/*
+ * PreparedStatementHashHash hashes the query string a prepared statement hash
+ * key points to.
+ */
+static uint32
+PreparedStatementHashHash(const void *key, Size keysize)
+{
+	const char *queryString = *((const char **) key);
+
+	return DatumGetUInt32(hash_any((const unsigned char *) queryString,
+								   strlen(queryString)));
+}
+
+
+/*
+ * PreparedStatementHashCompare compares the query strings two prepared
+ * statement hash keys point to.
+ */
+static int
+PreparedStatementHashCompare(const void *a, const void *b, Size keysize)
+{
+	const char *queryStringA = *((const char **) a);
+	const char *queryStringB = *((const char **) b);
+
+	return strcmp(queryStringA, queryStringB);
+}
@@ -0,0 +1,438 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_connection_pool.c
+ *   Bounds the number of connections that all backends of a node open to
+ *   each worker node.
+ *
+ * Each backend keeps its own cache of connections to worker nodes, so with
+ * many client sessions, the coordinator can exhaust max_connections on the
+ * workers. We therefore count the connections that all backends hold to each
+ * worker node in shared memory, and never open more than
+ * citus.max_shared_pool_size of them. Backends that need a new connection
+ * while the pool is exhausted wait for another backend to give one back, and
+ * error out if none is given back within the connection timeout. The
+ * executors, which open connections asynchronously, queue their tasks instead
+ * of waiting. While the limit is set, backends give back their connections at
+ * transaction end instead of caching them for the session; an idle session
+ * would otherwise hold on to them indefinitely. Connections still aren't
+ * shared between backends; a backend keeps its connections for the duration
+ * of a transaction, so transaction affinity is preserved.
+ *
+ * When the limit is 0, we don't count connections at all. Connections opened
+ * before the limit is set therefore don't count against it.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include "distributed/connection_management.h"
+#include "distributed/shared_connection_pool.h"
+#include "distributed/worker_manager.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+
+/* SharedConnectionKey identifies a worker node in the connection count hashes */
+typedef struct SharedConnectionKey
+{
+	char hostname[MAX_NODE_LENGTH];
+	int32 port;
+} SharedConnectionKey;
+
+
+/* SharedConnectionCount counts the connections to a worker node */
+typedef struct SharedConnectionCount
+{
+	SharedConnectionKey key;    /* hash key; must be first */
+	int32 connectionCount;
+} SharedConnectionCount;
+
+
+/*
+ * SharedConnectionPoolData holds the shared hash of connection counts, and the
+ * lock that protects it.
+ */
+typedef struct SharedConnectionPoolData
+{
+	HTAB *connectionCountHash;
+
+	int connectionCountTrancheId;
+	LWLockTranche connectionCountLockTranche;
+	LWLockPadded connectionCountLock;
+} SharedConnectionPoolData;
+
+
+/* Config variable managed via guc.c */
+int MaxSharedPoolSize = 0; /* maximum connections to each worker; 0 means no limit */
+
+/* Shared memory state and hooks */
+static SharedConnectionPoolData *SharedConnectionPool = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/* connections this backend counts in the shared pool */
+static HTAB *LocalConnectionCountHash = NULL;
+
+
+/* Local functions forward declarations */
+static Size SharedConnectionPoolShmemSize(void);
+static void SharedConnectionPoolShmemInit(void);
+static void UpdateLocalConnectionCount(SharedConnectionKey *connectionKey,
+									   int32 connectionCountChange);
+static void ReleaseLocalSharedConnections(int code, Datum arg);
+static void InitSharedConnectionKey(SharedConnectionKey *connectionKey,
+									const char *hostname, int32 port);
+
+
+/*
+ * InitializeSharedConnectionPool organizes, at startup, that the shared memory
+ * for connection counts is allocated.
+ */
+void
+InitializeSharedConnectionPool(void)
+{
+	RequestAddinShmemSpace(SharedConnectionPoolShmemSize());
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = SharedConnectionPoolShmemInit;
+}
+
+
+/* Estimates the shared memory size used for counting connections. */
+static Size
+SharedConnectionPoolShmemSize(void)
+{
+	Size size = 0;
+	Size hashSize = 0;
+
+	size = add_size(size, sizeof(SharedConnectionPoolData));
+
+	hashSize = hash_estimate_size(MaxWorkerNodesTracked, sizeof(SharedConnectionCount));
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/* Initializes the shared memory used for counting connections. */
+static void
+SharedConnectionPoolShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+	int hashFlags = 0;
+	long maxTableSize = (long) MaxWorkerNodesTracked;
+	long initTableSize = maxTableSize;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(SharedConnectionKey);
+	info.entrysize = sizeof(SharedConnectionCount);
+	hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	SharedConnectionPool =
+		(SharedConnectionPoolData *) ShmemInitStruct("Shared Connection Pool Control",
+													 sizeof(SharedConnectionPoolData),
+													 &alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		/* initialize the lwlock protecting the connection count hash */
+		LWLockTranche *tranche = &SharedConnectionPool->connectionCountLockTranche;
+
+		SharedConnectionPool->connectionCountTrancheId = LWLockNewTrancheId();
+		tranche->array_base = &SharedConnectionPool->connectionCountLock;
+		tranche->array_stride = sizeof(LWLockPadded);
+		tranche->name = "Shared Connection Pool Tranche";
+		LWLockRegisterTranche(SharedConnectionPool->connectionCountTrancheId, tranche);
+
+		LWLockInitialize(&SharedConnectionPool->connectionCountLock.lock,
+						 SharedConnectionPool->connectionCountTrancheId);
+	}
+
+	SharedConnectionPool->connectionCountHash =
+		ShmemInitHash("Shared Connection Count Hash", initTableSize, maxTableSize,
+					  &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(SharedConnectionPool->connectionCountHash != NULL);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * TryReserveSharedConnection counts one more connection to the given worker
+ * node in the shared pool, unless the pool for that node is exhausted. The
+ * function returns whether it reserved the connection. If the shared hash has
+ * no room left for the node, we don't count its connections.
+ */
+bool
+TryReserveSharedConnection(const char *hostname, int32 port)
+{
+	SharedConnectionKey connectionKey;
+	SharedConnectionCount *connectionCount = NULL;
+	bool connectionCountFound = false;
+	bool reserved = true;
+
+	if (MaxSharedPoolSize <= 0)
+	{
+		return true;
+	}
+
+	InitSharedConnectionKey(&connectionKey, hostname, port);
+
+	LWLockAcquire(&SharedConnectionPool->connectionCountLock.lock, LW_EXCLUSIVE);
+
+	connectionCount = (SharedConnectionCount *) hash_search(
+		SharedConnectionPool->connectionCountHash, &connectionKey, HASH_ENTER_NULL,
+		&connectionCountFound);
+	if (connectionCount != NULL)
+	{
+		if (!connectionCountFound)
+		{
+			connectionCount->connectionCount = 0;
+		}
+
+		if (connectionCount->connectionCount >= MaxSharedPoolSize)
+		{
+			reserved = false;
+		}
+		else
+		{
+			connectionCount->connectionCount++;
+		}
+	}
+
+	LWLockRelease(&SharedConnectionPool->connectionCountLock.lock);
+
+	if (connectionCount != NULL && reserved)
+	{
+		UpdateLocalConnectionCount(&connectionKey, 1);
+	}
+
+	return reserved;
+}
+
+
+/*
+ * WaitForSharedConnection reserves a connection to the given worker node in
+ * the shared pool, waiting for other backends to release connections if the
+ * pool is exhausted. This also applies to the backend's first connection to
+ * the node, so that the limit holds. Backends that wait for each other could
+ * wait forever, so we error out after waiting for the connection timeout.
+ */
+void
+WaitForSharedConnection(const char *hostname, int32 port)
+{
+	TimestampTz waitStartTime = 0;
+
+	if (MaxSharedPoolSize <= 0)
+	{
+		return;
+	}
+
+	waitStartTime = GetCurrentTimestamp();
+
+	while (!TryReserveSharedConnection(hostname, port))
+	{
+		if (TimestampDifferenceExceeds(waitStartTime, GetCurrentTimestamp(),
+									   NodeConnectionTimeout))
+		{
+			ReportSharedConnectionPoolExhausted(hostname, port);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		pg_usleep(SHARED_CONNECTION_WAIT_INTERVAL * 1000L);
+	}
+}
+
+
+/*
+ * ReportSharedConnectionPoolExhausted errors out after a backend waited for
+ * the connection timeout for a connection to the given worker node.
+ */
+void
+ReportSharedConnectionPoolExhausted(const char *hostname, int32 port)
+{
+	ereport(ERROR, (errcode(ERRCODE_TOO_MANY_CONNECTIONS),
+					errmsg("could not reserve a connection to %s:%d", hostname, port),
+					errdetail("All %d connections that citus.max_shared_pool_size "
+							  "allows to the node stayed in use for %d ms.",
+							  MaxSharedPoolSize, NodeConnectionTimeout)));
+}
+
+
+/*
+ * ReleaseSharedConnection gives a connection to the given worker node back to
+ * the shared pool.
+ */
+void
+ReleaseSharedConnection(const char *hostname, int32 port)
+{
+	SharedConnectionKey connectionKey;
+	SharedConnectionCount *localConnectionCount = NULL;
+	SharedConnectionCount *connectionCount = NULL;
+
+	InitSharedConnectionKey(&connectionKey, hostname, port);
+
+	/* only release connections we have counted */
+	if (LocalConnectionCountHash != NULL)
+	{
+		localConnectionCount = (SharedConnectionCount *) hash_search(
+			LocalConnectionCountHash, &connectionKey, HASH_FIND, NULL);
+	}
+
+	if (localConnectionCount == NULL || localConnectionCount->connectionCount <= 0)
+	{
+		return;
+	}
+
+	LWLockAcquire(&SharedConnectionPool->connectionCountLock.lock, LW_EXCLUSIVE);
+
+	connectionCount = (SharedConnectionCount *) hash_search(
+		SharedConnectionPool->connectionCountHash, &connectionKey, HASH_FIND, NULL);
+	if (connectionCount != NULL && connectionCount->connectionCount > 0)
+	{
+		connectionCount->connectionCount--;
+	}
+
+	LWLockRelease(&SharedConnectionPool->connectionCountLock.lock);
+
+	UpdateLocalConnectionCount(&connectionKey, -1);
+}
+
+
+/*
+ * SharedConnectionPoolExhausted returns whether all backends together hold
+ * the maximum number of connections to the given worker node.
+ */
+bool
+SharedConnectionPoolExhausted(const char *hostname, int32 port)
+{
+	SharedConnectionKey connectionKey;
+	SharedConnectionCount *connectionCount = NULL;
+	bool poolExhausted = false;
+
+	if (MaxSharedPoolSize <= 0)
+	{
+		return false;
+	}
+
+	InitSharedConnectionKey(&connectionKey, hostname, port);
+
+	LWLockAcquire(&SharedConnectionPool->connectionCountLock.lock, LW_SHARED);
+
+	connectionCount = (SharedConnectionCount *) hash_search(
+		SharedConnectionPool->connectionCountHash, &connectionKey, HASH_FIND, NULL);
+	if (connectionCount != NULL && connectionCount->connectionCount >= MaxSharedPoolSize)
+	{
+		poolExhausted = true;
+	}
+
+	LWLockRelease(&SharedConnectionPool->connectionCountLock.lock);
+
+	return poolExhausted;
+}
+
+
+/*
+ * UpdateLocalConnectionCount changes the number of connections this backend
+ * counts in the shared pool for the given node. When first called, the
+ * function also organizes that the backend's connections are released when
+ * it exits.
+ */
+static void
+UpdateLocalConnectionCount(SharedConnectionKey *connectionKey,
+						   int32 connectionCountChange)
+{
+	SharedConnectionCount *localConnectionCount = NULL;
+	bool localConnectionCountFound = false;
+
+	if (LocalConnectionCountHash == NULL)
+	{
+		HASHCTL info;
+		int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(SharedConnectionKey);
+		info.entrysize = sizeof(SharedConnectionCount);
+		info.hcxt = TopMemoryContext;
+
+		LocalConnectionCountHash = hash_create("Local Connection Count Hash", 32,
+											   &info, hashFlags);
+
+		before_shmem_exit(ReleaseLocalSharedConnections, 0);
+	}
+
+	localConnectionCount = (SharedConnectionCount *) hash_search(
+		LocalConnectionCountHash, connectionKey, HASH_ENTER,
+		&localConnectionCountFound);
+	if (!localConnectionCountFound)
+	{
+		localConnectionCount->connectionCount = 0;
+	}
+
+	localConnectionCount->connectionCount += connectionCountChange;
+}
+
+
+/*
+ * ReleaseLocalSharedConnections gives all connections this backend counts back
+ * to the shared pool when the backend exits, since exiting backends don't
+ * close their connections one by one.
+ */
+static void
+ReleaseLocalSharedConnections(int code, Datum arg)
+{
+	HASH_SEQ_STATUS status;
+	SharedConnectionCount *localConnectionCount = NULL;
+
+	LWLockAcquire(&SharedConnectionPool->connectionCountLock.lock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, LocalConnectionCountHash);
+
+	localConnectionCount = (SharedConnectionCount *) hash_seq_search(&status);
+	while (localConnectionCount != NULL)
+	{
+		SharedConnectionCount *connectionCount = (SharedConnectionCount *) hash_search(
+			SharedConnectionPool->connectionCountHash, &localConnectionCount->key,
+			HASH_FIND, NULL);
+
+		if (connectionCount != NULL)
+		{
+			connectionCount->connectionCount -= localConnectionCount->connectionCount;
+			connectionCount->connectionCount = Max(connectionCount->connectionCount, 0);
+		}
+
+		localConnectionCount->connectionCount = 0;
+
+		localConnectionCount = (SharedConnectionCount *) hash_seq_search(&status);
+	}
+
+	LWLockRelease(&SharedConnectionPool->connectionCountLock.lock);
+}
+
+
+/* InitSharedConnectionKey fills in the connection count hash key for a node. */
+static void
+InitSharedConnectionKey(SharedConnectionKey *connectionKey, const char *hostname,
+						int32 port)
+{
+	memset(connectionKey, 0, sizeof(SharedConnectionKey));
+	strlcpy(connectionKey->hostname, hostname, MAX_NODE_LENGTH);
+	connectionKey->port = port;
+}
@@ -50,6 +50,8 @@ static PostgresPollingStatusType ClientPollingStatusArray[MAX_CONNECTION_COUNT];
 
 /* Local functions forward declarations */
 static void ClearRemainingResults(MultiConnection *connection);
+static void AppendCopyDataToFile(void *fileDescriptorPointer, char *copyData,
+								 int copyDataLength);
 static bool ClientConnectionReady(MultiConnection *connection,
 								  PostgresPollingStatusType pollingStatus);
 
@@ -131,6 +133,10 @@ MultiClientConnect(const char *nodeName, uint32 nodePort, const char *nodeDataba
  * MultiClientConnectStart asynchronously tries to establish a connection. If it
  * succeeds, it returns the connection id. Otherwise, it reports connection
  * error and returns INVALID_CONNECTION_ID.
+ *
+ * Asynchronous callers can't wait for the shared connection pool, so they
+ * reserve the connection with TryReserveSharedConnection beforehand. If we
+ * can't start the connection, we give the reservation back.
  */
 int32
 MultiClientConnectStart(const char *nodeName, uint32 nodePort, const char *nodeDatabase)
@@ -138,16 +144,20 @@ MultiClientConnectStart(const char *nodeName, uint32 nodePort, const char *nodeD
 	MultiConnection *connection = NULL;
 	ConnStatusType connStatusType = CONNECTION_OK;
 	int32 connectionId = AllocateConnectionId();
-	int connectionFlags = FORCE_NEW_CONNECTION; /* no cached connections for now */
+	int connectionFlags = FORCE_NEW_CONNECTION | SHARED_CONNECTION_RESERVED;
 
 	if (connectionId == INVALID_CONNECTION_ID)
 	{
+		ReleaseSharedConnection(nodeName, nodePort);
+
 		ereport(WARNING, (errmsg("could not allocate connection in connection pool")));
 		return connectionId;
 	}
 
 	if (XactModificationLevel > XACT_MODIFICATION_NONE)
 	{
+		ReleaseSharedConnection(nodeName, nodePort);
+
 		ereport(ERROR, (errcode(ERRCODE_ACTIVE_SQL_TRANSACTION),
 						errmsg("cannot open new connections after the first modification "
 							   "command within a transaction")));
@@ -610,9 +620,26 @@ MultiClientQueryStatus(int32 connectionId)
 }
 
 
-/* MultiClientCopyData copies data from the file. */
+/*
+ * MultiClientCopyData copies data from the connection, and appends these data
+ * to the given file.
+ */
 CopyStatus
 MultiClientCopyData(int32 connectionId, int32 fileDescriptor)
+{
+	return MultiClientReceiveCopyData(connectionId, AppendCopyDataToFile,
+									  (void *) &fileDescriptor);
+}
+
+
+/*
+ * MultiClientReceiveCopyData reads all copy data messages that can be read
+ * without blocking from the connection, and passes each message to the given
+ * receiver function.
+ */
+CopyStatus
+MultiClientReceiveCopyData(int32 connectionId, CopyDataReceiver copyDataReceiver,
+						   void *receiverState)
 {
 	MultiConnection *connection = NULL;
 	char *receiveBuffer = NULL;
@@ -640,21 +667,8 @@ MultiClientCopyData(int32 connectionId, int32 fileDescriptor)
 	receiveLength = PQgetCopyData(connection->pgConn, &receiveBuffer, asynchronous);
 	while (receiveLength > 0)
 	{
-		/* received copy data; append these data to file */
-		int appended = -1;
-		errno = 0;
-
-		appended = write(fileDescriptor, receiveBuffer, receiveLength);
-		if (appended != receiveLength)
-		{
-			/* if write didn't set errno, assume problem is no disk space */
-			if (errno == 0)
-			{
-				errno = ENOSPC;
-			}
-			ereport(FATAL, (errcode_for_file_access(),
-							errmsg("could not append to copied file: %m")));
-		}
+		/* received copy data; hand these data to the receiver */
+		copyDataReceiver(receiverState, receiveBuffer, receiveLength);
 
 		PQfreemem(receiveBuffer);
 
@@ -858,6 +872,31 @@ MultiClientWait(WaitInfo *waitInfo)
 }
 
 
+/*
+ * AppendCopyDataToFile appends received copy data to the file whose descriptor
+ * is pointed to by fileDescriptorPointer.
+ */
+static void
+AppendCopyDataToFile(void *fileDescriptorPointer, char *copyData, int copyDataLength)
+{
+	int32 fileDescriptor = *((int32 *) fileDescriptorPointer);
+	int appended = -1;
+	errno = 0;
+
+	appended = write(fileDescriptor, copyData, copyDataLength);
+	if (appended != copyDataLength)
+	{
+		/* if write didn't set errno, assume problem is no disk space */
+		if (errno == 0)
+		{
+			errno = ENOSPC;
+		}
+		ereport(FATAL, (errcode_for_file_access(),
+						errmsg("could not append to copied file: %m")));
+	}
+}
+
+
 /*
  * ClearRemainingResults reads result objects from the connection until we get
  * null, and clears these results. This is the last step in completing an async
@@ -12,6 +12,7 @@
 
 #include "miscadmin.h"
 
+#include "access/heapam.h"
 #include "access/xact.h"
 #include "catalog/dependency.h"
 #include "catalog/namespace.h"
@@ -20,16 +21,25 @@
 #include "distributed/multi_planner.h"
 #include "distributed/multi_router_executor.h"
 #include "distributed/multi_resowner.h"
+#include "distributed/multi_result_stream.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/multi_utility.h"
 #include "distributed/worker_protocol.h"
 #include "executor/execdebug.h"
+#include "optimizer/tlist.h"
+#include "storage/bufmgr.h"
 #include "storage/lmgr.h"
 #include "tcop/utility.h"
 #include "utils/snapmgr.h"
+#include "utils/sortsupport.h"
 
 
+static void CreateMasterTable(CreateStmt *masterCreateStmt);
+static void StreamQueryResults(MultiPlan *multiPlan, bool mergeTaskResults);
 static void CopyQueryResults(List *masterCopyStmtList);
+static void MergeQueryResults(MultiPlan *multiPlan);
+static SortSupport MasterQuerySortKeys(Query *masterQuery);
+static uint64 MasterTableSize(MultiPlan *multiPlan);
 
 
 /*
@@ -76,9 +86,10 @@ multi_ExecutorStart(QueryDesc *queryDesc, int eflags)
 		}
 		else
 		{
-			PlannedStmt *masterSelectPlan = MasterNodeSelectPlan(multiPlan);
+			PlannedStmt *masterSelectPlan = NULL;
 			CreateStmt *masterCreateStmt = MasterNodeCreateStatement(multiPlan);
 			List *masterCopyStmtList = MasterNodeCopyStatementList(multiPlan);
+			bool mergeTaskResults = MasterNodeMergesTaskResults(multiPlan);
 			RangeTblEntry *masterRangeTableEntry = NULL;
 			StringInfo jobDirectoryName = NULL;
 
@@ -96,31 +107,45 @@ multi_ExecutorStart(QueryDesc *queryDesc, int eflags)
 			if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
 			{
 				/* skip distributed query execution for EXPLAIN commands */
+				CreateMasterTable(masterCreateStmt);
 			}
-			else if (executorType == MULTI_EXECUTOR_REAL_TIME)
+			else if (executorType == MULTI_EXECUTOR_REAL_TIME && StreamRealTimeResults)
 			{
-				MultiRealTimeExecute(workerJob);
+				/* create the result relation up front, and stream results into it */
+				CreateMasterTable(masterCreateStmt);
+				StreamQueryResults(multiPlan, mergeTaskResults);
 			}
-			else if (executorType == MULTI_EXECUTOR_TASK_TRACKER)
+			else
 			{
-				MultiTaskTrackerExecute(workerJob);
+				if (executorType == MULTI_EXECUTOR_REAL_TIME)
+				{
+					MultiRealTimeExecute(workerJob, NULL);
+				}
+				else if (executorType == MULTI_EXECUTOR_TASK_TRACKER)
+				{
+					MultiTaskTrackerExecute(workerJob);
+				}
+
+				/*
+				 * Then create the result relation, and copy task results into it.
+				 * If task results are sorted, merge them in sort order instead.
+				 */
+				CreateMasterTable(masterCreateStmt);
+				if (mergeTaskResults)
+				{
+					MergeQueryResults(multiPlan);
+				}
+				else
+				{
+					CopyQueryResults(masterCopyStmtList);
+				}
 			}
 
-			/* then create the result relation */
-			ProcessUtility((Node *) masterCreateStmt,
-						   "(temp table creation)",
-						   PROCESS_UTILITY_QUERY,
-						   NULL,
-						   None_Receiver,
-						   NULL);
-
-			/* make the temporary table visible */
-			CommandCounterIncrement();
-
-			if (!(eflags & EXEC_FLAG_EXPLAIN_ONLY))
-			{
-				CopyQueryResults(masterCopyStmtList);
-			}
+			/*
+			 * Build the master select plan only now, so that it can take the
+			 * size of task results into account.
+			 */
+			masterSelectPlan = MasterNodeSelectPlan(multiPlan, MasterTableSize(multiPlan));
 
 			/*
 			 * Update the QueryDesc's snapshot so it sees the table. That's not
@@ -168,6 +193,72 @@ multi_ExecutorStart(QueryDesc *queryDesc, int eflags)
 }
 
 
+/*
+ * CreateMasterTable executes the command that creates the temporary table
+ * that holds task results on the master node, and makes this table visible.
+ */
+static void
+CreateMasterTable(CreateStmt *masterCreateStmt)
+{
+	ProcessUtility((Node *) masterCreateStmt,
+				   "(temp table creation)",
+				   PROCESS_UTILITY_QUERY,
+				   NULL,
+				   None_Receiver,
+				   NULL);
+
+	/* make the temporary table visible */
+	CommandCounterIncrement();
+}
+
+
+/*
+ * StreamQueryResults runs the plan's worker job with the real-time executor,
+ * and streams task results directly into the previously created temporary
+ * table as they arrive, skipping the intermediate task files. If task results
+ * are sorted, the stream merges them in sort order as they arrive, like
+ * MergeQueryResults() does for task files. If the master query only needs a
+ * limited number of rows, the executor stops as soon as these rows arrived,
+ * and cancels the remaining tasks.
+ */
+static void
+StreamQueryResults(MultiPlan *multiPlan, bool mergeTaskResults)
+{
+	Query *masterQuery = multiPlan->masterQuery;
+	Job *workerJob = multiPlan->workerJob;
+	Oid masterTableId = RelnameGetRelid(multiPlan->masterTableName);
+	Relation masterTable = heap_open(masterTableId, RowExclusiveLock);
+	int64 rowLimit = MasterNodeRowLimit(multiPlan);
+	TaskResultStream *resultStream = NULL;
+
+	if (mergeTaskResults)
+	{
+		SortSupport sortKeys = MasterQuerySortKeys(masterQuery);
+		int sortKeyCount = list_length(masterQuery->sortClause);
+		int taskCount = list_length(workerJob->taskList);
+
+		ereport(DEBUG1, (errmsg("merging sorted task results as they arrive")));
+
+		resultStream = CreateTaskResultMergeStream(masterTable, BinaryMasterCopyFormat,
+												   rowLimit, taskCount, sortKeys,
+												   sortKeyCount);
+	}
+	else
+	{
+		resultStream = CreateTaskResultStream(masterTable, BinaryMasterCopyFormat,
+											  rowLimit);
+	}
+
+	MultiRealTimeExecute(workerJob, resultStream);
+
+	FinishTaskResultStream(resultStream);
+	heap_close(masterTable, NoLock);
+
+	/* make the streamed contents visible */
+	CommandCounterIncrement();
+}
+
+
 /*
  * CopyQueryResults executes the commands that copy query results into a
  * temporary table.
@@ -197,6 +288,97 @@ CopyQueryResults(List *masterCopyStmtList)
 }
 
 
+/*
+ * MergeQueryResults merges the task result files of the plan's worker job into
+ * the previously created temporary table. Worker nodes already sorted their
+ * results in the master query's sort order, so appending the merged rows keeps
+ * the table in that order, and the master query doesn't need to sort it. If
+ * the master query applies a limit, merging stops once the limit is reached.
+ */
+static void
+MergeQueryResults(MultiPlan *multiPlan)
+{
+	Query *masterQuery = multiPlan->masterQuery;
+	Job *workerJob = multiPlan->workerJob;
+	StringInfo jobDirectoryName = MasterJobDirectoryName(workerJob->jobId);
+	Oid masterTableId = RelnameGetRelid(multiPlan->masterTableName);
+	Relation masterTable = heap_open(masterTableId, RowExclusiveLock);
+	int64 rowLimit = MasterNodeRowLimit(multiPlan);
+	SortSupport sortKeys = MasterQuerySortKeys(masterQuery);
+	int sortKeyCount = list_length(masterQuery->sortClause);
+	List *taskFileNameList = NIL;
+	ListCell *taskCell = NULL;
+
+	foreach(taskCell, workerJob->taskList)
+	{
+		Task *workerTask = (Task *) lfirst(taskCell);
+		StringInfo taskFilename = TaskFilename(jobDirectoryName, workerTask->taskId);
+
+		taskFileNameList = lappend(taskFileNameList, taskFilename->data);
+	}
+
+	MergeTaskResultFiles(masterTable, BinaryMasterCopyFormat, taskFileNameList,
+						 sortKeys, sortKeyCount, rowLimit);
+
+	heap_close(masterTable, NoLock);
+
+	/* make the merged contents visible */
+	CommandCounterIncrement();
+}
+
+
+/*
+ * MasterQuerySortKeys prepares sort support for the master query's sort clause.
+ * The master query sorts on task result columns as they are, so that the sort
+ * keys directly refer to columns of the temporary table.
+ */
+static SortSupport
+MasterQuerySortKeys(Query *masterQuery)
+{
+	List *sortClauseList = masterQuery->sortClause;
+	int sortKeyCount = list_length(sortClauseList);
+	SortSupport sortKeys = palloc0(sortKeyCount * sizeof(SortSupportData));
+	ListCell *sortClauseCell = NULL;
+	int sortKeyIndex = 0;
+
+	foreach(sortClauseCell, sortClauseList)
+	{
+		SortGroupClause *sortClause = (SortGroupClause *) lfirst(sortClauseCell);
+		TargetEntry *sortTargetEntry = get_sortgroupclause_tle(sortClause,
+															   masterQuery->targetList);
+		Var *sortColumn = (Var *) sortTargetEntry->expr;
+		SortSupport sortKey = &sortKeys[sortKeyIndex];
+
+		sortKey->ssup_cxt = CurrentMemoryContext;
+		sortKey->ssup_collation = sortColumn->varcollid;
+		sortKey->ssup_nulls_first = sortClause->nulls_first;
+		sortKey->ssup_attno = sortColumn->varattno;
+
+		PrepareSortSupportFromOrderingOp(sortClause->sortop, sortKey);
+		sortKeyIndex++;
+	}
+
+	return sortKeys;
+}
+
+
+/*
+ * MasterTableSize returns the size of the temporary table that holds the task
+ * results of the given plan on the master node, in bytes.
+ */
+static uint64
+MasterTableSize(MultiPlan *multiPlan)
+{
+	Oid masterTableId = RelnameGetRelid(multiPlan->masterTableName);
+	Relation masterTable = heap_open(masterTableId, AccessShareLock);
+	BlockNumber blockCount = RelationGetNumberOfBlocks(masterTable);
+
+	heap_close(masterTable, NoLock);
+
+	return ((uint64) blockCount) * BLCKSZ;
+}
+
+
 /* Execute query plan. */
 void
 multi_ExecutorRun(QueryDesc *queryDesc, ScanDirection direction, tuplecount_t count)
@@ -0,0 +1,716 @@
+/*-------------------------------------------------------------------------
+ *
+ * multi_node_load.c
+ *
+ * Routines for tracking the load that executors put on worker nodes, and for
+ * ordering shard placements by this load. Executors report when they start
+ * and finish running a task on a node; we keep the number of in-flight tasks
+ * and the average task latency of each node in shared memory, so that the
+ * load-aware task assignment policy sees the load generated by all backends.
+ * We only keep these statistics while the load-aware policy or hedged reads
+ * need them.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include <math.h>
+
+#include "access/xact.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/multi_node_load.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/multi_server_executor.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+
+/*
+ * NodeLoadSharedStateData holds the shared hash of node load statistics, a
+ * histogram of recent task latencies over all nodes, and the locks that
+ * protect them. Each partition of the hash has its own lock, so that backends
+ * running tasks on different nodes don't contend with each other.
+ */
+typedef struct NodeLoadSharedStateData
+{
+	HTAB *nodeLoadHash;
+
+	uint32 latencyHistogram[TASK_LATENCY_BUCKET_COUNT];
+	uint32 latencySampleCount;
+
+	/*
+	 * Locks protecting the partitions of nodeLoadHash, followed by the lock
+	 * protecting the latency histogram.
+	 */
+	int nodeLoadTrancheId;
+	LWLockTranche nodeLoadLockTranche;
+	LWLockPadded nodeLoadLocks[NODE_LOAD_HASH_PARTITIONS + 1];
+} NodeLoadSharedStateData;
+
+
+/*
+ * NodeTaskCount counts tasks per node. The load-aware policy uses it for tasks
+ * assigned while planning a query, and backends use it to remember the tasks
+ * they have reported as started but not yet as finished.
+ */
+typedef struct NodeTaskCount
+{
+	NodeLoadKey key;            /* hash key; must be first */
+	int32 taskCount;
+} NodeTaskCount;
+
+
+/*
+ * PlacementLoad is a shard placement along with the cost of running one more
+ * task on its node.
+ */
+typedef struct PlacementLoad
+{
+	ShardPlacement *placement;
+	double taskCost;
+} PlacementLoad;
+
+
+/* Shared memory state and hooks */
+static NodeLoadSharedStateData *NodeLoadSharedState = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+/* tasks this backend has started but not yet finished */
+static HTAB *LocalNodeTaskCountHash = NULL;
+
+
+/* Local functions forward declarations */
+static Size NodeLoadShmemSize(void);
+static void NodeLoadShmemInit(void);
+static void NodeLoadTransactionCallback(XactEvent event, void *arg);
+static void ReleaseLocalNodeTasks(void);
+static void InitNodeLoadKey(NodeLoadKey *nodeLoadKey, const char *nodeName,
+							uint32 nodePort);
+static LWLock * NodeLoadPartitionLock(uint32 hashCode);
+static LWLock * LatencyHistogramLock(void);
+static void UpdateLocalNodeTaskCount(NodeLoadKey *nodeLoadKey, int32 taskCountChange);
+static double NodeTaskCost(NodeLoadKey *nodeLoadKey, HTAB *assignedTaskCountHash);
+static void ReleaseNodeTasks(NodeLoadKey *nodeLoadKey, int32 taskCount,
+							 double taskLatency);
+static void RecordTaskLatency(double taskLatency);
+static int TaskLatencyBucket(double taskLatency);
+
+
+/*
+ * InitializeNodeLoadTracking organizes, at startup, that the shared memory for
+ * node load statistics is allocated, and that tasks a backend fails to report
+ * as finished are released at the end of its transaction.
+ */
+void
+InitializeNodeLoadTracking(void)
+{
+	RequestAddinShmemSpace(NodeLoadShmemSize());
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = NodeLoadShmemInit;
+
+	RegisterXactCallback(NodeLoadTransactionCallback, NULL);
+}
+
+
+/* Estimates the shared memory size used for keeping track of node load. */
+static Size
+NodeLoadShmemSize(void)
+{
+	Size size = 0;
+	Size hashSize = 0;
+
+	size = add_size(size, sizeof(NodeLoadSharedStateData));
+
+	hashSize = hash_estimate_size(MaxWorkerNodesTracked, sizeof(NodeLoad));
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/* Initializes the shared memory used for keeping track of node load. */
+static void
+NodeLoadShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+	int hashFlags = 0;
+	long maxTableSize = (long) MaxWorkerNodesTracked;
+	long initTableSize = maxTableSize;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(NodeLoadKey);
+	info.entrysize = sizeof(NodeLoad);
+	info.num_partitions = NODE_LOAD_HASH_PARTITIONS;
+	hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_PARTITION);
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	NodeLoadSharedState =
+		(NodeLoadSharedStateData *) ShmemInitStruct("Node Load Control",
+													sizeof(NodeLoadSharedStateData),
+													&alreadyInitialized);
+
+	if (!alreadyInitialized)
+	{
+		/* initialize the lwlocks protecting the node load hash and histogram */
+		LWLockTranche *tranche = &NodeLoadSharedState->nodeLoadLockTranche;
+		int lockIndex = 0;
+
+		NodeLoadSharedState->nodeLoadTrancheId = LWLockNewTrancheId();
+		tranche->array_base = NodeLoadSharedState->nodeLoadLocks;
+		tranche->array_stride = sizeof(LWLockPadded);
+		tranche->name = "Node Load Hash Tranche";
+		LWLockRegisterTranche(NodeLoadSharedState->nodeLoadTrancheId, tranche);
+
+		for (lockIndex = 0; lockIndex <= NODE_LOAD_HASH_PARTITIONS; lockIndex++)
+		{
+			LWLockInitialize(&NodeLoadSharedState->nodeLoadLocks[lockIndex].lock,
+							 NodeLoadSharedState->nodeLoadTrancheId);
+		}
+
+		memset(NodeLoadSharedState->latencyHistogram, 0,
+			   sizeof(NodeLoadSharedState->latencyHistogram));
+		NodeLoadSharedState->latencySampleCount = 0;
+	}
+
+	NodeLoadSharedState->nodeLoadHash =
+		ShmemInitHash("Node Load Hash", initTableSize, maxTableSize,
+					  &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	Assert(NodeLoadSharedState->nodeLoadHash != NULL);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
+
+
+/*
+ * NodeLoadTrackingEnabled returns true if the load-aware task assignment policy
+ * or hedged reads use node load statistics, and executors should therefore
+ * report the tasks they run.
+ */
+bool
+NodeLoadTrackingEnabled(void)
+{
+	return TaskAssignmentPolicy == TASK_ASSIGNMENT_LOAD_AWARE ||
+		   HedgedReadPercentile > 0;
+}
+
+
+/*
+ * NodeTaskStarted records that this backend started running a task on the
+ * given node. If node load tracking is disabled, or if the shared hash has no
+ * room left for the node, we don't track the node's load and treat it as idle.
+ */
+void
+NodeTaskStarted(const char *nodeName, uint32 nodePort)
+{
+	NodeLoadKey nodeLoadKey;
+	NodeLoad *nodeLoad = NULL;
+	bool nodeLoadFound = false;
+	uint32 hashCode = 0;
+	LWLock *partitionLock = NULL;
+
+	if (!NodeLoadTrackingEnabled())
+	{
+		return;
+	}
+
+	InitNodeLoadKey(&nodeLoadKey, nodeName, nodePort);
+
+	hashCode = get_hash_value(NodeLoadSharedState->nodeLoadHash, &nodeLoadKey);
+	partitionLock = NodeLoadPartitionLock(hashCode);
+
+	LWLockAcquire(partitionLock, LW_EXCLUSIVE);
+
+	nodeLoad = (NodeLoad *) hash_search_with_hash_value(
+		NodeLoadSharedState->nodeLoadHash, &nodeLoadKey, hashCode, HASH_ENTER_NULL,
+		&nodeLoadFound);
+	if (nodeLoad != NULL)
+	{
+		if (!nodeLoadFound)
+		{
+			nodeLoad->inFlightTaskCount = 0;
+			nodeLoad->completedTaskCount = 0;
+			nodeLoad->averageTaskLatency = 0.0;
+		}
+
+		nodeLoad->inFlightTaskCount++;
+	}
+
+	LWLockRelease(partitionLock);
+
+	if (nodeLoad != NULL)
+	{
+		UpdateLocalNodeTaskCount(&nodeLoadKey, 1);
+	}
+}
+
+
+/*
+ * NodeTaskFinished records that this backend finished running a task on the
+ * given node. If the task succeeded, the function also folds the task's
+ * latency into the node's average task latency. Failed tasks don't tell us how
+ * fast the node is, so we only release them. Tasks that we didn't count as
+ * started, for instance because node load tracking was disabled, are ignored.
+ */
+void
+NodeTaskFinished(const char *nodeName, uint32 nodePort, TimestampTz taskStartTime,
+				 bool taskSucceeded)
+{
+	NodeLoadKey nodeLoadKey;
+	NodeTaskCount *localTaskCount = NULL;
+	double taskLatency = -1.0;
+
+	/* only release tasks we have counted as started */
+	if (LocalNodeTaskCountHash == NULL)
+	{
+		return;
+	}
+
+	InitNodeLoadKey(&nodeLoadKey, nodeName, nodePort);
+
+	localTaskCount = (NodeTaskCount *) hash_search(LocalNodeTaskCountHash,
+												   &nodeLoadKey, HASH_FIND, NULL);
+	if (localTaskCount == NULL || localTaskCount->taskCount <= 0)
+	{
+		return;
+	}
+
+	if (taskSucceeded)
+	{
+		long seconds = 0;
+		int microseconds = 0;
+
+		TimestampDifference(taskStartTime, GetCurrentTimestamp(),
+							&seconds, &microseconds);
+		taskLatency = (seconds * 1000.0) + (microseconds / 1000.0);
+	}
+
+	ReleaseNodeTasks(&nodeLoadKey, 1, taskLatency);
+
+	localTaskCount->taskCount--;
+}
+
+
+/*
+ * ReleaseNodeTasks removes the given number of tasks from the given node's
+ * in-flight tasks. If a task latency is given, the function also folds it
+ * into the node's average task latency and the latency histogram.
+ */
+static void
+ReleaseNodeTasks(NodeLoadKey *nodeLoadKey, int32 taskCount, double taskLatency)
+{
+	NodeLoad *nodeLoad = NULL;
+	uint32 hashCode = get_hash_value(NodeLoadSharedState->nodeLoadHash, nodeLoadKey);
+	LWLock *partitionLock = NodeLoadPartitionLock(hashCode);
+
+	LWLockAcquire(partitionLock, LW_EXCLUSIVE);
+
+	nodeLoad = (NodeLoad *) hash_search_with_hash_value(
+		NodeLoadSharedState->nodeLoadHash, nodeLoadKey, hashCode, HASH_FIND, NULL);
+	if (nodeLoad != NULL)
+	{
+		nodeLoad->inFlightTaskCount -= taskCount;
+
+		if (taskLatency >= 0.0)
+		{
+			if (nodeLoad->completedTaskCount == 0)
+			{
+				nodeLoad->averageTaskLatency = taskLatency;
+			}
+			else
+			{
+				nodeLoad->averageTaskLatency =
+					(NODE_LATENCY_SMOOTHING_FACTOR * taskLatency) +
+					((1.0 - NODE_LATENCY_SMOOTHING_FACTOR) *
+					 nodeLoad->averageTaskLatency);
+			}
+
+			nodeLoad->completedTaskCount++;
+		}
+	}
+
+	LWLockRelease(partitionLock);
+
+	if (nodeLoad != NULL && taskLatency >= 0.0)
+	{
+		RecordTaskLatency(taskLatency);
+	}
+}
+
+
+/*
+ * NodeLoadTransactionCallback releases tasks that this backend started but
+ * didn't report as finished, for instance because the executor errored out,
+ * once the transaction ends.
+ */
+static void
+NodeLoadTransactionCallback(XactEvent event, void *arg)
+{
+	if (event == XACT_EVENT_COMMIT || event == XACT_EVENT_ABORT)
+	{
+		ReleaseLocalNodeTasks();
+	}
+}
+
+
+/* ReleaseLocalNodeTasks removes all of this backend's tasks from node loads. */
+static void
+ReleaseLocalNodeTasks(void)
+{
+	HASH_SEQ_STATUS status;
+	NodeTaskCount *localTaskCount = NULL;
+	const double noTaskLatency = -1.0;
+
+	if (LocalNodeTaskCountHash == NULL)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, LocalNodeTaskCountHash);
+
+	localTaskCount = (NodeTaskCount *) hash_seq_search(&status);
+	while (localTaskCount != NULL)
+	{
+		if (localTaskCount->taskCount > 0)
+		{
+			ReleaseNodeTasks(&localTaskCount->key, localTaskCount->taskCount,
+							 noTaskLatency);
+
+			localTaskCount->taskCount = 0;
+		}
+
+		localTaskCount = (NodeTaskCount *) hash_seq_search(&status);
+	}
+}
+
+
+/*
+ * CreateNodeTaskCountHash creates a hash that counts tasks per node in the
+ * current memory context.
+ */
+HTAB *
+CreateNodeTaskCountHash(void)
+{
+	HASHCTL info;
+	int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(NodeLoadKey);
+	info.entrysize = sizeof(NodeTaskCount);
+	info.hcxt = CurrentMemoryContext;
+
+	return hash_create("Node Task Count Hash", 32, &info, hashFlags);
+}
+
+
+/*
+ * LoadAwarePlacementList returns a copy of the given placement list, ordered
+ * by the expected cost of running one more task on each placement's node. The
+ * cost is the number of tasks in flight on the node times the node's average
+ * task latency; placements with equal costs keep their original order.
+ *
+ * If an assigned task count hash is given, the function also counts the tasks
+ * that were assigned to nodes while planning the current query, but haven't
+ * started yet, and records the task assigned to the first placement.
+ */
+List *
+LoadAwarePlacementList(List *placementList, HTAB *assignedTaskCountHash)
+{
+	List *orderedPlacementList = NIL;
+	ListCell *placementCell = NULL;
+	PlacementLoad *placementLoadArray = NULL;
+	int placementCount = list_length(placementList);
+	int placementIndex = 0;
+
+	if (placementCount == 0)
+	{
+		return NIL;
+	}
+
+	placementLoadArray = (PlacementLoad *) palloc0(placementCount *
+												   sizeof(PlacementLoad));
+
+	foreach(placementCell, placementList)
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+		NodeLoadKey nodeLoadKey;
+
+		InitNodeLoadKey(&nodeLoadKey, placement->nodeName, placement->nodePort);
+
+		placementLoadArray[placementIndex].placement = placement;
+		placementLoadArray[placementIndex].taskCost =
+			NodeTaskCost(&nodeLoadKey, assignedTaskCountHash);
+		placementIndex++;
+	}
+
+	/* insertion sort keeps equal cost placements in their original order */
+	for (placementIndex = 1; placementIndex < placementCount; placementIndex++)
+	{
+		PlacementLoad placementLoad = placementLoadArray[placementIndex];
+		int otherIndex = placementIndex - 1;
+
+		while (otherIndex >= 0 &&
+			   placementLoadArray[otherIndex].taskCost > placementLoad.taskCost)
+		{
+			placementLoadArray[otherIndex + 1] = placementLoadArray[otherIndex];
+			otherIndex--;
+		}
+
+		placementLoadArray[otherIndex + 1] = placementLoad;
+	}
+
+	for (placementIndex = 0; placementIndex < placementCount; placementIndex++)
+	{
+		ShardPlacement *placement = placementLoadArray[placementIndex].placement;
+		orderedPlacementList = lappend(orderedPlacementList, placement);
+	}
+
+	if (assignedTaskCountHash != NULL)
+	{
+		ShardPlacement *assignedPlacement = placementLoadArray[0].placement;
+		NodeLoadKey nodeLoadKey;
+		NodeTaskCount *assignedTaskCount = NULL;
+		bool assignedTaskCountFound = false;
+
+		InitNodeLoadKey(&nodeLoadKey, assignedPlacement->nodeName,
+						assignedPlacement->nodePort);
+
+		assignedTaskCount = (NodeTaskCount *) hash_search(assignedTaskCountHash,
+														  &nodeLoadKey, HASH_ENTER,
+														  &assignedTaskCountFound);
+		if (!assignedTaskCountFound)
+		{
+			assignedTaskCount->taskCount = 0;
+		}
+
+		assignedTaskCount->taskCount++;
+	}
+
+	pfree(placementLoadArray);
+
+	return orderedPlacementList;
+}
+
+
+/* NodeTaskCost estimates the cost of running one more task on the given node. */
+static double
+NodeTaskCost(NodeLoadKey *nodeLoadKey, HTAB *assignedTaskCountHash)
+{
+	NodeLoad *nodeLoad = NULL;
+	int32 taskCount = 1;
+	double taskLatency = DEFAULT_NODE_TASK_LATENCY;
+	uint32 hashCode = get_hash_value(NodeLoadSharedState->nodeLoadHash, nodeLoadKey);
+	LWLock *partitionLock = NodeLoadPartitionLock(hashCode);
+
+	LWLockAcquire(partitionLock, LW_SHARED);
+
+	nodeLoad = (NodeLoad *) hash_search_with_hash_value(
+		NodeLoadSharedState->nodeLoadHash, nodeLoadKey, hashCode, HASH_FIND, NULL);
+	if (nodeLoad != NULL)
+	{
+		taskCount += Max(nodeLoad->inFlightTaskCount, 0);
+
+		if (nodeLoad->completedTaskCount > 0)
+		{
+			taskLatency = Max(nodeLoad->averageTaskLatency,
+							  DEFAULT_NODE_TASK_LATENCY);
+		}
+	}
+
+	LWLockRelease(partitionLock);
+
+	if (assignedTaskCountHash != NULL)
+	{
+		NodeTaskCount *assignedTaskCount =
+			(NodeTaskCount *) hash_search(assignedTaskCountHash, nodeLoadKey,
+										  HASH_FIND, NULL);
+		if (assignedTaskCount != NULL)
+		{
+			taskCount += assignedTaskCount->taskCount;
+		}
+	}
+
+	return taskCount * taskLatency;
+}
+
+
+/*
+ * TaskLatencyPercentile estimates the given percentile of recent task latencies
+ * over all nodes, in milliseconds. The estimate is the upper bound of the
+ * histogram bucket that contains the percentile. If too few tasks completed to
+ * tell, the function returns -1.
+ */
+double
+TaskLatencyPercentile(int percentile)
+{
+	double latencyPercentile = -1.0;
+	uint32 sampleCount = 0;
+	uint32 percentileRank = 0;
+	uint32 cumulativeCount = 0;
+	int bucketIndex = 0;
+
+	LWLockAcquire(LatencyHistogramLock(), LW_SHARED);
+
+	sampleCount = NodeLoadSharedState->latencySampleCount;
+	if (sampleCount >= TASK_LATENCY_MIN_SAMPLES)
+	{
+		/* rank of the sample at the percentile, rounded up */
+		percentileRank = (uint32) ((((uint64) sampleCount) * percentile + 99) / 100);
+		percentileRank = Max(percentileRank, 1);
+
+		for (bucketIndex = 0; bucketIndex < TASK_LATENCY_BUCKET_COUNT; bucketIndex++)
+		{
+			cumulativeCount += NodeLoadSharedState->latencyHistogram[bucketIndex];
+			if (cumulativeCount >= percentileRank)
+			{
+				double bucketExponent = (double) (bucketIndex + 1) /
+										TASK_LATENCY_BUCKETS_PER_DOUBLING;
+				latencyPercentile = pow(2.0, bucketExponent);
+				break;
+			}
+		}
+	}
+
+	LWLockRelease(LatencyHistogramLock());
+
+	return latencyPercentile;
+}
+
+
+/*
+ * RecordTaskLatency adds the given task latency to the latency histogram. Once
+ * the histogram holds a full history, the function halves all bucket counts,
+ * so that older latencies gradually lose their weight.
+ */
+static void
+RecordTaskLatency(double taskLatency)
+{
+	uint32 *latencyHistogram = NodeLoadSharedState->latencyHistogram;
+	int bucketIndex = TaskLatencyBucket(taskLatency);
+
+	LWLockAcquire(LatencyHistogramLock(), LW_EXCLUSIVE);
+
+	latencyHistogram[bucketIndex]++;
+	NodeLoadSharedState->latencySampleCount++;
+
+	if (NodeLoadSharedState->latencySampleCount >= TASK_LATENCY_HISTORY_SIZE)
+	{
+		uint32 sampleCount = 0;
+
+		for (bucketIndex = 0; bucketIndex < TASK_LATENCY_BUCKET_COUNT; bucketIndex++)
+		{
+			latencyHistogram[bucketIndex] /= 2;
+			sampleCount += latencyHistogram[bucketIndex];
+		}
+
+		NodeLoadSharedState->latencySampleCount = sampleCount;
+	}
+
+	LWLockRelease(LatencyHistogramLock());
+}
+
+
+/*
+ * TaskLatencyBucket returns the histogram bucket for the given task latency.
+ * Bucket i holds latencies up to 2^((i + 1) / TASK_LATENCY_BUCKETS_PER_DOUBLING)
+ * milliseconds.
+ */
+static int
+TaskLatencyBucket(double taskLatency)
+{
+	int bucketIndex = 0;
+
+	if (taskLatency > 1.0)
+	{
+		double bucketPosition = log2(taskLatency) * TASK_LATENCY_BUCKETS_PER_DOUBLING;
+		bucketIndex = (int) bucketPosition;
+
+		/* latencies at a bucket's upper bound belong to that bucket */
+		if (bucketPosition == (double) bucketIndex)
+		{
+			bucketIndex--;
+		}
+	}
+
+	bucketIndex = Max(bucketIndex, 0);
+	bucketIndex = Min(bucketIndex, TASK_LATENCY_BUCKET_COUNT - 1);
+
+	return bucketIndex;
+}
+
+
+/* InitNodeLoadKey fills in the node load hash key for the given node. */
+static void
+InitNodeLoadKey(NodeLoadKey *nodeLoadKey, const char *nodeName, uint32 nodePort)
+{
+	memset(nodeLoadKey, 0, sizeof(NodeLoadKey));
+	strlcpy(nodeLoadKey->nodeName, nodeName, WORKER_LENGTH);
+	nodeLoadKey->nodePort = nodePort;
+}
+
+
+/*
+ * NodeLoadPartitionLock returns the lock that protects the partition of the
+ * node load hash that holds the node with the given hash code.
+ */
+static LWLock *
+NodeLoadPartitionLock(uint32 hashCode)
+{
+	uint32 partitionIndex = hashCode % NODE_LOAD_HASH_PARTITIONS;
+
+	return &NodeLoadSharedState->nodeLoadLocks[partitionIndex].lock;
+}
+
+
+/* LatencyHistogramLock returns the lock that protects the latency histogram. */
+static LWLock *
+LatencyHistogramLock(void)
+{
+	return &NodeLoadSharedState->nodeLoadLocks[NODE_LOAD_HASH_PARTITIONS].lock;
+}
+
+
+/*
+ * UpdateLocalNodeTaskCount changes the number of tasks this backend runs on
+ * the given node by the given amount.
+ */
+static void
+UpdateLocalNodeTaskCount(NodeLoadKey *nodeLoadKey, int32 taskCountChange)
+{
+	NodeTaskCount *localTaskCount = NULL;
+	bool localTaskCountFound = false;
+
+	if (LocalNodeTaskCountHash == NULL)
+	{
+		MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+
+		LocalNodeTaskCountHash = CreateNodeTaskCountHash();
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	localTaskCount = (NodeTaskCount *) hash_search(LocalNodeTaskCountHash,
+												   nodeLoadKey, HASH_ENTER,
+												   &localTaskCountFound);
+	if (!localTaskCountFound)
+	{
+		localTaskCount->taskCount = 0;
+	}
+
+	localTaskCount->taskCount += taskCountChange;
+}
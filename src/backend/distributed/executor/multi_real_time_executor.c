@@ -7,7 +7,9 @@
  * need to execute, and therefore return their results faster. However, they can
  * only handle as many tasks as the number of file descriptors (connections)
  * available. They also can't handle execution primitives that need to write
- * their results to intermediate files.
+ * their results to intermediate files. Task results are either written to
+ * one file per task, or when a result stream is given, decoded as they arrive
+ * and appended directly to the master node's result relation.
  *
  * Copyright (c) 2013-2016, Citus Data, Inc.
  *
@@ -26,20 +28,44 @@
 #include "commands/dbcommands.h"
 #include "distributed/connection_management.h"
 #include "distributed/multi_client_executor.h"
+#include "distributed/multi_node_load.h"
 #include "distributed/multi_physical_planner.h"
+#include "distributed/multi_result_stream.h"
 #include "distributed/multi_server_executor.h"
+#include "distributed/shared_connection_pool.h"
 #include "distributed/worker_protocol.h"
 #include "storage/fd.h"
 #include "utils/timestamp.h"
 
 
+/* Config variable managed via guc.c */
+int HedgedReadPercentile = 0; /* latency percentile after which reads are hedged */
+
+
 /* Local functions forward declarations */
 static ConnectAction ManageTaskExecution(Task *task, TaskExecution *taskExecution,
-										 TaskExecutionStatus *executionStatus);
+										 TaskExecutionStatus *executionStatus,
+										 TaskResultStream *resultStream);
 static bool TaskExecutionReadyToStart(TaskExecution *taskExecution);
 static bool TaskExecutionCompleted(TaskExecution *taskExecution);
 static void CancelTaskExecutionIfActive(TaskExecution *taskExecution);
 static void CancelRequestIfActive(TaskExecStatus taskStatus, int connectionId);
+static void ReleaseTaskExecutionLoad(Task *task, TaskExecution *taskExecution);
+static void CleanupTaskExecutionList(List *taskList, List *taskExecutionList);
+
+/* Hedged read functions */
+static void ManageHedgeExecution(Task *task, TaskExecution *taskExecution,
+								 TaskExecutionStatus *executionStatus,
+								 HTAB *workerHash, WaitInfo *waitInfo,
+								 double hedgeDeadline);
+static bool HedgeDeadlinePassed(TaskExecution *taskExecution, double hedgeDeadline);
+static void PromoteHedgeExecution(Task *task, TaskExecution *taskExecution,
+								  HTAB *workerHash);
+static void AbandonHedgeExecution(Task *task, TaskExecution *taskExecution,
+								  HTAB *workerHash);
+static void CloseTaskExecution(Task *task, TaskExecution *taskExecution,
+							   HTAB *workerHash);
+static StringInfo HedgeTaskFilename(Task *task);
 
 /* Worker node state hash functions */
 static HTAB * WorkerHash(const char *workerHashName, List *workerNodeList);
@@ -64,9 +90,16 @@ static void UpdateConnectionCounter(WorkerNodeState *workerNode,
  * until either one task permanently fails or all tasks successfully complete.
  * The function opens up a connection for each task it needs to execute, and
  * manages these tasks' execution in real-time.
+ *
+ * If resultStream is NULL, the function writes each task's results into a file
+ * in the master job directory. Otherwise, task results are streamed into the
+ * result stream's relation as they arrive. If the stream merges sorted task
+ * results, each task streams into its own input of the merge. In both cases,
+ * the function stops as soon as the stream received all rows the master query
+ * needs, and cancels all tasks that are still running.
  */
 void
-MultiRealTimeExecute(Job *job)
+MultiRealTimeExecute(Job *job, TaskResultStream *resultStream)
 {
 	List *taskList = job->taskList;
 	List *taskExecutionList = NIL;
@@ -80,11 +113,23 @@ MultiRealTimeExecute(Job *job)
 	List *workerNodeList = NIL;
 	HTAB *workerHash = NULL;
 	const char *workerHashName = "Worker node hash";
-	WaitInfo *waitInfo = MultiClientCreateWaitInfo(list_length(taskList));
+	double hedgeDeadline = -1.0;
+
+	/* each task may wait on a hedged execution as well */
+	WaitInfo *waitInfo = MultiClientCreateWaitInfo(2 * list_length(taskList));
 
 	workerNodeList = WorkerNodeList();
 	workerHash = WorkerHash(workerHashName, workerNodeList);
 
+	/*
+	 * Streamed rows can't be taken back, so we only hedge reads that write
+	 * their results into task files.
+	 */
+	if (HedgedReadPercentile > 0 && resultStream == NULL)
+	{
+		hedgeDeadline = TaskLatencyPercentile(HedgedReadPercentile);
+	}
+
 	/* initialize task execution structures for remote execution */
 	foreach(taskCell, taskList)
 	{
@@ -94,88 +139,133 @@ MultiRealTimeExecute(Job *job)
 		taskExecutionList = lappend(taskExecutionList, taskExecution);
 	}
 
-	/* loop around until all tasks complete, one task fails, or user cancels */
-	while (!(allTasksCompleted || taskFailed || QueryCancelPending))
+	/*
+	 * If we error out while managing the tasks, we still close their connections
+	 * and release the load they put on their nodes before rethrowing the error.
+	 */
+	PG_TRY();
 	{
-		uint32 taskCount = list_length(taskList);
-		uint32 completedTaskCount = 0;
+		/* loop around until all tasks complete, one task fails, or user cancels */
+		while (!(allTasksCompleted || taskFailed || QueryCancelPending))
+		{
+			uint32 taskCount = list_length(taskList);
+			uint32 completedTaskCount = 0;
+			int taskIndex = 0;
 
-		/* loop around all tasks and manage them */
-		ListCell *taskCell = NULL;
-		ListCell *taskExecutionCell = NULL;
+			/* loop around all tasks and manage them */
+			ListCell *taskCell = NULL;
+			ListCell *taskExecutionCell = NULL;
 
-		MultiClientResetWaitInfo(waitInfo);
+			MultiClientResetWaitInfo(waitInfo);
 
-		forboth(taskCell, taskList, taskExecutionCell, taskExecutionList)
-		{
-			Task *task = (Task *) lfirst(taskCell);
-			TaskExecution *taskExecution = (TaskExecution *) lfirst(taskExecutionCell);
-			ConnectAction connectAction = CONNECT_ACTION_NONE;
-			WorkerNodeState *workerNodeState = NULL;
-			TaskExecutionStatus executionStatus;
+			forboth(taskCell, taskList, taskExecutionCell, taskExecutionList)
+			{
+				Task *task = (Task *) lfirst(taskCell);
+				TaskExecution *taskExecution =
+					(TaskExecution *) lfirst(taskExecutionCell);
+				ConnectAction connectAction = CONNECT_ACTION_NONE;
+				WorkerNodeState *workerNodeState = NULL;
+				TaskResultStream *taskStream = NULL;
+				TaskExecutionStatus executionStatus;
+
+				if (resultStream != NULL)
+				{
+					taskStream = TaskResultStreamInput(resultStream, taskIndex);
+				}
+				taskIndex++;
 
-			workerNodeState = LookupWorkerForTask(workerHash, task, taskExecution);
+				workerNodeState = LookupWorkerForTask(workerHash, task, taskExecution);
 
-			/* in case the task is about to start, throttle if necessary */
-			if (TaskExecutionReadyToStart(taskExecution) &&
-				(WorkerConnectionsExhausted(workerNodeState) ||
-				 MasterConnectionsExhausted(workerHash)))
-			{
-				continue;
-			}
+				/* in case the task is about to start, throttle if necessary */
+				if (TaskExecutionReadyToStart(taskExecution) &&
+					(WorkerConnectionsExhausted(workerNodeState) ||
+					 MasterConnectionsExhausted(workerHash)))
+				{
+					continue;
+				}
+
+				/* call the function that performs the core task execution logic */
+				connectAction = ManageTaskExecution(task, taskExecution, &executionStatus,
+													taskStream);
+
+				/* update the connection counter for throttling */
+				UpdateConnectionCounter(workerNodeState, connectAction);
 
-			/* call the function that performs the core task execution logic */
-			connectAction = ManageTaskExecution(task, taskExecution, &executionStatus);
+				/* if the task is slow to answer, also run it on another placement */
+				ManageHedgeExecution(task, taskExecution, &executionStatus, workerHash,
+									 waitInfo, hedgeDeadline);
 
-			/* update the connection counter for throttling */
-			UpdateConnectionCounter(workerNodeState, connectAction);
+				/*
+				 * If this task failed, we need to iterate over task executions, and
+				 * manually clean out their client-side resources. Hence, we record
+				 * the failure here instead of immediately erroring out.
+				 */
+				taskFailed = TaskExecutionFailed(taskExecution);
+				if (taskFailed)
+				{
+					failedTaskId = taskExecution->taskId;
+					break;
+				}
+
+				taskCompleted = TaskExecutionCompleted(taskExecution);
+				if (taskCompleted)
+				{
+					completedTaskCount++;
+				}
+				else
+				{
+					uint32 currentIndex = taskExecution->currentNodeIndex;
+					int32 *connectionIdArray = taskExecution->connectionIdArray;
+					int32 connectionId = connectionIdArray[currentIndex];
+
+					/*
+					 * If not done with the task yet, make note of what this task
+					 * and its associated connection is waiting for.
+					 */
+					MultiClientRegisterWait(waitInfo, executionStatus, connectionId);
+				}
+			}
 
 			/*
-			 * If this task failed, we need to iterate over task executions, and
-			 * manually clean out their client-side resources. Hence, we record
-			 * the failure here instead of immediately erroring out.
+			 * Merge sorted task results as far as the rows that arrived allow. If
+			 * the master query doesn't need any more rows, there's no point in
+			 * waiting for the remaining tasks. They get cancelled below.
 			 */
-			taskFailed = TaskExecutionFailed(taskExecution);
-			if (taskFailed)
+			if (!taskFailed && resultStream != NULL)
 			{
-				failedTaskId = taskExecution->taskId;
-				break;
+				MergeTaskResultStreamInputs(resultStream);
+
+				if (TaskResultStreamLimitReached(resultStream))
+				{
+					break;
+				}
 			}
 
-			taskCompleted = TaskExecutionCompleted(taskExecution);
-			if (taskCompleted)
+			/*
+			 * Check if all tasks completed; otherwise wait as appropriate to
+			 * avoid a tight loop. That means we immediately continue if tasks are
+			 * ready to be processed further, and block when we're waiting for
+			 * network IO.
+			 */
+			if (completedTaskCount == taskCount)
 			{
-				completedTaskCount++;
+				allTasksCompleted = true;
 			}
 			else
 			{
-				uint32 currentIndex = taskExecution->currentNodeIndex;
-				int32 *connectionIdArray = taskExecution->connectionIdArray;
-				int32 connectionId = connectionIdArray[currentIndex];
-
-				/*
-				 * If not done with the task yet, make note of what this task
-				 * and its associated connection is waiting for.
-				 */
-				MultiClientRegisterWait(waitInfo, executionStatus, connectionId);
+				MultiClientWait(waitInfo);
 			}
 		}
+	}
+	PG_CATCH();
+	{
+		HOLD_INTERRUPTS();
+		CleanupTaskExecutionList(taskList, taskExecutionList);
+		RESUME_INTERRUPTS();
 
-		/*
-		 * Check if all tasks completed; otherwise wait as appropriate to
-		 * avoid a tight loop. That means we immediately continue if tasks are
-		 * ready to be processed further, and block when we're waiting for
-		 * network IO.
-		 */
-		if (completedTaskCount == taskCount)
-		{
-			allTasksCompleted = true;
-		}
-		else
-		{
-			MultiClientWait(waitInfo);
-		}
+		PG_RE_THROW();
 	}
+	PG_END_TRY();
 
 	MultiClientFreeWaitInfo(waitInfo);
 
@@ -193,6 +283,11 @@ MultiRealTimeExecute(Job *job)
 	{
 		TaskExecution *taskExecution = (TaskExecution *) lfirst(taskExecutionCell);
 		CancelTaskExecutionIfActive(taskExecution);
+
+		if (taskExecution->hedgeExecution != NULL)
+		{
+			CancelTaskExecutionIfActive(taskExecution->hedgeExecution);
+		}
 	}
 
 	/*
@@ -209,12 +304,7 @@ MultiRealTimeExecute(Job *job)
 	}
 
 	/* close connections and open files */
-	taskExecutionCell = NULL;
-	foreach(taskExecutionCell, taskExecutionList)
-	{
-		TaskExecution *taskExecution = (TaskExecution *) lfirst(taskExecutionCell);
-		CleanupTaskExecution(taskExecution);
-	}
+	CleanupTaskExecutionList(taskList, taskExecutionList);
 
 	RESUME_INTERRUPTS();
 
@@ -244,10 +334,15 @@ MultiRealTimeExecute(Job *job)
  * returns a ConnectAction enum indicating whether a connection has been opened
  * or closed in this call.  Via the executionStatus parameter this function returns
  * what a Task is blocked on.
+ *
+ * When a result stream is given, task results are appended to the stream
+ * instead of a task file. Rows that have been streamed can't be taken back, so
+ * a task that fails while streaming its results isn't retried on another node.
  */
 static ConnectAction
 ManageTaskExecution(Task *task, TaskExecution *taskExecution,
-					TaskExecutionStatus *executionStatus)
+					TaskExecutionStatus *executionStatus,
+					TaskResultStream *resultStream)
 {
 	TaskExecStatus *taskStatusArray = taskExecution->taskStatusArray;
 	int32 *connectionIdArray = taskExecution->connectionIdArray;
@@ -270,6 +365,32 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 			int32 connectionId = INVALID_CONNECTION_ID;
 			char *nodeDatabase = NULL;
 
+			/*
+			 * If all backends together hold the maximum number of connections
+			 * to the node, we queue the task rather than block the other tasks,
+			 * and retry after a short delay. We give up after the connection
+			 * timeout.
+			 */
+			if (!TryReserveSharedConnection(nodeName, nodePort))
+			{
+				TimestampTz currentTime = GetCurrentTimestamp();
+
+				if (taskExecution->poolWaitStartTime == 0)
+				{
+					taskExecution->poolWaitStartTime = currentTime;
+				}
+				else if (TimestampDifferenceExceeds(taskExecution->poolWaitStartTime,
+													currentTime, NodeConnectionTimeout))
+				{
+					ReportSharedConnectionPoolExhausted(nodeName, nodePort);
+				}
+
+				*executionStatus = TASK_STATUS_ERROR;
+				break;
+			}
+
+			taskExecution->poolWaitStartTime = 0;
+
 			/* we use the same database name on the master and worker nodes */
 			nodeDatabase = get_database_name(MyDatabaseId);
 
@@ -282,6 +403,8 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 				taskStatusArray[currentIndex] = EXEC_TASK_CONNECT_POLL;
 				taskExecution->connectStartTime = GetCurrentTimestamp();
 				connectAction = CONNECT_ACTION_OPENED;
+
+				NodeTaskStarted(nodeName, nodePort);
 			}
 			else
 			{
@@ -359,6 +482,9 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 			connectionIdArray[currentIndex] = INVALID_CONNECTION_ID;
 			connectAction = CONNECT_ACTION_CLOSED;
 
+			NodeTaskFinished(nodeName, nodePort, taskExecution->connectStartTime,
+							 false);
+
 			taskStatusArray[currentIndex] = EXEC_TASK_CONNECT_START;
 
 			/* try next worker node */
@@ -513,12 +639,24 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 
 			/* check if our request to copy query results has been acknowledged */
 			queryStatus = MultiClientQueryStatus(connectionId);
-			if (queryStatus == CLIENT_QUERY_COPY)
+			if (queryStatus == CLIENT_QUERY_COPY && resultStream != NULL)
+			{
+				/* results are streamed into the result relation, no file needed */
+				taskStatusArray[currentIndex] = EXEC_COMPUTE_TASK_COPYING;
+			}
+			else if (queryStatus == CLIENT_QUERY_COPY)
 			{
 				StringInfo jobDirectoryName = MasterJobDirectoryName(task->jobId);
 				StringInfo taskFilename = TaskFilename(jobDirectoryName, task->taskId);
+				char *filename = NULL;
 
-				char *filename = taskFilename->data;
+				/* hedged executions write to their own file until they win */
+				if (taskExecution->isHedge)
+				{
+					taskFilename = HedgeTaskFilename(task);
+				}
+
+				filename = taskFilename->data;
 				int fileFlags = (O_APPEND | O_CREAT | O_RDWR | O_TRUNC | PG_BINARY);
 				int fileMode = (S_IRUSR | S_IWUSR);
 
@@ -558,9 +696,25 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 			int32 connectionId = connectionIdArray[currentIndex];
 			int32 fileDesc = fileDescriptorArray[currentIndex];
 			int closed = -1;
+			CopyStatus copyStatus = CLIENT_INVALID_COPY;
 
-			/* copy data from worker node, and write to local file */
-			CopyStatus copyStatus = MultiClientCopyData(connectionId, fileDesc);
+			if (resultStream != NULL)
+			{
+				/* copy data from worker node, and append to the result relation */
+				copyStatus = MultiClientReceiveCopyData(connectionId,
+														TaskResultStreamReceive,
+														(void *) resultStream);
+				if (copyStatus == CLIENT_COPY_FAILED)
+				{
+					/* partial results are already visible, so we can't retry */
+					taskExecution->failureCount = MAX_TASK_EXECUTION_FAILURES;
+				}
+			}
+			else
+			{
+				/* copy data from worker node, and write to local file */
+				copyStatus = MultiClientCopyData(connectionId, fileDesc);
+			}
 
 			/* if worker node will continue to send more data, keep reading */
 			if (copyStatus == CLIENT_COPY_MORE)
@@ -570,8 +724,17 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 			}
 			else if (copyStatus == CLIENT_COPY_DONE)
 			{
-				closed = close(fileDesc);
-				fileDescriptorArray[currentIndex] = -1;
+				if (fileDesc >= 0)
+				{
+					closed = close(fileDesc);
+					fileDescriptorArray[currentIndex] = -1;
+				}
+				else
+				{
+					/* results were streamed, there is no file to close */
+					resultStream->inputComplete = true;
+					closed = 0;
+				}
 
 				if (closed >= 0)
 				{
@@ -581,6 +744,9 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 					MultiClientDisconnect(connectionId);
 					connectionIdArray[currentIndex] = INVALID_CONNECTION_ID;
 					connectAction = CONNECT_ACTION_CLOSED;
+
+					NodeTaskFinished(nodeName, nodePort,
+									 taskExecution->connectStartTime, true);
 				}
 				else
 				{
@@ -594,13 +760,16 @@ ManageTaskExecution(Task *task, TaskExecution *taskExecution,
 			{
 				taskStatusArray[currentIndex] = EXEC_TASK_FAILED;
 
-				closed = close(fileDesc);
-				fileDescriptorArray[currentIndex] = -1;
-
-				if (closed < 0)
+				if (fileDesc >= 0)
 				{
-					ereport(WARNING, (errcode_for_file_access(),
-									  errmsg("could not close copy file: %m")));
+					closed = close(fileDesc);
+					fileDescriptorArray[currentIndex] = -1;
+
+					if (closed < 0)
+					{
+						ereport(WARNING, (errcode_for_file_access(),
+										  errmsg("could not close copy file: %m")));
+					}
 				}
 			}
 
@@ -707,6 +876,269 @@ CancelRequestIfActive(TaskExecStatus taskStatus, int connectionId)
 }
 
 
+/*
+ * ReleaseTaskExecutionLoad reports a task execution that still has an open
+ * connection as finished, since tasks we cancel no longer put load on their
+ * nodes.
+ */
+static void
+ReleaseTaskExecutionLoad(Task *task, TaskExecution *taskExecution)
+{
+	uint32 currentIndex = taskExecution->currentNodeIndex;
+
+	if (taskExecution->connectionIdArray[currentIndex] != INVALID_CONNECTION_ID)
+	{
+		ShardPlacement *taskPlacement = list_nth(task->taskPlacementList,
+												 currentIndex);
+
+		NodeTaskFinished(taskPlacement->nodeName, taskPlacement->nodePort,
+						 taskExecution->connectStartTime, false);
+	}
+}
+
+
+/*
+ * CleanupTaskExecutionList releases the load that the given task executions and
+ * their hedged executions put on their nodes, and closes their connections and
+ * open files.
+ */
+static void
+CleanupTaskExecutionList(List *taskList, List *taskExecutionList)
+{
+	ListCell *taskCell = NULL;
+	ListCell *taskExecutionCell = NULL;
+
+	forboth(taskCell, taskList, taskExecutionCell, taskExecutionList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		TaskExecution *taskExecution = (TaskExecution *) lfirst(taskExecutionCell);
+		TaskExecution *hedgeExecution = taskExecution->hedgeExecution;
+
+		if (hedgeExecution != NULL)
+		{
+			ReleaseTaskExecutionLoad(task, hedgeExecution);
+			CleanupTaskExecution(hedgeExecution);
+		}
+
+		ReleaseTaskExecutionLoad(task, taskExecution);
+		CleanupTaskExecution(taskExecution);
+	}
+}
+
+
+/*
+ * ManageHedgeExecution implements hedged reads. If a task hasn't answered
+ * within the hedge deadline, the function starts a second execution of the
+ * task on the next placement, and manages this execution alongside the
+ * original one. The first execution to complete wins, and the other one gets
+ * cancelled. If the hedged execution fails, we simply drop it; if the original
+ * execution fails, the hedged execution takes its place.
+ *
+ * The executionStatus parameter holds what the original execution waits for.
+ * When the hedged execution takes its place, the previous status no longer
+ * applies to the task's connection, so the function resets it to ready. The
+ * caller then picks up the promoted execution without waiting, and learns its
+ * actual status on the next round.
+ */
+static void
+ManageHedgeExecution(Task *task, TaskExecution *taskExecution,
+					 TaskExecutionStatus *executionStatus, HTAB *workerHash,
+					 WaitInfo *waitInfo, double hedgeDeadline)
+{
+	TaskExecution *hedgeExecution = taskExecution->hedgeExecution;
+	WorkerNodeState *workerNodeState = NULL;
+	ConnectAction connectAction = CONNECT_ACTION_NONE;
+	TaskExecutionStatus hedgeStatus;
+
+	if (hedgeExecution == NULL)
+	{
+		if (!HedgeDeadlinePassed(taskExecution, hedgeDeadline))
+		{
+			return;
+		}
+
+		hedgeExecution = InitTaskExecution(task, EXEC_TASK_CONNECT_START);
+		hedgeExecution->currentNodeIndex =
+			(taskExecution->currentNodeIndex + 1) % taskExecution->nodeCount;
+		hedgeExecution->isHedge = true;
+
+		taskExecution->hedgeExecution = hedgeExecution;
+		taskExecution->hedged = true;
+
+		ereport(DEBUG2, (errmsg("hedging task %u after %.0f ms", task->taskId,
+								hedgeDeadline)));
+	}
+
+	if (TaskExecutionCompleted(taskExecution))
+	{
+		AbandonHedgeExecution(task, taskExecution, workerHash);
+		return;
+	}
+	else if (taskExecution->failureCount > 0)
+	{
+		PromoteHedgeExecution(task, taskExecution, workerHash);
+		*executionStatus = TASK_STATUS_READY;
+		return;
+	}
+
+	/*
+	 * In case the hedged execution is about to start, throttle if necessary.
+	 * Hedging is optional, so the hedged execution doesn't queue for the shared
+	 * connection pool either.
+	 */
+	workerNodeState = LookupWorkerForTask(workerHash, task, hedgeExecution);
+	if (TaskExecutionReadyToStart(hedgeExecution) &&
+		(WorkerConnectionsExhausted(workerNodeState) ||
+		 MasterConnectionsExhausted(workerHash) ||
+		 SharedConnectionPoolExhausted(workerNodeState->workerName,
+									   workerNodeState->workerPort)))
+	{
+		return;
+	}
+
+	connectAction = ManageTaskExecution(task, hedgeExecution, &hedgeStatus, NULL);
+	UpdateConnectionCounter(workerNodeState, connectAction);
+
+	if (hedgeExecution->failureCount > 0)
+	{
+		AbandonHedgeExecution(task, taskExecution, workerHash);
+	}
+	else if (TaskExecutionCompleted(hedgeExecution))
+	{
+		PromoteHedgeExecution(task, taskExecution, workerHash);
+		*executionStatus = TASK_STATUS_READY;
+	}
+	else
+	{
+		uint32 currentIndex = hedgeExecution->currentNodeIndex;
+		int32 connectionId = hedgeExecution->connectionIdArray[currentIndex];
+
+		MultiClientRegisterWait(waitInfo, hedgeStatus, connectionId);
+	}
+}
+
+
+/*
+ * HedgeDeadlinePassed determines if the given task execution has been waiting
+ * for its placement to answer for longer than the hedge deadline. We hedge a
+ * task at most once, only if it has another placement and hasn't failed yet,
+ * and only until its placement starts sending results.
+ */
+static bool
+HedgeDeadlinePassed(TaskExecution *taskExecution, double hedgeDeadline)
+{
+	uint32 currentIndex = taskExecution->currentNodeIndex;
+	TaskExecStatus taskStatus = taskExecution->taskStatusArray[currentIndex];
+
+	if (hedgeDeadline < 0 || taskExecution->hedged ||
+		taskExecution->nodeCount < 2 || taskExecution->failureCount > 0)
+	{
+		return false;
+	}
+
+	if (taskStatus == EXEC_TASK_CONNECT_START || taskStatus == EXEC_TASK_FAILED ||
+		taskStatus == EXEC_COMPUTE_TASK_COPYING || taskStatus == EXEC_TASK_DONE)
+	{
+		return false;
+	}
+
+	return TimestampDifferenceExceeds(taskExecution->connectStartTime,
+									  GetCurrentTimestamp(), (int) hedgeDeadline);
+}
+
+
+/*
+ * PromoteHedgeExecution closes the given task execution, and replaces it with
+ * its hedged execution. The hedged execution's results file, if it already has
+ * one, becomes the task's results file.
+ */
+static void
+PromoteHedgeExecution(Task *task, TaskExecution *taskExecution, HTAB *workerHash)
+{
+	TaskExecution *hedgeExecution = taskExecution->hedgeExecution;
+	StringInfo jobDirectoryName = MasterJobDirectoryName(task->jobId);
+	StringInfo taskFilename = TaskFilename(jobDirectoryName, task->taskId);
+	StringInfo hedgeFilename = HedgeTaskFilename(task);
+	int renamed = 0;
+
+	CloseTaskExecution(task, taskExecution, workerHash);
+
+	*taskExecution = *hedgeExecution;
+	taskExecution->isHedge = false;
+	taskExecution->hedged = true;
+	taskExecution->hedgeExecution = NULL;
+	pfree(hedgeExecution);
+
+	renamed = rename(hedgeFilename->data, taskFilename->data);
+	if (renamed < 0 && errno != ENOENT)
+	{
+		ereport(WARNING, (errcode_for_file_access(),
+						  errmsg("could not rename file \"%s\" to \"%s\": %m",
+								 hedgeFilename->data, taskFilename->data)));
+
+		taskExecution->failureCount = MAX_TASK_EXECUTION_FAILURES;
+	}
+}
+
+
+/*
+ * AbandonHedgeExecution closes the given task execution's hedged execution,
+ * and removes its results file.
+ */
+static void
+AbandonHedgeExecution(Task *task, TaskExecution *taskExecution, HTAB *workerHash)
+{
+	TaskExecution *hedgeExecution = taskExecution->hedgeExecution;
+	StringInfo hedgeFilename = HedgeTaskFilename(task);
+
+	CloseTaskExecution(task, hedgeExecution, workerHash);
+
+	pfree(hedgeExecution);
+	taskExecution->hedgeExecution = NULL;
+
+	/* the job directory is removed at transaction end, so we ignore errors */
+	(void) unlink(hedgeFilename->data);
+}
+
+
+/*
+ * CloseTaskExecution cancels the given task execution's active request, if
+ * any, and closes its connection and results file.
+ */
+static void
+CloseTaskExecution(Task *task, TaskExecution *taskExecution, HTAB *workerHash)
+{
+	uint32 currentIndex = taskExecution->currentNodeIndex;
+	int32 connectionId = taskExecution->connectionIdArray[currentIndex];
+
+	if (connectionId != INVALID_CONNECTION_ID)
+	{
+		WorkerNodeState *workerNodeState =
+			LookupWorkerForTask(workerHash, task, taskExecution);
+		TaskExecStatus taskStatus = taskExecution->taskStatusArray[currentIndex];
+
+		CancelRequestIfActive(taskStatus, connectionId);
+		ReleaseTaskExecutionLoad(task, taskExecution);
+		UpdateConnectionCounter(workerNodeState, CONNECT_ACTION_CLOSED);
+	}
+
+	CleanupTaskExecution(taskExecution);
+}
+
+
+/* HedgeTaskFilename returns the results filename of a hedged task execution. */
+static StringInfo
+HedgeTaskFilename(Task *task)
+{
+	StringInfo jobDirectoryName = MasterJobDirectoryName(task->jobId);
+	StringInfo hedgeFilename = TaskFilename(jobDirectoryName, task->taskId);
+
+	appendStringInfoString(hedgeFilename, ATTEMPT_FILE_SUFFIX);
+
+	return hedgeFilename;
+}
+
+
 /*
  * WorkerHash creates a worker node hash with the given name. The function
  * then inserts one entry for each worker node in the given worker node
@@ -858,6 +1290,19 @@ WorkerConnectionsExhausted(WorkerNodeState *workerNodeState)
 		reachedLimit = true;
 	}
 
+	/*
+	 * Other backends' connections to the worker count against the shared pool
+	 * as well. If the pool is exhausted, we run tasks over the connections we
+	 * already have instead of queueing for more. Without any connection to the
+	 * worker, the task queues for the pool when it starts to connect.
+	 */
+	else if (workerNodeState->openConnectionCount > 0 &&
+			 SharedConnectionPoolExhausted(workerNodeState->workerName,
+										   workerNodeState->workerPort))
+	{
+		reachedLimit = true;
+	}
+
 	return reachedLimit;
 }
 
@@ -0,0 +1,1164 @@
+/*-------------------------------------------------------------------------
+ *
+ * multi_result_stream.c
+ *
+ * Routines for decoding task results as they arrive from worker nodes over
+ * the COPY protocol, and for appending the decoded rows directly to the
+ * master node's result relation. This allows the real-time executor to skip
+ * writing task results to intermediate files and copying these files into the
+ * result relation once all tasks complete. Since the result relation is a
+ * temporary table, rows are kept in local buffers and only spill to disk when
+ * temp_buffers is exceeded. If worker nodes return sorted results, a stream
+ * may also merge the results of all tasks in sort order as they arrive. Worker
+ * nodes also use these routines to stream partition files of other worker
+ * nodes directly into merge tables.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+
+#include <arpa/inet.h> /* for ntohl */
+#include <ctype.h>
+#include <netinet/in.h> /* for ntohs */
+#include <string.h>
+
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "common/pg_lzcompress.h"
+#include "distributed/multi_result_stream.h"
+#include "distributed/worker_protocol.h"
+#include "executor/tuptable.h"
+#include "lib/binaryheap.h"
+#include "storage/fd.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+
+/* controls whether the real-time executor streams results into the result table */
+bool StreamRealTimeResults = false;
+
+/*
+ * TaskResultMerge keeps the input streams of a merging stream, and the current
+ * row of each input. Inputs decode their rows into tuple stores, and the merge
+ * counts how many rows it read from each tuple store so far. The binary heap
+ * holds the inputs whose current row hasn't been appended yet, and keeps the
+ * input whose row sorts first on top.
+ */
+typedef struct TaskResultMerge
+{
+	int inputCount;
+	TaskResultStream **inputStreamArray;
+	uint64 *inputReadCountArray;
+	bool *inputInHeapArray;
+	TupleTableSlot **slotArray;
+	binaryheap *mergeHeap;
+	SortSupport sortKeys;
+	int sortKeyCount;
+} TaskResultMerge;
+
+
+/* constant used in binary protocol */
+static const char BinarySignature[11] = "PGCOPY\n\377\r\n\0";
+
+
+/* Local functions forward declarations */
+static void DecodeTextRow(TaskResultStream *resultStream, char *rowData,
+						  int rowDataLength);
+static void DecodeBinaryRow(TaskResultStream *resultStream, char *rowData,
+							int rowDataLength);
+static void ReceiveCompressedBlocks(TaskResultStream *resultStream);
+static void ReceiveFileRows(TaskResultStream *resultStream, char *fileData,
+							int fileDataLength);
+static int TextRowLength(char *data, int dataLength);
+static int BinaryRowLength(char *data, int dataLength);
+static char * SkipBinaryHeaders(char *cursor, char *dataEnd);
+static int32 ReadBinaryInt32(char **cursor, char *dataEnd);
+static int16 ReadBinaryInt16(char **cursor, char *dataEnd);
+static void AppendDecodedRow(TaskResultStream *resultStream);
+static bool LoadNextMergeRow(TaskResultMerge *merge, int inputIndex);
+static void ReadTaskFileIntoStream(const char *fileName, TaskResultStream *inputStream);
+static int CompareTaskResultRows(Datum leftIndex, Datum rightIndex, void *arg);
+
+
+/*
+ * CreateTaskResultStream creates a stream that decodes rows sent in the given
+ * COPY format, and appends them to the given relation. The caller is expected
+ * to hold a lock on the relation that allows for row insertions. If rowLimit
+ * is not -1, the stream drops all rows once it appended rowLimit rows.
+ */
+TaskResultStream *
+CreateTaskResultStream(Relation relation, bool binaryFormat, int64 rowLimit)
+{
+	TaskResultStream *resultStream = palloc0(sizeof(TaskResultStream));
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	uint32 columnCount = (uint32) tupleDescriptor->natts;
+	uint32 columnIndex = 0;
+
+	resultStream->relation = relation;
+	resultStream->tupleDescriptor = tupleDescriptor;
+	resultStream->binary = binaryFormat;
+
+	resultStream->columnInputFunctions = palloc0(columnCount * sizeof(FmgrInfo));
+	resultStream->columnTypeIOParams = palloc0(columnCount * sizeof(Oid));
+
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute currentColumn = tupleDescriptor->attrs[columnIndex];
+		Oid columnTypeId = currentColumn->atttypid;
+		Oid inputFunctionId = InvalidOid;
+		Oid *typeIOParam = &resultStream->columnTypeIOParams[columnIndex];
+
+		if (binaryFormat)
+		{
+			getTypeBinaryInputInfo(columnTypeId, &inputFunctionId, typeIOParam);
+		}
+		else
+		{
+			getTypeInputInfo(columnTypeId, &inputFunctionId, typeIOParam);
+		}
+
+		fmgr_info(inputFunctionId, &resultStream->columnInputFunctions[columnIndex]);
+	}
+
+	resultStream->valueArray = palloc0(columnCount * sizeof(Datum));
+	resultStream->isNullArray = palloc0(columnCount * sizeof(bool));
+	resultStream->fieldBuffer = makeStringInfo();
+	resultStream->pendingData = makeStringInfo();
+	resultStream->compressedData = makeStringInfo();
+	resultStream->decompressedBlock = makeStringInfo();
+	resultStream->fileFormatKnown = false;
+	resultStream->compressedFile = false;
+	resultStream->rowContext = AllocSetContextCreate(CurrentMemoryContext,
+													 "Task Result Stream Row Context",
+													 ALLOCSET_DEFAULT_MINSIZE,
+													 ALLOCSET_DEFAULT_INITSIZE,
+													 ALLOCSET_DEFAULT_MAXSIZE);
+
+	resultStream->bulkInsertState = GetBulkInsertState();
+	resultStream->commandId = GetCurrentCommandId(true);
+	resultStream->rowCount = 0;
+	resultStream->tupleStore = NULL;
+	resultStream->rowLimit = rowLimit;
+	resultStream->inputComplete = false;
+	resultStream->merge = NULL;
+
+	return resultStream;
+}
+
+
+/*
+ * CreateTaskResultMergeStream creates a stream that merges the rows of the
+ * given number of inputs, which each arrive sorted on the given sort keys, and
+ * appends them to the given relation in sort order. Each input receives its
+ * rows through its own stream, see TaskResultStreamInput(). If rowLimit is not
+ * -1, the merge stops once it appended rowLimit rows, and inputs drop all rows
+ * after their first rowLimit rows.
+ */
+TaskResultStream *
+CreateTaskResultMergeStream(Relation relation, bool binaryFormat, int64 rowLimit,
+							int inputCount, SortSupport sortKeys, int sortKeyCount)
+{
+	TaskResultStream *resultStream = CreateTaskResultStream(relation, binaryFormat,
+															rowLimit);
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	TaskResultMerge *merge = palloc0(sizeof(TaskResultMerge));
+	int inputIndex = 0;
+
+	merge->inputCount = inputCount;
+	merge->inputStreamArray = palloc0(inputCount * sizeof(TaskResultStream *));
+	merge->inputReadCountArray = palloc0(inputCount * sizeof(uint64));
+	merge->inputInHeapArray = palloc0(inputCount * sizeof(bool));
+	merge->slotArray = palloc0(inputCount * sizeof(TupleTableSlot *));
+	merge->sortKeys = sortKeys;
+	merge->sortKeyCount = sortKeyCount;
+	merge->mergeHeap = binaryheap_allocate(Max(inputCount, 1), CompareTaskResultRows,
+										   merge);
+
+	for (inputIndex = 0; inputIndex < inputCount; inputIndex++)
+	{
+		TaskResultStream *inputStream = CreateTaskResultStream(relation, binaryFormat,
+															   rowLimit);
+		inputStream->tupleStore = tuplestore_begin_heap(false, false, work_mem);
+
+		merge->inputStreamArray[inputIndex] = inputStream;
+		merge->slotArray[inputIndex] = MakeSingleTupleTableSlot(tupleDescriptor);
+	}
+
+	resultStream->merge = merge;
+
+	return resultStream;
+}
+
+
+/*
+ * TaskResultStreamInput returns the stream that receives the rows of the input
+ * with the given index. A stream that doesn't merge inputs receives the rows
+ * of all inputs itself, and the function then returns the stream as is.
+ */
+TaskResultStream *
+TaskResultStreamInput(TaskResultStream *resultStream, int inputIndex)
+{
+	TaskResultMerge *merge = resultStream->merge;
+	if (merge == NULL)
+	{
+		return resultStream;
+	}
+
+	Assert(inputIndex >= 0 && inputIndex < merge->inputCount);
+
+	return merge->inputStreamArray[inputIndex];
+}
+
+
+/*
+ * MergeTaskResultStreamInputs appends the rows that a merging stream's inputs
+ * received so far to the stream's relation, in sort order. The next row in sort
+ * order is only known once each input either has a row that hasn't been
+ * appended yet, or won't receive any more rows. The function therefore stops
+ * at the first input that still waits for rows, and the caller calls it again
+ * after more rows arrived. For streams that don't merge, the function does
+ * nothing.
+ */
+void
+MergeTaskResultStreamInputs(TaskResultStream *resultStream)
+{
+	TaskResultMerge *merge = resultStream->merge;
+	binaryheap *mergeHeap = NULL;
+	bool inputsReady = true;
+	int inputIndex = 0;
+
+	if (merge == NULL)
+	{
+		return;
+	}
+
+	mergeHeap = merge->mergeHeap;
+
+	/* inputs that ran out of rows the last time may have received more since */
+	for (inputIndex = 0; inputIndex < merge->inputCount; inputIndex++)
+	{
+		if (!merge->inputInHeapArray[inputIndex] && !LoadNextMergeRow(merge, inputIndex))
+		{
+			inputsReady = false;
+		}
+	}
+
+	while (inputsReady && !binaryheap_empty(mergeHeap) &&
+		   !TaskResultStreamLimitReached(resultStream))
+	{
+		int firstIndex = DatumGetInt32(binaryheap_first(mergeHeap));
+		TupleTableSlot *firstSlot = merge->slotArray[firstIndex];
+		HeapTuple heapTuple = ExecCopySlotTuple(firstSlot);
+
+		heap_insert(resultStream->relation, heapTuple, resultStream->commandId, 0,
+					resultStream->bulkInsertState);
+		heap_freetuple(heapTuple);
+		resultStream->rowCount++;
+
+		/* move on to the next row of the input we just appended from */
+		binaryheap_remove_first(mergeHeap);
+		merge->inputInHeapArray[firstIndex] = false;
+
+		inputsReady = LoadNextMergeRow(merge, firstIndex);
+	}
+}
+
+
+/*
+ * LoadNextMergeRow makes the next row of the given input the input's current
+ * row, and adds the input to the merge heap. If the input doesn't have such a
+ * row, the function returns whether the input is done, that is whether it
+ * won't receive any more rows.
+ */
+static bool
+LoadNextMergeRow(TaskResultMerge *merge, int inputIndex)
+{
+	TaskResultStream *inputStream = merge->inputStreamArray[inputIndex];
+	TupleTableSlot *slot = merge->slotArray[inputIndex];
+
+	/*
+	 * We only read rows that already arrived, as a tuple store doesn't continue
+	 * reading once it reached its end. We also copy the row, since writing more
+	 * rows may move the tuple store's rows to disk and free them.
+	 */
+	if (merge->inputReadCountArray[inputIndex] < inputStream->rowCount)
+	{
+		tuplestore_gettupleslot(inputStream->tupleStore, true, true, slot);
+		merge->inputReadCountArray[inputIndex]++;
+
+		binaryheap_add(merge->mergeHeap, Int32GetDatum(inputIndex));
+		merge->inputInHeapArray[inputIndex] = true;
+
+		return true;
+	}
+
+	/* inputs drop all rows after reaching their limit */
+	return (inputStream->inputComplete || TaskResultStreamLimitReached(inputStream));
+}
+
+
+/*
+ * TaskResultStreamReceive decodes one COPY data message received from a worker
+ * node, and appends the decoded row to the stream's relation. The function's
+ * signature allows for it to be used as a callback when receiving COPY data.
+ * Note that worker nodes send the binary COPY headers as part of the first
+ * row's message, and the binary COPY trailer as a separate message.
+ */
+void
+TaskResultStreamReceive(void *streamState, char *copyData, int copyDataLength)
+{
+	TaskResultStream *resultStream = (TaskResultStream *) streamState;
+	MemoryContext oldContext = NULL;
+
+	/* no need to decode rows nobody is going to look at */
+	if (TaskResultStreamLimitReached(resultStream))
+	{
+		return;
+	}
+
+	oldContext = MemoryContextSwitchTo(resultStream->rowContext);
+
+	if (resultStream->binary)
+	{
+		DecodeBinaryRow(resultStream, copyData, copyDataLength);
+	}
+	else
+	{
+		DecodeTextRow(resultStream, copyData, copyDataLength);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextReset(resultStream->rowContext);
+}
+
+
+/*
+ * TaskResultStreamReceiveFileData receives a chunk of a file in COPY format,
+ * such as the contents of a partition file sent by the transmit command. The
+ * file may also be compressed in blocks, which the function recognizes by the
+ * file's signature. Chunks don't need to end at row or block boundaries, so the
+ * function keeps incomplete data until the next chunk arrives.
+ */
+void
+TaskResultStreamReceiveFileData(void *streamState, char *fileData, int fileDataLength)
+{
+	TaskResultStream *resultStream = (TaskResultStream *) streamState;
+	StringInfo compressedData = resultStream->compressedData;
+
+	if (!resultStream->fileFormatKnown)
+	{
+		const int signatureLength = COMPRESSED_FILE_SIGNATURE_LENGTH;
+		int comparedLength = 0;
+
+		/* buffer the first bytes until we can tell whether they are a signature */
+		appendBinaryStringInfo(compressedData, fileData, fileDataLength);
+
+		comparedLength = Min(compressedData->len, signatureLength);
+		if (memcmp(compressedData->data, COMPRESSED_FILE_SIGNATURE,
+				   comparedLength) != 0)
+		{
+			resultStream->fileFormatKnown = true;
+			resultStream->compressedFile = false;
+
+			ReceiveFileRows(resultStream, compressedData->data, compressedData->len);
+			resetStringInfo(compressedData);
+			return;
+		}
+		else if (comparedLength < signatureLength)
+		{
+			return;
+		}
+
+		resultStream->fileFormatKnown = true;
+		resultStream->compressedFile = true;
+
+		/* skip the signature */
+		compressedData->len -= signatureLength;
+		memmove(compressedData->data, compressedData->data + signatureLength,
+				compressedData->len);
+		compressedData->data[compressedData->len] = '\0';
+	}
+	else if (resultStream->compressedFile)
+	{
+		appendBinaryStringInfo(compressedData, fileData, fileDataLength);
+	}
+	else
+	{
+		ReceiveFileRows(resultStream, fileData, fileDataLength);
+		return;
+	}
+
+	ReceiveCompressedBlocks(resultStream);
+}
+
+
+/*
+ * TaskResultStreamFileComplete returns true if the file data received so far
+ * ended with a complete row, and for compressed files, a complete block.
+ */
+bool
+TaskResultStreamFileComplete(TaskResultStream *resultStream)
+{
+	return (resultStream->pendingData->len == 0 &&
+			resultStream->compressedData->len == 0);
+}
+
+
+/*
+ * ReceiveCompressedBlocks decompresses all complete blocks in the stream's
+ * compressed data, and passes the decompressed data on to ReceiveFileRows().
+ * See CompressedBlock() in worker_partition_protocol.c for the block format.
+ */
+static void
+ReceiveCompressedBlocks(TaskResultStream *resultStream)
+{
+	StringInfo compressedData = resultStream->compressedData;
+	StringInfo decompressedBlock = resultStream->decompressedBlock;
+	char *dataEnd = compressedData->data + compressedData->len;
+	char *blockStart = compressedData->data;
+	int remainingLength = 0;
+
+	while ((dataEnd - blockStart) >= 2 * sizeof(int32))
+	{
+		char *cursor = blockStart;
+		int32 rawLength = ReadBinaryInt32(&cursor, dataEnd);
+		int32 storedLength = ReadBinaryInt32(&cursor, dataEnd);
+
+		if (rawLength < 0 || storedLength < 0 || storedLength > rawLength)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+							errmsg("invalid compressed block in task result")));
+		}
+
+		if (storedLength > (dataEnd - cursor))
+		{
+			/* the block isn't complete yet */
+			break;
+		}
+
+		if (storedLength == rawLength)
+		{
+			/* the block's data didn't compress well, and is stored as is */
+			ReceiveFileRows(resultStream, cursor, rawLength);
+		}
+		else
+		{
+			int32 decompressedLength = 0;
+
+			resetStringInfo(decompressedBlock);
+			enlargeStringInfo(decompressedBlock, rawLength);
+
+			decompressedLength = pglz_decompress(cursor, storedLength,
+												 decompressedBlock->data, rawLength);
+			if (decompressedLength != rawLength)
+			{
+				ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+								errmsg("compressed data in task result is corrupt")));
+			}
+
+			ReceiveFileRows(resultStream, decompressedBlock->data, rawLength);
+		}
+
+		blockStart = cursor + storedLength;
+	}
+
+	/* move the incomplete block to the start of the buffer */
+	remainingLength = (int) (dataEnd - blockStart);
+	if (blockStart != compressedData->data)
+	{
+		memmove(compressedData->data, blockStart, remainingLength);
+		compressedData->len = remainingLength;
+		compressedData->data[remainingLength] = '\0';
+	}
+}
+
+
+/*
+ * ReceiveFileRows passes all rows in the given uncompressed file data that are
+ * complete to TaskResultStreamReceive(), and keeps the rest of the data until
+ * more data arrives.
+ */
+static void
+ReceiveFileRows(TaskResultStream *resultStream, char *fileData, int fileDataLength)
+{
+	StringInfo pendingData = resultStream->pendingData;
+	int rowStart = 0;
+	int remainingLength = 0;
+
+	appendBinaryStringInfo(pendingData, fileData, fileDataLength);
+
+	while (rowStart < pendingData->len)
+	{
+		char *rowData = pendingData->data + rowStart;
+		int availableLength = pendingData->len - rowStart;
+		int rowLength = 0;
+
+		if (resultStream->binary)
+		{
+			rowLength = BinaryRowLength(rowData, availableLength);
+		}
+		else
+		{
+			rowLength = TextRowLength(rowData, availableLength);
+		}
+
+		if (rowLength == 0)
+		{
+			/* the row isn't complete yet */
+			break;
+		}
+
+		TaskResultStreamReceive(resultStream, rowData, rowLength);
+		rowStart += rowLength;
+	}
+
+	/* move the incomplete row to the start of the buffer */
+	remainingLength = pendingData->len - rowStart;
+	if (rowStart > 0)
+	{
+		memmove(pendingData->data, pendingData->data + rowStart, remainingLength);
+		pendingData->len = remainingLength;
+		pendingData->data[remainingLength] = '\0';
+	}
+}
+
+
+/*
+ * TaskResultStreamLimitReached returns true if the stream has a row limit, and
+ * already appended as many rows.
+ */
+bool
+TaskResultStreamLimitReached(TaskResultStream *resultStream)
+{
+	int64 rowLimit = resultStream->rowLimit;
+
+	return (rowLimit >= 0 && resultStream->rowCount >= (uint64) rowLimit);
+}
+
+
+/*
+ * FinishTaskResultStream releases the resources used for inserting rows, and
+ * for merging inputs. The caller is responsible for making the inserted rows
+ * visible.
+ */
+void
+FinishTaskResultStream(TaskResultStream *resultStream)
+{
+	TaskResultMerge *merge = resultStream->merge;
+
+	if (merge != NULL)
+	{
+		int inputIndex = 0;
+
+		for (inputIndex = 0; inputIndex < merge->inputCount; inputIndex++)
+		{
+			TaskResultStream *inputStream = merge->inputStreamArray[inputIndex];
+
+			ExecDropSingleTupleTableSlot(merge->slotArray[inputIndex]);
+			tuplestore_end(inputStream->tupleStore);
+			FinishTaskResultStream(inputStream);
+		}
+
+		binaryheap_free(merge->mergeHeap);
+		resultStream->merge = NULL;
+	}
+
+	FreeBulkInsertState(resultStream->bulkInsertState);
+	MemoryContextDelete(resultStream->rowContext);
+
+	resultStream->bulkInsertState = NULL;
+	resultStream->rowContext = NULL;
+}
+
+
+/*
+ * MergeTaskResultFiles merges the rows of the given task result files, which
+ * are each sorted on the given sort keys, and appends the merged rows to the
+ * given relation in sort order. Each file becomes one input of a merging
+ * stream. If rowLimit is not -1, the function stops after appending rowLimit
+ * rows, and only reads as many rows from each file. The function returns the
+ * number of appended rows, and the caller is responsible for making these rows
+ * visible.
+ */
+uint64
+MergeTaskResultFiles(Relation relation, bool binaryFormat, List *fileNameList,
+					 SortSupport sortKeys, int sortKeyCount, int64 rowLimit)
+{
+	int fileCount = list_length(fileNameList);
+	TaskResultStream *resultStream = NULL;
+	uint64 rowCount = 0;
+	int fileIndex = 0;
+	ListCell *fileNameCell = NULL;
+
+	resultStream = CreateTaskResultMergeStream(relation, binaryFormat, rowLimit,
+											   fileCount, sortKeys, sortKeyCount);
+
+	foreach(fileNameCell, fileNameList)
+	{
+		char *fileName = (char *) lfirst(fileNameCell);
+		TaskResultStream *inputStream = TaskResultStreamInput(resultStream, fileIndex);
+
+		ReadTaskFileIntoStream(fileName, inputStream);
+		fileIndex++;
+	}
+
+	MergeTaskResultStreamInputs(resultStream);
+
+	rowCount = resultStream->rowCount;
+	FinishTaskResultStream(resultStream);
+
+	return rowCount;
+}
+
+
+/*
+ * ReadTaskFileIntoStream passes the contents of the given task result file to
+ * the given input stream, and marks the input as complete. If the stream has a
+ * row limit, the function stops reading the file once the stream reached it.
+ */
+static void
+ReadTaskFileIntoStream(const char *fileName, TaskResultStream *inputStream)
+{
+	char *readBuffer = palloc(BLCKSZ * 8);
+	size_t readLength = 0;
+
+	FILE *file = AllocateFile(fileName, PG_BINARY_R);
+	if (file == NULL)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\": %m", fileName)));
+	}
+
+	readLength = fread(readBuffer, 1, BLCKSZ * 8, file);
+	while (readLength > 0 && !TaskResultStreamLimitReached(inputStream))
+	{
+		TaskResultStreamReceiveFileData(inputStream, readBuffer, (int) readLength);
+
+		readLength = fread(readBuffer, 1, BLCKSZ * 8, file);
+	}
+
+	if (ferror(file))
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not read file \"%s\": %m", fileName)));
+	}
+
+	FreeFile(file);
+
+	if (!TaskResultStreamLimitReached(inputStream) &&
+		!TaskResultStreamFileComplete(inputStream))
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("unexpected end of task file \"%s\"", fileName)));
+	}
+
+	inputStream->inputComplete = true;
+	pfree(readBuffer);
+}
+
+
+/*
+ * CompareTaskResultRows compares the current rows of the two merge inputs
+ * with the given indexes on the merge's sort keys. The binary heap keeps the
+ * largest element on top, so the function inverts the comparison to keep the
+ * smallest row on top instead.
+ */
+static int
+CompareTaskResultRows(Datum leftIndex, Datum rightIndex, void *arg)
+{
+	TaskResultMerge *merge = (TaskResultMerge *) arg;
+	TupleTableSlot *leftSlot = merge->slotArray[DatumGetInt32(leftIndex)];
+	TupleTableSlot *rightSlot = merge->slotArray[DatumGetInt32(rightIndex)];
+	int sortKeyIndex = 0;
+
+	for (sortKeyIndex = 0; sortKeyIndex < merge->sortKeyCount; sortKeyIndex++)
+	{
+		SortSupport sortKey = &merge->sortKeys[sortKeyIndex];
+		AttrNumber columnNumber = sortKey->ssup_attno;
+		bool leftNull = false;
+		bool rightNull = false;
+		Datum leftValue = slot_getattr(leftSlot, columnNumber, &leftNull);
+		Datum rightValue = slot_getattr(rightSlot, columnNumber, &rightNull);
+
+		int comparison = ApplySortComparator(leftValue, leftNull, rightValue, rightNull,
+											 sortKey);
+		if (comparison != 0)
+		{
+			return -comparison;
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ * DecodeTextRow decodes one row in COPY's text format, using the default tab
+ * delimiter and \N null marker. The function is loosely based on
+ * CopyReadAttributesText() in commands/copy.c.
+ */
+static void
+DecodeTextRow(TaskResultStream *resultStream, char *rowData, int rowDataLength)
+{
+	TupleDesc tupleDescriptor = resultStream->tupleDescriptor;
+	int columnCount = tupleDescriptor->natts;
+	int columnIndex = 0;
+	StringInfo fieldBuffer = resultStream->fieldBuffer;
+	char *cursor = rowData;
+	char *rowEnd = rowData + rowDataLength;
+
+	/* remove the line terminator, raw newlines are always escaped in fields */
+	while (rowEnd > rowData && (rowEnd[-1] == '\n' || rowEnd[-1] == '\r'))
+	{
+		rowEnd--;
+	}
+
+	while (true)
+	{
+		char *fieldStart = cursor;
+		bool isNull = false;
+
+		resetStringInfo(fieldBuffer);
+
+		while (cursor < rowEnd && *cursor != '\t')
+		{
+			char currentChar = *cursor++;
+
+			if (currentChar == '\\' && cursor < rowEnd)
+			{
+				currentChar = *cursor++;
+
+				switch (currentChar)
+				{
+					case '0':
+					case '1':
+					case '2':
+					case '3':
+					case '4':
+					case '5':
+					case '6':
+					case '7':
+					{
+						int octalValue = currentChar - '0';
+						int digitCount = 1;
+
+						while (digitCount < 3 && cursor < rowEnd &&
+							   *cursor >= '0' && *cursor <= '7')
+						{
+							octalValue = (octalValue << 3) + (*cursor++ - '0');
+							digitCount++;
+						}
+
+						currentChar = (char) (octalValue & 0377);
+						break;
+					}
+
+					case 'x':
+					{
+						int hexValue = 0;
+						int digitCount = 0;
+
+						while (digitCount < 2 && cursor < rowEnd &&
+							   isxdigit((unsigned char) *cursor))
+						{
+							char hexChar = *cursor++;
+							int hexDigit = 0;
+
+							if (hexChar >= '0' && hexChar <= '9')
+							{
+								hexDigit = hexChar - '0';
+							}
+							else if (hexChar >= 'a' && hexChar <= 'f')
+							{
+								hexDigit = hexChar - 'a' + 10;
+							}
+							else
+							{
+								hexDigit = hexChar - 'A' + 10;
+							}
+
+							hexValue = (hexValue << 4) + hexDigit;
+							digitCount++;
+						}
+
+						/* a lone \x is taken to mean a literal x */
+						currentChar = (digitCount > 0) ? (char) (hexValue & 0xff) : 'x';
+						break;
+					}
+
+					case 'b':
+					{
+						currentChar = '\b';
+						break;
+					}
+
+					case 'f':
+					{
+						currentChar = '\f';
+						break;
+					}
+
+					case 'n':
+					{
+						currentChar = '\n';
+						break;
+					}
+
+					case 'r':
+					{
+						currentChar = '\r';
+						break;
+					}
+
+					case 't':
+					{
+						currentChar = '\t';
+						break;
+					}
+
+					case 'v':
+					{
+						currentChar = '\v';
+						break;
+					}
+
+					default:
+					{
+						/* all other backslashed characters are taken literally */
+						break;
+					}
+				}
+			}
+
+			appendStringInfoCharMacro(fieldBuffer, currentChar);
+		}
+
+		/* as in copy.c, the null marker is matched against the raw input */
+		if ((cursor - fieldStart) == 2 && fieldStart[0] == '\\' && fieldStart[1] == 'N')
+		{
+			isNull = true;
+		}
+
+		if (columnIndex >= columnCount)
+		{
+			ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+							errmsg("extra data after last expected column in task "
+								   "result")));
+		}
+
+		/* input functions are called for nulls as well, to allow domain checks */
+		resultStream->isNullArray[columnIndex] = isNull;
+		resultStream->valueArray[columnIndex] =
+			InputFunctionCall(&resultStream->columnInputFunctions[columnIndex],
+							  isNull ? NULL : fieldBuffer->data,
+							  resultStream->columnTypeIOParams[columnIndex],
+							  tupleDescriptor->attrs[columnIndex]->atttypmod);
+		columnIndex++;
+
+		if (cursor >= rowEnd)
+		{
+			break;
+		}
+
+		/* skip over the delimiter */
+		cursor++;
+	}
+
+	if (columnIndex < columnCount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("missing data for column %d in task result",
+							   columnIndex + 1)));
+	}
+
+	AppendDecodedRow(resultStream);
+}
+
+
+/*
+ * DecodeBinaryRow decodes one row in COPY's binary format. The function skips
+ * over binary headers and ignores the binary trailer. The function is loosely
+ * based on CopyReadBinaryAttribute() in commands/copy.c.
+ */
+static void
+DecodeBinaryRow(TaskResultStream *resultStream, char *rowData, int rowDataLength)
+{
+	TupleDesc tupleDescriptor = resultStream->tupleDescriptor;
+	int columnCount = tupleDescriptor->natts;
+	int columnIndex = 0;
+	StringInfo fieldBuffer = resultStream->fieldBuffer;
+	char *cursor = rowData;
+	char *rowEnd = rowData + rowDataLength;
+	int16 fieldCount = 0;
+
+	cursor = SkipBinaryHeaders(cursor, rowEnd);
+	if (cursor == rowEnd)
+	{
+		return;
+	}
+
+	fieldCount = ReadBinaryInt16(&cursor, rowEnd);
+	if (fieldCount == -1)
+	{
+		/* received the binary trailer */
+		return;
+	}
+
+	if (fieldCount != columnCount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("row field count is %d, expected %d in task result",
+							   (int) fieldCount, columnCount)));
+	}
+
+	for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		FmgrInfo *receiveFunction = &resultStream->columnInputFunctions[columnIndex];
+		Oid typeIOParam = resultStream->columnTypeIOParams[columnIndex];
+		int32 typeMod = tupleDescriptor->attrs[columnIndex]->atttypmod;
+		int32 fieldSize = ReadBinaryInt32(&cursor, rowEnd);
+
+		if (fieldSize == -1)
+		{
+			resultStream->isNullArray[columnIndex] = true;
+			resultStream->valueArray[columnIndex] =
+				ReceiveFunctionCall(receiveFunction, NULL, typeIOParam, typeMod);
+			continue;
+		}
+
+		if (fieldSize < 0 || fieldSize > (rowEnd - cursor))
+		{
+			ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+							errmsg("invalid field size in task result")));
+		}
+
+		/* receive functions expect a null-terminated buffer */
+		resetStringInfo(fieldBuffer);
+		appendBinaryStringInfo(fieldBuffer, cursor, fieldSize);
+		cursor += fieldSize;
+
+		resultStream->isNullArray[columnIndex] = false;
+		resultStream->valueArray[columnIndex] =
+			ReceiveFunctionCall(receiveFunction, fieldBuffer, typeIOParam, typeMod);
+
+		if (fieldBuffer->cursor != fieldSize)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							errmsg("incorrect binary data format in task result")));
+		}
+	}
+
+	AppendDecodedRow(resultStream);
+}
+
+
+/*
+ * TextRowLength returns the length of the first row in the given data in
+ * COPY's text format, including its line terminator. If the data doesn't
+ * contain a complete row, the function returns 0.
+ */
+static int
+TextRowLength(char *data, int dataLength)
+{
+	char *lineEnd = memchr(data, '\n', dataLength);
+	if (lineEnd == NULL)
+	{
+		return 0;
+	}
+
+	return (int) (lineEnd - data) + 1;
+}
+
+
+/*
+ * BinaryRowLength returns the length of the first row in the given data in
+ * COPY's binary format, including binary headers that precede the row. The
+ * binary trailer counts as a row of its own. If the data doesn't contain a
+ * complete row, the function returns 0.
+ */
+static int
+BinaryRowLength(char *data, int dataLength)
+{
+	char *cursor = data;
+	char *dataEnd = data + dataLength;
+	int signatureLength = Min(dataLength, (int) sizeof(BinarySignature));
+	int16 fieldCount = 0;
+	int fieldIndex = 0;
+
+	/* the headers are sent along with the first row, see SkipBinaryHeaders */
+	if (memcmp(data, BinarySignature, signatureLength) == 0)
+	{
+		int32 headerExtensionLength = 0;
+
+		if ((dataEnd - cursor) < sizeof(BinarySignature) + 2 * sizeof(int32))
+		{
+			return 0;
+		}
+
+		/* skip the signature and the flags field */
+		cursor += sizeof(BinarySignature) + sizeof(int32);
+
+		headerExtensionLength = ReadBinaryInt32(&cursor, dataEnd);
+		if (headerExtensionLength < 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+							errmsg("invalid binary COPY header in task result")));
+		}
+
+		if (headerExtensionLength > (dataEnd - cursor))
+		{
+			return 0;
+		}
+
+		cursor += headerExtensionLength;
+	}
+
+	if ((dataEnd - cursor) < sizeof(int16))
+	{
+		return 0;
+	}
+
+	fieldCount = ReadBinaryInt16(&cursor, dataEnd);
+
+	for (fieldIndex = 0; fieldIndex < fieldCount; fieldIndex++)
+	{
+		int32 fieldSize = 0;
+
+		if ((dataEnd - cursor) < sizeof(int32))
+		{
+			return 0;
+		}
+
+		fieldSize = ReadBinaryInt32(&cursor, dataEnd);
+		if (fieldSize == -1)
+		{
+			continue;
+		}
+
+		if (fieldSize < 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+							errmsg("invalid field size in task result")));
+		}
+
+		if (fieldSize > (dataEnd - cursor))
+		{
+			return 0;
+		}
+
+		cursor += fieldSize;
+	}
+
+	return (int) (cursor - data);
+}
+
+
+/*
+ * SkipBinaryHeaders checks if the given data starts with binary COPY headers,
+ * and if so, returns a pointer to the first byte after the headers. Otherwise,
+ * the function returns the given cursor. Note that a row's field count can't
+ * be confused with the signature, as the latter would mean more than 20000
+ * fields.
+ */
+static char *
+SkipBinaryHeaders(char *cursor, char *dataEnd)
+{
+	int32 headerExtensionLength = 0;
+
+	if ((dataEnd - cursor) < sizeof(BinarySignature) ||
+		memcmp(cursor, BinarySignature, sizeof(BinarySignature)) != 0)
+	{
+		return cursor;
+	}
+
+	cursor += sizeof(BinarySignature);
+
+	/* we don't ask for OIDs, so the flags field can be skipped */
+	(void) ReadBinaryInt32(&cursor, dataEnd);
+
+	headerExtensionLength = ReadBinaryInt32(&cursor, dataEnd);
+	if (headerExtensionLength < 0 || headerExtensionLength > (dataEnd - cursor))
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid binary COPY header in task result")));
+	}
+
+	cursor += headerExtensionLength;
+
+	return cursor;
+}
+
+
+/* ReadBinaryInt32 reads an int32 in network byte order, and advances the cursor. */
+static int32
+ReadBinaryInt32(char **cursor, char *dataEnd)
+{
+	uint32 networkValue = 0;
+
+	if ((dataEnd - *cursor) < sizeof(networkValue))
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("unexpected end of data in task result")));
+	}
+
+	memcpy(&networkValue, *cursor, sizeof(networkValue));
+	*cursor += sizeof(networkValue);
+
+	return (int32) ntohl(networkValue);
+}
+
+
+/* ReadBinaryInt16 reads an int16 in network byte order, and advances the cursor. */
+static int16
+ReadBinaryInt16(char **cursor, char *dataEnd)
+{
+	uint16 networkValue = 0;
+
+	if ((dataEnd - *cursor) < sizeof(networkValue))
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("unexpected end of data in task result")));
+	}
+
+	memcpy(&networkValue, *cursor, sizeof(networkValue));
+	*cursor += sizeof(networkValue);
+
+	return (int16) ntohs(networkValue);
+}
+
+
+/*
+ * AppendDecodedRow forms a tuple from the stream's decoded values, and inserts
+ * this tuple into the stream's relation. The result relation is a temporary
+ * table without indexes or triggers, so a plain heap insert suffices. If the
+ * stream has a tuple store, the function puts the values there instead.
+ */
+static void
+AppendDecodedRow(TaskResultStream *resultStream)
+{
+	HeapTuple heapTuple = NULL;
+
+	if (resultStream->tupleStore != NULL)
+	{
+		tuplestore_putvalues(resultStream->tupleStore, resultStream->tupleDescriptor,
+							 resultStream->valueArray, resultStream->isNullArray);
+
+		resultStream->rowCount++;
+		return;
+	}
+
+	heapTuple = heap_form_tuple(resultStream->tupleDescriptor,
+								resultStream->valueArray,
+								resultStream->isNullArray);
+
+	heap_insert(resultStream->relation, heapTuple, resultStream->commandId, 0,
+				resultStream->bulkInsertState);
+
+	resultStream->rowCount++;
+}
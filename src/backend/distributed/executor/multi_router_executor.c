@@ -34,6 +34,7 @@
 #include "distributed/master_metadata_utility.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_executor.h"
+#include "distributed/multi_node_load.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_planner.h"
 #include "distributed/multi_router_executor.h"
@@ -72,6 +73,30 @@
 bool AllModificationsCommutative = false;
 bool EnableDeadlockPrevention = true;
 
+/* maximum number of multi-shard modification commands in progress per node */
+int MaxConcurrentModifyTasksPerNode = 0;
+
+
+/*
+ * ModifyTaskState keeps track of the execution of a task of a multi-shard
+ * modification. The task's command is run on the placements of its shard one
+ * after another, in the order of the shard's connections.
+ */
+typedef struct ModifyTaskState
+{
+	Task *task;
+	List *connectionList;
+
+	/* placement the command is running on, or is sent to next */
+	int placementIndex;
+
+	/* connection with the command in progress, NULL if none */
+	MultiConnection *pendingConnection;
+
+	/* number of tuples modified on the first placement */
+	int64 affectedTupleCount;
+} ModifyTaskState;
+
 /* functions needed during run phase */
 static void ReacquireMetadataLocks(List *taskList);
 static void ExecuteSingleModifyTask(QueryDesc *queryDesc, Task *task,
@@ -86,6 +111,13 @@ static int64 ExecuteModifyTasks(List *taskList, bool expectResults,
 								ParamListInfo paramListInfo,
 								MaterialState *routerState,
 								TupleDesc tupleDescriptor);
+static bool SendNextModifyTaskCommand(ModifyTaskState *taskState,
+									  List *pendingConnectionList,
+									  ParamListInfo paramListInfo);
+static int PendingNodeCommandCount(List *pendingConnectionList,
+								   MultiConnection *connection);
+static bool ExecutionOrderPrecedes(int leftPlacementIndex, int leftTaskIndex,
+								   int rightPlacementIndex, int rightTaskIndex);
 static List * TaskShardIntervalList(List *taskList);
 static void AcquireExecutorShardLock(Task *task, CmdType commandType);
 static void AcquireExecutorMultiShardLocks(List *taskList);
@@ -99,9 +131,10 @@ static void ExtractParametersFromParamListInfo(ParamListInfo paramListInfo,
 static bool SendQueryInSingleRowMode(MultiConnection *connection, char *query,
 									 ParamListInfo paramListInfo);
 static bool StoreQueryResult(MaterialState *routerState, MultiConnection *connection,
-							 TupleDesc tupleDescriptor, bool failOnError, int64 *rows);
+							 TupleDesc tupleDescriptor, bool failOnError, int64 *rows,
+							 PGresult **errorResult);
 static bool ConsumeQueryResult(MultiConnection *connection, bool failOnError,
-							   int64 *rows);
+							   int64 *rows, PGresult **errorResult);
 
 
 /*
@@ -530,7 +563,16 @@ RouterExecutorRun(QueryDesc *queryDesc, ScanDirection direction, long count)
 			Query *jobQuery = workerJob->jobQuery;
 
 			ExecuteMasterEvaluableFunctions(jobQuery);
-			RebuildQueryStrings(jobQuery, taskList);
+
+			/* rows of multi-row INSERTs can only be routed after evaluation */
+			if (ExtractValuesRangeTableEntry(jobQuery) != NULL)
+			{
+				taskList = MultiRowInsertTaskList(jobQuery);
+			}
+			else
+			{
+				RebuildQueryStrings(jobQuery, taskList);
+			}
 		}
 
 		if (list_length(taskList) == 1)
@@ -619,6 +661,17 @@ ExecuteSingleSelectTask(QueryDesc *queryDesc, Task *task)
 							   "which contain multi-shard data modifications")));
 	}
 
+	/*
+	 * With the load-aware policy, read from the least loaded placement first.
+	 * Once the transaction modified placements, reads have to go over the same
+	 * connections to see these modifications, so we keep the planned order.
+	 */
+	if (TaskAssignmentPolicy == TASK_ASSIGNMENT_LOAD_AWARE &&
+		XactModificationLevel == XACT_MODIFICATION_NONE)
+	{
+		taskPlacementList = LoadAwarePlacementList(taskPlacementList, NULL);
+	}
+
 	/*
 	 * Try to run the query to completion on one placement. If the query fails
 	 * attempt the query on the next placement.
@@ -630,17 +683,23 @@ ExecuteSingleSelectTask(QueryDesc *queryDesc, Task *task)
 		bool dontFailOnError = false;
 		int64 currentAffectedTupleCount = 0;
 		int connectionFlags = SESSION_LIFESPAN;
+		TimestampTz taskStartTime = GetCurrentTimestamp();
 		MultiConnection *connection =
 			GetPlacementConnection(connectionFlags, taskPlacement, NULL);
 
+		NodeTaskStarted(taskPlacement->nodeName, taskPlacement->nodePort);
+
 		queryOK = SendQueryInSingleRowMode(connection, queryString, paramListInfo);
-		if (!queryOK)
+		if (queryOK)
 		{
-			continue;
+			queryOK = StoreQueryResult(routerState, connection, tupleDescriptor,
+									   dontFailOnError, &currentAffectedTupleCount,
+									   NULL);
 		}
 
-		queryOK = StoreQueryResult(routerState, connection, tupleDescriptor,
-								   dontFailOnError, &currentAffectedTupleCount);
+		NodeTaskFinished(taskPlacement->nodeName, taskPlacement->nodePort,
+						 taskStartTime, queryOK);
+
 		if (queryOK)
 		{
 			return;
@@ -681,6 +740,12 @@ ExecuteSingleModifyTask(QueryDesc *queryDesc, Task *task,
 	bool startedInTransaction =
 		InCoordinatedTransaction() && XactModificationLevel == XACT_MODIFICATION_DATA;
 
+	/* parameters of the task were already resolved into its query string */
+	if (task->parametersInQueryStringResolved)
+	{
+		paramListInfo = NULL;
+	}
+
 	if (XactModificationLevel == XACT_MODIFICATION_MULTI_SHARD)
 	{
 		ereport(ERROR, (errcode(ERRCODE_ACTIVE_SQL_TRANSACTION),
@@ -762,12 +827,12 @@ ExecuteSingleModifyTask(QueryDesc *queryDesc, Task *task,
 		if (!gotResults && expectResults)
 		{
 			queryOK = StoreQueryResult(routerState, connection, tupleDescriptor,
-									   failOnError, &currentAffectedTupleCount);
+									   failOnError, &currentAffectedTupleCount, NULL);
 		}
 		else
 		{
 			queryOK = ConsumeQueryResult(connection, failOnError,
-										 &currentAffectedTupleCount);
+										 &currentAffectedTupleCount, NULL);
 		}
 
 		if (queryOK)
@@ -930,9 +995,16 @@ ExecuteModifyTasksWithoutResults(List *taskList)
  * ExecuteModifyTasks executes a list of tasks on remote nodes, and
  * optionally retrieves the results and stores them in a tuple store.
  *
+ * The commands of all tasks are sent right away, unless that would exceed
+ * citus.max_concurrent_modify_tasks_per_node on a node. Whenever a command
+ * finishes, the task's next placement, or another task waiting for the node,
+ * gets its command. Thus a slow placement only delays the tasks that wait for
+ * it, and not the whole modification.
+ *
  * If a task fails on one of the placements, the transaction rolls back.
  * Otherwise, the changes are committed using 2PC when the local transaction
- * commits.
+ * commits. If several placements fail, the error of the one that would come
+ * first when executing the placements in rounds, in task order, is reported.
  */
 static int64
 ExecuteModifyTasks(List *taskList, bool expectResults, ParamListInfo paramListInfo,
@@ -943,10 +1015,14 @@ ExecuteModifyTasks(List *taskList, bool expectResults, ParamListInfo paramListIn
 	Task *firstTask = NULL;
 	int connectionFlags = 0;
 	List *shardIntervalList = NIL;
-	List *affectedTupleCountList = NIL;
 	HTAB *shardConnectionHash = NULL;
-	bool tasksPending = true;
-	int placementIndex = 0;
+	int taskCount = list_length(taskList);
+	ModifyTaskState *taskStateArray = NULL;
+	int taskIndex = 0;
+	MultiConnection *failedConnection = NULL;
+	PGresult *failedResult = NULL;
+	int failedPlacementIndex = 0;
+	int failedTaskIndex = 0;
 
 	if (taskList == NIL)
 	{
@@ -991,74 +1067,85 @@ ExecuteModifyTasks(List *taskList, bool expectResults, ParamListInfo paramListIn
 
 	XactModificationLevel = XACT_MODIFICATION_MULTI_SHARD;
 
-	/* iterate over placements in rounds, to ensure in-order execution */
-	while (tasksPending)
+	taskStateArray = (ModifyTaskState *) palloc0(taskCount * sizeof(ModifyTaskState));
+
+	foreach(taskCell, taskList)
 	{
-		int taskIndex = 0;
+		Task *task = (Task *) lfirst(taskCell);
+		ModifyTaskState *taskState = &taskStateArray[taskIndex];
+		bool shardConnectionsFound = false;
+		ShardConnections *shardConnections =
+			GetShardHashConnections(shardConnectionHash, task->anchorShardId,
+									&shardConnectionsFound);
 
-		tasksPending = false;
+		taskState->task = task;
+		taskState->connectionList = shardConnections->connectionList;
 
-		/* send command to all shard placements with the current index in parallel */
-		foreach(taskCell, taskList)
+		taskIndex++;
+	}
+
+	while (true)
+	{
+		List *pendingConnectionList = NIL;
+
+		for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
 		{
-			Task *task = (Task *) lfirst(taskCell);
-			int64 shardId = task->anchorShardId;
-			char *queryString = task->queryString;
-			bool shardConnectionsFound = false;
-			ShardConnections *shardConnections = NULL;
-			List *connectionList = NIL;
-			MultiConnection *connection = NULL;
-			bool queryOK = false;
-
-			shardConnections = GetShardHashConnections(shardConnectionHash, shardId,
-													   &shardConnectionsFound);
-			connectionList = shardConnections->connectionList;
-
-			if (placementIndex >= list_length(connectionList))
+			MultiConnection *pendingConnection =
+				taskStateArray[taskIndex].pendingConnection;
+
+			if (pendingConnection != NULL)
 			{
-				/* no more active placements for this task */
-				continue;
+				pendingConnectionList = lappend(pendingConnectionList,
+												pendingConnection);
 			}
+		}
 
-			connection =
-				(MultiConnection *) list_nth(connectionList, placementIndex);
+		/*
+		 * Send commands to the placements which are next in line. After a
+		 * failure, only placements which precede the failed one in the
+		 * round-based order are still modified, to find the error to report.
+		 */
+		for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
+		{
+			ModifyTaskState *taskState = &taskStateArray[taskIndex];
+
+			if (failedResult != NULL &&
+				!ExecutionOrderPrecedes(taskState->placementIndex, taskIndex,
+										failedPlacementIndex, failedTaskIndex))
+			{
+				continue;
+			}
 
-			queryOK = SendQueryInSingleRowMode(connection, queryString, paramListInfo);
-			if (!queryOK)
+			if (SendNextModifyTaskCommand(taskState, pendingConnectionList,
+										  paramListInfo))
 			{
-				ReportConnectionError(connection, ERROR);
+				pendingConnectionList = lappend(pendingConnectionList,
+												taskState->pendingConnection);
 			}
 		}
 
-		/* collects results from all relevant shard placements */
-		foreach(taskCell, taskList)
+		if (pendingConnectionList == NIL)
 		{
-			Task *task = (Task *) lfirst(taskCell);
-			int64 shardId = task->anchorShardId;
-			bool shardConnectionsFound = false;
-			ShardConnections *shardConnections = NULL;
-			List *connectionList = NIL;
-			MultiConnection *connection = NULL;
-			int64 currentAffectedTupleCount = 0;
-			bool failOnError = true;
-			bool queryOK PG_USED_FOR_ASSERTS_ONLY = false;
+			break;
+		}
 
-			/* abort in case of cancellation */
-			CHECK_FOR_INTERRUPTS();
+		WaitForAnyRemoteCommandResult(pendingConnectionList);
 
-			shardConnections = GetShardHashConnections(shardConnectionHash, shardId,
-													   &shardConnectionsFound);
-			connectionList = shardConnections->connectionList;
+		/* collect the results of all finished commands */
+		for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
+		{
+			ModifyTaskState *taskState = &taskStateArray[taskIndex];
+			MultiConnection *connection = taskState->pendingConnection;
+			int placementIndex = taskState->placementIndex;
+			int64 currentAffectedTupleCount = 0;
+			bool failOnError = true;
+			PGresult *errorResult = NULL;
 
-			if (placementIndex >= list_length(connectionList))
+			if (connection == NULL || !RemoteCommandResultAvailable(connection))
 			{
-				/* no more active placements for this task */
-				taskIndex++;
 				continue;
 			}
 
-			connection = (MultiConnection *) list_nth(connectionList, placementIndex);
-
 			/*
 			 * If caller is interested, store query results the first time
 			 * through. The output of the query's execution on other shards is
@@ -1068,54 +1155,67 @@ ExecuteModifyTasks(List *taskList, bool expectResults, ParamListInfo paramListIn
 			{
 				Assert(routerState != NULL && tupleDescriptor != NULL);
 
-				queryOK = StoreQueryResult(routerState, connection, tupleDescriptor,
-										   failOnError, &currentAffectedTupleCount);
+				StoreQueryResult(routerState, connection, tupleDescriptor,
+								 failOnError, &currentAffectedTupleCount, &errorResult);
 			}
 			else
 			{
-				queryOK = ConsumeQueryResult(connection, failOnError,
-											 &currentAffectedTupleCount);
+				ConsumeQueryResult(connection, failOnError, &currentAffectedTupleCount,
+								   &errorResult);
 			}
 
-			/* should have rolled back on error */
-			Assert(queryOK);
+			taskState->pendingConnection = NULL;
+			taskState->placementIndex++;
 
-			if (placementIndex == 0)
+			if (errorResult != NULL)
+			{
+				/* remember the error to report, see the function comment */
+				if (failedResult == NULL ||
+					ExecutionOrderPrecedes(placementIndex, taskIndex,
+										   failedPlacementIndex, failedTaskIndex))
+				{
+					if (failedResult != NULL)
+					{
+						PQclear(failedResult);
+					}
+
+					failedConnection = connection;
+					failedResult = errorResult;
+					failedPlacementIndex = placementIndex;
+					failedTaskIndex = taskIndex;
+				}
+				else
+				{
+					PQclear(errorResult);
+				}
+			}
+			else if (placementIndex == 0)
 			{
 				totalAffectedTupleCount += currentAffectedTupleCount;
 
 				/* keep track of the initial affected tuple count */
-				affectedTupleCountList = lappend_int(affectedTupleCountList,
-													 currentAffectedTupleCount);
+				taskState->affectedTupleCount = currentAffectedTupleCount;
 			}
-			else
+			else if (currentAffectedTupleCount != taskState->affectedTupleCount)
 			{
 				/* warn the user if shard placements have diverged */
-				int64 previousAffectedTupleCount = list_nth_int(affectedTupleCountList,
-																taskIndex);
-
-				if (currentAffectedTupleCount != previousAffectedTupleCount)
-				{
-					ereport(WARNING,
-							(errmsg("modified "INT64_FORMAT " tuples of shard "
-									UINT64_FORMAT ", but expected to modify "INT64_FORMAT,
-									currentAffectedTupleCount, shardId,
-									previousAffectedTupleCount),
-							 errdetail("modified placement on %s:%d",
-									   connection->hostname, connection->port)));
-				}
-			}
-
-			if (!tasksPending && placementIndex + 1 < list_length(connectionList))
-			{
-				/* more tasks to be done after thise one */
-				tasksPending = true;
+				ereport(WARNING,
+						(errmsg("modified "INT64_FORMAT " tuples of shard "
+								UINT64_FORMAT ", but expected to modify "INT64_FORMAT,
+								currentAffectedTupleCount,
+								taskState->task->anchorShardId,
+								taskState->affectedTupleCount),
+						 errdetail("modified placement on %s:%d",
+								   connection->hostname, connection->port)));
 			}
-
-			taskIndex++;
 		}
 
-		placementIndex++;
+		list_free(pendingConnectionList);
+	}
+
+	if (failedResult != NULL)
+	{
+		ReportResultError(failedConnection, failedResult, ERROR);
 	}
 
 	UnclaimAllShardConnections(shardConnectionHash);
@@ -1126,6 +1226,100 @@ ExecuteModifyTasks(List *taskList, bool expectResults, ParamListInfo paramListIn
 }
 
 
+/*
+ * SendNextModifyTaskCommand sends the task's command to the next placement, if
+ * there is one, no command of the task is in progress, and the placement's
+ * node doesn't already have citus.max_concurrent_modify_tasks_per_node of the
+ * given pending commands. Returns true if the command was sent.
+ */
+static bool
+SendNextModifyTaskCommand(ModifyTaskState *taskState, List *pendingConnectionList,
+						  ParamListInfo paramListInfo)
+{
+	Task *task = taskState->task;
+	MultiConnection *connection = NULL;
+	bool queryOK = false;
+
+	if (taskState->pendingConnection != NULL ||
+		taskState->placementIndex >= list_length(taskState->connectionList))
+	{
+		return false;
+	}
+
+	connection = (MultiConnection *) list_nth(taskState->connectionList,
+											  taskState->placementIndex);
+
+	if (MaxConcurrentModifyTasksPerNode > 0 &&
+		PendingNodeCommandCount(pendingConnectionList, connection) >=
+		MaxConcurrentModifyTasksPerNode)
+	{
+		return false;
+	}
+
+	/* parameters of the task were already resolved into its query string */
+	if (task->parametersInQueryStringResolved)
+	{
+		paramListInfo = NULL;
+	}
+
+	queryOK = SendQueryInSingleRowMode(connection, task->queryString, paramListInfo);
+	if (!queryOK)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	taskState->pendingConnection = connection;
+
+	return true;
+}
+
+
+/*
+ * PendingNodeCommandCount returns the number of connections in the given list
+ * which are connected to the same node as the given connection.
+ */
+static int
+PendingNodeCommandCount(List *pendingConnectionList, MultiConnection *connection)
+{
+	ListCell *pendingConnectionCell = NULL;
+	int pendingCommandCount = 0;
+
+	foreach(pendingConnectionCell, pendingConnectionList)
+	{
+		MultiConnection *pendingConnection =
+			(MultiConnection *) lfirst(pendingConnectionCell);
+
+		if (pendingConnection->port == connection->port &&
+			strncmp(pendingConnection->hostname, connection->hostname,
+					MAX_NODE_LENGTH) == 0)
+		{
+			pendingCommandCount++;
+		}
+	}
+
+	return pendingCommandCount;
+}
+
+
+/*
+ * ExecutionOrderPrecedes returns true if the command on the left placement
+ * comes before the one on the right placement when executing the placements
+ * of all tasks in rounds, that is all first placements in task order, then all
+ * second placements, and so on.
+ */
+static bool
+ExecutionOrderPrecedes(int leftPlacementIndex, int leftTaskIndex,
+					   int rightPlacementIndex, int rightTaskIndex)
+{
+	if (leftPlacementIndex != rightPlacementIndex)
+	{
+		return leftPlacementIndex < rightPlacementIndex;
+	}
+
+	return leftTaskIndex < rightTaskIndex;
+}
+
+
 /*
  * TaskShardIntervalList returns a list of shard intervals for a given list of
  * tasks.
@@ -1214,8 +1408,8 @@ SendQueryInSingleRowMode(MultiConnection *connection, char *query,
 		ExtractParametersFromParamListInfo(paramListInfo, &parameterTypes,
 										   &parameterValues);
 
-		querySent = SendRemoteCommandParams(connection, query, parameterCount,
-											parameterTypes, parameterValues);
+		querySent = SendRemoteCachedCommandParams(connection, query, parameterCount,
+												  parameterTypes, parameterValues);
 	}
 	else
 	{
@@ -1316,10 +1510,15 @@ ExtractParametersFromParamListInfo(ParamListInfo paramListInfo, Oid **parameterT
  * tuple-store. If the function can't receive query results, it returns
  * false. Note that this function assumes the query has already been sent on
  * the connection.
+ *
+ * If errorResult is not NULL, errors are not reported. Instead, the first
+ * error result is returned in errorResult, and the caller has to report and
+ * clear it.
  */
 static bool
 StoreQueryResult(MaterialState *routerState, MultiConnection *connection,
-				 TupleDesc tupleDescriptor, bool failOnError, int64 *rows)
+				 TupleDesc tupleDescriptor, bool failOnError, int64 *rows,
+				 PGresult **errorResult)
 {
 	AttInMetadata *attributeInputMetadata = TupleDescGetAttInMetadata(tupleDescriptor);
 	Tuplestorestate *tupleStore = NULL;
@@ -1377,7 +1576,16 @@ StoreQueryResult(MaterialState *routerState, MultiConnection *connection,
 			category = ERRCODE_TO_CATEGORY(ERRCODE_INTEGRITY_CONSTRAINT_VIOLATION);
 			isConstraintViolation = SqlStateMatchesCategory(sqlStateString, category);
 
-			if (isConstraintViolation || failOnError)
+			if (errorResult != NULL)
+			{
+				/* the caller reports the error, keep only the first one */
+				if (*errorResult == NULL)
+				{
+					*errorResult = result;
+					result = NULL;
+				}
+			}
+			else if (isConstraintViolation || failOnError)
 			{
 				ReportResultError(connection, result, ERROR);
 			}
@@ -1445,10 +1653,11 @@ StoreQueryResult(MaterialState *routerState, MultiConnection *connection,
  * ConsumeQueryResult gets a query result from a connection, counting the rows
  * and checking for errors, but otherwise discarding potentially returned
  * rows.  Returns true if a non-error result has been returned, false if there
- * has been an error.
+ * has been an error. Errors are handled as in StoreQueryResult.
  */
 static bool
-ConsumeQueryResult(MultiConnection *connection, bool failOnError, int64 *rows)
+ConsumeQueryResult(MultiConnection *connection, bool failOnError, int64 *rows,
+				   PGresult **errorResult)
 {
 	bool commandFailed = false;
 	bool gotResponse = false;
@@ -1491,7 +1700,16 @@ ConsumeQueryResult(MultiConnection *connection, bool failOnError, int64 *rows)
 			category = ERRCODE_TO_CATEGORY(ERRCODE_INTEGRITY_CONSTRAINT_VIOLATION);
 			isConstraintViolation = SqlStateMatchesCategory(sqlStateString, category);
 
-			if (isConstraintViolation || failOnError)
+			if (errorResult != NULL)
+			{
+				/* the caller reports the error, keep only the first one */
+				if (*errorResult == NULL)
+				{
+					*errorResult = result;
+					result = NULL;
+				}
+			}
+			else if (isConstraintViolation || failOnError)
 			{
 				ReportResultError(connection, result, ERROR);
 			}
@@ -155,6 +155,7 @@ InitTaskExecution(Task *task, TaskExecStatus initialTaskExecStatus)
 	taskExecution->taskId = task->taskId;
 	taskExecution->nodeCount = nodeCount;
 	taskExecution->connectStartTime = 0;
+	taskExecution->poolWaitStartTime = 0;
 	taskExecution->currentNodeIndex = 0;
 	taskExecution->dataFetchTaskIndex = -1;
 	taskExecution->failureCount = 0;
@@ -31,6 +31,7 @@
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/pg_dist_partition.h"
+#include "distributed/shared_connection_pool.h"
 #include "distributed/worker_protocol.h"
 #include "storage/fd.h"
 #include "utils/builtins.h"
@@ -40,6 +41,13 @@
 
 int MaxAssignTaskBatchSize = 64; /* maximum number of tasks to assign per round */
 
+/*
+ * Number of check intervals for which task trackers may hold on to a task
+ * status query. Trackers answer as soon as one of the tasks finishes, so this
+ * only bounds the wait when no task finishes.
+ */
+#define TASK_STATUS_WAIT_INTERVALS 10
+
 /* TaskMapKey is used as a key in task hash */
 typedef struct TaskMapKey
 {
@@ -113,12 +121,14 @@ static void ReassignMapFetchTaskList(List *mapFetchTaskList);
 static List * ShardFetchTaskList(List *taskList);
 
 /* Local functions forward declarations to manage task trackers */
-static void ManageTaskTracker(TaskTracker *taskTracker);
+static void ManageTaskTracker(TaskTracker *taskTracker, int32 statusWaitTime);
 static bool TrackerConnectionUp(TaskTracker *taskTracker);
 static void TrackerReconnectPoll(TaskTracker *taskTracker);
 static List * AssignQueuedTasks(TaskTracker *taskTracker);
-static int32 NextRunningTaskIndex(List *assignedTaskList, int32 currentTaskIndex);
-static TaskStatus TaskStatusQueryResponse(int32 connectionId);
+static bool TrackerHasQueuedTasks(TaskTracker *taskTracker);
+static List * RunningTaskList(List *assignedTaskList);
+static StringInfo TaskStatusesQuery(List *taskStateList, int32 waitTime);
+static void TaskStatusesQueryResponse(int32 connectionId, List *taskStateList);
 static void ManageTransmitTracker(TaskTracker *transmitTracker);
 static TrackerTaskState * NextQueuedFileTransmit(HTAB *taskStateHash);
 
@@ -209,6 +219,8 @@ MultiTaskTrackerExecute(Job *job)
 		uint32 completedTransmitCount = 0;
 		uint32 healthyTrackerCount = 0;
 		double acceptableHealthyTrackerCount = 0.0;
+		bool unassignedTasksLeft = false;
+		int32 statusWaitTime = 0;
 
 		/* first, loop around all tasks and manage them */
 		ListCell *taskAndExecutionCell = NULL;
@@ -228,6 +240,12 @@ MultiTaskTrackerExecute(Job *job)
 			taskExecutionStatus = ManageTaskExecution(execTaskTracker, mapTaskTracker,
 													  task, taskExecution);
 
+			/* tasks still waiting on their dependencies get queued later */
+			if (taskExecutionStatus == EXEC_TASK_UNASSIGNED)
+			{
+				unassignedTasksLeft = true;
+			}
+
 			/*
 			 * If task cannot execute on this task/map tracker, we fail over all
 			 * tasks in the same constraint group to the next task/map tracker.
@@ -345,6 +363,23 @@ MultiTaskTrackerExecute(Job *job)
 			}
 		}
 
+		/*
+		 * Task trackers hold on to our task status queries until one of the
+		 * checked tasks finishes. Tasks may however get queued for a tracker
+		 * while its query waits, for example when the map tasks a merge task
+		 * depends on finish on other nodes. We can't assign these tasks over
+		 * the busy connection, so we wait no longer than one check interval
+		 * while tasks wait on their dependencies.
+		 */
+		if (unassignedTasksLeft)
+		{
+			statusWaitTime = RemoteTaskCheckInterval;
+		}
+		else
+		{
+			statusWaitTime = RemoteTaskCheckInterval * TASK_STATUS_WAIT_INTERVALS;
+		}
+
 		/* third, loop around task trackers and manage them */
 		hash_seq_init(&taskStatus, taskTrackerHash);
 		hash_seq_init(&transmitStatus, transmitTrackerHash);
@@ -358,7 +393,7 @@ MultiTaskTrackerExecute(Job *job)
 				healthyTrackerCount++;
 			}
 
-			ManageTaskTracker(taskTracker);
+			ManageTaskTracker(taskTracker, statusWaitTime);
 
 			taskTracker = (TaskTracker *) hash_seq_search(&taskStatus);
 		}
@@ -773,7 +808,6 @@ TrackerHashEnter(HTAB *taskTrackerHash, char *nodeName, uint32 nodePort)
 	memcpy(taskTracker, &taskTrackerKey, sizeof(TaskTracker));
 	taskTracker->trackerStatus = TRACKER_CONNECT_START;
 	taskTracker->connectionId = INVALID_CONNECTION_ID;
-	taskTracker->currentTaskIndex = -1;
 
 	return taskTracker;
 }
@@ -838,9 +872,34 @@ TrackerConnectPoll(TaskTracker *taskTracker)
 			char *nodeName = taskTracker->workerName;
 			uint32 nodePort = taskTracker->workerPort;
 			char *nodeDatabase = get_database_name(MyDatabaseId);
+			int32 connectionId = INVALID_CONNECTION_ID;
+
+			/*
+			 * If all backends together hold the maximum number of connections
+			 * to the node, we try again in the next pass, for at most as long
+			 * as we would wait for the connection itself.
+			 */
+			if (!TryReserveSharedConnection(nodeName, nodePort))
+			{
+				uint32 maxCount =
+					ceil(NodeConnectionTimeout * 1.0f / RemoteTaskCheckInterval);
+
+				taskTracker->connectPollCount++;
+				if (taskTracker->connectPollCount >= maxCount)
+				{
+					ereport(WARNING, (errmsg("could not reserve a connection to "
+											 "%s:%u after %u ms", nodeName,
+											 nodePort, NodeConnectionTimeout)));
+
+					taskTracker->trackerStatus = TRACKER_CONNECTION_FAILED;
+				}
+
+				break;
+			}
+
+			taskTracker->connectPollCount = 0;
 
-			int32 connectionId = MultiClientConnectStart(nodeName, nodePort,
-														 nodeDatabase);
+			connectionId = MultiClientConnectStart(nodeName, nodePort, nodeDatabase);
 			if (connectionId != INVALID_CONNECTION_ID)
 			{
 				taskTracker->connectionId = connectionId;
@@ -2144,11 +2203,12 @@ ShardFetchTaskList(List *taskList)
  * ManageTaskTracker manages tasks assigned to the given task tracker. For this,
  * the function coordinates access to the underlying connection. The function
  * also: (1) synchronously assigns locally queued tasks to the task tracker, (2)
- * issues an asynchronous task status query for one assigned task at a time, and
- * (3) retrieves status query results for the previously issued status query.
+ * issues an asynchronous status query for all running tasks, which the task
+ * tracker holds on to for up to the given wait time in milliseconds, and (3)
+ * retrieves status query results for the previously issued status query.
  */
 static void
-ManageTaskTracker(TaskTracker *taskTracker)
+ManageTaskTracker(TaskTracker *taskTracker, int32 statusWaitTime)
 {
 	bool trackerConnectionUp = false;
 	bool trackerHealthy = false;
@@ -2179,46 +2239,52 @@ ManageTaskTracker(TaskTracker *taskTracker)
 	}
 
 	/*
-	 * (2) We find an assigned task. We then send an asynchronous query to check
-	 * task's status.
+	 * (2) We find all assigned tasks that are still running. We then send one
+	 * asynchronous query to check these tasks' statuses. The task tracker holds
+	 * on to this query until one of the tasks finishes. We can't assign new
+	 * tasks over the connection in the meantime, so we don't wait at all if we
+	 * have queued tasks left to assign.
 	 */
 	if (!taskTracker->connectionBusy)
 	{
-		List *assignedTaskList = taskTracker->assignedTaskList;
-		int32 currentTaskIndex = taskTracker->currentTaskIndex;
-		int32 nextTaskIndex = -1;
-
-		nextTaskIndex = NextRunningTaskIndex(assignedTaskList, currentTaskIndex);
-		taskTracker->currentTaskIndex = nextTaskIndex;
+		List *runningTaskList = RunningTaskList(taskTracker->assignedTaskList);
 
-		/* if we have a running task's index, check task's status */
-		if (nextTaskIndex != -1)
+		if (runningTaskList != NIL)
 		{
 			int32 connectionId = taskTracker->connectionId;
-			TrackerTaskState *taskState = NULL;
-			StringInfo taskStatusQuery = NULL;
+			StringInfo taskStatusesQuery = NULL;
 			bool querySent = false;
 
-			taskState = (TrackerTaskState *) list_nth(assignedTaskList, nextTaskIndex);
-			Assert(taskState != NULL);
+			int32 waitTime = statusWaitTime;
+
+			bool queuedTasksLeft = TrackerHasQueuedTasks(taskTracker);
+			if (queuedTasksLeft)
+			{
+				waitTime = 0;
+			}
 
-			taskStatusQuery = makeStringInfo();
-			appendStringInfo(taskStatusQuery, TASK_STATUS_QUERY,
-							 taskState->jobId, taskState->taskId);
+			taskStatusesQuery = TaskStatusesQuery(runningTaskList, waitTime);
 
-			querySent = MultiClientSendQuery(connectionId, taskStatusQuery->data);
+			querySent = MultiClientSendQuery(connectionId, taskStatusesQuery->data);
 			if (querySent)
 			{
 				taskTracker->connectionBusy = true;
-				taskTracker->connectionBusyOnTask = taskState;
+				taskTracker->connectionBusyOnTaskList = runningTaskList;
 			}
 			else
 			{
-				taskState->status = TASK_CLIENT_SIDE_STATUS_FAILED;
+				ListCell *taskStateCell = NULL;
+				foreach(taskStateCell, runningTaskList)
+				{
+					TrackerTaskState *taskState = lfirst(taskStateCell);
+					taskState->status = TASK_CLIENT_SIDE_STATUS_FAILED;
+				}
 
-				taskTracker->connectionBusy = false;
-				taskTracker->connectionBusyOnTask = NULL;
+				list_free(runningTaskList);
 			}
+
+			pfree(taskStatusesQuery->data);
+			pfree(taskStatusesQuery);
 		}
 	}
 
@@ -2229,25 +2295,32 @@ ManageTaskTracker(TaskTracker *taskTracker)
 	{
 		int32 connectionId = taskTracker->connectionId;
 		ResultStatus resultStatus = CLIENT_INVALID_RESULT_STATUS;
-		TrackerTaskState *taskState = taskTracker->connectionBusyOnTask;
-		Assert(taskState != NULL);
+		List *taskStateList = taskTracker->connectionBusyOnTaskList;
+		Assert(taskStateList != NIL);
 
-		/* if connection is available, update task status accordingly */
+		/* if connection is available, update task statuses accordingly */
 		resultStatus = MultiClientResultStatus(connectionId);
 		if (resultStatus == CLIENT_RESULT_READY)
 		{
-			taskState->status = TaskStatusQueryResponse(connectionId);
+			TaskStatusesQueryResponse(connectionId, taskStateList);
 		}
 		else if (resultStatus == CLIENT_RESULT_UNAVAILABLE)
 		{
-			taskState->status = TASK_CLIENT_SIDE_STATUS_FAILED;
+			ListCell *taskStateCell = NULL;
+			foreach(taskStateCell, taskStateList)
+			{
+				TrackerTaskState *taskState = lfirst(taskStateCell);
+				taskState->status = TASK_CLIENT_SIDE_STATUS_FAILED;
+			}
 		}
 
 		/* if connection is available, give it back to the task tracker */
 		if (resultStatus != CLIENT_RESULT_BUSY)
 		{
 			taskTracker->connectionBusy = false;
-			taskTracker->connectionBusyOnTask = NULL;
+			taskTracker->connectionBusyOnTaskList = NIL;
+
+			list_free(taskStateList);
 		}
 	}
 }
@@ -2406,109 +2479,166 @@ AssignQueuedTasks(TaskTracker *taskTracker)
 
 
 /*
- * NextRunningTaskIndex walks over the tasks in the given list, and looks for a
- * task that was still running as of the last time we checked. If such a task
- * exists (before wrapping around the assigned task list), the function returns
- * that task's index in the list. Else, the function returns -1 to signal either
- * no such task exists or that the function may be called again to search from
- * the beginning of the task list.
+ * TrackerHasQueuedTasks returns true if the given task tracker has tasks that
+ * are queued for assignment.
  */
-static int32
-NextRunningTaskIndex(List *assignedTaskList, int32 currentTaskIndex)
+static bool
+TrackerHasQueuedTasks(TaskTracker *taskTracker)
 {
-	int32 nextTaskIndex = -1;
-	int32 lastTaskIndex = -1;
-	int32 assignedTaskIndex = 0;
-	ListCell *assignedTaskCell = NULL;
+	bool queuedTasksLeft = false;
 
-	int32 assignedTaskCount = list_length(assignedTaskList);
-	if (assignedTaskCount == 0)
-	{
-		return -1;
-	}
+	HASH_SEQ_STATUS status;
+	TrackerTaskState *taskState = NULL;
+	hash_seq_init(&status, taskTracker->taskStateHash);
 
-	lastTaskIndex = (assignedTaskCount - 1);
-	if (currentTaskIndex >= lastTaskIndex)
+	taskState = (TrackerTaskState *) hash_seq_search(&status);
+	while (taskState != NULL)
 	{
-		currentTaskIndex = -1;
+		if (taskState->status == TASK_CLIENT_SIDE_QUEUED)
+		{
+			queuedTasksLeft = true;
+
+			hash_seq_term(&status);
+			break;
+		}
+
+		taskState = (TrackerTaskState *) hash_seq_search(&status);
 	}
 
-	assignedTaskCell = NULL;
+	return queuedTasksLeft;
+}
+
+
+/*
+ * RunningTaskList walks over the tasks in the given list, and returns a new
+ * list with the tasks that are still running.
+ */
+static List *
+RunningTaskList(List *assignedTaskList)
+{
+	List *runningTaskList = NIL;
+	ListCell *assignedTaskCell = NULL;
+
 	foreach(assignedTaskCell, assignedTaskList)
 	{
 		TrackerTaskState *assignedTask = (TrackerTaskState *) lfirst(assignedTaskCell);
 		TaskStatus taskStatus = assignedTask->status;
 
 		/* task tracker retries tasks that only failed once (task_failed) */
-		bool taskRunning = false;
 		if (taskStatus == TASK_ASSIGNED || taskStatus == TASK_SCHEDULED ||
 			taskStatus == TASK_RUNNING || taskStatus == TASK_FAILED)
 		{
-			taskRunning = true;
+			runningTaskList = lappend(runningTaskList, assignedTask);
 		}
+	}
+
+	return runningTaskList;
+}
+
+
+/*
+ * TaskStatusesQuery builds the query that checks the statuses of the given
+ * tasks, and waits on the worker node for up to the given number of
+ * milliseconds for one of the tasks to finish.
+ */
+static StringInfo
+TaskStatusesQuery(List *taskStateList, int32 waitTime)
+{
+	StringInfo taskStatusesQuery = makeStringInfo();
+	StringInfo jobIdArrayString = makeStringInfo();
+	StringInfo taskIdArrayString = makeStringInfo();
+	ListCell *taskStateCell = NULL;
+
+	appendStringInfoChar(jobIdArrayString, '{');
+	appendStringInfoChar(taskIdArrayString, '{');
 
-		if (taskRunning && (assignedTaskIndex > currentTaskIndex))
+	foreach(taskStateCell, taskStateList)
+	{
+		TrackerTaskState *taskState = (TrackerTaskState *) lfirst(taskStateCell);
+
+		if (taskStateCell != list_head(taskStateList))
 		{
-			nextTaskIndex = assignedTaskIndex;
-			break;
+			appendStringInfoChar(jobIdArrayString, ',');
+			appendStringInfoChar(taskIdArrayString, ',');
 		}
 
-		assignedTaskIndex++;
+		appendStringInfo(jobIdArrayString, UINT64_FORMAT, taskState->jobId);
+		appendStringInfo(taskIdArrayString, "%u", taskState->taskId);
 	}
 
-	/*
-	 * We might have wrapped around the assigned task list and found nothing. If
-	 * that's the case, we'll start looking from the beginning next time.
-	 */
-	return nextTaskIndex;
+	appendStringInfoChar(jobIdArrayString, '}');
+	appendStringInfoChar(taskIdArrayString, '}');
+
+	appendStringInfo(taskStatusesQuery, TASK_STATUSES_QUERY, jobIdArrayString->data,
+					 taskIdArrayString->data, waitTime);
+
+	return taskStatusesQuery;
 }
 
 
 /*
- * TaskStatusQueryResponse assumes that a task status query has been previously
- * sent on the given connection, and reads the response for this status query.
+ * TaskStatusesQueryResponse assumes that a task statuses query has been
+ * previously sent on the given connection for the given tasks. The function
+ * reads the task statuses, which come in the same order as the tasks, and
+ * updates the tasks accordingly. Tasks that the task tracker couldn't find, or
+ * whose statuses we couldn't read, are marked as failed on the client side.
  */
-static TaskStatus
-TaskStatusQueryResponse(int32 connectionId)
+static void
+TaskStatusesQueryResponse(int32 connectionId, List *taskStateList)
 {
-	TaskStatus taskStatus = TASK_STATUS_INVALID_FIRST;
 	void *queryResult = NULL;
 	int rowCount = 0;
 	int columnCount = 0;
+	int rowIndex = 0;
+	ListCell *taskStateCell = NULL;
 
 	bool resultReceived = MultiClientQueryResult(connectionId, &queryResult,
 												 &rowCount, &columnCount);
-	if (resultReceived)
+	if (resultReceived && rowCount != list_length(taskStateList))
 	{
-		char *valueString = MultiClientGetValue(queryResult, 0, 0);
-		if (valueString == NULL || (*valueString) == '\0')
-		{
-			taskStatus = TASK_PERMANENTLY_FAILED;
-		}
-		else
+		resultReceived = false;
+	}
+
+	foreach(taskStateCell, taskStateList)
+	{
+		TrackerTaskState *taskState = (TrackerTaskState *) lfirst(taskStateCell);
+		TaskStatus taskStatus = TASK_CLIENT_SIDE_STATUS_FAILED;
+
+		if (resultReceived)
 		{
+			char *valueString = MultiClientGetValue(queryResult, rowIndex, 0);
 			char *valueStringEnd = NULL;
 			errno = 0;
 
-			taskStatus = strtoul(valueString, &valueStringEnd, 0);
-			if (errno != 0 || (*valueStringEnd) != '\0')
+			if (valueString != NULL && (*valueString) != '\0')
+			{
+				taskStatus = strtoul(valueString, &valueStringEnd, 0);
+				if (errno != 0 || (*valueStringEnd) != '\0')
+				{
+					/* we couldn't parse received integer */
+					taskStatus = TASK_PERMANENTLY_FAILED;
+				}
+			}
+			else
 			{
-				/* we couldn't parse received integer */
 				taskStatus = TASK_PERMANENTLY_FAILED;
 			}
 
+			/* the task tracker couldn't find the task */
+			if (taskStatus == TASK_STATUS_INVALID_FIRST)
+			{
+				taskStatus = TASK_CLIENT_SIDE_STATUS_FAILED;
+			}
+
 			Assert(taskStatus > TASK_STATUS_INVALID_FIRST);
 			Assert(taskStatus < TASK_STATUS_LAST);
 		}
-	}
-	else
-	{
-		taskStatus = TASK_CLIENT_SIDE_STATUS_FAILED;
+
+		taskState->status = taskStatus;
+		rowIndex++;
 	}
 
 	MultiClientClearResult(queryResult);
-
-	return taskStatus;
 }
 
 
@@ -2713,6 +2843,9 @@ TrackerHashWaitActiveRequest(HTAB *taskTrackerHash)
 			{
 				taskTracker->connectionBusy = false;
 				taskTracker->connectionBusyOnTask = NULL;
+
+				list_free(taskTracker->connectionBusyOnTaskList);
+				taskTracker->connectionBusyOnTaskList = NIL;
 			}
 		}
 
@@ -18,10 +18,13 @@
 #include "access/heapam.h"
 #include "access/htup_details.h"
 #include "catalog/pg_am.h"
+#include "distributed/master_metadata_utility.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_join_order.h"
 #include "distributed/multi_physical_planner.h"
+#include "distributed/multi_server_executor.h"
 #include "distributed/pg_dist_partition.h"
+#include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "lib/stringinfo.h"
 #include "optimizer/var.h"
@@ -36,6 +39,7 @@
 /* Config variables managed via guc.c */
 int LargeTableShardCount = 4;   /* shard counts for a large table */
 bool LogMultiJoinOrder = false; /* print join order as a debugging aid */
+bool EnableCostBasedJoinOrder = false; /* rank join rules by data transfer */
 
 /* Function pointer type definition for join rule evaluation functions */
 typedef JoinOrderNode *(*RuleEvalFunction) (JoinOrderNode *currentJoinNode,
@@ -51,6 +55,7 @@ static RuleEvalFunction RuleEvalFunctionArray[JOIN_RULE_LAST] = { 0 }; /* join r
 /* Local functions forward declarations */
 static JoinOrderNode * CreateFirstJoinOrderNode(FromExpr *fromExpr,
 												List *tableEntryList);
+static JoinOrderNode * MakeFirstJoinOrderNode(TableEntry *firstTable);
 static bool JoinExprListWalker(Node *node, List **joinList);
 static bool ExtractLeftMostRangeTableIndex(Node *node, int *rangeTableIndex);
 static List * MergeShardIntervals(List *leftShardIntervalList,
@@ -63,10 +68,13 @@ static List * BestJoinOrder(List *candidateJoinOrders);
 static List * FewestOfJoinRuleType(List *candidateJoinOrders, JoinRuleType ruleType);
 static uint32 JoinRuleTypeCount(List *joinOrder, JoinRuleType ruleTypeToCount);
 static List * LatestLargeDataTransfer(List *candidateJoinOrders);
+static List * LeastDataTransfer(List *candidateJoinOrders);
+static double JoinOrderTransferSize(List *joinOrder);
 static void PrintJoinOrderList(List *joinOrder);
 static uint32 LargeDataTransferLocation(List *joinOrder);
 static List * TableEntryListDifference(List *lhsTableList, List *rhsTableList);
 static TableEntry * FindTableEntry(List *tableEntryList, uint32 tableId);
+static bool CostBasedJoinOrder(void);
 
 /* Local functions forward declarations for join evaluations */
 static JoinOrderNode * EvaluateJoinRules(List *joinedTableList,
@@ -74,6 +82,10 @@ static JoinOrderNode * EvaluateJoinRules(List *joinedTableList,
 										 TableEntry *candidateTable,
 										 List *candidateShardList,
 										 List *joinClauseList, JoinType joinType);
+static bool PreferJoinOrderNode(JoinOrderNode *joinNode, JoinOrderNode *bestJoinNode);
+static void EstimateDataTransfer(JoinOrderNode *currentJoinNode,
+								 JoinOrderNode *nextJoinNode, double candidateSize);
+static double ShardListDataSize(List *shardIntervalList);
 static List * RangeTableIdList(List *tableList);
 static RuleEvalFunction JoinRuleEvalFunction(JoinRuleType ruleType);
 static char * JoinRuleName(JoinRuleType ruleType);
@@ -280,24 +292,43 @@ CreateFirstJoinOrderNode(FromExpr *fromExpr, List *tableEntryList)
 {
 	JoinOrderNode *firstJoinNode = NULL;
 	TableEntry *firstTable = NULL;
-	JoinRuleType firstJoinRule = JOIN_RULE_INVALID_FIRST;
-	Var *firstPartitionColumn = NULL;
-	char firstPartitionMethod = '\0';
 	int rangeTableIndex = 0;
 
 	ExtractLeftMostRangeTableIndex((Node *) fromExpr, &rangeTableIndex);
 
 	firstTable = FindTableEntry(tableEntryList, rangeTableIndex);
 
-	firstPartitionColumn = PartitionColumn(firstTable->relationId,
-										   firstTable->rangeTableId);
-	firstPartitionMethod = PartitionMethod(firstTable->relationId);
+	firstJoinNode = MakeFirstJoinOrderNode(firstTable);
+
+	return firstJoinNode;
+}
+
+
+/*
+ * MakeFirstJoinOrderNode constructs the join order node for the first table in
+ * a join order, along with the table's shards. If cost based join ordering is
+ * enabled, the function also estimates the table's size from these shards.
+ */
+static JoinOrderNode *
+MakeFirstJoinOrderNode(TableEntry *firstTable)
+{
+	JoinOrderNode *firstJoinNode = NULL;
+	JoinRuleType firstJoinRule = JOIN_RULE_INVALID_FIRST;
+	Oid firstRelationId = firstTable->relationId;
+	Var *firstPartitionColumn = PartitionColumn(firstRelationId,
+												firstTable->rangeTableId);
+	char firstPartitionMethod = PartitionMethod(firstRelationId);
 
 	firstJoinNode = MakeJoinOrderNode(firstTable, firstJoinRule,
 									  firstPartitionColumn,
 									  firstPartitionMethod);
 
-	firstJoinNode->shardIntervalList = LoadShardIntervalList(firstTable->relationId);
+	firstJoinNode->shardIntervalList = LoadShardIntervalList(firstRelationId);
+
+	if (CostBasedJoinOrder())
+	{
+		firstJoinNode->dataSize = ShardListDataSize(firstJoinNode->shardIntervalList);
+	}
 
 	return firstJoinNode;
 }
@@ -649,29 +680,22 @@ JoinOrderList(List *tableEntryList, List *joinClauseList)
  * JoinOrderForTable creates a join order whose first element is the given first
  * table. To determine each subsequent element in the join order, the function
  * then chooses the table that has the lowest ranking join rule, and with which
- * it can join the table to the previous table in the join order. The function
- * repeats this until it determines all elements in the join order list, and
- * returns this list.
+ * it can join the table to the previous table in the join order. If cost based
+ * join ordering is enabled, the function instead chooses the table whose join
+ * rule moves the fewest bytes. The function repeats this until it determines
+ * all elements in the join order list, and returns this list.
  */
 static List *
 JoinOrderForTable(TableEntry *firstTable, List *tableEntryList, List *joinClauseList)
 {
 	JoinOrderNode *currentJoinNode = NULL;
-	JoinRuleType firstJoinRule = JOIN_RULE_INVALID_FIRST;
 	List *joinOrderList = NIL;
 	List *joinedTableList = NIL;
 	int joinedTableCount = 1;
 	int totalTableCount = list_length(tableEntryList);
 
 	/* create join node for the first table */
-	Oid firstRelationId = firstTable->relationId;
-	uint32 firstTableId = firstTable->rangeTableId;
-	Var *firstPartitionColumn = PartitionColumn(firstRelationId, firstTableId);
-	char firstPartitionMethod = PartitionMethod(firstRelationId);
-
-	JoinOrderNode *firstJoinNode = MakeJoinOrderNode(firstTable, firstJoinRule,
-													 firstPartitionColumn,
-													 firstPartitionMethod);
+	JoinOrderNode *firstJoinNode = MakeFirstJoinOrderNode(firstTable);
 
 	/* add first node to the join order */
 	joinOrderList = list_make1(firstJoinNode);
@@ -685,7 +709,6 @@ JoinOrderForTable(TableEntry *firstTable, List *tableEntryList, List *joinClause
 		ListCell *pendingTableCell = NULL;
 		JoinOrderNode *nextJoinNode = NULL;
 		TableEntry *nextJoinedTable = NULL;
-		JoinRuleType nextJoinRuleType = JOIN_RULE_LAST;
 
 		pendingTableList = TableEntryListDifference(tableEntryList, joinedTableList);
 
@@ -698,7 +721,6 @@ JoinOrderForTable(TableEntry *firstTable, List *tableEntryList, List *joinClause
 		{
 			TableEntry *pendingTable = (TableEntry *) lfirst(pendingTableCell);
 			JoinOrderNode *pendingJoinNode = NULL;
-			JoinRuleType pendingJoinRuleType = JOIN_RULE_LAST;
 			JoinType joinType = JOIN_INNER;
 			List *candidateShardList = LoadShardIntervalList(pendingTable->relationId);
 
@@ -708,11 +730,9 @@ JoinOrderForTable(TableEntry *firstTable, List *tableEntryList, List *joinClause
 												joinClauseList, joinType);
 
 			/* if this rule is better than previous ones, keep it */
-			pendingJoinRuleType = pendingJoinNode->joinRuleType;
-			if (pendingJoinRuleType < nextJoinRuleType)
+			if (PreferJoinOrderNode(pendingJoinNode, nextJoinNode))
 			{
 				nextJoinNode = pendingJoinNode;
-				nextJoinRuleType = pendingJoinRuleType;
 			}
 		}
 
@@ -736,7 +756,10 @@ JoinOrderForTable(TableEntry *firstTable, List *tableEntryList, List *joinClause
  * best join order among these candidates. The function uses two heuristics for
  * this. First, the function chooses join orders that have the fewest number of
  * join operators that cause large data transfers. Second, the function chooses
- * join orders where large data transfers occur later in the execution.
+ * join orders where large data transfers occur later in the execution. If cost
+ * based join ordering is enabled, the function first keeps join orders that
+ * have the fewest cartesian products and move the fewest estimated bytes, and
+ * uses the two heuristics above only to break ties.
  */
 static List *
 BestJoinOrder(List *candidateJoinOrders)
@@ -746,6 +769,13 @@ BestJoinOrder(List *candidateJoinOrders)
 	uint32 highestValidIndex = JOIN_RULE_LAST - 1;
 	uint32 candidateCount PG_USED_FOR_ASSERTS_ONLY = 0;
 
+	if (CostBasedJoinOrder())
+	{
+		candidateJoinOrders = FewestOfJoinRuleType(candidateJoinOrders,
+												   CARTESIAN_PRODUCT);
+		candidateJoinOrders = LeastDataTransfer(candidateJoinOrders);
+	}
+
 	/*
 	 * We start with the highest ranking rule type (cartesian product), and walk
 	 * over these rules in reverse order. For each rule type, we then keep join
@@ -876,6 +906,55 @@ LatestLargeDataTransfer(List *candidateJoinOrders)
 }
 
 
+/*
+ * LeastDataTransfer finds and returns join orders that move the fewest estimated
+ * bytes across the network, summed over all join rules in the join order.
+ */
+static List *
+LeastDataTransfer(List *candidateJoinOrders)
+{
+	List *leastJoinOrders = NIL;
+	double leastTransferSize = 0.0;
+	ListCell *joinOrderCell = NULL;
+
+	foreach(joinOrderCell, candidateJoinOrders)
+	{
+		List *joinOrder = (List *) lfirst(joinOrderCell);
+		double transferSize = JoinOrderTransferSize(joinOrder);
+
+		if (leastJoinOrders != NIL && transferSize == leastTransferSize)
+		{
+			leastJoinOrders = lappend(leastJoinOrders, joinOrder);
+		}
+		else if (leastJoinOrders == NIL || transferSize < leastTransferSize)
+		{
+			leastJoinOrders = list_make1(joinOrder);
+			leastTransferSize = transferSize;
+		}
+	}
+
+	return leastJoinOrders;
+}
+
+
+/* Sums the estimated data transfer of all join rules in the join order. */
+static double
+JoinOrderTransferSize(List *joinOrder)
+{
+	double transferSize = 0.0;
+	ListCell *joinOrderNodeCell = NULL;
+
+	foreach(joinOrderNodeCell, joinOrder)
+	{
+		JoinOrderNode *joinOrderNode = (JoinOrderNode *) lfirst(joinOrderNodeCell);
+
+		transferSize += joinOrderNode->transferSize;
+	}
+
+	return transferSize;
+}
+
+
 /*
  * LargeDataTransferLocation finds the first location of a large data transfer
  * join rule, and returns that location. If the join order does not have any
@@ -999,11 +1078,28 @@ FindTableEntry(List *tableEntryList, uint32 tableId)
 }
 
 
+/*
+ * CostBasedJoinOrder returns whether join rules and join orders are ranked by
+ * their estimated data transfer. Cost based ranking often prefers repartition
+ * joins, which only the task-tracker executor runs; for other executors, we
+ * therefore keep ranking join rules by their type.
+ */
+static bool
+CostBasedJoinOrder(void)
+{
+	return EnableCostBasedJoinOrder && TaskExecutorType == MULTI_EXECUTOR_TASK_TRACKER;
+}
+
+
 /*
  * EvaluateJoinRules takes in a list of already joined tables and a candidate
  * next table, evaluates different join rules between the two tables, and finds
- * the best join rule that applies. The function returns the applicable join
- * order node which includes the join rule and the partition information.
+ * the best join rule that applies. By default, the best rule is the first one
+ * that applies in rule order. If cost based join ordering is enabled and the
+ * join is an inner join, the function evaluates all rules and picks the one
+ * that moves the fewest estimated bytes instead. The function returns the
+ * applicable join order node which includes the join rule and the partition
+ * information.
  */
 static JoinOrderNode *
 EvaluateJoinRules(List *joinedTableList, JoinOrderNode *currentJoinNode,
@@ -1017,6 +1113,8 @@ EvaluateJoinRules(List *joinedTableList, JoinOrderNode *currentJoinNode,
 	uint32 lowestValidIndex = JOIN_RULE_INVALID_FIRST + 1;
 	uint32 highestValidIndex = JOIN_RULE_LAST - 1;
 	uint32 ruleIndex = 0;
+	bool costBasedJoinRule = (CostBasedJoinOrder() && joinType == JOIN_INNER);
+	double candidateSize = 0.0;
 
 	/*
 	 * We first find all applicable join clauses between already joined tables
@@ -1027,20 +1125,49 @@ EvaluateJoinRules(List *joinedTableList, JoinOrderNode *currentJoinNode,
 	applicableJoinClauses = ApplicableJoinClauses(joinedTableIdList, candidateTableId,
 												  joinClauseList);
 
+	if (costBasedJoinRule)
+	{
+		candidateSize = ShardListDataSize(candidateShardList);
+	}
+
 	/* we then evaluate all join rules in order */
 	for (ruleIndex = lowestValidIndex; ruleIndex <= highestValidIndex; ruleIndex++)
 	{
 		JoinRuleType ruleType = (JoinRuleType) ruleIndex;
 		RuleEvalFunction ruleEvalFunction = JoinRuleEvalFunction(ruleType);
 
-		nextJoinNode = (*ruleEvalFunction)(currentJoinNode,
+		JoinOrderNode *ruleJoinNode = NULL;
+
+		/* cartesian products are only a catch-all for cost based join rules */
+		if (costBasedJoinRule && ruleType == CARTESIAN_PRODUCT && nextJoinNode != NULL)
+		{
+			break;
+		}
+
+		ruleJoinNode = (*ruleEvalFunction)(currentJoinNode,
 										   candidateTable,
 										   candidateShardList,
 										   applicableJoinClauses,
 										   joinType);
+		if (ruleJoinNode == NULL)
+		{
+			continue;
+		}
+
+		if (costBasedJoinRule)
+		{
+			EstimateDataTransfer(currentJoinNode, ruleJoinNode, candidateSize);
+		}
+
+		/* on ties, the join rule that comes first in rule order wins */
+		if (nextJoinNode == NULL ||
+			ruleJoinNode->transferSize < nextJoinNode->transferSize)
+		{
+			nextJoinNode = ruleJoinNode;
+		}
 
 		/* break after finding the first join rule that applies */
-		if (nextJoinNode != NULL)
+		if (!costBasedJoinRule)
 		{
 			break;
 		}
@@ -1053,6 +1180,143 @@ EvaluateJoinRules(List *joinedTableList, JoinOrderNode *currentJoinNode,
 }
 
 
+/*
+ * PreferJoinOrderNode returns true if the given join order node should replace
+ * the best join order node found so far for the next table in the join order.
+ * Join rules that appear earlier in rule order are preferred. If cost based
+ * join ordering is enabled, cartesian products are avoided first, and the node
+ * that moves fewer estimated bytes is preferred next.
+ */
+static bool
+PreferJoinOrderNode(JoinOrderNode *joinNode, JoinOrderNode *bestJoinNode)
+{
+	if (bestJoinNode == NULL)
+	{
+		return true;
+	}
+
+	if (CostBasedJoinOrder())
+	{
+		bool cartesianProduct = (joinNode->joinRuleType == CARTESIAN_PRODUCT);
+		bool bestCartesianProduct = (bestJoinNode->joinRuleType == CARTESIAN_PRODUCT);
+
+		if (cartesianProduct != bestCartesianProduct)
+		{
+			return bestCartesianProduct;
+		}
+
+		if (joinNode->transferSize != bestJoinNode->transferSize)
+		{
+			return joinNode->transferSize < bestJoinNode->transferSize;
+		}
+	}
+
+	return joinNode->joinRuleType < bestJoinNode->joinRuleType;
+}
+
+
+/*
+ * EstimateDataTransfer estimates the number of bytes that the next join order
+ * node's join rule moves across the network, and the number of bytes in the
+ * join result after the join. The estimates are based on shard sizes recorded
+ * in the metadata, and assume that joins neither filter nor multiply rows. The
+ * function stores the estimates in the next join order node.
+ */
+static void
+EstimateDataTransfer(JoinOrderNode *currentJoinNode, JoinOrderNode *nextJoinNode,
+					 double candidateSize)
+{
+	double currentSize = currentJoinNode->dataSize;
+	double transferSize = 0.0;
+	TableEntry *candidateTable = nextJoinNode->tableEntry;
+	Oid candidateRelationId = candidateTable->relationId;
+
+	switch (nextJoinNode->joinRuleType)
+	{
+		case BROADCAST_JOIN:
+		case CARTESIAN_PRODUCT:
+		{
+			/* reference tables already have a copy on every worker node */
+			if (PartitionMethod(candidateRelationId) != DISTRIBUTE_BY_NONE)
+			{
+				transferSize = candidateSize * WorkerGetLiveNodeCount();
+			}
+			break;
+		}
+
+		case LOCAL_PARTITION_JOIN:
+		{
+			transferSize = 0.0;
+			break;
+		}
+
+		case SINGLE_PARTITION_JOIN:
+		{
+			Var *candidatePartitionColumn =
+				PartitionColumn(candidateRelationId, candidateTable->rangeTableId);
+
+			/* the side that isn't partitioned on the join column is repartitioned */
+			if (equal(nextJoinNode->partitionColumn, candidatePartitionColumn))
+			{
+				transferSize = currentSize;
+			}
+			else
+			{
+				transferSize = candidateSize;
+			}
+			break;
+		}
+
+		case DUAL_PARTITION_JOIN:
+		{
+			transferSize = currentSize + candidateSize;
+			break;
+		}
+
+		default:
+		{
+			ereport(ERROR, (errmsg("unrecognized join rule type: %d",
+								   nextJoinNode->joinRuleType)));
+			break;
+		}
+	}
+
+	nextJoinNode->dataSize = currentSize + candidateSize;
+	nextJoinNode->transferSize = transferSize;
+}
+
+
+/*
+ * ShardListDataSize sums up the lengths of the shards in the given list, using
+ * the length recorded for the first finalized placement of each shard. Shards
+ * whose lengths haven't been collected, or that have no finalized placements,
+ * count as empty.
+ */
+static double
+ShardListDataSize(List *shardIntervalList)
+{
+	double dataSize = 0.0;
+	ListCell *shardIntervalCell = NULL;
+
+	foreach(shardIntervalCell, shardIntervalList)
+	{
+		ShardInterval *shardInterval = (ShardInterval *) lfirst(shardIntervalCell);
+		List *shardPlacementList = FinalizedShardPlacementList(shardInterval->shardId);
+		ShardPlacement *shardPlacement = NULL;
+
+		if (shardPlacementList == NIL)
+		{
+			continue;
+		}
+
+		shardPlacement = (ShardPlacement *) linitial(shardPlacementList);
+		dataSize += (double) shardPlacement->shardLength;
+	}
+
+	return dataSize;
+}
+
+
 /* Extracts range table identifiers from the given table list, and returns them. */
 static List *
 RangeTableIdList(List *tableList)
@@ -22,6 +22,7 @@
 #include "catalog/namespace.h"
 #include "catalog/pg_aggregate.h"
 #include "catalog/pg_am.h"
+#include "catalog/pg_collation.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
 #include "commands/extension.h"
@@ -54,6 +55,7 @@
 /* Config variable managed via guc.c */
 int LimitClauseRowFetchCount = -1; /* number of rows to fetch from each task */
 double CountDistinctErrorRate = 0.0; /* precision of count(distinct) approximate */
+bool EnableApproximatePercentiles = false; /* approximate percentile_cont() */
 
 
 typedef struct MasterAggregateWalkerContext
@@ -118,13 +120,20 @@ static Expr * MasterAggregateExpression(Aggref *originalAggregate,
 										MasterAggregateWalkerContext *walkerContext);
 static Expr * MasterAverageExpression(Oid sumAggregateType, Oid countAggregateType,
 									  AttrNumber *columnId);
+static Aggref * MasterSketchUnionAggregate(AggregateType unionAggregateType,
+										   Oid sketchType, AttrNumber *columnId);
 static Expr * AddTypeConversion(Node *originalAggregate, Node *newExpression);
-static MultiExtendedOp * WorkerExtendedOpNode(MultiExtendedOp *originalOpNode);
+static MultiExtendedOp * WorkerExtendedOpNode(MultiExtendedOp *originalOpNode,
+											   bool groupedByDisjointPartitionColumn);
 static bool WorkerAggregateWalker(Node *node,
 								  WorkerAggregateWalkerContext *walkerContext);
 static List * WorkerAggregateExpressionList(Aggref *originalAggregate,
 											WorkerAggregateWalkerContext *walkerContextry);
 static AggregateType GetAggregateType(Oid aggFunctionId);
+static bool CombinableAggregate(Oid aggFunctionId);
+#if (PG_VERSION_NUM >= 90600)
+static bool TypeHasBinaryFunctions(Oid typeId);
+#endif
 static Oid AggregateArgumentType(Aggref *aggregate);
 static Oid AggregateFunctionOid(const char *functionName, Oid inputType);
 static Oid TypeOid(Oid schemaId, const char *typeName);
@@ -134,10 +143,15 @@ static char * CountDistinctHashFunctionName(Oid argumentType);
 static int CountDistinctStorageSize(double approximationErrorRate);
 static Const * MakeIntegerConst(int32 integerValue);
 static Const * MakeIntegerConstInt64(int64 integerValue);
+static Const * MakeOidConst(Oid oidValue);
+static Const * MakeRegProcedureConst(Oid functionId);
 
 /* Local functions forward declarations for aggregate expression checks */
 static void ErrorIfContainsUnsupportedAggregate(MultiNode *logicalPlanNode);
 static void ErrorIfUnsupportedArrayAggregate(Aggref *arrayAggregateExpression);
+static void ErrorIfUnsupportedCombineAggregate(Aggref *combineAggregateExpression);
+static void ErrorIfUnsupportedPercentileAggregate(Aggref *percentileExpression);
+static bool PercentileOrderedDescending(Aggref *percentileExpression);
 static void ErrorIfUnsupportedAggregateDistinct(Aggref *aggregateExpression,
 												MultiNode *logicalPlanNode);
 static Var * AggregateDistinctColumn(Aggref *aggregateExpression);
@@ -145,6 +159,8 @@ static bool TablePartitioningSupportsDistinct(List *tableNodeList,
 											  MultiExtendedOp *opNode,
 											  Var *distinctColumn);
 static bool GroupedByColumn(List *groupClauseList, List *targetList, Var *column);
+static bool GroupedByDisjointPartitionColumn(List *tableNodeList,
+											 MultiExtendedOp *opNode);
 
 /* Local functions forward declarations for subquery pushdown checks */
 static void ErrorIfContainsUnsupportedSubquery(MultiNode *logicalPlanNode);
@@ -168,12 +184,19 @@ static bool EqualOpExpressionLists(List *firstOpExpressionList,
 								   List *secondOpExpressionList);
 
 /* Local functions forward declarations for limit clauses */
-static Node * WorkerLimitCount(MultiExtendedOp *originalOpNode);
-static List * WorkerSortClauseList(MultiExtendedOp *originalOpNode);
+static Node * WorkerLimitCount(MultiExtendedOp *originalOpNode,
+							   bool groupedByDisjointPartitionColumn);
+static List * WorkerSortClauseList(MultiExtendedOp *originalOpNode,
+								   bool groupedByDisjointPartitionColumn);
+static bool CanPushDownLimitExactly(MultiExtendedOp *originalOpNode,
+									bool groupedByDisjointPartitionColumn);
 static bool CanPushDownLimitApproximate(List *sortClauseList, List *targetList);
+static bool WorkersSortByAggregates(List *sortClauseList, List *targetList);
 static bool HasOrderByAggregate(List *sortClauseList, List *targetList);
 static bool HasOrderByAverage(List *sortClauseList, List *targetList);
+static bool HasOrderByPartialAggregate(List *sortClauseList, List *targetList);
 static bool HasOrderByComplexExpression(List *sortClauseList, List *targetList);
+static bool HasOrderByApproximateDistinct(List *sortClauseList, List *targetList);
 static bool HasOrderByHllType(List *sortClauseList, List *targetList);
 
 
@@ -194,6 +217,7 @@ void
 MultiLogicalPlanOptimize(MultiTreeRoot *multiLogicalPlan)
 {
 	bool hasOrderByHllType = false;
+	bool groupedByDisjointPartitionColumn = false;
 	List *selectNodeList = NIL;
 	List *projectNodeList = NIL;
 	List *collectNodeList = NIL;
@@ -271,12 +295,16 @@ MultiLogicalPlanOptimize(MultiTreeRoot *multiLogicalPlan)
 	extendedOpNodeList = FindNodesOfType(logicalPlanNode, T_MultiExtendedOp);
 	extendedOpNode = (MultiExtendedOp *) linitial(extendedOpNodeList);
 
+	tableNodeList = FindNodesOfType(logicalPlanNode, T_MultiTable);
+	groupedByDisjointPartitionColumn =
+		GroupedByDisjointPartitionColumn(tableNodeList, extendedOpNode);
+
 	masterExtendedOpNode = MasterExtendedOpNode(extendedOpNode);
-	workerExtendedOpNode = WorkerExtendedOpNode(extendedOpNode);
+	workerExtendedOpNode = WorkerExtendedOpNode(extendedOpNode,
+												groupedByDisjointPartitionColumn);
 
 	ApplyExtendedOpNodes(extendedOpNode, masterExtendedOpNode, workerExtendedOpNode);
 
-	tableNodeList = FindNodesOfType(logicalPlanNode, T_MultiTable);
 	foreach(tableNodeCell, tableNodeList)
 	{
 		MultiTable *tableNode = (MultiTable *) lfirst(tableNodeCell);
@@ -1177,7 +1205,7 @@ TransformSubqueryNode(MultiTable *subqueryNode)
 	MultiNode *collectNode = ChildNode((MultiUnaryNode *) extendedOpNode);
 	MultiNode *collectChildNode = ChildNode((MultiUnaryNode *) collectNode);
 	MultiExtendedOp *masterExtendedOpNode = MasterExtendedOpNode(extendedOpNode);
-	MultiExtendedOp *workerExtendedOpNode = WorkerExtendedOpNode(extendedOpNode);
+	MultiExtendedOp *workerExtendedOpNode = WorkerExtendedOpNode(extendedOpNode, false);
 	MultiPartition *partitionNode = CitusMakeNode(MultiPartition);
 	List *groupClauseList = extendedOpNode->groupClauseList;
 	List *targetEntryList = extendedOpNode->targetList;
@@ -1613,6 +1641,131 @@ MasterAggregateExpression(Aggref *originalAggregate,
 
 		newMasterExpression = (Expr *) newMasterAggregate;
 	}
+	else if (aggregateType == AGGREGATE_TDIGEST_ADD ||
+			 aggregateType == AGGREGATE_TDIGEST_UNION)
+	{
+		/*
+		 * T-digests are handled in two steps. First, worker nodes compute the
+		 * digests over their shards. Then, the master node merges these digests
+		 * using the tdigest_union_agg() aggregate.
+		 */
+		Oid workerReturnType = exprType((Node *) originalAggregate);
+
+		newMasterExpression = (Expr *) MasterSketchUnionAggregate(
+			AGGREGATE_TDIGEST_UNION, workerReturnType, &(walkerContext->columnId));
+	}
+	else if (aggregateType == AGGREGATE_TOPN_ADD ||
+			 aggregateType == AGGREGATE_TOPN_UNION)
+	{
+		/*
+		 * Top-n summaries are handled like t-digests; the master node merges
+		 * the workers' summaries using the topn_union_agg() aggregate.
+		 */
+		Oid workerReturnType = exprType((Node *) originalAggregate);
+
+		newMasterExpression = (Expr *) MasterSketchUnionAggregate(
+			AGGREGATE_TOPN_UNION, workerReturnType, &(walkerContext->columnId));
+	}
+	else if (aggregateType == AGGREGATE_PERCENTILE_CONT)
+	{
+		/*
+		 * If enabled, we approximate percentiles using t-digests. For this, we
+		 * first compute tdigest_add_agg(column) on worker nodes. We then merge
+		 * these digests on the master node, and compute the percentile using
+		 * tdigest_percentile(tdigest_union_agg(digest), fraction).
+		 */
+		const int percentileArgumentCount = 2;
+		Aggref *unionAggregate = NULL;
+		FuncExpr *percentileExpression = NULL;
+		Expr *fractionExpression = NULL;
+
+		unionAggregate = MasterSketchUnionAggregate(AGGREGATE_TDIGEST_UNION,
+													FLOAT8ARRAYOID,
+													&(walkerContext->columnId));
+
+		/* the fraction doesn't reference any columns; so we can copy it as is */
+		fractionExpression = (Expr *) copyObject(
+			linitial(originalAggregate->aggdirectargs));
+
+		/*
+		 * The digest orders values ascending. A percentile of values ordered
+		 * descending is therefore the digest's 1 - fraction percentile.
+		 */
+		if (PercentileOrderedDescending(originalAggregate))
+		{
+			FuncExpr *subtractExpression = makeNode(FuncExpr);
+			Const *oneConst = makeConst(FLOAT8OID, -1, InvalidOid, sizeof(float8),
+										Float8GetDatum(1.0), false, FLOAT8PASSBYVAL);
+
+			subtractExpression->funcid = F_FLOAT8MI;
+			subtractExpression->funcresulttype = FLOAT8OID;
+			subtractExpression->funcformat = COERCE_EXPLICIT_CALL;
+			subtractExpression->args = list_make2(oneConst, fractionExpression);
+			subtractExpression->location = -1;
+
+			fractionExpression = (Expr *) subtractExpression;
+		}
+
+		percentileExpression = makeNode(FuncExpr);
+		percentileExpression->funcid = FunctionOid("pg_catalog",
+												   TDIGEST_PERCENTILE_FUNC_NAME,
+												   percentileArgumentCount);
+		percentileExpression->funcresulttype = FLOAT8OID;
+		percentileExpression->funcformat = COERCE_EXPLICIT_CALL;
+		percentileExpression->args = list_make2(unionAggregate, fractionExpression);
+		percentileExpression->location = -1;
+
+		newMasterExpression = (Expr *) percentileExpression;
+	}
+	else if (aggregateType == AGGREGATE_COMBINE)
+	{
+		/*
+		 * For other aggregates that can combine partial states, worker nodes
+		 * report their serialized transition states. The master node then
+		 * computes master_combine_agg(), which combines these states and applies
+		 * the original aggregate's final function. The function's last argument
+		 * is a NULL of the original return type, and determines the return type
+		 * of master_combine_agg().
+		 */
+		const int combineArgumentCount = 3;
+		const AttrNumber stateArgumentId = 2;
+		const AttrNumber typeArgumentId = 3;
+		Var *column = NULL;
+		Const *aggregateIdConst = NULL;
+		Const *returnTypeConst = NULL;
+		List *combineArgumentList = NIL;
+		Aggref *newMasterAggregate = NULL;
+
+		Oid returnType = exprType((Node *) originalAggregate);
+		int32 returnTypeMod = exprTypmod((Node *) originalAggregate);
+		Oid returnCollationId = exprCollation((Node *) originalAggregate);
+
+		column = makeVar(masterTableId, walkerContext->columnId, BYTEAOID, -1,
+						 InvalidOid, columnLevelsUp);
+		walkerContext->columnId++;
+
+		aggregateIdConst = MakeOidConst(originalAggregate->aggfnoid);
+		returnTypeConst = makeNullConst(returnType, returnTypeMod, returnCollationId);
+
+		combineArgumentList = list_make3(
+			makeTargetEntry((Expr *) aggregateIdConst, argumentId, NULL, false),
+			makeTargetEntry((Expr *) column, stateArgumentId, NULL, false),
+			makeTargetEntry((Expr *) returnTypeConst, typeArgumentId, NULL, false));
+
+		newMasterAggregate = copyObject(originalAggregate);
+		newMasterAggregate->aggfnoid = FunctionOid("pg_catalog",
+												   MASTER_COMBINE_AGGREGATE_NAME,
+												   combineArgumentCount);
+		newMasterAggregate->args = combineArgumentList;
+		newMasterAggregate->aggfilter = NULL;
+#if (PG_VERSION_NUM >= 90600)
+		newMasterAggregate->aggtranstype = InvalidOid;
+		newMasterAggregate->aggargtypes = list_make3_oid(OIDOID, BYTEAOID, returnType);
+		newMasterAggregate->aggsplit = AGGSPLIT_SIMPLE;
+#endif
+
+		newMasterExpression = (Expr *) newMasterAggregate;
+	}
 	else
 	{
 		/*
@@ -1747,6 +1900,49 @@ MasterAverageExpression(Oid sumAggregateType, Oid countAggregateType,
 }
 
 
+/*
+ * MasterSketchUnionAggregate creates the aggregate that merges the sketches
+ * which worker nodes computed in the given column. The union aggregate type
+ * determines how we merge the sketches.
+ */
+static Aggref *
+MasterSketchUnionAggregate(AggregateType unionAggregateType, Oid sketchType,
+						   AttrNumber *columnId)
+{
+	const char *unionAggregateName = AggregateNames[unionAggregateType];
+	const uint32 masterTableId = 1;
+	const int32 defaultTypeMod = -1;
+	const Index defaultLevelsUp = 0;
+	const AttrNumber argumentId = 1;
+
+	Oid sketchTypeCollationId = get_typcollation(sketchType);
+	Var *sketchColumn = NULL;
+	TargetEntry *sketchTargetEntry = NULL;
+	Aggref *unionAggregate = NULL;
+
+	sketchColumn = makeVar(masterTableId, (*columnId), sketchType, defaultTypeMod,
+						   sketchTypeCollationId, defaultLevelsUp);
+	sketchTargetEntry = makeTargetEntry((Expr *) sketchColumn, argumentId, NULL, false);
+	(*columnId)++;
+
+	unionAggregate = makeNode(Aggref);
+	unionAggregate->aggfnoid = AggregateFunctionOid(unionAggregateName, sketchType);
+	unionAggregate->aggtype = get_func_rettype(unionAggregate->aggfnoid);
+	unionAggregate->aggcollid = sketchTypeCollationId;
+	unionAggregate->args = list_make1(sketchTargetEntry);
+	unionAggregate->aggkind = AGGKIND_NORMAL;
+	unionAggregate->aggfilter = NULL;
+	unionAggregate->location = -1;
+#if (PG_VERSION_NUM >= 90600)
+	unionAggregate->aggtranstype = InvalidOid;
+	unionAggregate->aggargtypes = list_make1_oid(sketchType);
+	unionAggregate->aggsplit = AGGSPLIT_SIMPLE;
+#endif
+
+	return unionAggregate;
+}
+
+
 /*
  * AddTypeConversion checks if the given expressions generate the same types. If
  * they don't, the function adds a type conversion function on top of the new
@@ -1782,13 +1978,16 @@ AddTypeConversion(Node *originalAggregate, Node *newExpression)
  * with aggregates in them, this function calls the recursive aggregate walker
  * function to create aggregates for the worker nodes. Also, the function checks
  * if we can push down the limit to worker nodes; and if we can, sets the limit
- * count and sort clause list fields in the new operator node. It provides special
+ * count and sort clause list fields in the new operator node. When results are
+ * grouped by a disjoint partition column, each group lies within one task, and
+ * worker nodes may also apply limits on aggregates exactly. It provides special
  * treatment for count distinct operator if it is used in repartition subqueries.
  * Each column in count distinct aggregate is added to target list, and group by
  * list of worker extended operator.
  */
 static MultiExtendedOp *
-WorkerExtendedOpNode(MultiExtendedOp *originalOpNode)
+WorkerExtendedOpNode(MultiExtendedOp *originalOpNode,
+					 bool groupedByDisjointPartitionColumn)
 {
 	MultiExtendedOp *workerExtendedOpNode = NULL;
 	MultiNode *parentNode = ParentNode((MultiNode *) originalOpNode);
@@ -1942,8 +2141,10 @@ WorkerExtendedOpNode(MultiExtendedOp *originalOpNode)
 	workerExtendedOpNode->groupClauseList = groupClauseList;
 
 	/* if we can push down the limit, also set related fields */
-	workerExtendedOpNode->limitCount = WorkerLimitCount(originalOpNode);
-	workerExtendedOpNode->sortClauseList = WorkerSortClauseList(originalOpNode);
+	workerExtendedOpNode->limitCount =
+		WorkerLimitCount(originalOpNode, groupedByDisjointPartitionColumn);
+	workerExtendedOpNode->sortClauseList =
+		WorkerSortClauseList(originalOpNode, groupedByDisjointPartitionColumn);
 
 	return workerExtendedOpNode;
 }
@@ -2123,6 +2324,71 @@ WorkerAggregateExpressionList(Aggref *originalAggregate,
 		workerAggregateList = lappend(workerAggregateList, sumAggregate);
 		workerAggregateList = lappend(workerAggregateList, countAggregate);
 	}
+	else if (aggregateType == AGGREGATE_PERCENTILE_CONT)
+	{
+		/*
+		 * If the original aggregate is a percentile approximation, we want to
+		 * compute tdigest_add_agg(column) on worker nodes, where the column is
+		 * the percentile's ordering column.
+		 */
+		const AttrNumber argumentId = 1;
+		TargetEntry *argument = (TargetEntry *) linitial(originalAggregate->args);
+		TargetEntry *digestArgument = makeTargetEntry(copyObject(argument->expr),
+													  argumentId, NULL, false);
+
+		Aggref *addAggregate = makeNode(Aggref);
+		addAggregate->aggfnoid = AggregateFunctionOid(
+			AggregateNames[AGGREGATE_TDIGEST_ADD], FLOAT8OID);
+		addAggregate->aggtype = FLOAT8ARRAYOID;
+		addAggregate->args = list_make1(digestArgument);
+		addAggregate->aggkind = AGGKIND_NORMAL;
+		addAggregate->aggfilter = (Expr *) copyObject(originalAggregate->aggfilter);
+		addAggregate->location = -1;
+#if (PG_VERSION_NUM >= 90600)
+		addAggregate->aggtranstype = InvalidOid;
+		addAggregate->aggargtypes = list_make1_oid(FLOAT8OID);
+		addAggregate->aggsplit = AGGSPLIT_SIMPLE;
+#endif
+
+		workerAggregateList = lappend(workerAggregateList, addAggregate);
+	}
+	else if (aggregateType == AGGREGATE_COMBINE)
+	{
+		/*
+		 * For other aggregates that can combine partial states, we compute
+		 * worker_partial_agg(aggregate oid, argument) on worker nodes. This
+		 * returns the serialized transition state of the original aggregate.
+		 * Aggregate oids differ between nodes, so we pass the aggregate as a
+		 * regprocedure, which deparses to its qualified name and signature,
+		 * and which the worker node resolves to its own oid.
+		 */
+		const int partialArgumentCount = 2;
+		const AttrNumber firstArgumentId = 1;
+		const AttrNumber secondArgumentId = 2;
+
+		Aggref *partialAggregate = copyObject(originalAggregate);
+		Oid argumentType = AggregateArgumentType(originalAggregate);
+		TargetEntry *argument = (TargetEntry *) linitial(partialAggregate->args);
+		Const *aggregateIdConst = MakeRegProcedureConst(originalAggregate->aggfnoid);
+		TargetEntry *aggregateIdArgument = makeTargetEntry((Expr *) aggregateIdConst,
+														   firstArgumentId, NULL, false);
+
+		argument->resno = secondArgumentId;
+
+		partialAggregate->aggfnoid = FunctionOid("pg_catalog",
+												 WORKER_PARTIAL_AGGREGATE_NAME,
+												 partialArgumentCount);
+		partialAggregate->aggtype = BYTEAOID;
+		partialAggregate->aggcollid = InvalidOid;
+		partialAggregate->args = list_make2(aggregateIdArgument, argument);
+#if (PG_VERSION_NUM >= 90600)
+		partialAggregate->aggtranstype = InvalidOid;
+		partialAggregate->aggargtypes = list_make2_oid(REGPROCEDUREOID, argumentType);
+		partialAggregate->aggsplit = AGGSPLIT_SIMPLE;
+#endif
+
+		workerAggregateList = lappend(workerAggregateList, partialAggregate);
+	}
 	else
 	{
 		/*
@@ -2181,6 +2447,12 @@ GetAggregateType(Oid aggFunctionId)
 
 	if (!found)
 	{
+		/* other aggregates are supported if we can combine their partial states */
+		if (CombinableAggregate(aggFunctionId))
+		{
+			return AGGREGATE_COMBINE;
+		}
+
 		ereport(ERROR, (errmsg("unsupported aggregate function %s", aggregateProcName)));
 	}
 
@@ -2188,6 +2460,95 @@ GetAggregateType(Oid aggFunctionId)
 }
 
 
+/*
+ * CombinableAggregate checks whether worker nodes can compute partial states of
+ * the given aggregate, and the master node can combine these states. This is
+ * the case for normal aggregates with a single argument, a combine function,
+ * and serialization functions for internal transition states. Since partial
+ * states are shipped in the transition type's binary format, the argument and
+ * transition types also need to be concrete types, and other transition types
+ * than internal need binary send and receive functions. Combine functions only
+ * exist as of PostgreSQL 9.6.
+ */
+static bool
+CombinableAggregate(Oid aggFunctionId)
+{
+	bool combinable = false;
+
+#if (PG_VERSION_NUM >= 90600)
+	HeapTuple aggregateTuple = NULL;
+	Form_pg_aggregate aggregateForm = NULL;
+	Oid *argumentTypeArray = NULL;
+	int argumentCount = 0;
+
+	get_func_signature(aggFunctionId, &argumentTypeArray, &argumentCount);
+	if (argumentCount != 1 || IsPolymorphicType(argumentTypeArray[0]) ||
+		argumentTypeArray[0] == ANYOID)
+	{
+		return false;
+	}
+
+	aggregateTuple = SearchSysCache1(AGGFNOID, ObjectIdGetDatum(aggFunctionId));
+	if (!HeapTupleIsValid(aggregateTuple))
+	{
+		return false;
+	}
+
+	aggregateForm = (Form_pg_aggregate) GETSTRUCT(aggregateTuple);
+	if (aggregateForm->aggkind == AGGKIND_NORMAL &&
+		OidIsValid(aggregateForm->aggcombinefn) &&
+		!IsPolymorphicType(aggregateForm->aggtranstype))
+	{
+		combinable = true;
+	}
+
+	if (aggregateForm->aggtranstype == INTERNALOID &&
+		(!OidIsValid(aggregateForm->aggserialfn) ||
+		 !OidIsValid(aggregateForm->aggdeserialfn)))
+	{
+		combinable = false;
+	}
+	else if (combinable && aggregateForm->aggtranstype != INTERNALOID &&
+			 !TypeHasBinaryFunctions(aggregateForm->aggtranstype))
+	{
+		combinable = false;
+	}
+
+	ReleaseSysCache(aggregateTuple);
+#endif
+
+	return combinable;
+}
+
+
+#if (PG_VERSION_NUM >= 90600)
+
+/*
+ * TypeHasBinaryFunctions returns true if the given type has both a binary send
+ * and a binary receive function.
+ */
+static bool
+TypeHasBinaryFunctions(Oid typeId)
+{
+	bool hasBinaryFunctions = false;
+	HeapTuple typeTuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(typeId));
+
+	if (HeapTupleIsValid(typeTuple))
+	{
+		Form_pg_type typeForm = (Form_pg_type) GETSTRUCT(typeTuple);
+
+		hasBinaryFunctions = (OidIsValid(typeForm->typsend) &&
+							  OidIsValid(typeForm->typreceive));
+
+		ReleaseSysCache(typeTuple);
+	}
+
+	return hasBinaryFunctions;
+}
+
+#endif
+
+
 /* Extracts the type of the argument over which the aggregate is operating. */
 static Oid
 AggregateArgumentType(Aggref *aggregate)
@@ -2419,6 +2780,43 @@ MakeIntegerConstInt64(int64 integerValue)
 }
 
 
+/* Makes an oid constant node from the given value, and returns that node. */
+static Const *
+MakeOidConst(Oid oidValue)
+{
+	const int typeCollationId = get_typcollation(OIDOID);
+	const int16 typeLength = get_typlen(OIDOID);
+	const int32 typeModifier = -1;
+	const bool typeIsNull = false;
+	const bool typePassByValue = true;
+
+	Datum oidDatum = ObjectIdGetDatum(oidValue);
+	Const *oidConst = makeConst(OIDOID, typeModifier, typeCollationId, typeLength,
+								oidDatum, typeIsNull, typePassByValue);
+
+	return oidConst;
+}
+
+
+/* Makes a regprocedure constant node for the given function, and returns it. */
+static Const *
+MakeRegProcedureConst(Oid functionId)
+{
+	const int typeCollationId = get_typcollation(REGPROCEDUREOID);
+	const int16 typeLength = get_typlen(REGPROCEDUREOID);
+	const int32 typeModifier = -1;
+	const bool typeIsNull = false;
+	const bool typePassByValue = true;
+
+	Datum functionIdDatum = ObjectIdGetDatum(functionId);
+	Const *functionIdConst = makeConst(REGPROCEDUREOID, typeModifier, typeCollationId,
+									   typeLength, functionIdDatum, typeIsNull,
+									   typePassByValue);
+
+	return functionIdConst;
+}
+
+
 /*
  * ErrorIfContainsUnsupportedAggregate extracts aggregate expressions from the
  * logical plan, walks over them and uses helper functions to check if we can
@@ -2472,6 +2870,14 @@ ErrorIfContainsUnsupportedAggregate(MultiNode *logicalPlanNode)
 		{
 			ErrorIfUnsupportedArrayAggregate(aggregateExpression);
 		}
+		else if (aggregateType == AGGREGATE_PERCENTILE_CONT)
+		{
+			ErrorIfUnsupportedPercentileAggregate(aggregateExpression);
+		}
+		else if (aggregateType == AGGREGATE_COMBINE)
+		{
+			ErrorIfUnsupportedCombineAggregate(aggregateExpression);
+		}
 		else if (aggregateExpression->aggdistinct)
 		{
 			ErrorIfUnsupportedAggregateDistinct(aggregateExpression, logicalPlanNode);
@@ -2504,6 +2910,115 @@ ErrorIfUnsupportedArrayAggregate(Aggref *arrayAggregateExpression)
 }
 
 
+/*
+ * ErrorIfUnsupportedCombineAggregate checks if we can compute the aggregate by
+ * combining partial states. Partial states of ordered and distinct aggregates
+ * can't be combined, so we error out for these.
+ */
+static void
+ErrorIfUnsupportedCombineAggregate(Aggref *combineAggregateExpression)
+{
+	char *aggregateName = get_func_name(combineAggregateExpression->aggfnoid);
+
+	if (combineAggregateExpression->aggorder)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("%s with order by is unsupported", aggregateName)));
+	}
+
+	if (combineAggregateExpression->aggdistinct)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("%s (distinct) is unsupported", aggregateName)));
+	}
+}
+
+
+/*
+ * ErrorIfUnsupportedPercentileAggregate checks if we can approximate the given
+ * percentile_cont() aggregate using t-digests. We only approximate single
+ * percentiles of double precision values, and the percentile fraction must not
+ * reference any columns.
+ */
+static void
+ErrorIfUnsupportedPercentileAggregate(Aggref *percentileExpression)
+{
+	Node *fractionExpression = NULL;
+	TargetEntry *argument = NULL;
+
+	if (!EnableApproximatePercentiles)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot compute percentile_cont exactly"),
+						errhint("Set citus.enable_approximate_percentiles to on "
+								"to approximate percentiles using t-digests.")));
+	}
+
+	fractionExpression = (Node *) linitial(percentileExpression->aggdirectargs);
+	if (exprType(fractionExpression) != FLOAT8OID)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot approximate percentile_cont"),
+						errdetail("Only single percentile fractions are supported.")));
+	}
+
+	if (contain_vars_of_level_or_above(fractionExpression, 0) ||
+		contain_agg_clause(fractionExpression))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot approximate percentile_cont"),
+						errdetail("Percentile fractions must not reference "
+								  "columns.")));
+	}
+
+	argument = (TargetEntry *) linitial(percentileExpression->args);
+	if (exprType((Node *) argument->expr) != FLOAT8OID)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot approximate percentile_cont"),
+						errdetail("Only percentiles of double precision values "
+								  "are supported.")));
+	}
+
+	/* errors out if the values are ordered by a custom operator */
+	PercentileOrderedDescending(percentileExpression);
+}
+
+
+/*
+ * PercentileOrderedDescending returns true if the given percentile_cont()
+ * aggregate orders its double precision values by the default descending
+ * operator, and false if it orders them by the default ascending operator. For
+ * any other ordering operator, the function errors out; the digest could then
+ * not tell which values the percentile refers to.
+ */
+static bool
+PercentileOrderedDescending(Aggref *percentileExpression)
+{
+	SortGroupClause *sortClause = NULL;
+	Oid lessThanOperator = InvalidOid;
+	Oid greaterThanOperator = InvalidOid;
+
+	sortClause = (SortGroupClause *) linitial(percentileExpression->aggorder);
+	get_sort_group_operators(FLOAT8OID, true, false, true, &lessThanOperator, NULL,
+							 &greaterThanOperator, NULL);
+
+	if (sortClause->sortop == greaterThanOperator)
+	{
+		return true;
+	}
+	else if (sortClause->sortop != lessThanOperator)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot approximate percentile_cont"),
+						errdetail("Only percentiles ordered by the default ascending "
+								  "or descending order are supported.")));
+	}
+
+	return false;
+}
+
+
 /*
  * ErrorIfUnsupportedAggregateDistinct checks if we can transform the aggregate
  * (distinct expression) and push it down to the worker node. It handles count
@@ -2798,6 +3313,33 @@ GroupedByColumn(List *groupClauseList, List *targetList, Var *column)
 }
 
 
+/*
+ * GroupedByDisjointPartitionColumn checks if the given extended operator node
+ * groups the rows of a single distributed table on the table's partition
+ * column, and the table's shards don't overlap on that column. If so, each
+ * group lies within one task, and worker nodes compute the final values of the
+ * group's aggregates.
+ */
+static bool
+GroupedByDisjointPartitionColumn(List *tableNodeList, MultiExtendedOp *opNode)
+{
+	MultiTable *tableNode = NULL;
+
+	if (opNode->groupClauseList == NIL || list_length(tableNodeList) != 1)
+	{
+		return false;
+	}
+
+	tableNode = (MultiTable *) linitial(tableNodeList);
+	if (tableNode->relationId == SUBQUERY_RELATION_ID)
+	{
+		return false;
+	}
+
+	return TablePartitioningSupportsDistinct(tableNodeList, opNode, NULL);
+}
+
+
 /*
  * ErrorIfContainsUnsupportedSubquery extracts subquery multi table from the
  * logical plan and uses helper functions to check if we can push down subquery
@@ -4367,9 +4909,16 @@ EqualOpExpressionLists(List *firstOpExpressionList, List *secondOpExpressionList
  *                       1/           \0
  *           has order by agg?          (no pd)
  *            1/           \0
- *     can approximate?    (exact pd)
- *      1/       \0
- * (approx pd)   (no pd)
+ *   groups within tasks?   (exact pd)
+ *      1/         \0
+ * (exact pd)  can approximate?
+ *               1/       \0
+ *          (approx pd)   (no pd)
+ *
+ * Groups lie within tasks when the query groups by the partition column of a
+ * table whose shards don't overlap, and worker nodes can then sort on the
+ * aggregates' final values, unless the query has a having clause or sorts on
+ * aggregates that are only finalized on the master node.
  *
  * When an offset is present, the offset value is added to limit because for a query
  * with LIMIT x OFFSET y, (x+y) records should be pulled from the workers.
@@ -4378,13 +4927,11 @@ EqualOpExpressionLists(List *firstOpExpressionList, List *secondOpExpressionList
  * returns null.
  */
 static Node *
-WorkerLimitCount(MultiExtendedOp *originalOpNode)
+WorkerLimitCount(MultiExtendedOp *originalOpNode, bool groupedByDisjointPartitionColumn)
 {
 	Node *workerLimitNode = NULL;
-	List *groupClauseList = originalOpNode->groupClauseList;
 	List *sortClauseList = originalOpNode->sortClauseList;
 	List *targetList = originalOpNode->targetList;
-	bool hasOrderByAggregate = HasOrderByAggregate(sortClauseList, targetList);
 	bool canPushDownLimit = false;
 	bool canApproximate = false;
 
@@ -4395,23 +4942,13 @@ WorkerLimitCount(MultiExtendedOp *originalOpNode)
 	}
 
 	/*
-	 * If we don't have group by clauses, or if we have order by clauses without
-	 * aggregates, we can push down the original limit. Else if we have order by
-	 * clauses with commutative aggregates, we can push down approximate limits.
+	 * If we can push down the original limit, we do so. Else if we have order
+	 * by clauses with commutative aggregates, we can push down approximate
+	 * limits.
 	 */
-	if (groupClauseList == NIL)
-	{
-		canPushDownLimit = true;
-	}
-	else if (sortClauseList == NIL)
-	{
-		canPushDownLimit = false;
-	}
-	else if (!hasOrderByAggregate)
-	{
-		canPushDownLimit = true;
-	}
-	else
+	canPushDownLimit = CanPushDownLimitExactly(originalOpNode,
+											   groupedByDisjointPartitionColumn);
+	if (!canPushDownLimit && sortClauseList != NIL)
 	{
 		canApproximate = CanPushDownLimitApproximate(sortClauseList, targetList);
 	}
@@ -4467,7 +5004,8 @@ WorkerLimitCount(MultiExtendedOp *originalOpNode)
  * the function returns null.
  */
 static List *
-WorkerSortClauseList(MultiExtendedOp *originalOpNode)
+WorkerSortClauseList(MultiExtendedOp *originalOpNode,
+					 bool groupedByDisjointPartitionColumn)
 {
 	List *workerSortClauseList = NIL;
 	List *groupClauseList = originalOpNode->groupClauseList;
@@ -4495,6 +5033,8 @@ WorkerSortClauseList(MultiExtendedOp *originalOpNode)
 	else if (sortClauseList != NIL)
 	{
 		bool orderByNonAggregates = !(HasOrderByAggregate(sortClauseList, targetList));
+		bool canPushDownExactly = CanPushDownLimitExactly(originalOpNode,
+														  groupedByDisjointPartitionColumn);
 		bool canApproximate = CanPushDownLimitApproximate(sortClauseList, targetList);
 
 		if (orderByNonAggregates)
@@ -4502,7 +5042,7 @@ WorkerSortClauseList(MultiExtendedOp *originalOpNode)
 			workerSortClauseList = list_copy(sortClauseList);
 			workerSortClauseList = list_concat(workerSortClauseList, groupClauseList);
 		}
-		else if (canApproximate)
+		else if (canPushDownExactly || canApproximate)
 		{
 			workerSortClauseList = originalOpNode->sortClauseList;
 		}
@@ -4512,6 +5052,45 @@ WorkerSortClauseList(MultiExtendedOp *originalOpNode)
 }
 
 
+/*
+ * CanPushDownLimitExactly checks if we can push down the original limit clause
+ * to the worker nodes. We can do this when the query doesn't group results, or
+ * when it orders the groups on group by clauses only. When each group lies
+ * within one task, we can also do this if the query orders groups on
+ * aggregates that worker nodes compute in their final form; then the first
+ * groups of each task contain the first groups overall.
+ */
+static bool
+CanPushDownLimitExactly(MultiExtendedOp *originalOpNode,
+						bool groupedByDisjointPartitionColumn)
+{
+	List *groupClauseList = originalOpNode->groupClauseList;
+	List *sortClauseList = originalOpNode->sortClauseList;
+	List *targetList = originalOpNode->targetList;
+
+	if (groupClauseList == NIL)
+	{
+		return true;
+	}
+	else if (sortClauseList == NIL)
+	{
+		return false;
+	}
+	else if (!HasOrderByAggregate(sortClauseList, targetList))
+	{
+		return true;
+	}
+
+	/* the master node evaluates the having clause, which may drop groups */
+	if (groupedByDisjointPartitionColumn && originalOpNode->havingQual == NULL)
+	{
+		return WorkersSortByAggregates(sortClauseList, targetList);
+	}
+
+	return false;
+}
+
+
 /*
  * CanPushDownLimitApproximate checks if we can push down the limit clause to
  * the worker nodes, and get approximate and meaningful results. We can do this
@@ -4531,23 +5110,33 @@ CanPushDownLimitApproximate(List *sortClauseList, List *targetList)
 
 	if (sortClauseList != NIL)
 	{
-		bool orderByAverage = HasOrderByAverage(sortClauseList, targetList);
-		bool orderByComplex = HasOrderByComplexExpression(sortClauseList, targetList);
-
-		/*
-		 * If we don't have any order by average or any complex expressions with
-		 * aggregates in them, we can meaningfully approximate.
-		 */
-		if (!orderByAverage && !orderByComplex)
-		{
-			canApproximate = true;
-		}
+		canApproximate = WorkersSortByAggregates(sortClauseList, targetList);
 	}
 
 	return canApproximate;
 }
 
 
+/*
+ * WorkersSortByAggregates checks if worker nodes can apply the given order by
+ * clauses on the aggregates they compute. If we don't have any order by
+ * average, by aggregates computed from partial states or sketches, by
+ * approximate count distincts, or any complex expressions with aggregates in
+ * them, the aggregates on worker nodes sort like their final values.
+ */
+static bool
+WorkersSortByAggregates(List *sortClauseList, List *targetList)
+{
+	bool orderByAverage = HasOrderByAverage(sortClauseList, targetList);
+	bool orderByPartial = HasOrderByPartialAggregate(sortClauseList, targetList);
+	bool orderByComplex = HasOrderByComplexExpression(sortClauseList, targetList);
+	bool orderByApproximate = HasOrderByApproximateDistinct(sortClauseList, targetList);
+
+	return (!orderByAverage && !orderByPartial && !orderByComplex &&
+			!orderByApproximate);
+}
+
+
 /*
  * HasOrderByAggregate walks over the given order by clauses, and checks if we
  * have an order by an aggregate function. If we do, the function returns true.
@@ -4608,6 +5197,46 @@ HasOrderByAverage(List *sortClauseList, List *targetList)
 }
 
 
+/*
+ * HasOrderByPartialAggregate walks over the given order by clauses, and checks
+ * if we have an order by an aggregate that worker nodes compute as a partial
+ * state or a sketch. Since these don't sort like the aggregate's results,
+ * worker nodes can't apply the order by. If we do, the function returns true.
+ */
+static bool
+HasOrderByPartialAggregate(List *sortClauseList, List *targetList)
+{
+	bool hasOrderByPartialAggregate = false;
+	ListCell *sortClauseCell = NULL;
+
+	foreach(sortClauseCell, sortClauseList)
+	{
+		SortGroupClause *sortClause = (SortGroupClause *) lfirst(sortClauseCell);
+		Node *sortExpression = get_sortgroupclause_expr(sortClause, targetList);
+
+		/* if sort expression is an aggregate, check its type */
+		if (IsA(sortExpression, Aggref))
+		{
+			Aggref *aggregate = (Aggref *) sortExpression;
+
+			AggregateType aggregateType = GetAggregateType(aggregate->aggfnoid);
+			if (aggregateType == AGGREGATE_COMBINE ||
+				aggregateType == AGGREGATE_PERCENTILE_CONT ||
+				aggregateType == AGGREGATE_TDIGEST_ADD ||
+				aggregateType == AGGREGATE_TDIGEST_UNION ||
+				aggregateType == AGGREGATE_TOPN_ADD ||
+				aggregateType == AGGREGATE_TOPN_UNION)
+			{
+				hasOrderByPartialAggregate = true;
+				break;
+			}
+		}
+	}
+
+	return hasOrderByPartialAggregate;
+}
+
+
 /*
  * HasOrderByComplexExpression walks over the given order by clauses, and checks
  * if we have a nested expression that contains an aggregate function within it.
@@ -4643,6 +5272,38 @@ HasOrderByComplexExpression(List *sortClauseList, List *targetList)
 }
 
 
+/*
+ * HasOrderByApproximateDistinct walks over the given order by clauses, and
+ * checks if we have an order by a count(distinct) that worker nodes compute as
+ * an hll sketch. If we do, the function returns true.
+ */
+static bool
+HasOrderByApproximateDistinct(List *sortClauseList, List *targetList)
+{
+	bool hasOrderByApproximateDistinct = false;
+	ListCell *sortClauseCell = NULL;
+
+	if (CountDistinctErrorRate == DISABLE_DISTINCT_APPROXIMATION)
+	{
+		return false;
+	}
+
+	foreach(sortClauseCell, sortClauseList)
+	{
+		SortGroupClause *sortClause = (SortGroupClause *) lfirst(sortClauseCell);
+		Node *sortExpression = get_sortgroupclause_expr(sortClause, targetList);
+
+		if (IsA(sortExpression, Aggref) && ((Aggref *) sortExpression)->aggdistinct)
+		{
+			hasOrderByApproximateDistinct = true;
+			break;
+		}
+	}
+
+	return hasOrderByApproximateDistinct;
+}
+
+
 /*
  * HasOrderByHllType walks over the given order by clauses, and checks if any of
  * those clauses operate on hll data type. If they do, the function returns true.
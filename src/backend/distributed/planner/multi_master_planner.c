@@ -12,6 +12,7 @@
  */
 
 #include "postgres.h"
+#include "miscadmin.h"
 
 #include "distributed/multi_master_planner.h"
 #include "distributed/multi_physical_planner.h"
@@ -114,9 +115,16 @@ BuildCreateStatement(char *masterTableName, List *masterTargetList,
  * BuildAggregatePlan creates and returns an aggregate plan. This aggregate plan
  * builds aggreation and grouping operators (if any) that are to be executed on
  * the master node.
+ *
+ * Grouped results are usually aggregated in a hash table. Hash aggregation
+ * however keeps all groups in memory, and doesn't spill them to disk once they
+ * exceed work_mem. Since task results hold at most one row per group and task,
+ * their size bounds the size of the groups. If task results don't fit into
+ * work_mem, the function therefore sorts them on the group by columns, and
+ * aggregates sorted groups instead; the sort then spills to disk as needed.
  */
 static Agg *
-BuildAggregatePlan(Query *masterQuery, Plan *subPlan)
+BuildAggregatePlan(Query *masterQuery, Plan *subPlan, uint64 taskResultSize)
 {
 	Agg *aggregatePlan = NULL;
 	AggStrategy aggregateStrategy = AGG_PLAIN;
@@ -131,6 +139,7 @@ BuildAggregatePlan(Query *masterQuery, Plan *subPlan)
 	Node *havingQual = NULL;
 	Oid *groupColumnOpArray = NULL;
 	uint32 groupColumnCount = 0;
+	uint64 hashTableSizeLimit = ((uint64) work_mem) * 1024L;
 	const long rowEstimate = 10;
 
 	/* assert that we need to build an aggregate plan */
@@ -170,17 +179,45 @@ BuildAggregatePlan(Query *masterQuery, Plan *subPlan)
 	/* if we have grouping, then initialize appropriate information */
 	if (groupColumnCount > 0)
 	{
-		if (!grouping_is_hashable(groupColumnList))
+		bool hashable = grouping_is_hashable(groupColumnList);
+		bool sortable = grouping_is_sortable(groupColumnList);
+
+		if (!hashable && !sortable)
 		{
-			ereport(ERROR, (errmsg("grouped column list cannot be hashed")));
+			ereport(ERROR, (errmsg("grouped column list cannot be hashed or sorted")));
 		}
 
-		/* switch to hashed aggregate strategy to allow grouping */
-		aggregateStrategy = AGG_HASHED;
-
 		/* get column indexes that are being grouped */
 		groupColumnIdArray = extract_grouping_cols(groupColumnList, subPlan->targetlist);
 		groupColumnOpArray = extract_grouping_ops(groupColumnList);
+
+		if (sortable && (!hashable || taskResultSize > hashTableSizeLimit))
+		{
+			/* sort task results on the group by columns to aggregate sorted groups */
+#if (PG_VERSION_NUM >= 90600)
+			Sort *sortPlan = make_sort_from_sortclauses(groupColumnList, subPlan);
+#else
+			Sort *sortPlan = make_sort_from_sortclauses(NULL, groupColumnList, subPlan);
+#endif
+			aggregateStrategy = AGG_SORTED;
+			subPlan = (Plan *) sortPlan;
+
+			if (!hashable)
+			{
+				ereport(DEBUG1, (errmsg("group by columns can't be hashed, using "
+										"sorted aggregation on the master node")));
+			}
+			else
+			{
+				ereport(DEBUG1, (errmsg("task results exceed work_mem, using sorted "
+										"aggregation on the master node")));
+			}
+		}
+		else
+		{
+			/* switch to hashed aggregate strategy to allow grouping */
+			aggregateStrategy = AGG_HASHED;
+		}
 	}
 
 	/* finally create the plan */
@@ -204,11 +241,15 @@ BuildAggregatePlan(Query *masterQuery, Plan *subPlan)
  * BuildSelectStatement builds the final select statement to run on the master
  * node, before returning results to the user. The function first builds a scan
  * statement for all results fetched to the master, and layers aggregation, sort
- * and limit plans on top of the scan statement if necessary.
+ * and limit plans on top of the scan statement if necessary. If task results
+ * are merged into the temporary table in sort order, the function skips the
+ * sort plan, since scanning the table already returns rows in that order.
+ * The size of the task results lets the function choose how to aggregate them.
  */
 static PlannedStmt *
 BuildSelectStatement(Query *masterQuery, char *masterTableName,
-					 List *masterTargetList)
+					 List *masterTargetList, bool mergedTaskResults,
+					 uint64 taskResultSize)
 {
 	PlannedStmt *selectStatement = NULL;
 	RangeTblEntry *rangeTableEntry = NULL;
@@ -246,7 +287,8 @@ BuildSelectStatement(Query *masterQuery, char *masterTableName,
 	{
 		sequentialScan->plan.targetlist = masterTargetList;
 
-		aggregationPlan = BuildAggregatePlan(masterQuery, (Plan *) sequentialScan);
+		aggregationPlan = BuildAggregatePlan(masterQuery, (Plan *) sequentialScan,
+											 taskResultSize);
 		topLevelPlan = (Plan *) aggregationPlan;
 	}
 	else
@@ -257,7 +299,7 @@ BuildSelectStatement(Query *masterQuery, char *masterTableName,
 	}
 
 	/* (4) add a sorting plan if needed */
-	if (masterQuery->sortClause)
+	if (masterQuery->sortClause && !mergedTaskResults)
 	{
 		List *sortClauseList = masterQuery->sortClause;
 #if (PG_VERSION_NUM >= 90600)
@@ -344,25 +386,164 @@ MasterNodeCreateStatement(MultiPlan *multiPlan)
  * MasterNodeSelectPlan takes in a distributed plan, finds the master node query
  * structure in that plan, and builds the final select plan to execute on the
  * master node. Note that this select plan is executed after result files are
- * retrieved from worker nodes and are merged into a temporary table.
+ * retrieved from worker nodes and are merged into a temporary table. The caller
+ * passes in the size of this table, or 0 if it isn't known.
  */
 PlannedStmt *
-MasterNodeSelectPlan(MultiPlan *multiPlan)
+MasterNodeSelectPlan(MultiPlan *multiPlan, uint64 taskResultSize)
 {
 	Query *masterQuery = multiPlan->masterQuery;
 	char *tableName = multiPlan->masterTableName;
 	PlannedStmt *masterSelectPlan = NULL;
+	bool mergedTaskResults = MasterNodeMergesTaskResults(multiPlan);
 
 	Job *workerJob = multiPlan->workerJob;
 	List *workerTargetList = workerJob->jobQuery->targetList;
 	List *masterTargetList = MasterTargetList(workerTargetList);
 
-	masterSelectPlan = BuildSelectStatement(masterQuery, tableName, masterTargetList);
+	masterSelectPlan = BuildSelectStatement(masterQuery, tableName, masterTargetList,
+											mergedTaskResults, taskResultSize);
 
 	return masterSelectPlan;
 }
 
 
+/*
+ * MasterNodeMergesTaskResults returns true if the master node can merge task
+ * results in the master query's sort order, instead of sorting all of them.
+ * This is the case when the master query only sorts and limits task results,
+ * and worker nodes already return their results sorted on the same columns in
+ * the same order. The executor then merges task results into the temporary
+ * table, and the master select plan skips the sort.
+ */
+bool
+MasterNodeMergesTaskResults(MultiPlan *multiPlan)
+{
+	Query *masterQuery = multiPlan->masterQuery;
+	Query *workerQuery = multiPlan->workerJob->jobQuery;
+	List *masterSortClauseList = NIL;
+	List *workerSortClauseList = NIL;
+	ListCell *masterSortClauseCell = NULL;
+	ListCell *workerSortClauseCell = NULL;
+
+	if (masterQuery == NULL || masterQuery->hasAggs || masterQuery->groupClause ||
+		masterQuery->havingQual || masterQuery->sortClause == NIL)
+	{
+		return false;
+	}
+
+	/* worker nodes may sort on more columns, but not on fewer */
+	masterSortClauseList = masterQuery->sortClause;
+	workerSortClauseList = workerQuery->sortClause;
+	if (list_length(workerSortClauseList) < list_length(masterSortClauseList))
+	{
+		return false;
+	}
+
+	forboth(masterSortClauseCell, masterSortClauseList,
+			workerSortClauseCell, workerSortClauseList)
+	{
+		SortGroupClause *masterSortClause =
+			(SortGroupClause *) lfirst(masterSortClauseCell);
+		SortGroupClause *workerSortClause =
+			(SortGroupClause *) lfirst(workerSortClauseCell);
+		TargetEntry *masterTargetEntry =
+			get_sortgroupclause_tle(masterSortClause, masterQuery->targetList);
+		TargetEntry *workerTargetEntry =
+			get_sortgroupclause_tle(workerSortClause, workerQuery->targetList);
+		Var *masterColumn = NULL;
+
+		/* the master query needs to sort on a task result column as is */
+		if (!IsA(masterTargetEntry->expr, Var))
+		{
+			return false;
+		}
+
+		masterColumn = (Var *) masterTargetEntry->expr;
+		if (masterColumn->varattno != workerTargetEntry->resno ||
+			masterSortClause->sortop != workerSortClause->sortop ||
+			masterSortClause->nulls_first != workerSortClause->nulls_first)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * MasterNodeRowLimit returns the number of task result rows that the master
+ * node select plan consumes at most, if this number is known up front. This is
+ * the case when the master query applies a constant limit (and offset) directly
+ * on top of the task results, without aggregating them first. Then, if the
+ * master query doesn't sort task results either, any rows will do, and the
+ * executor may stop fetching task results once it has this many. If the master
+ * node merges task results in sort order instead, the executor may stop merging
+ * once it has this many. For all other queries, the function returns -1.
+ */
+int64
+MasterNodeRowLimit(MultiPlan *multiPlan)
+{
+	Query *masterQuery = multiPlan->masterQuery;
+	Const *limitCount = NULL;
+	int64 rowLimit = 0;
+
+	if (masterQuery == NULL || masterQuery->hasAggs || masterQuery->groupClause ||
+		masterQuery->havingQual)
+	{
+		return -1;
+	}
+
+	if (masterQuery->sortClause != NIL && !MasterNodeMergesTaskResults(multiPlan))
+	{
+		return -1;
+	}
+
+	if (masterQuery->limitCount == NULL || !IsA(masterQuery->limitCount, Const))
+	{
+		return -1;
+	}
+
+	limitCount = (Const *) masterQuery->limitCount;
+	if (limitCount->constisnull)
+	{
+		return -1;
+	}
+
+	rowLimit = DatumGetInt64(limitCount->constvalue);
+
+	if (masterQuery->limitOffset != NULL)
+	{
+		Const *limitOffset = (Const *) masterQuery->limitOffset;
+
+		if (!IsA(limitOffset, Const))
+		{
+			return -1;
+		}
+
+		if (!limitOffset->constisnull)
+		{
+			int64 offsetCount = DatumGetInt64(limitOffset->constvalue);
+			if (offsetCount < 0)
+			{
+				return -1;
+			}
+
+			rowLimit += offsetCount;
+		}
+	}
+
+	/* negative limits error out during execution, leave that to the executor */
+	if (rowLimit < 0)
+	{
+		return -1;
+	}
+
+	return rowLimit;
+}
+
+
 /*
  * MasterNodeCopyStatementList takes in a multi plan, and constructs
  * statements that copy over worker task results to a temporary table on the
@@ -36,6 +36,7 @@
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_logical_optimizer.h"
 #include "distributed/multi_logical_planner.h"
+#include "distributed/multi_node_load.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/pg_dist_shard.h"
@@ -162,9 +163,9 @@ static Task * GreedyAssignTask(WorkerNode *workerNode, List *taskList,
 							   List *activeShardPlacementLists);
 static List * RoundRobinAssignTaskList(List *taskList);
 static List * RoundRobinReorder(Task *task, List *placementList);
+static List * LoadAwareAssignTaskList(List *taskList);
 static List * ReorderAndAssignTaskList(List *taskList,
 									   List * (*reorderFunction)(Task *, List *));
-static int CompareTasksByShardId(const void *leftElement, const void *rightElement);
 static List * ActiveShardPlacementLists(List *taskList);
 static List * ActivePlacementList(List *placementList);
 static List * LeftRotateList(List *list, uint32 rotateCount);
@@ -4896,6 +4897,10 @@ AssignAnchorShardTaskList(List *taskList)
 	{
 		assignedTaskList = RoundRobinAssignTaskList(taskList);
 	}
+	else if (TaskAssignmentPolicy == TASK_ASSIGNMENT_LOAD_AWARE)
+	{
+		assignedTaskList = LoadAwareAssignTaskList(taskList);
+	}
 
 	Assert(assignedTaskList != NIL);
 	return assignedTaskList;
@@ -5102,6 +5107,66 @@ RoundRobinReorder(Task *task, List *placementList)
 }
 
 
+/*
+ * LoadAwareAssignTaskList assigns each task to the placement whose node has the
+ * lowest expected cost of running one more task. This cost is based on the
+ * node's in-flight tasks and recent task latencies, as tracked by executors in
+ * all backends. Tasks we assign while planning this query don't show up in
+ * node loads until they start running, so we count them separately; this way,
+ * a query's tasks still spread over the replicas when nodes are equally loaded.
+ */
+static List *
+LoadAwareAssignTaskList(List *taskList)
+{
+	List *assignedTaskList = NIL;
+	List *activeShardPlacementLists = NIL;
+	ListCell *taskCell = NULL;
+	ListCell *placementListCell = NULL;
+	uint32 unAssignedTaskCount = 0;
+	HTAB *assignedTaskCountHash = CreateNodeTaskCountHash();
+
+	/* sort tasks and placements to make ties between nodes deterministic */
+	taskList = SortList(taskList, CompareTasksByShardId);
+	activeShardPlacementLists = ActiveShardPlacementLists(taskList);
+
+	forboth(taskCell, taskList, placementListCell, activeShardPlacementLists)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		List *placementList = (List *) lfirst(placementListCell);
+
+		if (list_length(placementList) > 0)
+		{
+			ShardPlacement *primaryPlacement = NULL;
+
+			task->taskPlacementList = LoadAwarePlacementList(placementList,
+															 assignedTaskCountHash);
+
+			primaryPlacement = (ShardPlacement *) linitial(task->taskPlacementList);
+			ereport(DEBUG3, (errmsg("assigned task %u to node %s:%u", task->taskId,
+									primaryPlacement->nodeName,
+									primaryPlacement->nodePort)));
+
+			assignedTaskList = lappend(assignedTaskList, task);
+		}
+		else
+		{
+			unAssignedTaskCount++;
+		}
+	}
+
+	hash_destroy(assignedTaskCountHash);
+
+	/* if we have unassigned tasks, error out */
+	if (unAssignedTaskCount > 0)
+	{
+		ereport(ERROR, (errmsg("failed to assign %u task(s) to worker nodes",
+							   unAssignedTaskCount)));
+	}
+
+	return assignedTaskList;
+}
+
+
 /*
  * ReorderAndAssignTaskList finds the placements for a task based on its anchor
  * shard id and then sorts them by insertion time. If reorderFunction is given,
@@ -5167,7 +5232,7 @@ ReorderAndAssignTaskList(List *taskList, List * (*reorderFunction)(Task *, List
 
 
 /* Helper function to compare two tasks by their anchor shardId. */
-static int
+int
 CompareTasksByShardId(const void *leftElement, const void *rightElement)
 {
 	const Task *leftTask = *((const Task **) leftElement);
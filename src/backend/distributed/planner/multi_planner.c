@@ -20,6 +20,7 @@
 #include "distributed/multi_logical_optimizer.h"
 #include "distributed/multi_logical_planner.h"
 #include "distributed/multi_physical_planner.h"
+#include "distributed/multi_router_plan_cache.h"
 #include "distributed/multi_router_planner.h"
 
 #include "executor/executor.h"
@@ -49,7 +50,6 @@ static struct PlannedStmt * CreateDistributedPlan(PlannedStmt *localPlan,
 static RelationRestrictionContext * CreateAndPushRestrictionContext(void);
 static RelationRestrictionContext * CurrentRestrictionContext(void);
 static void PopRestrictionContext(void);
-static bool HasUnresolvedExternParamsWalker(Node *expression, ParamListInfo boundParams);
 
 
 /* Distributed planner hook */
@@ -60,6 +60,21 @@ multi_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 	bool needsDistributedPlanning = NeedsDistributedPlanning(parse);
 	Query *originalQuery = NULL;
 	RelationRestrictionContext *restrictionContext = NULL;
+	char *routerPlanCacheKey = NULL;
+
+	/*
+	 * Custom plans of prepared single shard queries only differ in the target
+	 * shard, so reuse a previously created plan for that shard if possible.
+	 */
+	if (needsDistributedPlanning)
+	{
+		routerPlanCacheKey = RouterPlanCacheKey(parse, boundParams);
+		result = GetCachedRouterPlan(routerPlanCacheKey, boundParams);
+		if (result != NULL)
+		{
+			return result;
+		}
+	}
 
 	/*
 	 * standard_planner scribbles on it's input, but for deparsing we need the
@@ -107,6 +122,9 @@ multi_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 		{
 			result = CreateDistributedPlan(result, originalQuery, parse,
 										   boundParams, restrictionContext);
+
+			StoreCachedRouterPlan(routerPlanCacheKey, originalQuery, boundParams,
+								  result);
 		}
 	}
 	PG_CATCH();
@@ -183,7 +201,8 @@ CreateDistributedPlan(PlannedStmt *localPlan, Query *originalQuery, Query *query
 	if (IsModifyCommand(query))
 	{
 		/* modifications are always routed through the same planner/executor */
-		distributedPlan = CreateModifyPlan(originalQuery, query, restrictionContext);
+		distributedPlan = CreateModifyPlan(originalQuery, query, boundParams,
+										   restrictionContext);
 		Assert(distributedPlan);
 	}
 	else
@@ -363,7 +382,7 @@ MultiQueryContainerNode(PlannedStmt *result, MultiPlan *multiPlan)
 	serializedPlan = CitusNodeToString(multiPlan);
 	multiPlanData = makeNode(Const);
 	multiPlanData->consttype = CSTRINGOID;
-	multiPlanData->constlen = strlen(serializedPlan);
+	multiPlanData->constlen = -2;
 	multiPlanData->constvalue = CStringGetDatum(serializedPlan);
 	multiPlanData->constbyval = false;
 	multiPlanData->location = -1;
@@ -591,7 +610,7 @@ PopRestrictionContext(void)
  * has external parameters that are not contained in boundParams, false
  * otherwise.
  */
-static bool
+bool
 HasUnresolvedExternParamsWalker(Node *expression, ParamListInfo boundParams)
 {
 	if (expression == NULL)
@@ -0,0 +1,765 @@
+/*-------------------------------------------------------------------------
+ *
+ * multi_router_plan_cache.c
+ *	  Coordinator-side cache of router plans for parameterized single shard
+ *	  queries.
+ *
+ * Prepared statements with a parameter on the partition column can't use a
+ * generic plan, since the target shard depends on the parameter value. Every
+ * execution therefore goes through the standard planner, the router planner
+ * and the shard query deparser again. This file keeps the resulting plans in
+ * a cache keyed on the shape of the query, with one plan per target shard. On
+ * a cache hit, only the shard for the parameter value is computed and the
+ * cached plan for that shard is returned, skipping distributed planning
+ * entirely. Shard queries keep referencing the parameters, which are sent to
+ * the worker at execution time.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "access/stratnum.h"
+#include "catalog/namespace.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_join_order.h"
+#include "distributed/multi_logical_planner.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/multi_planner.h"
+#include "distributed/multi_router_plan_cache.h"
+#include "distributed/multi_router_planner.h"
+#include "distributed/shardinterval_utils.h"
+#include "lib/ilist.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "parser/parsetree.h"
+#include "utils/catcache.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+
+
+/*
+ * RouterPlanCacheEntry keeps the router plans of a query shape, one for each
+ * shard of the queried table. Entries for query shapes which can't be cached
+ * are kept as well, so that they aren't analyzed again on every execution.
+ */
+typedef struct RouterPlanCacheEntry
+{
+	char *queryShape; /* hash key, must be first */
+	MemoryContext context;
+	Oid relationId;
+	bool cacheable;
+
+	/* parameter which determines the target shard, and its type */
+	int partitionParamId;
+	Oid partitionParamType;
+
+	/* plans indexed by shard index, NULL if not planned yet */
+	int shardCount;
+	PlannedStmt **shardPlanArray;
+
+	dlist_node cacheNode;
+} RouterPlanCacheEntry;
+
+
+/* Config variable managed via guc.c */
+int MaxCachedRouterPlans = 0;
+
+static MemoryContext RouterPlanCacheContext = NULL;
+static HTAB *RouterPlanCacheHash = NULL;
+
+/* cache entries ordered by last use, most recently used first */
+static dlist_head RouterPlanCacheList = DLIST_STATIC_INIT(RouterPlanCacheList);
+
+/* incremented whenever entries are removed by an invalidation */
+static uint64 RouterPlanCacheGeneration = 0;
+
+
+/* local function forward declarations */
+static void CreateRouterPlanCache(void);
+static bool AnalyzeRouterPlanCacheQuery(Query *query, int *partitionParamId,
+										Oid *partitionParamType);
+static bool ContainsExternParamWalker(Node *node, void *context);
+static bool ExternParamValue(ParamListInfo boundParams, int paramId, Oid paramType,
+							 Datum *paramValue);
+static ShardInterval * PartitionValueShardInterval(Oid relationId, Datum partitionValue,
+												   int *shardIndex, int *shardCount);
+static bool PlanTargetsShard(PlannedStmt *plan, uint64 shardId);
+static RouterPlanCacheEntry * CreateRouterPlanCacheEntry(const char *cacheKey,
+														 Oid relationId, bool cacheable,
+														 int partitionParamId,
+														 Oid partitionParamType,
+														 int shardCount);
+static void RemoveRouterPlanCacheEntry(RouterPlanCacheEntry *cacheEntry);
+static void InvalidateRouterPlanCacheCallback(Datum argument, Oid relationId);
+static uint32 RouterPlanCacheHashHash(const void *key, Size keysize);
+static int RouterPlanCacheHashCompare(const void *a, const void *b, Size keysize);
+
+
+/*
+ * RouterPlanCacheKey returns the key under which plans for the given query are
+ * cached, or NULL if the query can't possibly be served from the cache. Only
+ * queries on a single table which have parameter values bound, i.e. custom
+ * plans of prepared statements, are considered. The key is built from the
+ * query tree before planning and the search path, which affects deparsing.
+ */
+char *
+RouterPlanCacheKey(Query *query, ParamListInfo boundParams)
+{
+	CmdType commandType = query->commandType;
+	RangeTblEntry *rangeTableEntry = NULL;
+	char *queryString = NULL;
+
+	if (MaxCachedRouterPlans <= 0)
+	{
+		return NULL;
+	}
+
+	if (boundParams == NULL || boundParams->numParams == 0)
+	{
+		return NULL;
+	}
+
+	if (commandType == CMD_SELECT)
+	{
+		if (!EnableRouterExecution)
+		{
+			return NULL;
+		}
+	}
+	else if (commandType != CMD_INSERT && commandType != CMD_UPDATE &&
+			 commandType != CMD_DELETE)
+	{
+		return NULL;
+	}
+
+	if (query->utilityStmt != NULL || query->hasSubLinks || query->cteList != NIL ||
+		query->setOperations != NULL || list_length(query->rtable) != 1)
+	{
+		return NULL;
+	}
+
+	rangeTableEntry = (RangeTblEntry *) linitial(query->rtable);
+	if (rangeTableEntry->rtekind != RTE_RELATION)
+	{
+		return NULL;
+	}
+
+	queryString = nodeToString(query);
+
+	return psprintf("%s:%s", namespace_search_path, queryString);
+}
+
+
+/*
+ * GetCachedRouterPlan returns a copy of the cached plan for the query with the
+ * given cache key and parameter values, or NULL if there is no such plan.
+ */
+PlannedStmt *
+GetCachedRouterPlan(const char *cacheKey, ParamListInfo boundParams)
+{
+	RouterPlanCacheEntry *cacheEntry = NULL;
+	ShardInterval *shardInterval = NULL;
+	PlannedStmt *cachedPlan = NULL;
+	uint64 cacheGeneration = RouterPlanCacheGeneration;
+	Oid relationId = InvalidOid;
+	int partitionParamId = 0;
+	Oid partitionParamType = InvalidOid;
+	Datum partitionValue = 0;
+	int shardIndex = INVALID_SHARD_INDEX;
+	int shardCount = 0;
+
+	if (cacheKey == NULL || RouterPlanCacheHash == NULL)
+	{
+		return NULL;
+	}
+
+	cacheEntry = (RouterPlanCacheEntry *) hash_search(RouterPlanCacheHash, &cacheKey,
+													  HASH_FIND, NULL);
+	if (cacheEntry == NULL || !cacheEntry->cacheable)
+	{
+		return NULL;
+	}
+
+	relationId = cacheEntry->relationId;
+	partitionParamId = cacheEntry->partitionParamId;
+	partitionParamType = cacheEntry->partitionParamType;
+
+	if (!ExternParamValue(boundParams, partitionParamId, partitionParamType,
+						  &partitionValue))
+	{
+		return NULL;
+	}
+
+	shardInterval = PartitionValueShardInterval(relationId, partitionValue,
+												&shardIndex, &shardCount);
+
+	/*
+	 * Fetching the parameter and the shard metadata may have processed
+	 * invalidations, removing the entry.
+	 */
+	if (cacheGeneration != RouterPlanCacheGeneration)
+	{
+		return NULL;
+	}
+
+	if (shardInterval == NULL || shardCount != cacheEntry->shardCount)
+	{
+		return NULL;
+	}
+
+	cachedPlan = cacheEntry->shardPlanArray[shardIndex];
+	if (cachedPlan == NULL)
+	{
+		return NULL;
+	}
+
+	dlist_move_head(&RouterPlanCacheList, &cacheEntry->cacheNode);
+
+	ereport(DEBUG1, (errmsg("using cached router plan for shard " UINT64_FORMAT,
+							shardInterval->shardId)));
+
+	return (PlannedStmt *) copyObject(cachedPlan);
+}
+
+
+/*
+ * StoreCachedRouterPlan adds the given plan, which was created for the query
+ * with the given cache key and parameter values, to the cache. The plan is only
+ * stored if it is a router plan for the shard the partition column parameter
+ * points to, so that it can be reused for all values falling into that shard.
+ */
+void
+StoreCachedRouterPlan(const char *cacheKey, Query *originalQuery,
+					  ParamListInfo boundParams, PlannedStmt *plan)
+{
+	RouterPlanCacheEntry *cacheEntry = NULL;
+	RangeTblEntry *rangeTableEntry = NULL;
+	ShardInterval *shardInterval = NULL;
+	MemoryContext oldContext = NULL;
+	uint64 cacheGeneration = 0;
+	Oid relationId = InvalidOid;
+	bool cacheable = false;
+	int partitionParamId = 0;
+	Oid partitionParamType = InvalidOid;
+	Datum partitionValue = 0;
+	int shardIndex = INVALID_SHARD_INDEX;
+	int shardCount = 0;
+
+	if (cacheKey == NULL)
+	{
+		return;
+	}
+
+	if (RouterPlanCacheHash == NULL)
+	{
+		CreateRouterPlanCache();
+	}
+
+	cacheGeneration = RouterPlanCacheGeneration;
+	cacheEntry = (RouterPlanCacheEntry *) hash_search(RouterPlanCacheHash, &cacheKey,
+													  HASH_FIND, NULL);
+	if (cacheEntry != NULL)
+	{
+		if (!cacheEntry->cacheable)
+		{
+			return;
+		}
+
+		relationId = cacheEntry->relationId;
+		cacheable = true;
+		partitionParamId = cacheEntry->partitionParamId;
+		partitionParamType = cacheEntry->partitionParamType;
+	}
+	else
+	{
+		rangeTableEntry = (RangeTblEntry *) linitial(originalQuery->rtable);
+		relationId = rangeTableEntry->relid;
+		cacheable = AnalyzeRouterPlanCacheQuery(originalQuery, &partitionParamId,
+												&partitionParamType);
+	}
+
+	if (cacheable)
+	{
+		if (!ExternParamValue(boundParams, partitionParamId, partitionParamType,
+							  &partitionValue))
+		{
+			return;
+		}
+
+		shardInterval = PartitionValueShardInterval(relationId, partitionValue,
+													&shardIndex, &shardCount);
+		if (shardInterval == NULL || !PlanTargetsShard(plan, shardInterval->shardId))
+		{
+			return;
+		}
+	}
+
+	/* metadata lookups may have processed invalidations, removing the entry */
+	if (cacheGeneration != RouterPlanCacheGeneration)
+	{
+		return;
+	}
+
+	if (cacheEntry == NULL)
+	{
+		cacheEntry = CreateRouterPlanCacheEntry(cacheKey, relationId, cacheable,
+												partitionParamId, partitionParamType,
+												shardCount);
+	}
+	else
+	{
+		dlist_move_head(&RouterPlanCacheList, &cacheEntry->cacheNode);
+	}
+
+	if (!cacheable || shardCount != cacheEntry->shardCount ||
+		cacheEntry->shardPlanArray[shardIndex] != NULL)
+	{
+		return;
+	}
+
+	oldContext = MemoryContextSwitchTo(cacheEntry->context);
+	cacheEntry->shardPlanArray[shardIndex] = (PlannedStmt *) copyObject(plan);
+	MemoryContextSwitchTo(oldContext);
+
+	ereport(DEBUG1, (errmsg("caching router plan for shard " UINT64_FORMAT,
+							shardInterval->shardId)));
+}
+
+
+/*
+ * CreateRouterPlanCache creates the hash table and memory context holding the
+ * cached router plans, and registers for relcache invalidations.
+ */
+static void
+CreateRouterPlanCache(void)
+{
+	HASHCTL info;
+	int hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_CONTEXT);
+
+	if (CacheMemoryContext == NULL)
+	{
+		CreateCacheMemoryContext();
+	}
+
+	RouterPlanCacheContext = AllocSetContextCreate(CacheMemoryContext,
+												   "Router Plan Cache",
+												   ALLOCSET_DEFAULT_MINSIZE,
+												   ALLOCSET_DEFAULT_INITSIZE,
+												   ALLOCSET_DEFAULT_MAXSIZE);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(char *);
+	info.entrysize = sizeof(RouterPlanCacheEntry);
+	info.hash = RouterPlanCacheHashHash;
+	info.match = RouterPlanCacheHashCompare;
+	info.hcxt = RouterPlanCacheContext;
+
+	RouterPlanCacheHash = hash_create("Router Plan Cache Hash", 64, &info, hashFlags);
+
+	/* drop cached plans when the queried table or its metadata change */
+	CacheRegisterRelcacheCallback(InvalidateRouterPlanCacheCallback, (Datum) 0);
+}
+
+
+/*
+ * AnalyzeRouterPlanCacheQuery determines whether plans for the given query can
+ * be cached. That is the case if the queried table is hash or range partitioned
+ * and the target shard is determined by a single parameter: the value inserted
+ * into the partition column, or the only filter on the partition column, which
+ * has to be an equality filter. If so, the function sets partitionParamId and
+ * partitionParamType to the parameter's id and type.
+ *
+ * Parameter values which end up in the plan's target list would be baked into
+ * cached plans, so the function rejects queries with such parameters. UPDATEs
+ * of the partition column are rejected as well, since whether the router
+ * planner allows them depends on the parameter values.
+ */
+static bool
+AnalyzeRouterPlanCacheQuery(Query *query, int *partitionParamId,
+							Oid *partitionParamType)
+{
+	CmdType commandType = query->commandType;
+	RangeTblEntry *rangeTableEntry = (RangeTblEntry *) linitial(query->rtable);
+	Oid relationId = rangeTableEntry->relid;
+	uint32 rangeTableId = 1;
+	Var *partitionColumn = NULL;
+	Param *partitionParam = NULL;
+	char partitionMethod = 0;
+
+	if (!IsDistributedTable(relationId))
+	{
+		return false;
+	}
+
+	partitionMethod = PartitionMethod(relationId);
+	if (partitionMethod != DISTRIBUTE_BY_HASH && partitionMethod != DISTRIBUTE_BY_RANGE)
+	{
+		return false;
+	}
+
+	if (query->onConflict != NULL || query->hasModifyingCTE)
+	{
+		return false;
+	}
+
+	if (commandType == CMD_SELECT)
+	{
+		if (ContainsExternParamWalker((Node *) query->targetList, NULL))
+		{
+			return false;
+		}
+	}
+	else if (ContainsExternParamWalker((Node *) query->returningList, NULL))
+	{
+		return false;
+	}
+
+	partitionColumn = PartitionColumn(relationId, rangeTableId);
+
+	if (commandType == CMD_INSERT)
+	{
+		TargetEntry *targetEntry = get_tle_by_resno(query->targetList,
+													partitionColumn->varattno);
+
+		if (targetEntry != NULL && IsA(targetEntry->expr, Param))
+		{
+			partitionParam = (Param *) targetEntry->expr;
+		}
+	}
+	else
+	{
+		Node *quals = query->jointree->quals;
+		List *qualList = make_ands_implicit((Expr *) quals);
+		List *columnList = pull_var_clause_default(quals);
+		OpExpr *equalityExpr = MakeOpExpression(partitionColumn, BTEqualStrategyNumber);
+		int partitionColumnCount = 0;
+		ListCell *qualCell = NULL;
+		ListCell *columnCell = NULL;
+
+		if (commandType == CMD_UPDATE)
+		{
+			TargetEntry *targetEntry = get_tle_by_resno(query->targetList,
+														partitionColumn->varattno);
+			if (targetEntry != NULL && !targetEntry->resjunk)
+			{
+				return false;
+			}
+		}
+
+		/* the partition column filter must be the only reference to the column */
+		foreach(columnCell, columnList)
+		{
+			Var *column = (Var *) lfirst(columnCell);
+
+			if (column->varattno == partitionColumn->varattno)
+			{
+				partitionColumnCount++;
+			}
+		}
+
+		if (partitionColumnCount != 1)
+		{
+			return false;
+		}
+
+		foreach(qualCell, qualList)
+		{
+			Node *qual = (Node *) lfirst(qualCell);
+			OpExpr *operatorExpression = NULL;
+			Node *leftOperand = NULL;
+			Node *rightOperand = NULL;
+
+			if (!IsA(qual, OpExpr) || list_length(((OpExpr *) qual)->args) != 2)
+			{
+				continue;
+			}
+
+			operatorExpression = (OpExpr *) qual;
+			if (operatorExpression->opno != equalityExpr->opno)
+			{
+				continue;
+			}
+
+			leftOperand = get_leftop((Expr *) operatorExpression);
+			rightOperand = get_rightop((Expr *) operatorExpression);
+
+			if (IsA(leftOperand, Param) && IsA(rightOperand, Var))
+			{
+				Node *swapOperand = leftOperand;
+
+				leftOperand = rightOperand;
+				rightOperand = swapOperand;
+			}
+
+			if (IsA(leftOperand, Var) && IsA(rightOperand, Param) &&
+				((Var *) leftOperand)->varattno == partitionColumn->varattno)
+			{
+				partitionParam = (Param *) rightOperand;
+			}
+		}
+	}
+
+	if (partitionParam == NULL || partitionParam->paramkind != PARAM_EXTERN ||
+		partitionParam->paramtype != partitionColumn->vartype)
+	{
+		return false;
+	}
+
+	*partitionParamId = partitionParam->paramid;
+	*partitionParamType = partitionParam->paramtype;
+
+	return true;
+}
+
+
+/*
+ * ContainsExternParamWalker returns true if the given expression contains an
+ * external parameter.
+ */
+static bool
+ContainsExternParamWalker(Node *node, void *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Param))
+	{
+		Param *param = (Param *) node;
+
+		return (param->paramkind == PARAM_EXTERN);
+	}
+
+	return expression_tree_walker(node, ContainsExternParamWalker, context);
+}
+
+
+/*
+ * ExternParamValue looks up the value of the given parameter and returns true
+ * if the value is bound, not NULL and of the given type.
+ */
+static bool
+ExternParamValue(ParamListInfo boundParams, int paramId, Oid paramType,
+				 Datum *paramValue)
+{
+	ParamExternData *externParam = NULL;
+
+	if (boundParams == NULL || paramId <= 0 || paramId > boundParams->numParams)
+	{
+		return false;
+	}
+
+	externParam = &boundParams->params[paramId - 1];
+
+	/* give hook a chance in case parameter is dynamic */
+	if (!OidIsValid(externParam->ptype) && boundParams->paramFetch != NULL)
+	{
+		(*boundParams->paramFetch)(boundParams, paramId);
+	}
+
+	if (externParam->ptype != paramType || externParam->isnull)
+	{
+		return false;
+	}
+
+	*paramValue = externParam->value;
+
+	return true;
+}
+
+
+/*
+ * PartitionValueShardInterval returns the shard interval of the given table
+ * that the partition value falls into, or NULL if there is none. The function
+ * also sets shardIndex to the index of the shard interval in the table's sorted
+ * shard interval array, and shardCount to the length of that array.
+ */
+static ShardInterval *
+PartitionValueShardInterval(Oid relationId, Datum partitionValue, int *shardIndex,
+							int *shardCount)
+{
+	DistTableCacheEntry *cacheEntry = DistributedTableCacheEntry(relationId);
+	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	char partitionMethod = cacheEntry->partitionMethod;
+	bool useBinarySearch = false;
+
+	*shardCount = cacheEntry->shardIntervalArrayLength;
+	*shardIndex = INVALID_SHARD_INDEX;
+
+	if (*shardCount == 0)
+	{
+		return NULL;
+	}
+
+	if (partitionMethod != DISTRIBUTE_BY_HASH || !cacheEntry->hasUniformHashDistribution)
+	{
+		useBinarySearch = true;
+	}
+
+	FindShardIntervalIndexes(&partitionValue, 1, sortedShardIntervalArray, *shardCount,
+							 partitionMethod, cacheEntry->shardIntervalCompareFunction,
+							 cacheEntry->hashFunction, useBinarySearch, shardIndex);
+
+	if (*shardIndex == INVALID_SHARD_INDEX)
+	{
+		return NULL;
+	}
+
+	return sortedShardIntervalArray[*shardIndex];
+}
+
+
+/*
+ * PlanTargetsShard returns true if the given plan is a router plan consisting
+ * of a single task on the given shard.
+ */
+static bool
+PlanTargetsShard(PlannedStmt *plan, uint64 shardId)
+{
+	MultiPlan *multiPlan = GetMultiPlan(plan);
+	Job *workerJob = multiPlan->workerJob;
+	Task *task = NULL;
+
+	if (multiPlan->planningError != NULL || !multiPlan->routerExecutable)
+	{
+		return false;
+	}
+
+	if (workerJob == NULL || list_length(workerJob->taskList) != 1)
+	{
+		return false;
+	}
+
+	task = (Task *) linitial(workerJob->taskList);
+
+	return (task->anchorShardId == shardId);
+}
+
+
+/*
+ * CreateRouterPlanCacheEntry adds an entry for the given query shape to the
+ * cache, evicting the least recently used entries if the cache is full.
+ */
+static RouterPlanCacheEntry *
+CreateRouterPlanCacheEntry(const char *cacheKey, Oid relationId, bool cacheable,
+						   int partitionParamId, Oid partitionParamType,
+						   int shardCount)
+{
+	RouterPlanCacheEntry *cacheEntry = NULL;
+	MemoryContext entryContext = NULL;
+	bool entryFound = false;
+
+	while (!dlist_is_empty(&RouterPlanCacheList) &&
+		   hash_get_num_entries(RouterPlanCacheHash) >= MaxCachedRouterPlans)
+	{
+		dlist_node *leastRecentlyUsedNode = dlist_tail_node(&RouterPlanCacheList);
+
+		RemoveRouterPlanCacheEntry(dlist_container(RouterPlanCacheEntry, cacheNode,
+												   leastRecentlyUsedNode));
+	}
+
+	entryContext = AllocSetContextCreate(RouterPlanCacheContext,
+										 "Router Plan Cache Entry",
+										 ALLOCSET_SMALL_MINSIZE,
+										 ALLOCSET_SMALL_INITSIZE,
+										 ALLOCSET_DEFAULT_MAXSIZE);
+
+	cacheEntry = (RouterPlanCacheEntry *) hash_search(RouterPlanCacheHash, &cacheKey,
+													  HASH_ENTER, &entryFound);
+	Assert(!entryFound);
+
+	cacheEntry->queryShape = MemoryContextStrdup(entryContext, cacheKey);
+	cacheEntry->context = entryContext;
+	cacheEntry->relationId = relationId;
+	cacheEntry->cacheable = cacheable;
+	cacheEntry->partitionParamId = partitionParamId;
+	cacheEntry->partitionParamType = partitionParamType;
+	cacheEntry->shardCount = shardCount;
+	cacheEntry->shardPlanArray = NULL;
+
+	if (cacheable)
+	{
+		cacheEntry->shardPlanArray = MemoryContextAllocZero(entryContext,
+															shardCount *
+															sizeof(PlannedStmt *));
+	}
+
+	dlist_push_head(&RouterPlanCacheList, &cacheEntry->cacheNode);
+
+	return cacheEntry;
+}
+
+
+/*
+ * RemoveRouterPlanCacheEntry removes the given entry from the cache and frees
+ * its plans.
+ */
+static void
+RemoveRouterPlanCacheEntry(RouterPlanCacheEntry *cacheEntry)
+{
+	char *queryShape = cacheEntry->queryShape;
+	MemoryContext entryContext = cacheEntry->context;
+
+	dlist_delete(&cacheEntry->cacheNode);
+	hash_search(RouterPlanCacheHash, &queryShape, HASH_REMOVE, NULL);
+
+	/* the key lives in the entry's context, so delete the context last */
+	MemoryContextDelete(entryContext);
+}
+
+
+/*
+ * InvalidateRouterPlanCacheCallback removes the cached plans for a relation
+ * when it is invalidated, or all cached plans if the entire relcache is reset.
+ * Changes to the metadata of a distributed table, such as its shards and shard
+ * placements, invalidate the table's relcache entry.
+ */
+static void
+InvalidateRouterPlanCacheCallback(Datum argument, Oid relationId)
+{
+	dlist_mutable_iter iter;
+
+	dlist_foreach_modify(iter, &RouterPlanCacheList)
+	{
+		RouterPlanCacheEntry *cacheEntry =
+			dlist_container(RouterPlanCacheEntry, cacheNode, iter.cur);
+
+		if (relationId == InvalidOid || cacheEntry->relationId == relationId)
+		{
+			RemoveRouterPlanCacheEntry(cacheEntry);
+			RouterPlanCacheGeneration++;
+		}
+	}
+}
+
+
+/*
+ * RouterPlanCacheHashHash hashes the query shape a cache key points to.
+ */
+static uint32
+RouterPlanCacheHashHash(const void *key, Size keysize)
+{
+	const char *queryShape = *((const char **) key);
+
+	return DatumGetUInt32(hash_any((const unsigned char *) queryShape,
+								   strlen(queryShape)));
+}
+
+
+/*
+ * RouterPlanCacheHashCompare compares the query shapes two cache keys point to.
+ */
+static int
+RouterPlanCacheHashCompare(const void *a, const void *b, Size keysize)
+{
+	const char *queryShapeA = *((const char **) a);
+	const char *queryShapeB = *((const char **) b);
+
+	return strcmp(queryShapeA, queryShapeB);
+}
@@ -55,8 +55,10 @@
 #include "parser/parse_oper.h"
 #include "storage/lock.h"
 #include "utils/builtins.h"
+#include "utils/datum.h"
 #include "utils/elog.h"
 #include "utils/errcodes.h"
+#include "utils/guc.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "utils/typcache.h"
@@ -79,6 +81,8 @@ static MultiPlan * CreateSingleTaskRouterPlan(Query *originalQuery,
 											  Query *query,
 											  RelationRestrictionContext *
 											  restrictionContext);
+static MultiPlan * CreateMultiRowInsertRouterPlan(Query *originalQuery, Query *query,
+												  ParamListInfo boundParams);
 static MultiPlan * CreateInsertSelectRouterPlan(Query *originalQuery,
 												RelationRestrictionContext *
 												restrictionContext);
@@ -94,9 +98,16 @@ static char MostPermissiveVolatileFlag(char left, char right);
 static bool TargetEntryChangesValue(TargetEntry *targetEntry, Var *column,
 									FromExpr *joinTree);
 static Task * RouterModifyTask(Query *originalQuery, Query *query);
+static DeferredErrorMessage * FoldTargetListIntoValuesRows(Query *query);
+static Node * ResolveExternalParams(Node *inputNode, ParamListInfo boundParams);
+static void ErrorIfNoShardsExist(DistTableCacheEntry *cacheEntry);
 static ShardInterval * TargetShardIntervalForModify(Query *query);
 static List * QueryRestrictList(Query *query);
 static bool FastShardPruningPossible(CmdType commandType, char partitionMethod);
+static bool FastPathShardPruning(Oid relationId, Index tableId, List *restrictClauseList,
+								 List **prunedShardList);
+static Const * PartitionColumnEqualityValue(List *restrictClauseList,
+											Var *partitionColumn);
 static Const * ExtractInsertPartitionValue(Query *query, Var *partitionColumn);
 static Task * RouterSelectTask(Query *originalQuery,
 							   RelationRestrictionContext *restrictionContext,
@@ -162,13 +173,17 @@ CreateRouterPlan(Query *originalQuery, Query *query,
  * the failure.
  */
 MultiPlan *
-CreateModifyPlan(Query *originalQuery, Query *query,
+CreateModifyPlan(Query *originalQuery, Query *query, ParamListInfo boundParams,
 				 RelationRestrictionContext *restrictionContext)
 {
 	if (InsertSelectQuery(originalQuery))
 	{
 		return CreateInsertSelectRouterPlan(originalQuery, restrictionContext);
 	}
+	else if (ExtractValuesRangeTableEntry(originalQuery) != NULL)
+	{
+		return CreateMultiRowInsertRouterPlan(originalQuery, query, boundParams);
+	}
 	else
 	{
 		return CreateSingleTaskRouterPlan(originalQuery, query,
@@ -241,6 +256,106 @@ CreateSingleTaskRouterPlan(Query *originalQuery, Query *query,
 }
 
 
+/*
+ * CreateMultiRowInsertRouterPlan creates a router plan for an INSERT with
+ * multiple VALUES rows. The rows are grouped by the shard they belong to, and
+ * the plan contains one task per shard which inserts all rows of that shard.
+ * The router executor runs the tasks of different shards in parallel. If the
+ * query is not supported, the returned plan has planningError set.
+ *
+ * Rows containing functions which are not IMMUTABLE, including column defaults
+ * such as nextval(), are evaluated on the master one by one. Their shards are
+ * only known after evaluation, so the tasks of such INSERTs are created by the
+ * executor.
+ */
+static MultiPlan *
+CreateMultiRowInsertRouterPlan(Query *originalQuery, Query *query,
+							   ParamListInfo boundParams)
+{
+	MultiPlan *multiPlan = CitusMakeNode(MultiPlan);
+	Oid distributedTableId = ExtractFirstDistributedTableId(originalQuery);
+	char partitionMethod = PartitionMethod(distributedTableId);
+	Query *jobQuery = NULL;
+	RangeTblEntry *valuesRangeTableEntry = NULL;
+	bool requiresMasterEvaluation = false;
+	List *taskList = NIL;
+	Job *job = NULL;
+
+	multiPlan->planningError = ModifyQuerySupported(query);
+	if (multiPlan->planningError != NULL)
+	{
+		return multiPlan;
+	}
+
+	if (partitionMethod == DISTRIBUTE_BY_APPEND)
+	{
+		multiPlan->planningError =
+			DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
+						  "cannot perform distributed planning for the given "
+						  "modification",
+						  "Multi-row INSERTs to append-distributed tables are not "
+						  "supported.",
+						  NULL);
+		return multiPlan;
+	}
+
+	/*
+	 * A task only contains some of the rows, and therefore might not reference
+	 * all parameters. We thus resolve the parameters into the query strings of
+	 * the tasks, which requires all of them to be bound. If they are not, the
+	 * planning error makes postgres use a custom plan instead.
+	 */
+	if (HasUnresolvedExternParamsWalker((Node *) originalQuery, boundParams))
+	{
+		multiPlan->planningError =
+			DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
+						  "cannot perform distributed planning for the given "
+						  "modification",
+						  "Multi-row INSERTs with unbound parameters are not "
+						  "supported.",
+						  NULL);
+		return multiPlan;
+	}
+
+	jobQuery = (Query *) ResolveExternalParams((Node *) originalQuery, boundParams);
+
+	multiPlan->planningError = FoldTargetListIntoValuesRows(jobQuery);
+	if (multiPlan->planningError != NULL)
+	{
+		return multiPlan;
+	}
+
+	/* fold constant expressions, so that partition values become constants */
+	valuesRangeTableEntry = ExtractValuesRangeTableEntry(jobQuery);
+	valuesRangeTableEntry->values_lists =
+		(List *) eval_const_expressions(NULL,
+										(Node *) valuesRangeTableEntry->values_lists);
+
+	requiresMasterEvaluation = RequiresMasterEvaluation(jobQuery);
+	if (!requiresMasterEvaluation)
+	{
+		taskList = MultiRowInsertTaskList(jobQuery);
+	}
+
+	ereport(DEBUG2, (errmsg("Creating router plan")));
+
+	job = CitusMakeNode(Job);
+	job->dependedJobList = NIL;
+	job->jobId = INVALID_JOB_ID;
+	job->subqueryPushdown = false;
+	job->jobQuery = jobQuery;
+	job->taskList = taskList;
+	job->requiresMasterEvaluation = requiresMasterEvaluation;
+
+	multiPlan->workerJob = job;
+	multiPlan->masterQuery = NULL;
+	multiPlan->masterTableName = NULL;
+	multiPlan->routerExecutable = true;
+
+	return multiPlan;
+}
+
+
 /*
  * Creates a router plan for INSERT ... SELECT queries which could consists of
  * multiple tasks.
@@ -1331,21 +1446,14 @@ ModifyQuerySupported(Query *queryTree)
 							 NULL);
 	}
 
-	/* reject queries which involve multi-row inserts */
-	if (hasValuesScan)
+	/* only multi-row inserts may scan a VALUES list */
+	if (hasValuesScan && commandType != CMD_INSERT)
 	{
-		/*
-		 * NB: If you remove this check you must also change the checks further in this
-		 * method and ensure that VOLATILE function calls aren't allowed in INSERT
-		 * statements. Currently they're allowed but the function call is replaced
-		 * with a constant, and if you're inserting multiple rows at once the function
-		 * should return a different value for each row.
-		 */
 		return DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
 							 "cannot perform distributed planning for the given"
 							 " modification",
-							 "Multi-row INSERTs to distributed tables are not "
-							 "supported.",
+							 "VALUES lists are only supported in multi-row "
+							 "INSERTs.",
 							 NULL);
 	}
 
@@ -1394,8 +1502,9 @@ ModifyQuerySupported(Query *queryTree)
 				specifiesPartitionValue = true;
 			}
 
+			/* partition values of multi-row INSERTs are checked per row */
 			if (commandType == CMD_INSERT && targetEntryPartitionColumn &&
-				!IsA(targetEntry->expr, Const))
+				!hasValuesScan && !IsA(targetEntry->expr, Const))
 			{
 				return DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
 									 "values given for the partition column must be"
@@ -1893,6 +2002,341 @@ RouterModifyTask(Query *originalQuery, Query *query)
 }
 
 
+/*
+ * MultiRowInsertTaskList builds the tasks of a multi-row INSERT from its job
+ * query, in which the target list references the columns of the VALUES list
+ * and the rows contain no functions left to evaluate. It determines the shard
+ * of each row from the row's partition column value, and creates one task per
+ * shard which inserts the rows of that shard. The returned tasks are sorted by
+ * shard id and assigned to the first replica of their shard.
+ */
+List *
+MultiRowInsertTaskList(Query *jobQuery)
+{
+	Oid distributedTableId = ExtractFirstDistributedTableId(jobQuery);
+	DistTableCacheEntry *cacheEntry = DistributedTableCacheEntry(distributedTableId);
+	char partitionMethod = cacheEntry->partitionMethod;
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	RangeTblEntry *valuesRangeTableEntry = ExtractValuesRangeTableEntry(jobQuery);
+	List *rowList = valuesRangeTableEntry->values_lists;
+	int rowCount = list_length(rowList);
+	int *shardIndexArray = palloc0(rowCount * sizeof(int));
+	List **shardRowListArray = NULL;
+	bool upsertQuery = false;
+	ListCell *rowCell = NULL;
+	int rowIndex = 0;
+	int shardIndex = 0;
+	List *taskList = NIL;
+
+	ErrorIfNoShardsExist(cacheEntry);
+
+	/* reference tables have a single shard, which all rows go to */
+	if (partitionMethod != DISTRIBUTE_BY_NONE)
+	{
+		uint32 rangeTableId = 1;
+		Var *partitionColumn = PartitionColumn(distributedTableId, rangeTableId);
+		TargetEntry *targetEntry = get_tle_by_resno(jobQuery->targetList,
+													partitionColumn->varattno);
+		Datum *partitionValueArray = palloc0(rowCount * sizeof(Datum));
+		FmgrInfo *hashFunction = NULL;
+		bool useBinarySearch = false;
+
+		foreach(rowCell, rowList)
+		{
+			List *row = (List *) lfirst(rowCell);
+			Node *partitionValue = NULL;
+
+			/* the target list references the columns of the VALUES list */
+			if (targetEntry != NULL)
+			{
+				Var *valuesColumn = (Var *) targetEntry->expr;
+
+				Assert(IsA(valuesColumn, Var));
+				partitionValue = (Node *) list_nth(row, valuesColumn->varattno - 1);
+			}
+
+			if (partitionValue != NULL && !IsA(partitionValue, Const))
+			{
+				ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+								errmsg("values given for the partition column must be "
+									   "constants or constant expressions")));
+			}
+
+			if (partitionValue == NULL || ((Const *) partitionValue)->constisnull)
+			{
+				ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+								errmsg("cannot plan INSERT using row with NULL value "
+									   "in partition column")));
+			}
+
+			partitionValueArray[rowIndex] = ((Const *) partitionValue)->constvalue;
+			rowIndex++;
+		}
+
+		/* determine whether to use binary search, same as in FastShardPruning */
+		if (partitionMethod != DISTRIBUTE_BY_HASH ||
+			!cacheEntry->hasUniformHashDistribution)
+		{
+			useBinarySearch = true;
+		}
+
+		if (partitionMethod == DISTRIBUTE_BY_HASH)
+		{
+			hashFunction = cacheEntry->hashFunction;
+		}
+
+		FindShardIntervalIndexes(partitionValueArray, rowCount, sortedShardIntervalArray,
+								 shardCount, partitionMethod,
+								 cacheEntry->shardIntervalCompareFunction, hashFunction,
+								 useBinarySearch, shardIndexArray);
+	}
+
+	/* group the rows by shard */
+	shardRowListArray = palloc0(shardCount * sizeof(List *));
+
+	rowIndex = 0;
+	foreach(rowCell, rowList)
+	{
+		List *row = (List *) lfirst(rowCell);
+
+		shardIndex = shardIndexArray[rowIndex];
+		if (shardIndex == INVALID_SHARD_INDEX)
+		{
+			char *partitionColumnName =
+				ColumnNameToColumn(distributedTableId, cacheEntry->partitionKeyString);
+
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("could not find shard for row %d of the INSERT",
+								   rowIndex + 1),
+							errhint("Make sure the value for partition column \"%s\" "
+									"falls into a single shard.",
+									partitionColumnName)));
+		}
+
+		shardRowListArray[shardIndex] = lappend(shardRowListArray[shardIndex], row);
+		rowIndex++;
+	}
+
+	if (jobQuery->onConflict != NULL)
+	{
+		RangeTblEntry *rangeTableEntry = linitial(jobQuery->rtable);
+
+		upsertQuery = true;
+
+		/* setting an alias simplifies deparsing of UPSERTs */
+		if (rangeTableEntry->alias == NULL)
+		{
+			rangeTableEntry->alias = makeAlias(CITUS_TABLE_ALIAS, NIL);
+		}
+	}
+
+	for (shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		List *shardRowList = shardRowListArray[shardIndex];
+		uint64 shardId = sortedShardIntervalArray[shardIndex]->shardId;
+		StringInfo queryString = NULL;
+		Task *modifyTask = NULL;
+
+		if (shardRowList == NIL)
+		{
+			continue;
+		}
+
+		/* grab shared metadata lock to stop concurrent placement additions */
+		LockShardDistributionMetadata(shardId, ShareLock);
+
+		/* deparse the query with only the rows of the current shard */
+		valuesRangeTableEntry->values_lists = shardRowList;
+
+		queryString = makeStringInfo();
+		deparse_shard_query(jobQuery, distributedTableId, shardId, queryString);
+		ereport(DEBUG4, (errmsg("distributed statement: %s", queryString->data)));
+
+		modifyTask = CitusMakeNode(Task);
+		modifyTask->jobId = INVALID_JOB_ID;
+		modifyTask->taskId = INVALID_TASK_ID;
+		modifyTask->taskType = MODIFY_TASK;
+		modifyTask->queryString = queryString->data;
+		modifyTask->anchorShardId = shardId;
+		modifyTask->dependedTaskList = NIL;
+		modifyTask->upsertQuery = upsertQuery;
+		modifyTask->replicationModel = cacheEntry->replicationModel;
+		modifyTask->parametersInQueryStringResolved = true;
+
+		taskList = lappend(taskList, modifyTask);
+	}
+
+	valuesRangeTableEntry->values_lists = rowList;
+
+	/* executor locks the shards in task order, so sort to avoid deadlocks */
+	taskList = SortList(taskList, CompareTasksByShardId);
+
+	return FirstReplicaAssignTaskList(taskList);
+}
+
+
+/*
+ * FoldTargetListIntoValuesRows rewrites the given multi-row INSERT such that
+ * the VALUES rows hold the complete value of every inserted column. Besides
+ * references to the columns of the VALUES list, the target list may contain
+ * expressions which apply to all rows, in particular the defaults of columns
+ * that the INSERT omits. These are copied into each row, so that functions in
+ * them are evaluated once per row, and the target list is replaced with plain
+ * references to the columns of the new VALUES list.
+ */
+static DeferredErrorMessage *
+FoldTargetListIntoValuesRows(Query *query)
+{
+	RangeTblRef *valuesTableReference = linitial(query->jointree->fromlist);
+	Index valuesTableId = valuesTableReference->rtindex;
+	RangeTblEntry *valuesRangeTableEntry = rt_fetch(valuesTableId, query->rtable);
+	List *rowList = valuesRangeTableEntry->values_lists;
+	List *foldedRowList = NIL;
+	List *columnNameList = NIL;
+	List *collationList = NIL;
+	ListCell *rowCell = NULL;
+	ListCell *targetEntryCell = NULL;
+	AttrNumber valuesColumnId = 0;
+
+	/* only VALUES list columns and expressions without columns can be folded */
+	foreach(targetEntryCell, query->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		Node *targetExpression = (Node *) targetEntry->expr;
+
+		if (targetEntry->resjunk || IsA(targetExpression, Var))
+		{
+			continue;
+		}
+
+		if (contain_var_clause(targetExpression))
+		{
+			return DeferredError(ERRCODE_FEATURE_NOT_SUPPORTED,
+								 "cannot perform distributed planning for the given "
+								 "modification",
+								 "Multi-row INSERTs into array elements or composite "
+								 "type fields are not supported.",
+								 NULL);
+		}
+	}
+
+	foreach(rowCell, rowList)
+	{
+		List *row = (List *) lfirst(rowCell);
+		List *foldedRow = NIL;
+
+		foreach(targetEntryCell, query->targetList)
+		{
+			TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+			Node *targetExpression = (Node *) targetEntry->expr;
+
+			if (targetEntry->resjunk)
+			{
+				continue;
+			}
+
+			if (IsA(targetExpression, Var))
+			{
+				Var *valuesColumn = (Var *) targetExpression;
+
+				Assert(valuesColumn->varno == valuesTableId);
+				targetExpression = (Node *) list_nth(row, valuesColumn->varattno - 1);
+			}
+
+			foldedRow = lappend(foldedRow, copyObject(targetExpression));
+		}
+
+		foldedRowList = lappend(foldedRowList, foldedRow);
+	}
+
+	foreach(targetEntryCell, query->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		Expr *targetExpression = targetEntry->expr;
+		Oid columnCollation = exprCollation((Node *) targetExpression);
+		Var *valuesColumn = NULL;
+
+		if (targetEntry->resjunk)
+		{
+			continue;
+		}
+
+		valuesColumnId++;
+		valuesColumn = makeVar(valuesTableId, valuesColumnId,
+							   exprType((Node *) targetExpression),
+							   exprTypmod((Node *) targetExpression),
+							   columnCollation, 0);
+
+		targetEntry->expr = (Expr *) valuesColumn;
+		columnNameList = lappend(columnNameList,
+								 makeString(psprintf("column%d", valuesColumnId)));
+		collationList = lappend_oid(collationList, columnCollation);
+	}
+
+	valuesRangeTableEntry->values_lists = foldedRowList;
+	valuesRangeTableEntry->values_collations = collationList;
+	valuesRangeTableEntry->eref = makeAlias(valuesRangeTableEntry->eref->aliasname,
+											columnNameList);
+
+	return NULL;
+}
+
+
+/*
+ * ResolveExternalParams returns a copy of the given expression tree in which
+ * all external parameters that have values in boundParams are replaced with
+ * constants holding these values. Other parameters are left as they are.
+ */
+static Node *
+ResolveExternalParams(Node *inputNode, ParamListInfo boundParams)
+{
+	if (inputNode == NULL)
+	{
+		return NULL;
+	}
+
+	if (IsA(inputNode, Param))
+	{
+		Param *param = (Param *) inputNode;
+		int paramId = param->paramid;
+		ParamExternData *externParam = NULL;
+		int16 typeLength = 0;
+		bool typeByValue = false;
+		Datum constValue = 0;
+
+		if (param->paramkind != PARAM_EXTERN || boundParams == NULL ||
+			paramId <= 0 || paramId > boundParams->numParams)
+		{
+			return (Node *) copyObject(param);
+		}
+
+		externParam = &boundParams->params[paramId - 1];
+		if (!OidIsValid(externParam->ptype))
+		{
+			return (Node *) copyObject(param);
+		}
+
+		get_typlenbyval(param->paramtype, &typeLength, &typeByValue);
+		if (!externParam->isnull)
+		{
+			constValue = datumCopy(externParam->value, typeByValue, typeLength);
+		}
+
+		return (Node *) makeConst(param->paramtype, param->paramtypmod,
+								  param->paramcollid, typeLength, constValue,
+								  externParam->isnull, typeByValue);
+	}
+	else if (IsA(inputNode, Query))
+	{
+		return (Node *) query_tree_mutator((Query *) inputNode, ResolveExternalParams,
+										   boundParams, 0);
+	}
+
+	return expression_tree_mutator(inputNode, ResolveExternalParams, boundParams);
+}
+
+
 /*
  * TargetShardIntervalForModify determines the single shard targeted by a provided
  * modify command. If no matching shards exist, or if the modification targets more
@@ -1913,19 +2357,8 @@ TargetShardIntervalForModify(Query *query)
 
 	Assert(commandType != CMD_SELECT);
 
-	/* error out if no shards exist for the table */
+	ErrorIfNoShardsExist(cacheEntry);
 	shardCount = cacheEntry->shardIntervalArrayLength;
-	if (shardCount == 0)
-	{
-		char *relationName = get_rel_name(distributedTableId);
-
-		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
-						errmsg("could not find any shards"),
-						errdetail("No shards exist for distributed table \"%s\".",
-								  relationName),
-						errhint("Run master_create_worker_shards to create shards "
-								"and try again.")));
-	}
 
 	fastShardPruningPossible = FastShardPruningPossible(query->commandType,
 														partitionMethod);
@@ -1947,10 +2380,17 @@ TargetShardIntervalForModify(Query *query)
 	{
 		List *restrictClauseList = QueryRestrictList(query);
 		Index tableId = 1;
-		List *shardIntervalList = LoadShardIntervalList(distributedTableId);
+		bool fastPathPruned = FastPathShardPruning(distributedTableId, tableId,
+												   restrictClauseList,
+												   &prunedShardList);
 
-		prunedShardList = PruneShardList(distributedTableId, tableId, restrictClauseList,
-										 shardIntervalList);
+		if (!fastPathPruned)
+		{
+			List *shardIntervalList = LoadShardIntervalList(distributedTableId);
+
+			prunedShardList = PruneShardList(distributedTableId, tableId,
+											 restrictClauseList, shardIntervalList);
+		}
 	}
 
 	prunedShardCount = list_length(prunedShardList);
@@ -2016,6 +2456,26 @@ TargetShardIntervalForModify(Query *query)
 }
 
 
+/*
+ * ErrorIfNoShardsExist errors out if the given distributed table has no shards.
+ */
+static void
+ErrorIfNoShardsExist(DistTableCacheEntry *cacheEntry)
+{
+	if (cacheEntry->shardIntervalArrayLength == 0)
+	{
+		char *relationName = get_rel_name(cacheEntry->relationId);
+
+		ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+						errmsg("could not find any shards"),
+						errdetail("No shards exist for distributed table \"%s\".",
+								  relationName),
+						errhint("Run master_create_worker_shards to create shards "
+								"and try again.")));
+	}
+}
+
+
 /*
  * UseFastShardPruning returns true if the commandType is INSERT and partition method
  * is hash or range.
@@ -2039,6 +2499,169 @@ FastShardPruningPossible(CmdType commandType, char partitionMethod)
 }
 
 
+/*
+ * FastPathShardPruning prunes the shards of the given table for point queries,
+ * that is queries whose restrictions contain an equality filter between the
+ * partition column and a constant. Instead of checking every shard's interval
+ * against the restrictions via constraint exclusion, the function looks up the
+ * shard the constant falls into directly. If the fast path applies, the
+ * function sets prunedShardList to the remaining shards and returns true.
+ * Otherwise, it returns false and the caller has to use PruneShardList().
+ *
+ * The fast path is only taken if the result is guaranteed to match that of
+ * PruneShardList(): the table has to be hash partitioned with a uniform hash
+ * distribution and initialized shard intervals, and the equality filter has
+ * to be the only restriction on the partition column.
+ *
+ * Note that the fast path only replaces shard pruning. Since the restrictions
+ * are taken from the local plan, standard_planner() has already run by the
+ * time this function is called.
+ */
+static bool
+FastPathShardPruning(Oid relationId, Index tableId, List *restrictClauseList,
+					 List **prunedShardList)
+{
+	DistTableCacheEntry *cacheEntry = DistributedTableCacheEntry(relationId);
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	Var *partitionColumn = NULL;
+	Const *partitionValue = NULL;
+	ShardInterval *targetShardInterval = NULL;
+
+	if (cacheEntry->partitionMethod != DISTRIBUTE_BY_HASH ||
+		!cacheEntry->hasUniformHashDistribution ||
+		cacheEntry->hasUninitializedShardInterval || shardCount == 0)
+	{
+		return false;
+	}
+
+	if (ContainsFalseClause(restrictClauseList))
+	{
+		return false;
+	}
+
+	partitionColumn = PartitionColumn(relationId, tableId);
+	partitionValue = PartitionColumnEqualityValue(restrictClauseList, partitionColumn);
+	if (partitionValue == NULL)
+	{
+		return false;
+	}
+
+	targetShardInterval = FastShardPruning(relationId, partitionValue->constvalue);
+
+	/* report pruned shards the same way PruneShardList() does */
+	if (log_min_messages <= DEBUG2 || client_min_messages <= DEBUG2)
+	{
+		int shardIndex = 0;
+
+		for (shardIndex = 0; shardIndex < shardCount; shardIndex++)
+		{
+			ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+
+			if (shardInterval != targetShardInterval)
+			{
+				ereport(DEBUG2, (errmsg("predicate pruning for shardId "
+										UINT64_FORMAT, shardInterval->shardId)));
+			}
+		}
+	}
+
+	*prunedShardList = NIL;
+	if (targetShardInterval != NULL)
+	{
+		ereport(DEBUG3, (errmsg("using fast path pruning for shardId "
+								UINT64_FORMAT, targetShardInterval->shardId)));
+
+		*prunedShardList = list_make1(targetShardInterval);
+	}
+
+	return true;
+}
+
+
+/*
+ * PartitionColumnEqualityValue returns the constant the partition column is
+ * compared to in the given restriction clauses, if the clauses contain a
+ * top-level equality filter between the partition column and a non-NULL
+ * constant of the same type, and that filter is the only clause referencing
+ * the partition column. Otherwise, the function returns NULL.
+ */
+static Const *
+PartitionColumnEqualityValue(List *restrictClauseList, Var *partitionColumn)
+{
+	OpExpr *equalityExpr = NULL;
+	List *columnList = pull_var_clause_default((Node *) restrictClauseList);
+	ListCell *columnCell = NULL;
+	ListCell *clauseCell = NULL;
+	int partitionColumnCount = 0;
+
+	foreach(columnCell, columnList)
+	{
+		Var *column = (Var *) lfirst(columnCell);
+
+		if (column->varno == partitionColumn->varno &&
+			column->varattno == partitionColumn->varattno)
+		{
+			partitionColumnCount++;
+		}
+	}
+
+	if (partitionColumnCount != 1)
+	{
+		return NULL;
+	}
+
+	equalityExpr = MakeOpExpression(partitionColumn, BTEqualStrategyNumber);
+
+	foreach(clauseCell, restrictClauseList)
+	{
+		Node *clause = (Node *) lfirst(clauseCell);
+		OpExpr *operatorExpression = NULL;
+		Node *leftOperand = NULL;
+		Node *rightOperand = NULL;
+		Var *column = NULL;
+		Const *constant = NULL;
+
+		if (!IsA(clause, OpExpr) || list_length(((OpExpr *) clause)->args) != 2)
+		{
+			continue;
+		}
+
+		operatorExpression = (OpExpr *) clause;
+		if (operatorExpression->opno != equalityExpr->opno)
+		{
+			continue;
+		}
+
+		leftOperand = get_leftop((Expr *) operatorExpression);
+		rightOperand = get_rightop((Expr *) operatorExpression);
+
+		if (IsA(leftOperand, Var) && IsA(rightOperand, Const))
+		{
+			column = (Var *) leftOperand;
+			constant = (Const *) rightOperand;
+		}
+		else if (IsA(leftOperand, Const) && IsA(rightOperand, Var))
+		{
+			column = (Var *) rightOperand;
+			constant = (Const *) leftOperand;
+		}
+		else
+		{
+			continue;
+		}
+
+		if (column->varno == partitionColumn->varno &&
+			column->varattno == partitionColumn->varattno &&
+			!constant->constisnull && constant->consttype == partitionColumn->vartype)
+		{
+			return constant;
+		}
+	}
+
+	return NULL;
+}
+
+
 /*
  * FastShardPruning is a higher level API for FindShardInterval function. Given the
  * relationId of the distributed table and partitionValue, FastShardPruning function finds
@@ -2414,18 +3037,25 @@ TargetShardIntervalsForSelect(Query *query,
 		whereFalseQuery = ContainsFalseClause(pseudoRestrictionList);
 		if (!whereFalseQuery && shardCount > 0)
 		{
-			List *shardIntervalList = NIL;
+			bool fastPathPruned = FastPathShardPruning(relationId, tableId,
+													   restrictClauseList,
+													   &prunedShardList);
 
-			for (shardIndex = 0; shardIndex < shardCount; shardIndex++)
+			if (!fastPathPruned)
 			{
-				ShardInterval *shardInterval =
-					cacheEntry->sortedShardIntervalArray[shardIndex];
-				shardIntervalList = lappend(shardIntervalList, shardInterval);
-			}
+				List *shardIntervalList = NIL;
+
+				for (shardIndex = 0; shardIndex < shardCount; shardIndex++)
+				{
+					ShardInterval *shardInterval =
+						cacheEntry->sortedShardIntervalArray[shardIndex];
+					shardIntervalList = lappend(shardIntervalList, shardInterval);
+				}
 
-			prunedShardList = PruneShardList(relationId, tableId,
-											 restrictClauseList,
-											 shardIntervalList);
+				prunedShardList = PruneShardList(relationId, tableId,
+												 restrictClauseList,
+												 shardIntervalList);
+			}
 
 			/*
 			 * Quick bail out. The query can not be router plannable if one
@@ -2881,6 +3511,46 @@ InsertSelectQuery(Query *query)
 }
 
 
+/*
+ * ExtractValuesRangeTableEntry returns the range table entry of the VALUES
+ * list of a multi-row INSERT, or NULL if the query is not a multi-row INSERT.
+ */
+RangeTblEntry *
+ExtractValuesRangeTableEntry(Query *query)
+{
+	List *fromList = NIL;
+	RangeTblRef *rangeTableReference = NULL;
+	RangeTblEntry *valuesRte = NULL;
+
+	if (query->commandType != CMD_INSERT)
+	{
+		return NULL;
+	}
+
+	if (query->jointree == NULL || !IsA(query->jointree, FromExpr))
+	{
+		return NULL;
+	}
+
+	fromList = query->jointree->fromlist;
+	if (list_length(fromList) != 1)
+	{
+		return NULL;
+	}
+
+	rangeTableReference = linitial(fromList);
+	Assert(IsA(rangeTableReference, RangeTblRef));
+
+	valuesRte = rt_fetch(rangeTableReference->rtindex, query->rtable);
+	if (valuesRte->rtekind != RTE_VALUES)
+	{
+		return NULL;
+	}
+
+	return valuesRte;
+}
+
+
 /*
  * Copy a RelationRestrictionContext. Note that several subfields are copied
  * shallowly, for lack of copyObject support.
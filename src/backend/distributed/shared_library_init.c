@@ -28,14 +28,18 @@
 #include "distributed/multi_explain.h"
 #include "distributed/multi_join_order.h"
 #include "distributed/multi_logical_optimizer.h"
+#include "distributed/multi_node_load.h"
 #include "distributed/multi_planner.h"
+#include "distributed/multi_result_stream.h"
 #include "distributed/multi_router_executor.h"
+#include "distributed/multi_router_plan_cache.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/multi_utility.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/placement_connection.h"
 #include "distributed/remote_commands.h"
+#include "distributed/shared_connection_pool.h"
 #include "distributed/task_tracker.h"
 #include "distributed/transaction_management.h"
 #include "distributed/worker_manager.h"
@@ -62,6 +66,7 @@ static const struct config_enum_entry task_assignment_policy_options[] = {
 	{ "greedy", TASK_ASSIGNMENT_GREEDY, false },
 	{ "first-replica", TASK_ASSIGNMENT_FIRST_REPLICA, false },
 	{ "round-robin", TASK_ASSIGNMENT_ROUND_ROBIN, false },
+	{ "load-aware", TASK_ASSIGNMENT_LOAD_AWARE, false },
 	{ NULL, 0, false }
 };
 
@@ -90,6 +95,12 @@ static const struct config_enum_entry multi_shard_commit_protocol_options[] = {
 	{ NULL, 0, false }
 };
 
+static const struct config_enum_entry task_scheduling_policy_options[] = {
+	{ "fifo", TASK_SCHEDULING_FIFO, false },
+	{ "fair-share", TASK_SCHEDULING_FAIR_SHARE, false },
+	{ NULL, 0, false }
+};
+
 /* *INDENT-ON* */
 
 
@@ -165,6 +176,12 @@ _PG_init(void)
 	/* organize that task tracker is started once server is up */
 	TaskTrackerRegister();
 
+	/* organize shared memory for tracking the load executors put on nodes */
+	InitializeNodeLoadTracking();
+
+	/* organize shared memory for counting connections to worker nodes */
+	InitializeSharedConnectionPool();
+
 	/* initialize coordinated transaction management */
 	InitializeTransactionManagement();
 	InitializeConnectionManagement();
@@ -223,6 +240,23 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MS,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_shared_pool_size",
+		gettext_noop("Sets the maximum number of connections that all backends "
+					 "together open to each worker node."),
+		gettext_noop("Backends that need a connection to a worker node while "
+					 "this many connections are open to it wait for other "
+					 "backends to release theirs, and error out after "
+					 "citus.node_connection_timeout. The executors queue tasks "
+					 "instead of waiting. While a limit is set, backends don't "
+					 "cache connections across transactions. A value of 0 "
+					 "disables the limit."),
+		&MaxSharedPoolSize,
+		0, 0, INT_MAX,
+		PGC_SIGHUP,
+		0,
+		NULL, NULL, NULL);
+
 	/* keeping temporarily for updates from pre-6.0 versions */
 	DefineCustomStringVariable(
 		"citus.worker_list_file",
@@ -246,6 +280,39 @@ RegisterCitusConfigVariables(void)
 		0,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.stream_real_time_results",
+		gettext_noop("Streams real-time executor results into the master table."),
+		gettext_noop("When enabled, the real-time executor decodes rows as they "
+					 "arrive from workers, and appends them directly to the "
+					 "temporary table on the master instead of writing one file "
+					 "per task and copying these files afterwards. Note that "
+					 "tasks that fail after streaming part of their results are "
+					 "not retried on other placements."),
+		&StreamRealTimeResults,
+		false,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.hedged_read_percentile",
+		gettext_noop("Sets the latency percentile after which the real-time "
+					 "executor hedges reads."),
+		gettext_noop("When set, the real-time executor sends a task that hasn't "
+					 "answered within this percentile of recent task latencies "
+					 "to the next placement of its shard as well. The first "
+					 "placement to answer wins, and the other execution gets "
+					 "cancelled. This reduces tail latencies caused by a single "
+					 "slow worker node, at the cost of running some tasks "
+					 "twice. Reads aren't hedged when results are streamed. "
+					 "The value of 0 disables hedged reads."),
+		&HedgedReadPercentile,
+		0, 0, 99,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.binary_worker_copy_format",
 		gettext_noop("Use the binary worker copy format."),
@@ -258,6 +325,66 @@ RegisterCitusConfigVariables(void)
 		0,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.stream_partition_files",
+		gettext_noop("Streams partition files directly into merge tables."),
+		gettext_noop("By default, worker nodes fetch the partition files that "
+					 "re-partition jobs produce on other worker nodes into "
+					 "local files, and then copy these files into merge tables. "
+					 "When enabled, fetch tasks only record where partition "
+					 "files are, and merge tasks receive the files' rows over "
+					 "the network and directly insert them into merge tables. "
+					 "This skips writing fetched files to disk and reading "
+					 "them back, but rows are still written to merge tables "
+					 "as before. Failures to reach the node holding a "
+					 "partition file then show up as merge task failures. "
+					 "Merge tasks recognize recorded locations by their file "
+					 "names whatever their own setting is, so superusers can "
+					 "enable streaming for some databases or roles only "
+					 "through ALTER DATABASE ... SET or ALTER ROLE ... SET."),
+		&StreamPartitionFiles,
+		false,
+		PGC_SUSET,
+		0,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.compress_partition_files",
+		gettext_noop("Compresses the partition files of re-partition jobs."),
+		gettext_noop("When enabled, worker nodes compress the partition files "
+					 "they write for re-partition jobs in blocks, using "
+					 "PostgreSQL's built-in LZ compression. This reduces the "
+					 "amount of data written to disk and sent between worker "
+					 "nodes, at the cost of CPU time for compressing and "
+					 "decompressing the data. Merge tasks detect compressed "
+					 "files by the signature at their start, so partition "
+					 "tasks can use different settings. Superusers can "
+					 "therefore enable compression only for databases or "
+					 "roles with large re-partition jobs through ALTER "
+					 "DATABASE ... SET or ALTER ROLE ... SET."),
+		&CompressPartitionFiles,
+		false,
+		PGC_SUSET,
+		0,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_parallel_partitioning",
+		gettext_noop("Allows map tasks to scan shards using parallel workers."),
+		gettext_noop("When enabled, worker nodes allow PostgreSQL to choose a "
+					 "parallel plan for the query that filters a shard in a "
+					 "re-partition job's map task. Parallel workers then scan "
+					 "and filter block ranges of large shards concurrently, "
+					 "and the worker node partitions the rows they produce "
+					 "into partition files. This setting has an effect on "
+					 "PostgreSQL 9.6 and later, and is bounded by the "
+					 "max_parallel_workers_per_gather setting."),
+		&EnableParallelPartitioning,
+		false,
+		PGC_SUSET,
+		0,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.expire_cached_shards",
 		gettext_noop("Enables shard cache expiration if a shard's size on disk has "
@@ -302,6 +429,21 @@ RegisterCitusConfigVariables(void)
 		0,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_cached_statements_per_connection",
+		gettext_noop("Sets the maximum number of statements prepared on each "
+					 "worker connection."),
+		gettext_noop("When set to a positive value, parameterized router queries "
+					 "are prepared once on each worker connection and executed "
+					 "with bound parameters afterwards. Statements are evicted "
+					 "in least-recently-used order once this limit is reached. "
+					 "Setting this to 0 disables statement caching."),
+		&MaxCachedStatementsPerConnection,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.explain_distributed_queries",
 		gettext_noop("Enables Explain for distributed queries."),
@@ -370,6 +512,39 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_cached_router_plans",
+		gettext_noop("Sets the maximum number of prepared router queries whose "
+					 "distributed plans are cached."),
+		gettext_noop("Prepared single shard queries with a parameter on the "
+					 "partition column are planned anew on every execution, "
+					 "since the target shard depends on the parameter value. "
+					 "When set to a positive value, the router plans of up to "
+					 "this many such queries are cached for each of their "
+					 "shards, and executions only compute the target shard. "
+					 "Setting this to 0 disables the cache."),
+		&MaxCachedRouterPlans,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_concurrent_modify_tasks_per_node",
+		gettext_noop("Sets the maximum number of commands of a multi-shard "
+					 "modification to run concurrently per node."),
+		gettext_noop("Multi-shard modifications and DDL commands send the "
+					 "commands for all shard placements at once, and send "
+					 "further commands as soon as running ones finish. When "
+					 "set to a positive value, at most this many commands of "
+					 "the same statement run on one node at any given time. "
+					 "Setting this to 0 removes the limit."),
+		&MaxConcurrentModifyTasksPerNode,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.shard_count",
 		gettext_noop("Sets the number of shards for a new hash-partitioned table"
@@ -491,6 +666,48 @@ RegisterCitusConfigVariables(void)
 		0,
 		NULL, NULL, NULL);
 
+	DefineCustomEnumVariable(
+		"citus.task_scheduling_policy",
+		gettext_noop("Sets the policy the task tracker uses to pick tasks to run."),
+		gettext_noop("The fifo policy runs the tasks assigned to the task tracker "
+					 "in their assignment order. The fair-share policy instead "
+					 "divides the running task slots among jobs in proportion "
+					 "to their scheduling weights, so that a large job can't "
+					 "keep smaller jobs from running."),
+		&TaskSchedulingPolicy,
+		TASK_SCHEDULING_FIFO,
+		task_scheduling_policy_options,
+		PGC_SIGHUP,
+		0,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.prioritize_merge_tasks",
+		gettext_noop("Runs merge and map output fetch tasks before other tasks."),
+		gettext_noop("These tasks only get assigned to the task tracker once the "
+					 "map tasks they depend on completed, and the remaining tasks "
+					 "of their job wait for them. Running them first shortens the "
+					 "time jobs hold on to their intermediate results."),
+		&PrioritizeMergeTasks,
+		false,
+		PGC_SIGHUP,
+		0,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.task_scheduling_weight",
+		gettext_noop("Sets the scheduling weight of tasks assigned by this user."),
+		gettext_noop("Under the fair-share task scheduling policy, jobs get running "
+					 "task slots on worker nodes in proportion to their weights. "
+					 "The weight is read on the worker node when the task is "
+					 "assigned, so it is usually set per role on worker nodes "
+					 "through ALTER ROLE ... SET."),
+		&TaskSchedulingWeight,
+		1, 1, 1000,
+		PGC_SUSET,
+		0,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.partition_buffer_size",
 		gettext_noop("Sets the buffer size to use for partition operations."),
@@ -505,6 +722,22 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_KB,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.copy_batch_size",
+		gettext_noop("Sets the buffer size to use per shard when copying into "
+					 "distributed tables."),
+		gettext_noop("When set to a non-zero value, COPY buffers the rows for "
+					 "each shard until the buffer reaches this size, and then "
+					 "sends the buffer to all of the shard's placements "
+					 "without waiting for the data to be transmitted. This "
+					 "lets all placements ingest data in parallel. A value "
+					 "of 0 sends each row as soon as it is parsed."),
+		&CopyBatchSize,
+		0, 0, (INT_MAX / 1024), /* result stored in int variable */
+		PGC_USERSET,
+		GUC_UNIT_KB,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.large_table_shard_count",
 		gettext_noop("The shard count threshold over which a table is considered large."),
@@ -518,6 +751,24 @@ RegisterCitusConfigVariables(void)
 		0,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_cost_based_join_order",
+		gettext_noop("Picks distributed join orders by estimated data transfer."),
+		gettext_noop("When enabled and citus.task_executor_type is task-tracker, "
+					 "the planner estimates the number of bytes that each "
+					 "applicable join rule moves across the network from shard "
+					 "sizes, and picks the join rules and the join order that "
+					 "move the least amount of data. Otherwise, join rules are "
+					 "ranked by their type. Shard sizes are only recorded for "
+					 "append distributed tables loaded with COPY or "
+					 "master_append_table_to_shard; for other tables, all "
+					 "estimates are 0 and the ranking by type decides."),
+		&EnableCostBasedJoinOrder,
+		false,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.limit_clause_row_fetch_count",
 		gettext_noop("Number of rows to fetch per task for limit clause optimization."),
@@ -546,6 +797,20 @@ RegisterCitusConfigVariables(void)
 		0,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_approximate_percentiles",
+		gettext_noop("Enables approximating percentile_cont() using t-digests."),
+		gettext_noop("Distributed queries can't compute percentiles exactly "
+					 "without pulling all values to the master node. When "
+					 "enabled, worker nodes summarize their values in t-digests "
+					 "instead, and the master node estimates percentiles from "
+					 "the merged digests."),
+		&EnableApproximatePercentiles,
+		false,
+		PGC_USERSET,
+		0,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.multi_shard_commit_protocol",
 		gettext_noop("Sets the commit protocol for commands modifying multiple shards."),
@@ -570,8 +835,12 @@ RegisterCitusConfigVariables(void)
 					 "use when making these assignments. The greedy policy aims to "
 					 "evenly distribute tasks across worker nodes, first-replica just "
 					 "assigns tasks in the order shard placements were created, "
-					 "and the round-robin policy assigns tasks to worker nodes in "
-					 "a round-robin fashion."),
+					 "the round-robin policy assigns tasks to worker nodes in "
+					 "a round-robin fashion, and the load-aware policy assigns "
+					 "tasks to the worker nodes with the fewest in-flight tasks "
+					 "and lowest recent task latencies. The load-aware policy "
+					 "also picks the placement to read from when executing "
+					 "router queries."),
 		&TaskAssignmentPolicy,
 		TASK_ASSIGNMENT_GREEDY,
 		task_assignment_policy_options,
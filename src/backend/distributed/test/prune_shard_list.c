@@ -23,12 +23,15 @@
 #include "distributed/multi_join_order.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/resource_lock.h"
+#include "distributed/shardinterval_utils.h"
 #include "distributed/test_helper_functions.h" /* IWYU pragma: keep */
 #include "nodes/pg_list.h"
 #include "nodes/primnodes.h"
 #include "nodes/nodes.h"
 #include "optimizer/clauses.h"
+#include "portability/instr_time.h"
 #include "utils/array.h"
+#include "utils/lsyscache.h"
 #include "utils/palloc.h"
 
 
@@ -36,6 +39,11 @@
 static Expr * MakeTextPartitionExpression(Oid distributedTableId, text *value);
 static ArrayType * PrunedShardIdsForTable(Oid distributedTableId, List *whereClauseList);
 static ArrayType * SortedShardIntervalArray(Oid distributedTableId);
+static Datum * PartitionValueArray(Oid distributedTableId, ArrayType *valueArrayObject,
+								   int *valueCount);
+static void RouteValuesToShards(DistTableCacheEntry *cacheEntry, Datum *valueArray,
+								int valueCount, bool batched,
+								ShardInterval **shardIntervalArray);
 
 
 /* declarations for dynamic loading */
@@ -45,6 +53,8 @@ PG_FUNCTION_INFO_V1(prune_using_either_value);
 PG_FUNCTION_INFO_V1(prune_using_both_values);
 PG_FUNCTION_INFO_V1(debug_equality_expression);
 PG_FUNCTION_INFO_V1(print_sorted_shard_intervals);
+PG_FUNCTION_INFO_V1(route_partition_values);
+PG_FUNCTION_INFO_V1(benchmark_shard_routing);
 
 
 /*
@@ -154,6 +164,86 @@ print_sorted_shard_intervals(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * route_partition_values returns the identifiers of the shards which the given
+ * partition column values are routed to, using the batched routing path.
+ */
+Datum
+route_partition_values(PG_FUNCTION_ARGS)
+{
+	Oid distributedTableId = PG_GETARG_OID(0);
+	ArrayType *valueArrayObject = PG_GETARG_ARRAYTYPE_P(1);
+	DistTableCacheEntry *cacheEntry = DistributedTableCacheEntry(distributedTableId);
+	ArrayType *shardIdArrayType = NULL;
+	Datum *shardIdDatumArray = NULL;
+	ShardInterval **shardIntervalArray = NULL;
+	int valueCount = 0;
+	int valueIndex = 0;
+
+	Datum *valueArray = PartitionValueArray(distributedTableId, valueArrayObject,
+											&valueCount);
+
+	shardIntervalArray = palloc0(valueCount * sizeof(ShardInterval *));
+	RouteValuesToShards(cacheEntry, valueArray, valueCount, true, shardIntervalArray);
+
+	shardIdDatumArray = palloc0(valueCount * sizeof(Datum));
+	for (valueIndex = 0; valueIndex < valueCount; valueIndex++)
+	{
+		ShardInterval *shardInterval = shardIntervalArray[valueIndex];
+
+		if (shardInterval == NULL)
+		{
+			ereport(ERROR, (errmsg("could not find shard for partition column value")));
+		}
+
+		shardIdDatumArray[valueIndex] = Int64GetDatum(shardInterval->shardId);
+	}
+
+	shardIdArrayType = DatumArrayToArrayType(shardIdDatumArray, valueCount, INT8OID);
+
+	PG_RETURN_ARRAYTYPE_P(shardIdArrayType);
+}
+
+
+/*
+ * benchmark_shard_routing routes the given partition column values to shards
+ * the given number of times, either one value at a time or using the batched
+ * routing path that COPY uses, and returns the elapsed time in milliseconds.
+ */
+Datum
+benchmark_shard_routing(PG_FUNCTION_ARGS)
+{
+	Oid distributedTableId = PG_GETARG_OID(0);
+	ArrayType *valueArrayObject = PG_GETARG_ARRAYTYPE_P(1);
+	int32 iterationCount = PG_GETARG_INT32(2);
+	bool batched = PG_GETARG_BOOL(3);
+	DistTableCacheEntry *cacheEntry = DistributedTableCacheEntry(distributedTableId);
+	ShardInterval **shardIntervalArray = NULL;
+	int valueCount = 0;
+	int iterationIndex = 0;
+	instr_time startTime;
+	instr_time elapsedTime;
+
+	Datum *valueArray = PartitionValueArray(distributedTableId, valueArrayObject,
+											&valueCount);
+
+	shardIntervalArray = palloc0(valueCount * sizeof(ShardInterval *));
+
+	INSTR_TIME_SET_CURRENT(startTime);
+
+	for (iterationIndex = 0; iterationIndex < iterationCount; iterationIndex++)
+	{
+		RouteValuesToShards(cacheEntry, valueArray, valueCount, batched,
+							shardIntervalArray);
+	}
+
+	INSTR_TIME_SET_CURRENT(elapsedTime);
+	INSTR_TIME_SUBTRACT(elapsedTime, startTime);
+
+	PG_RETURN_FLOAT8(INSTR_TIME_GET_MILLISEC(elapsedTime));
+}
+
+
 /*
  * MakeTextPartitionExpression returns an equality expression between the
  * specified table's partition column and the provided values.
@@ -257,3 +347,91 @@ SortedShardIntervalArray(Oid distributedTableId)
 
 	return shardIdArrayType;
 }
+
+
+/*
+ * PartitionValueArray deconstructs the given array of partition column values
+ * for the specified table, and errors out if the array contains NULLs or if
+ * its element type does not match the partition column type.
+ */
+static Datum *
+PartitionValueArray(Oid distributedTableId, ArrayType *valueArrayObject, int *valueCount)
+{
+	Var *partitionColumn = PartitionKey(distributedTableId);
+	Oid valueTypeId = ARR_ELEMTYPE(valueArrayObject);
+	Datum *valueArray = NULL;
+	bool *valueNullArray = NULL;
+	int16 typeLength = 0;
+	bool typeByValue = false;
+	char typeAlignment = 0;
+	int valueIndex = 0;
+
+	if (partitionColumn == NULL || partitionColumn->vartype != valueTypeId)
+	{
+		ereport(ERROR, (errmsg("values must be of the partition column type")));
+	}
+
+	get_typlenbyvalalign(valueTypeId, &typeLength, &typeByValue, &typeAlignment);
+	deconstruct_array(valueArrayObject, valueTypeId, typeLength, typeByValue,
+					  typeAlignment, &valueArray, &valueNullArray, valueCount);
+
+	for (valueIndex = 0; valueIndex < *valueCount; valueIndex++)
+	{
+		if (valueNullArray[valueIndex])
+		{
+			ereport(ERROR, (errmsg("values must not be NULL")));
+		}
+	}
+
+	return valueArray;
+}
+
+
+/*
+ * RouteValuesToShards finds the shard interval of each of the given partition
+ * column values, either using the batched routing path or by looking up one
+ * value at a time.
+ */
+static void
+RouteValuesToShards(DistTableCacheEntry *cacheEntry, Datum *valueArray, int valueCount,
+					bool batched, ShardInterval **shardIntervalArray)
+{
+	ShardInterval **shardIntervalCache = cacheEntry->sortedShardIntervalArray;
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	char partitionMethod = cacheEntry->partitionMethod;
+	FmgrInfo *compareFunction = cacheEntry->shardIntervalCompareFunction;
+	FmgrInfo *hashFunction = cacheEntry->hashFunction;
+	bool useBinarySearch = (partitionMethod != DISTRIBUTE_BY_HASH ||
+							!cacheEntry->hasUniformHashDistribution);
+	int valueIndex = 0;
+
+	if (batched)
+	{
+		int *shardIndexArray = palloc0(valueCount * sizeof(int));
+
+		FindShardIntervalIndexes(valueArray, valueCount, shardIntervalCache,
+								 shardCount, partitionMethod, compareFunction,
+								 hashFunction, useBinarySearch, shardIndexArray);
+
+		for (valueIndex = 0; valueIndex < valueCount; valueIndex++)
+		{
+			int shardIndex = shardIndexArray[valueIndex];
+
+			if (shardIndex != INVALID_SHARD_INDEX)
+			{
+				shardIntervalArray[valueIndex] = shardIntervalCache[shardIndex];
+			}
+		}
+
+		pfree(shardIndexArray);
+		return;
+	}
+
+	for (valueIndex = 0; valueIndex < valueCount; valueIndex++)
+	{
+		shardIntervalArray[valueIndex] = FindShardInterval(valueArray[valueIndex],
+														   shardIntervalCache, shardCount,
+														   partitionMethod, compareFunction,
+														   hashFunction, useBinarySearch);
+	}
+}
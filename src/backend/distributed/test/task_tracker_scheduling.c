@@ -0,0 +1,130 @@
+/*-------------------------------------------------------------------------
+ *
+ * test/src/task_tracker_scheduling.c
+ *
+ * This file contains functions to exercise the task tracker's scheduling
+ * policies without running tasks.
+ *
+ * Copyright (c) 2014-2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "c.h"
+#include "fmgr.h"
+
+#include <string.h>
+
+#include "catalog/pg_type.h"
+#include "distributed/task_tracker.h"
+#include "distributed/test_helper_functions.h" /* IWYU pragma: keep */
+#include "distributed/worker_protocol.h"
+#include "nodes/pg_list.h"
+#include "utils/array.h"
+#include "utils/hsearch.h"
+
+
+/* declarations for dynamic loading */
+PG_FUNCTION_INFO_V1(fair_share_task_list);
+
+
+/*
+ * fair_share_task_list builds a local task hash from the given job ids, task
+ * ids, scheduling weights, and running flags, and returns the ids of the tasks
+ * the fair-share policy picks to fill the given number of free slots, in the
+ * order it picks them. Tasks that aren't running are assigned in array order.
+ */
+Datum
+fair_share_task_list(PG_FUNCTION_ARGS)
+{
+	ArrayType *jobIdArrayObject = PG_GETARG_ARRAYTYPE_P(0);
+	ArrayType *taskIdArrayObject = PG_GETARG_ARRAYTYPE_P(1);
+	ArrayType *weightArrayObject = PG_GETARG_ARRAYTYPE_P(2);
+	ArrayType *runningArrayObject = PG_GETARG_ARRAYTYPE_P(3);
+	uint32 slotCount = PG_GETARG_UINT32(4);
+
+	int32 taskCount = ArrayObjectCount(jobIdArrayObject);
+	Datum *jobIdArray = DeconstructArrayObject(jobIdArrayObject);
+	Datum *taskIdArray = DeconstructArrayObject(taskIdArrayObject);
+	Datum *weightArray = DeconstructArrayObject(weightArrayObject);
+	Datum *runningArray = DeconstructArrayObject(runningArrayObject);
+	HTAB *workerTasksHash = NULL;
+	HASHCTL info;
+	int hashFlags = 0;
+	WorkerTask *taskQueue = NULL;
+	uint32 queueSize = 0;
+	List *scheduledTaskList = NIL;
+	ListCell *scheduledTaskCell = NULL;
+	Datum *scheduledTaskIdArray = NULL;
+	int scheduledTaskIndex = 0;
+	int taskIndex = 0;
+
+	if (ArrayObjectCount(taskIdArrayObject) != taskCount ||
+		ArrayObjectCount(weightArrayObject) != taskCount ||
+		ArrayObjectCount(runningArrayObject) != taskCount)
+	{
+		ereport(ERROR, (errmsg("task arrays must have the same size")));
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(uint64) + sizeof(uint32);
+	info.entrysize = sizeof(WorkerTask);
+	info.hash = tag_hash;
+	info.hcxt = CurrentMemoryContext;
+	hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	workerTasksHash = hash_create("Test Worker Task Hash", 32, &info, hashFlags);
+
+	for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
+	{
+		WorkerTask taskKey;
+		WorkerTask *workerTask = NULL;
+		bool taskFound = false;
+		bool running = DatumGetBool(runningArray[taskIndex]);
+
+		memset(&taskKey, 0, sizeof(taskKey));
+		taskKey.jobId = DatumGetInt64(jobIdArray[taskIndex]);
+		taskKey.taskId = DatumGetInt32(taskIdArray[taskIndex]);
+
+		workerTask = (WorkerTask *) hash_search(workerTasksHash, &taskKey,
+												HASH_ENTER, &taskFound);
+		if (taskFound)
+		{
+			ereport(ERROR, (errmsg("task " UINT64_FORMAT "/%u is given twice",
+								   taskKey.jobId, taskKey.taskId)));
+		}
+
+		workerTask->assignedAt = (uint32) (taskIndex + 1);
+		workerTask->taskStatus = running ? TASK_RUNNING : TASK_ASSIGNED;
+		workerTask->schedulingWeight = DatumGetInt32(weightArray[taskIndex]);
+		workerTask->mergeTask = false;
+
+		if (!running)
+		{
+			queueSize++;
+		}
+	}
+
+	taskQueue = SchedulableTaskPriorityQueue(workerTasksHash);
+	if (taskQueue != NULL)
+	{
+		scheduledTaskList = FairShareTaskList(workerTasksHash, taskQueue, queueSize,
+											  slotCount);
+	}
+
+	scheduledTaskIdArray = palloc0(Max(list_length(scheduledTaskList), 1) *
+								   sizeof(Datum));
+	foreach(scheduledTaskCell, scheduledTaskList)
+	{
+		WorkerTask *scheduledTask = (WorkerTask *) lfirst(scheduledTaskCell);
+
+		scheduledTaskIdArray[scheduledTaskIndex] = Int32GetDatum(scheduledTask->taskId);
+		scheduledTaskIndex++;
+	}
+
+	hash_destroy(workerTasksHash);
+
+	PG_RETURN_ARRAYTYPE_P(DatumArrayToArrayType(scheduledTaskIdArray,
+												scheduledTaskIndex, INT4OID));
+}
@@ -0,0 +1,651 @@
+/*-------------------------------------------------------------------------
+ *
+ * aggregate_utils.c
+ *
+ * This file contains the aggregates that split an arbitrary aggregate into
+ * worker and master parts. On worker nodes, worker_partial_agg() runs the
+ * aggregate's transition function and returns the serialized transition
+ * state. On the master node, master_combine_agg() deserializes these states,
+ * merges them using the aggregate's combine function, and applies the
+ * aggregate's final function. We can split every aggregate that has a combine
+ * function this way; these exist as of PostgreSQL 9.6. Transition states are
+ * shipped in their binary send format, so that floating point states don't
+ * lose precision.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+
+#include "access/htup_details.h"
+#include "catalog/pg_aggregate.h"
+#include "catalog/pg_type.h"
+#include "lib/stringinfo.h"
+#include "parser/parse_agg.h"
+#include "parser/parse_coerce.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/syscache.h"
+
+
+#if (PG_VERSION_NUM >= 90600)
+
+/*
+ * AggregateStateBox keeps the transition state of the aggregate that we run
+ * on behalf of worker_partial_agg() or master_combine_agg(), and the functions
+ * needed to advance and (de)serialize this state. On worker nodes, the
+ * transition function is the aggregate's transition function and the
+ * serialization function serializes internal states. On the master node, the
+ * transition function is the aggregate's combine function and the
+ * serialization function deserializes internal states.
+ */
+typedef struct AggregateStateBox
+{
+	Oid aggregateId;
+	Oid transitionTypeId;
+	int16 transitionTypeLength;
+	bool transitionTypeByValue;
+
+	FmgrInfo transitionFunction;
+	FmgrInfo serializationFunction;
+
+	Datum value;
+	bool valueNull;
+	bool valueInitialized; /* false until a strict transition function got input */
+} AggregateStateBox;
+
+
+/* local function forward declarations */
+static AggregateStateBox * CreateAggregateStateBox(FunctionCallInfo fcinfo,
+												   Oid aggregateId, bool combineStates);
+static void AdvanceAggregateStateBox(AggregateStateBox *stateBox,
+									 FunctionCallInfo fcinfo,
+									 Datum value, bool valueNull);
+static MemoryContext AggregateContext(FunctionCallInfo fcinfo);
+
+#endif
+
+
+/* exports for SQL callable functions */
+PG_FUNCTION_INFO_V1(worker_partial_agg_sfunc);
+PG_FUNCTION_INFO_V1(worker_partial_agg_ffunc);
+PG_FUNCTION_INFO_V1(master_combine_agg_sfunc);
+PG_FUNCTION_INFO_V1(master_combine_agg_ffunc);
+
+
+/*
+ * worker_partial_agg_sfunc is the transition function of worker_partial_agg().
+ * The function advances the transition state of the aggregate with the given
+ * oid using the aggregate's transition function. The aggregate needs to take
+ * the type of the given argument.
+ */
+Datum
+worker_partial_agg_sfunc(PG_FUNCTION_ARGS)
+{
+#if (PG_VERSION_NUM >= 90600)
+	AggregateStateBox *stateBox = NULL;
+	const bool combineStates = false;
+
+	if (PG_ARGISNULL(0))
+	{
+		Oid aggregateId = PG_GETARG_OID(1);
+		stateBox = CreateAggregateStateBox(fcinfo, aggregateId, combineStates);
+	}
+	else
+	{
+		stateBox = (AggregateStateBox *) PG_GETARG_POINTER(0);
+	}
+
+	AdvanceAggregateStateBox(stateBox, fcinfo, PG_GETARG_DATUM(2), PG_ARGISNULL(2));
+
+	PG_RETURN_POINTER(stateBox);
+#else
+	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("worker_partial_agg() requires PostgreSQL 9.6 or later")));
+
+	PG_RETURN_NULL();
+#endif
+}
+
+
+/*
+ * worker_partial_agg_ffunc is the final function of worker_partial_agg(). The
+ * function returns the aggregate's transition state in the binary format of
+ * the transition type's send function. Internal transition states are instead
+ * serialized using the aggregate's serialization function.
+ */
+Datum
+worker_partial_agg_ffunc(PG_FUNCTION_ARGS)
+{
+#if (PG_VERSION_NUM >= 90600)
+	AggregateStateBox *stateBox = NULL;
+	Oid sendFunctionId = InvalidOid;
+	bool typeVarLength = false;
+	Datum stateValue = 0;
+	bytea *stateBytes = NULL;
+
+	if (PG_ARGISNULL(0))
+	{
+		PG_RETURN_NULL();
+	}
+
+	stateBox = (AggregateStateBox *) PG_GETARG_POINTER(0);
+	if (stateBox->valueNull)
+	{
+		PG_RETURN_NULL();
+	}
+
+	stateValue = stateBox->value;
+
+	if (stateBox->transitionTypeId == INTERNALOID)
+	{
+		FunctionCallInfoData serializeFcinfo;
+
+		InitFunctionCallInfoData(serializeFcinfo, &stateBox->serializationFunction, 1,
+								 PG_GET_COLLATION(), fcinfo->context, NULL);
+		serializeFcinfo.arg[0] = stateBox->value;
+		serializeFcinfo.argnull[0] = false;
+
+		stateValue = FunctionCallInvoke(&serializeFcinfo);
+		if (serializeFcinfo.isnull)
+		{
+			PG_RETURN_NULL();
+		}
+
+		PG_RETURN_DATUM(stateValue);
+	}
+
+	getTypeBinaryOutputInfo(stateBox->transitionTypeId, &sendFunctionId,
+							&typeVarLength);
+	stateBytes = OidSendFunctionCall(sendFunctionId, stateValue);
+
+	PG_RETURN_BYTEA_P(stateBytes);
+#else
+	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("worker_partial_agg() requires PostgreSQL 9.6 or later")));
+
+	PG_RETURN_NULL();
+#endif
+}
+
+
+/*
+ * master_combine_agg_sfunc is the transition function of master_combine_agg().
+ * The function receives the given transition state of the aggregate with the
+ * given oid, and merges it into the combined transition state using the
+ * aggregate's combine function. The aggregate needs to return the type of the
+ * last argument.
+ */
+Datum
+master_combine_agg_sfunc(PG_FUNCTION_ARGS)
+{
+#if (PG_VERSION_NUM >= 90600)
+	AggregateStateBox *stateBox = NULL;
+	const bool combineStates = true;
+	Datum stateValue = 0;
+
+	if (PG_ARGISNULL(0))
+	{
+		Oid aggregateId = PG_GETARG_OID(1);
+		stateBox = CreateAggregateStateBox(fcinfo, aggregateId, combineStates);
+	}
+	else
+	{
+		stateBox = (AggregateStateBox *) PG_GETARG_POINTER(0);
+	}
+
+	/* workers return no state for empty groups; these don't change the result */
+	if (PG_ARGISNULL(2))
+	{
+		PG_RETURN_POINTER(stateBox);
+	}
+
+	if (stateBox->transitionTypeId == INTERNALOID)
+	{
+		FunctionCallInfoData deserializeFcinfo;
+		MemoryContext oldContext = NULL;
+
+		InitFunctionCallInfoData(deserializeFcinfo,
+								 &stateBox->serializationFunction, 2,
+								 PG_GET_COLLATION(), fcinfo->context, NULL);
+		deserializeFcinfo.arg[0] = PG_GETARG_DATUM(2);
+		deserializeFcinfo.argnull[0] = false;
+		deserializeFcinfo.arg[1] = PointerGetDatum(NULL);
+		deserializeFcinfo.argnull[1] = false;
+
+		/* internal states must live as long as the combined state */
+		oldContext = MemoryContextSwitchTo(AggregateContext(fcinfo));
+		stateValue = FunctionCallInvoke(&deserializeFcinfo);
+		MemoryContextSwitchTo(oldContext);
+	}
+	else
+	{
+		bytea *stateBytes = PG_GETARG_BYTEA_PP(2);
+		Oid receiveFunctionId = InvalidOid;
+		Oid typeIOParam = InvalidOid;
+		StringInfoData stateBuffer;
+
+		/* receive functions expect a null-terminated buffer */
+		initStringInfo(&stateBuffer);
+		appendBinaryStringInfo(&stateBuffer, VARDATA_ANY(stateBytes),
+							   VARSIZE_ANY_EXHDR(stateBytes));
+
+		getTypeBinaryInputInfo(stateBox->transitionTypeId, &receiveFunctionId,
+							   &typeIOParam);
+		stateValue = OidReceiveFunctionCall(receiveFunctionId, &stateBuffer,
+											typeIOParam, -1);
+
+		if (stateBuffer.cursor != stateBuffer.len)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							errmsg("incorrect binary data format in transition state")));
+		}
+	}
+
+	AdvanceAggregateStateBox(stateBox, fcinfo, stateValue, false);
+
+	PG_RETURN_POINTER(stateBox);
+#else
+	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("master_combine_agg() requires PostgreSQL 9.6 or later")));
+
+	PG_RETURN_NULL();
+#endif
+}
+
+
+/*
+ * master_combine_agg_ffunc is the final function of master_combine_agg(). The
+ * function applies the aggregate's final function to the combined transition
+ * state. The extra arguments of this final function let us declare that the
+ * aggregate returns the type of its last argument; the master node passes a
+ * NULL of the original aggregate's return type for that argument.
+ */
+Datum
+master_combine_agg_ffunc(PG_FUNCTION_ARGS)
+{
+#if (PG_VERSION_NUM >= 90600)
+	AggregateStateBox *stateBox = NULL;
+	HeapTuple aggregateTuple = NULL;
+	Form_pg_aggregate aggregateForm = NULL;
+	Oid finalFunctionId = InvalidOid;
+	bool finalFunctionExtraArguments = false;
+	Oid *argumentTypeArray = NULL;
+	int argumentCount = 0;
+	Oid resultTypeId = InvalidOid;
+	int finalArgumentCount = 1;
+	int argumentIndex = 0;
+	Expr *finalFunctionExpression = NULL;
+	FmgrInfo finalFunction;
+	FunctionCallInfoData finalFcinfo;
+	bool anyArgumentNull = false;
+	Datum result = 0;
+
+	if (PG_ARGISNULL(0))
+	{
+		PG_RETURN_NULL();
+	}
+
+	stateBox = (AggregateStateBox *) PG_GETARG_POINTER(0);
+
+	aggregateTuple = SearchSysCache1(AGGFNOID, ObjectIdGetDatum(stateBox->aggregateId));
+	if (!HeapTupleIsValid(aggregateTuple))
+	{
+		ereport(ERROR, (errmsg("cache lookup failed for aggregate %u",
+							   stateBox->aggregateId)));
+	}
+
+	aggregateForm = (Form_pg_aggregate) GETSTRUCT(aggregateTuple);
+	finalFunctionId = aggregateForm->aggfinalfn;
+	finalFunctionExtraArguments = aggregateForm->aggfinalextra;
+
+	ReleaseSysCache(aggregateTuple);
+
+	/* without a final function, the transition state is the result */
+	if (!OidIsValid(finalFunctionId))
+	{
+		if (stateBox->valueNull)
+		{
+			PG_RETURN_NULL();
+		}
+
+		PG_RETURN_DATUM(stateBox->value);
+	}
+
+	resultTypeId = get_func_signature(stateBox->aggregateId, &argumentTypeArray,
+									  &argumentCount);
+	if (finalFunctionExtraArguments)
+	{
+		finalArgumentCount += argumentCount;
+	}
+
+	build_aggregate_finalfn_expr(argumentTypeArray, finalArgumentCount,
+								 stateBox->transitionTypeId, resultTypeId,
+								 PG_GET_COLLATION(), finalFunctionId,
+								 &finalFunctionExpression);
+
+	fmgr_info(finalFunctionId, &finalFunction);
+	fmgr_info_set_expr((Node *) finalFunctionExpression, &finalFunction);
+
+	InitFunctionCallInfoData(finalFcinfo, &finalFunction, finalArgumentCount,
+							 PG_GET_COLLATION(), fcinfo->context, NULL);
+	finalFcinfo.arg[0] = stateBox->value;
+	finalFcinfo.argnull[0] = stateBox->valueNull;
+	anyArgumentNull = stateBox->valueNull;
+
+	for (argumentIndex = 1; argumentIndex < finalArgumentCount; argumentIndex++)
+	{
+		finalFcinfo.arg[argumentIndex] = (Datum) 0;
+		finalFcinfo.argnull[argumentIndex] = true;
+		anyArgumentNull = true;
+	}
+
+	if (finalFunction.fn_strict && anyArgumentNull)
+	{
+		PG_RETURN_NULL();
+	}
+
+	result = FunctionCallInvoke(&finalFcinfo);
+	if (finalFcinfo.isnull)
+	{
+		PG_RETURN_NULL();
+	}
+
+	PG_RETURN_DATUM(result);
+#else
+	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("master_combine_agg() requires PostgreSQL 9.6 or later")));
+
+	PG_RETURN_NULL();
+#endif
+}
+
+
+#if (PG_VERSION_NUM >= 90600)
+
+/*
+ * CreateAggregateStateBox looks up the aggregate with the given oid, and
+ * creates a box for its transition state in the aggregate memory context. The
+ * function initializes the state from the aggregate's initial value, and looks
+ * up the transition and serialization functions to use on worker nodes, or
+ * the combine and deserialization functions to use on the master node.
+ *
+ * Anyone may call worker_partial_agg() and master_combine_agg() with any oid,
+ * so the function first checks that the user may execute the aggregate, and
+ * that the aggregate fits the types of the calling function's arguments. The
+ * aggregate's functions would otherwise receive datums of the wrong type.
+ */
+static AggregateStateBox *
+CreateAggregateStateBox(FunctionCallInfo fcinfo, Oid aggregateId, bool combineStates)
+{
+	MemoryContext aggregateContext = AggregateContext(fcinfo);
+	MemoryContext oldContext = NULL;
+	AggregateStateBox *stateBox = NULL;
+	HeapTuple aggregateTuple = NULL;
+	Form_pg_aggregate aggregateForm = NULL;
+	Datum initialValueDatum = 0;
+	bool initialValueNull = true;
+	Oid transitionFunctionId = InvalidOid;
+	Oid serializationFunctionId = InvalidOid;
+	Expr *transitionExpression = NULL;
+	Expr *serializationExpression = NULL;
+	Oid *argumentTypeArray = NULL;
+	int argumentCount = 0;
+	Oid resultTypeId = InvalidOid;
+	AclResult aclResult = ACLCHECK_NO_PRIV;
+
+	aggregateTuple = SearchSysCache1(AGGFNOID, ObjectIdGetDatum(aggregateId));
+	if (!HeapTupleIsValid(aggregateTuple))
+	{
+		ereport(ERROR, (errmsg("cache lookup failed for aggregate %u", aggregateId)));
+	}
+
+	aclResult = pg_proc_aclcheck(aggregateId, GetUserId(), ACL_EXECUTE);
+	if (aclResult != ACLCHECK_OK)
+	{
+		aclcheck_error(aclResult, ACL_KIND_PROC, get_func_name(aggregateId));
+	}
+
+	aggregateForm = (Form_pg_aggregate) GETSTRUCT(aggregateTuple);
+	resultTypeId = get_func_signature(aggregateId, &argumentTypeArray, &argumentCount);
+
+	if (aggregateForm->aggkind != AGGKIND_NORMAL || argumentCount != 1 ||
+		IsPolymorphicType(argumentTypeArray[0]) || argumentTypeArray[0] == ANYOID ||
+		IsPolymorphicType(aggregateForm->aggtranstype))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("aggregate %s is not supported",
+							   format_procedure(aggregateId)),
+						errdetail("Only normal aggregates with a single argument "
+								  "of a concrete type can be combined.")));
+	}
+
+	if (combineStates)
+	{
+		Oid resultArgumentTypeId = get_fn_expr_argtype(fcinfo->flinfo, 3);
+
+		if (resultArgumentTypeId != resultTypeId)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+							errmsg("aggregate %s returns type %s, not %s",
+								   format_procedure(aggregateId),
+								   format_type_be(resultTypeId),
+								   format_type_be(resultArgumentTypeId))));
+		}
+	}
+	else
+	{
+		Oid inputTypeId = get_fn_expr_argtype(fcinfo->flinfo, 2);
+
+		if (!IsBinaryCoercible(inputTypeId, argumentTypeArray[0]))
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+							errmsg("aggregate %s does not accept arguments of type %s",
+								   format_procedure(aggregateId),
+								   format_type_be(inputTypeId))));
+		}
+	}
+
+	if (!OidIsValid(aggregateForm->aggcombinefn))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("aggregate %s does not have a combine function",
+							   format_procedure(aggregateId))));
+	}
+
+	if (aggregateForm->aggtranstype == INTERNALOID &&
+		(!OidIsValid(aggregateForm->aggserialfn) ||
+		 !OidIsValid(aggregateForm->aggdeserialfn)))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("aggregate %s does not have serialization functions",
+							   format_procedure(aggregateId))));
+	}
+
+	oldContext = MemoryContextSwitchTo(aggregateContext);
+
+	stateBox = palloc0(sizeof(AggregateStateBox));
+	stateBox->aggregateId = aggregateId;
+	stateBox->transitionTypeId = aggregateForm->aggtranstype;
+	get_typlenbyval(stateBox->transitionTypeId, &stateBox->transitionTypeLength,
+					&stateBox->transitionTypeByValue);
+
+	if (combineStates)
+	{
+		transitionFunctionId = aggregateForm->aggcombinefn;
+		serializationFunctionId = aggregateForm->aggdeserialfn;
+
+		build_aggregate_combinefn_expr(stateBox->transitionTypeId,
+									   PG_GET_COLLATION(), transitionFunctionId,
+									   &transitionExpression);
+
+		if (OidIsValid(serializationFunctionId))
+		{
+			build_aggregate_deserialfn_expr(serializationFunctionId,
+											&serializationExpression);
+		}
+	}
+	else
+	{
+		Expr *inverseTransitionExpression = NULL;
+
+		transitionFunctionId = aggregateForm->aggtransfn;
+		serializationFunctionId = aggregateForm->aggserialfn;
+
+		build_aggregate_transfn_expr(argumentTypeArray, 1, 0, false,
+									 stateBox->transitionTypeId, PG_GET_COLLATION(),
+									 transitionFunctionId, InvalidOid,
+									 &transitionExpression,
+									 &inverseTransitionExpression);
+
+		if (OidIsValid(serializationFunctionId))
+		{
+			build_aggregate_serialfn_expr(serializationFunctionId,
+										  &serializationExpression);
+		}
+	}
+
+	fmgr_info(transitionFunctionId, &stateBox->transitionFunction);
+	fmgr_info_set_expr((Node *) transitionExpression, &stateBox->transitionFunction);
+
+	if (OidIsValid(serializationFunctionId))
+	{
+		fmgr_info(serializationFunctionId, &stateBox->serializationFunction);
+		fmgr_info_set_expr((Node *) serializationExpression,
+						   &stateBox->serializationFunction);
+	}
+
+	/* initialize the transition state the same way nodeAgg.c does */
+	initialValueDatum = SysCacheGetAttr(AGGFNOID, aggregateTuple,
+										Anum_pg_aggregate_agginitval,
+										&initialValueNull);
+	if (initialValueNull)
+	{
+		stateBox->value = (Datum) 0;
+		stateBox->valueNull = true;
+		stateBox->valueInitialized = false;
+	}
+	else
+	{
+		Oid inputFunctionId = InvalidOid;
+		Oid typeIOParam = InvalidOid;
+		char *initialValueString = TextDatumGetCString(initialValueDatum);
+
+		getTypeInputInfo(stateBox->transitionTypeId, &inputFunctionId, &typeIOParam);
+
+		stateBox->value = OidInputFunctionCall(inputFunctionId, initialValueString,
+											   typeIOParam, -1);
+		stateBox->valueNull = false;
+		stateBox->valueInitialized = true;
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	ReleaseSysCache(aggregateTuple);
+
+	return stateBox;
+}
+
+
+/*
+ * AdvanceAggregateStateBox calls the box's transition function on the current
+ * transition state and the given value, and stores the result as the new
+ * transition state. The function follows nodeAgg.c's handling of strict
+ * transition functions and of pass-by-reference transition states.
+ */
+static void
+AdvanceAggregateStateBox(AggregateStateBox *stateBox, FunctionCallInfo fcinfo,
+						 Datum value, bool valueNull)
+{
+	MemoryContext aggregateContext = AggregateContext(fcinfo);
+	FunctionCallInfoData transitionFcinfo;
+	Datum newValue = 0;
+
+	if (stateBox->transitionFunction.fn_strict)
+	{
+		if (valueNull)
+		{
+			return;
+		}
+
+		/* the first input becomes the state if there is no initial value */
+		if (!stateBox->valueInitialized)
+		{
+			MemoryContext oldContext = MemoryContextSwitchTo(aggregateContext);
+
+			stateBox->value = datumCopy(value, stateBox->transitionTypeByValue,
+										stateBox->transitionTypeLength);
+			stateBox->valueNull = false;
+			stateBox->valueInitialized = true;
+
+			MemoryContextSwitchTo(oldContext);
+			return;
+		}
+
+		/* a strict transition function never changes a NULL state */
+		if (stateBox->valueNull)
+		{
+			return;
+		}
+	}
+
+	InitFunctionCallInfoData(transitionFcinfo, &stateBox->transitionFunction, 2,
+							 PG_GET_COLLATION(), fcinfo->context, NULL);
+	transitionFcinfo.arg[0] = stateBox->value;
+	transitionFcinfo.argnull[0] = stateBox->valueNull;
+	transitionFcinfo.arg[1] = value;
+	transitionFcinfo.argnull[1] = valueNull;
+
+	newValue = FunctionCallInvoke(&transitionFcinfo);
+
+	/* copy new pass-by-reference states into the aggregate memory context */
+	if (!stateBox->transitionTypeByValue &&
+		DatumGetPointer(newValue) != DatumGetPointer(stateBox->value))
+	{
+		if (!transitionFcinfo.isnull)
+		{
+			MemoryContext oldContext = MemoryContextSwitchTo(aggregateContext);
+
+			newValue = datumCopy(newValue, stateBox->transitionTypeByValue,
+								 stateBox->transitionTypeLength);
+
+			MemoryContextSwitchTo(oldContext);
+		}
+
+		if (!stateBox->valueNull)
+		{
+			pfree(DatumGetPointer(stateBox->value));
+		}
+	}
+
+	stateBox->value = newValue;
+	stateBox->valueNull = transitionFcinfo.isnull;
+	stateBox->valueInitialized = true;
+}
+
+
+/*
+ * AggregateContext returns the memory context in which the aggregate calling
+ * the given function keeps its transition states, and errors out if the
+ * function isn't called as part of an aggregate.
+ */
+static MemoryContext
+AggregateContext(FunctionCallInfo fcinfo)
+{
+	MemoryContext aggregateContext = NULL;
+
+	if (!AggCheckCallContext(fcinfo, &aggregateContext))
+	{
+		ereport(ERROR, (errmsg("aggregate function called in non-aggregate context")));
+	}
+
+	return aggregateContext;
+}
+
+#endif
@@ -0,0 +1,806 @@
+/*-------------------------------------------------------------------------
+ *
+ * approximate_aggregates.c
+ *
+ * This file contains mergeable sketch aggregates that approximate percentiles
+ * and the most frequent values of a column. Worker nodes build one sketch per
+ * shard, and the master node merges these sketches; so we don't need to pull
+ * the column's values to the master node.
+ *
+ * Percentiles are approximated using a t-digest, which keeps weighted
+ * centroids that are small at the tails of the distribution and larger in the
+ * middle. The digest is represented as a two dimensional double precision
+ * array of {mean, weight} pairs, sorted by mean.
+ *
+ * Frequent values are approximated using a Misra-Gries summary, which keeps
+ * at most TOPN_SKETCH_SIZE values with lower bounds on their frequencies. The
+ * summary is represented as a two dimensional text array of {value, frequency}
+ * pairs, sorted by descending frequency.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+
+#include <math.h>
+
+#include "catalog/pg_type.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/int8.h"
+#include "utils/memutils.h"
+
+
+/* t-digest compression; the digest keeps roughly this many centroids */
+#define TDIGEST_COMPRESSION 100
+
+/* number of centroids we buffer before compressing the digest */
+#define TDIGEST_BUFFER_SIZE (5 * TDIGEST_COMPRESSION)
+
+/* number of values the top-n summary keeps */
+#define TOPN_SKETCH_SIZE 1000
+
+/* number of values we buffer before reducing the top-n summary */
+#define TOPN_BUFFER_SIZE (4 * TOPN_SKETCH_SIZE)
+
+
+/* Centroid represents a group of nearby values in a t-digest */
+typedef struct Centroid
+{
+	double mean;
+	double weight;
+} Centroid;
+
+
+/* TDigest is the transition state of t-digest aggregates */
+typedef struct TDigest
+{
+	Centroid *centroids;
+	int centroidCount;
+	double totalWeight;
+} TDigest;
+
+
+/* TopNEntry is a value and its frequency in a top-n summary */
+typedef struct TopNEntry
+{
+	char *item;
+	int64 frequency;
+} TopNEntry;
+
+
+/* TopNSketch is the transition state of top-n aggregates */
+typedef struct TopNSketch
+{
+	TopNEntry *entries;
+	int entryCount;
+} TopNSketch;
+
+
+/* local function forward declarations */
+static TDigest * CreateTDigest(MemoryContext aggregateContext);
+static void TDigestAdd(TDigest *digest, double mean, double weight);
+static void TDigestCompress(TDigest *digest);
+static double TDigestScale(double quantile);
+static int CompareCentroids(const void *leftElement, const void *rightElement);
+static void ArrayToTDigest(ArrayType *digestArray, TDigest *digest);
+static TopNSketch * CreateTopNSketch(MemoryContext aggregateContext);
+static void TopNAdd(TopNSketch *sketch, MemoryContext aggregateContext,
+				   const char *item, int64 frequency);
+static void TopNReduce(TopNSketch *sketch);
+static int CompareTopNEntriesByItem(const void *leftElement, const void *rightElement);
+static int CompareTopNEntriesByFrequency(const void *leftElement,
+										 const void *rightElement);
+static MemoryContext AggregateMemoryContext(FunctionCallInfo fcinfo);
+
+
+/* exports for SQL callable functions */
+PG_FUNCTION_INFO_V1(tdigest_add_sfunc);
+PG_FUNCTION_INFO_V1(tdigest_union_sfunc);
+PG_FUNCTION_INFO_V1(tdigest_ffunc);
+PG_FUNCTION_INFO_V1(tdigest_percentile);
+PG_FUNCTION_INFO_V1(topn_add_sfunc);
+PG_FUNCTION_INFO_V1(topn_union_sfunc);
+PG_FUNCTION_INFO_V1(topn_ffunc);
+
+
+/*
+ * tdigest_add_sfunc is the transition function of tdigest_add_agg(). The
+ * function adds the given value to the digest.
+ */
+Datum
+tdigest_add_sfunc(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggregateContext = AggregateMemoryContext(fcinfo);
+	TDigest *digest = NULL;
+	const double valueWeight = 1.0;
+
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+		{
+			PG_RETURN_NULL();
+		}
+
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	}
+
+	if (PG_ARGISNULL(0))
+	{
+		digest = CreateTDigest(aggregateContext);
+	}
+	else
+	{
+		digest = (TDigest *) PG_GETARG_POINTER(0);
+	}
+
+	if (isinf(PG_GETARG_FLOAT8(1)) || isnan(PG_GETARG_FLOAT8(1)))
+	{
+		ereport(ERROR, (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+						errmsg("t-digest cannot summarize infinite or NaN values")));
+	}
+
+	TDigestAdd(digest, PG_GETARG_FLOAT8(1), valueWeight);
+
+	PG_RETURN_POINTER(digest);
+}
+
+
+/*
+ * tdigest_union_sfunc is the transition function of tdigest_union_agg(). The
+ * function adds the centroids of the given digest to the merged digest.
+ */
+Datum
+tdigest_union_sfunc(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggregateContext = AggregateMemoryContext(fcinfo);
+	TDigest *digest = NULL;
+	TDigest inputDigest;
+	int centroidIndex = 0;
+
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+		{
+			PG_RETURN_NULL();
+		}
+
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	}
+
+	if (PG_ARGISNULL(0))
+	{
+		digest = CreateTDigest(aggregateContext);
+	}
+	else
+	{
+		digest = (TDigest *) PG_GETARG_POINTER(0);
+	}
+
+	ArrayToTDigest(PG_GETARG_ARRAYTYPE_P(1), &inputDigest);
+
+	for (centroidIndex = 0; centroidIndex < inputDigest.centroidCount; centroidIndex++)
+	{
+		Centroid *centroid = &inputDigest.centroids[centroidIndex];
+		TDigestAdd(digest, centroid->mean, centroid->weight);
+	}
+
+	PG_RETURN_POINTER(digest);
+}
+
+
+/*
+ * tdigest_ffunc is the final function of the t-digest aggregates. The function
+ * compresses the digest, and returns its centroids as an array of {mean,
+ * weight} pairs.
+ */
+Datum
+tdigest_ffunc(PG_FUNCTION_ARGS)
+{
+	TDigest *digest = NULL;
+	Datum *centroidDatumArray = NULL;
+	ArrayType *digestArray = NULL;
+	int dimensions[2];
+	int lowerBounds[2] = { 1, 1 };
+	int centroidIndex = 0;
+
+	if (PG_ARGISNULL(0))
+	{
+		PG_RETURN_NULL();
+	}
+
+	digest = (TDigest *) PG_GETARG_POINTER(0);
+	TDigestCompress(digest);
+
+	centroidDatumArray = palloc0(2 * digest->centroidCount * sizeof(Datum));
+	for (centroidIndex = 0; centroidIndex < digest->centroidCount; centroidIndex++)
+	{
+		Centroid *centroid = &digest->centroids[centroidIndex];
+
+		centroidDatumArray[2 * centroidIndex] = Float8GetDatum(centroid->mean);
+		centroidDatumArray[2 * centroidIndex + 1] = Float8GetDatum(centroid->weight);
+	}
+
+	dimensions[0] = digest->centroidCount;
+	dimensions[1] = 2;
+
+	digestArray = construct_md_array(centroidDatumArray, NULL, 2, dimensions,
+									 lowerBounds, FLOAT8OID, sizeof(float8),
+									 FLOAT8PASSBYVAL, 'd');
+
+	PG_RETURN_ARRAYTYPE_P(digestArray);
+}
+
+
+/*
+ * tdigest_percentile estimates the given percentile of the values summarized in
+ * the given digest. The function interpolates between the centers of adjacent
+ * centroids; for digests whose centroids each hold a single value, this gives
+ * the same result as percentile_cont().
+ */
+Datum
+tdigest_percentile(PG_FUNCTION_ARGS)
+{
+	ArrayType *digestArray = PG_GETARG_ARRAYTYPE_P(0);
+	double percentile = PG_GETARG_FLOAT8(1);
+	TDigest digest;
+	double targetWeight = 0.0;
+	double weightBefore = 0.0;
+	double previousCenter = 0.0;
+	double previousMean = 0.0;
+	int centroidIndex = 0;
+
+	if (percentile < 0 || percentile > 1 || isnan(percentile))
+	{
+		ereport(ERROR, (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+						errmsg("percentile value %g is not between 0 and 1",
+							   percentile)));
+	}
+
+	ArrayToTDigest(digestArray, &digest);
+	if (digest.centroidCount == 0)
+	{
+		PG_RETURN_NULL();
+	}
+
+	qsort(digest.centroids, digest.centroidCount, sizeof(Centroid), CompareCentroids);
+
+	/* the center of the first value is at weight 0.5, of the last at total - 0.5 */
+	targetWeight = percentile * (digest.totalWeight - 1.0) + 0.5;
+
+	for (centroidIndex = 0; centroidIndex < digest.centroidCount; centroidIndex++)
+	{
+		Centroid *centroid = &digest.centroids[centroidIndex];
+		double center = weightBefore + centroid->weight / 2.0;
+
+		if (targetWeight <= center)
+		{
+			double fraction = 0.0;
+
+			if (centroidIndex == 0)
+			{
+				PG_RETURN_FLOAT8(centroid->mean);
+			}
+
+			fraction = (targetWeight - previousCenter) / (center - previousCenter);
+
+			PG_RETURN_FLOAT8(previousMean + fraction * (centroid->mean - previousMean));
+		}
+
+		previousCenter = center;
+		previousMean = centroid->mean;
+		weightBefore += centroid->weight;
+	}
+
+	PG_RETURN_FLOAT8(previousMean);
+}
+
+
+/*
+ * topn_add_sfunc is the transition function of topn_add_agg(). The function
+ * counts the given value in the summary.
+ */
+Datum
+topn_add_sfunc(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggregateContext = AggregateMemoryContext(fcinfo);
+	TopNSketch *sketch = NULL;
+	const int64 valueFrequency = 1;
+
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+		{
+			PG_RETURN_NULL();
+		}
+
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	}
+
+	if (PG_ARGISNULL(0))
+	{
+		sketch = CreateTopNSketch(aggregateContext);
+	}
+	else
+	{
+		sketch = (TopNSketch *) PG_GETARG_POINTER(0);
+	}
+
+	TopNAdd(sketch, aggregateContext, text_to_cstring(PG_GETARG_TEXT_PP(1)),
+			valueFrequency);
+
+	PG_RETURN_POINTER(sketch);
+}
+
+
+/*
+ * topn_union_sfunc is the transition function of topn_union_agg(). The
+ * function adds the values and frequencies of the given summary to the merged
+ * summary.
+ */
+Datum
+topn_union_sfunc(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggregateContext = AggregateMemoryContext(fcinfo);
+	TopNSketch *sketch = NULL;
+	ArrayType *sketchArray = NULL;
+	Datum *elementArray = NULL;
+	bool *elementNullArray = NULL;
+	int elementCount = 0;
+	int elementIndex = 0;
+
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+		{
+			PG_RETURN_NULL();
+		}
+
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	}
+
+	if (PG_ARGISNULL(0))
+	{
+		sketch = CreateTopNSketch(aggregateContext);
+	}
+	else
+	{
+		sketch = (TopNSketch *) PG_GETARG_POINTER(0);
+	}
+
+	sketchArray = PG_GETARG_ARRAYTYPE_P(1);
+	if (ARR_NDIM(sketchArray) != 0 &&
+		(ARR_NDIM(sketchArray) != 2 || ARR_DIMS(sketchArray)[1] != 2))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("invalid top-n summary"),
+						errdetail("Summaries are arrays of {value, frequency} pairs.")));
+	}
+
+	deconstruct_array(sketchArray, TEXTOID, -1, false, 'i',
+					  &elementArray, &elementNullArray, &elementCount);
+
+	for (elementIndex = 0; elementIndex + 1 < elementCount; elementIndex += 2)
+	{
+		char *frequencyString = NULL;
+		int64 frequency = 0;
+
+		if (elementNullArray[elementIndex] || elementNullArray[elementIndex + 1])
+		{
+			ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+							errmsg("top-n summary must not contain nulls")));
+		}
+
+		frequencyString = TextDatumGetCString(elementArray[elementIndex + 1]);
+		scanint8(frequencyString, false, &frequency);
+
+		TopNAdd(sketch, aggregateContext, TextDatumGetCString(elementArray[elementIndex]),
+				frequency);
+	}
+
+	PG_RETURN_POINTER(sketch);
+}
+
+
+/*
+ * topn_ffunc is the final function of the top-n aggregates. The function
+ * reduces the summary to TOPN_SKETCH_SIZE values, and returns these values and
+ * their frequencies as an array of {value, frequency} pairs, ordered by
+ * descending frequency.
+ */
+Datum
+topn_ffunc(PG_FUNCTION_ARGS)
+{
+	TopNSketch *sketch = NULL;
+	Datum *elementArray = NULL;
+	ArrayType *sketchArray = NULL;
+	int dimensions[2];
+	int lowerBounds[2] = { 1, 1 };
+	int entryIndex = 0;
+
+	if (PG_ARGISNULL(0))
+	{
+		PG_RETURN_NULL();
+	}
+
+	sketch = (TopNSketch *) PG_GETARG_POINTER(0);
+
+	TopNReduce(sketch);
+	qsort(sketch->entries, sketch->entryCount, sizeof(TopNEntry),
+		  CompareTopNEntriesByFrequency);
+
+	elementArray = palloc0(2 * sketch->entryCount * sizeof(Datum));
+	for (entryIndex = 0; entryIndex < sketch->entryCount; entryIndex++)
+	{
+		TopNEntry *entry = &sketch->entries[entryIndex];
+		char *frequencyString = psprintf(INT64_FORMAT, entry->frequency);
+
+		elementArray[2 * entryIndex] = CStringGetTextDatum(entry->item);
+		elementArray[2 * entryIndex + 1] = CStringGetTextDatum(frequencyString);
+	}
+
+	dimensions[0] = sketch->entryCount;
+	dimensions[1] = 2;
+
+	sketchArray = construct_md_array(elementArray, NULL, 2, dimensions, lowerBounds,
+									 TEXTOID, -1, false, 'i');
+
+	PG_RETURN_ARRAYTYPE_P(sketchArray);
+}
+
+
+/* CreateTDigest allocates an empty digest in the given memory context. */
+static TDigest *
+CreateTDigest(MemoryContext aggregateContext)
+{
+	TDigest *digest = MemoryContextAllocZero(aggregateContext, sizeof(TDigest));
+	digest->centroids = MemoryContextAllocZero(aggregateContext,
+											   TDIGEST_BUFFER_SIZE * sizeof(Centroid));
+
+	return digest;
+}
+
+
+/*
+ * TDigestAdd adds a centroid with the given mean and weight to the digest, and
+ * compresses the digest first if its buffer is full. Callers make sure that the
+ * mean is finite and the weight is finite and positive; compression then always
+ * frees buffer space unless the total weight overflows, which we error out on.
+ */
+static void
+TDigestAdd(TDigest *digest, double mean, double weight)
+{
+	Centroid *centroid = NULL;
+
+	if (isinf(digest->totalWeight + weight))
+	{
+		ereport(ERROR, (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+						errmsg("t-digest weight is out of range")));
+	}
+
+	if (digest->centroidCount >= TDIGEST_BUFFER_SIZE)
+	{
+		TDigestCompress(digest);
+	}
+
+	if (digest->centroidCount >= TDIGEST_BUFFER_SIZE)
+	{
+		ereport(ERROR, (errmsg("could not compress t-digest")));
+	}
+
+	centroid = &digest->centroids[digest->centroidCount];
+	centroid->mean = mean;
+	centroid->weight = weight;
+
+	digest->centroidCount++;
+	digest->totalWeight += weight;
+}
+
+
+/*
+ * TDigestCompress sorts the digest's centroids, and merges adjacent centroids
+ * as long as the merged centroid spans at most one unit of the digest's scale
+ * function. The scale function grows steeply at the tails, which keeps the
+ * centroids there small and extreme percentiles accurate.
+ */
+static void
+TDigestCompress(TDigest *digest)
+{
+	Centroid currentCentroid;
+	double weightBefore = 0.0;
+	int mergedCount = 0;
+	int centroidIndex = 0;
+
+	if (digest->centroidCount <= 1)
+	{
+		return;
+	}
+
+	qsort(digest->centroids, digest->centroidCount, sizeof(Centroid),
+		  CompareCentroids);
+
+	currentCentroid = digest->centroids[0];
+
+	for (centroidIndex = 1; centroidIndex < digest->centroidCount; centroidIndex++)
+	{
+		Centroid *nextCentroid = &digest->centroids[centroidIndex];
+		double mergedWeight = currentCentroid.weight + nextCentroid->weight;
+		double leftQuantile = weightBefore / digest->totalWeight;
+		double rightQuantile = (weightBefore + mergedWeight) / digest->totalWeight;
+
+		if (TDigestScale(rightQuantile) - TDigestScale(leftQuantile) <= 1.0)
+		{
+			currentCentroid.mean += (nextCentroid->mean - currentCentroid.mean) *
+									nextCentroid->weight / mergedWeight;
+			currentCentroid.weight = mergedWeight;
+		}
+		else
+		{
+			weightBefore += currentCentroid.weight;
+			digest->centroids[mergedCount] = currentCentroid;
+			mergedCount++;
+
+			currentCentroid = *nextCentroid;
+		}
+	}
+
+	digest->centroids[mergedCount] = currentCentroid;
+	mergedCount++;
+
+	digest->centroidCount = mergedCount;
+}
+
+
+/* TDigestScale maps the given quantile to the t-digest's k1 scale. */
+static double
+TDigestScale(double quantile)
+{
+	double boundedQuantile = Max(0.0, Min(1.0, quantile));
+
+	return TDIGEST_COMPRESSION / (2.0 * M_PI) * asin(2.0 * boundedQuantile - 1.0);
+}
+
+
+/* CompareCentroids orders centroids by their means. */
+static int
+CompareCentroids(const void *leftElement, const void *rightElement)
+{
+	const Centroid *leftCentroid = (const Centroid *) leftElement;
+	const Centroid *rightCentroid = (const Centroid *) rightElement;
+
+	if (leftCentroid->mean < rightCentroid->mean)
+	{
+		return -1;
+	}
+	else if (leftCentroid->mean > rightCentroid->mean)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * ArrayToTDigest reads the centroids of the given digest array into the given
+ * digest. The centroids are allocated in the current memory context.
+ */
+static void
+ArrayToTDigest(ArrayType *digestArray, TDigest *digest)
+{
+	Datum *elementArray = NULL;
+	bool *elementNullArray = NULL;
+	int elementCount = 0;
+	int centroidIndex = 0;
+
+	if (ARR_NDIM(digestArray) != 0 &&
+		(ARR_NDIM(digestArray) != 2 || ARR_DIMS(digestArray)[1] != 2))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("invalid t-digest"),
+						errdetail("Digests are arrays of {mean, weight} pairs.")));
+	}
+
+	deconstruct_array(digestArray, FLOAT8OID, sizeof(float8), FLOAT8PASSBYVAL, 'd',
+					  &elementArray, &elementNullArray, &elementCount);
+
+	memset(digest, 0, sizeof(TDigest));
+	digest->centroidCount = elementCount / 2;
+	digest->centroids = palloc0(Max(digest->centroidCount, 1) * sizeof(Centroid));
+
+	for (centroidIndex = 0; centroidIndex < digest->centroidCount; centroidIndex++)
+	{
+		Centroid *centroid = &digest->centroids[centroidIndex];
+
+		if (elementNullArray[2 * centroidIndex] ||
+			elementNullArray[2 * centroidIndex + 1])
+		{
+			ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+							errmsg("t-digest must not contain nulls")));
+		}
+
+		centroid->mean = DatumGetFloat8(elementArray[2 * centroidIndex]);
+		centroid->weight = DatumGetFloat8(elementArray[2 * centroidIndex + 1]);
+
+		/* zero or non-finite weights would break compression and percentiles */
+		if (isinf(centroid->mean) || isnan(centroid->mean) ||
+			isinf(centroid->weight) || isnan(centroid->weight) ||
+			centroid->weight <= 0.0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("invalid t-digest"),
+							errdetail("Centroid means must be finite, and their "
+									  "weights finite and positive.")));
+		}
+
+		digest->totalWeight += centroid->weight;
+		if (isinf(digest->totalWeight))
+		{
+			ereport(ERROR, (errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+							errmsg("t-digest weight is out of range")));
+		}
+	}
+}
+
+
+/* CreateTopNSketch allocates an empty summary in the given memory context. */
+static TopNSketch *
+CreateTopNSketch(MemoryContext aggregateContext)
+{
+	TopNSketch *sketch = MemoryContextAllocZero(aggregateContext, sizeof(TopNSketch));
+	sketch->entries = MemoryContextAllocZero(aggregateContext,
+											 TOPN_BUFFER_SIZE * sizeof(TopNEntry));
+
+	return sketch;
+}
+
+
+/*
+ * TopNAdd adds the given value with the given frequency to the summary, and
+ * reduces the summary first if its buffer is full.
+ */
+static void
+TopNAdd(TopNSketch *sketch, MemoryContext aggregateContext, const char *item,
+		int64 frequency)
+{
+	TopNEntry *entry = NULL;
+
+	if (sketch->entryCount >= TOPN_BUFFER_SIZE)
+	{
+		TopNReduce(sketch);
+	}
+
+	entry = &sketch->entries[sketch->entryCount];
+	entry->item = MemoryContextStrdup(aggregateContext, item);
+	entry->frequency = frequency;
+
+	sketch->entryCount++;
+}
+
+
+/*
+ * TopNReduce sums up the frequencies of equal values in the summary. If more
+ * than TOPN_SKETCH_SIZE values remain, the function subtracts the frequency of
+ * the first value beyond that size from all frequencies, and drops the values
+ * whose frequency drops to zero. This is the Misra-Gries reduction, which
+ * keeps the frequencies as lower bounds and allows merging summaries.
+ */
+static void
+TopNReduce(TopNSketch *sketch)
+{
+	int distinctCount = 0;
+	int entryIndex = 0;
+
+	if (sketch->entryCount == 0)
+	{
+		return;
+	}
+
+	qsort(sketch->entries, sketch->entryCount, sizeof(TopNEntry),
+		  CompareTopNEntriesByItem);
+
+	for (entryIndex = 1; entryIndex < sketch->entryCount; entryIndex++)
+	{
+		TopNEntry *distinctEntry = &sketch->entries[distinctCount];
+		TopNEntry *entry = &sketch->entries[entryIndex];
+
+		if (strcmp(distinctEntry->item, entry->item) == 0)
+		{
+			distinctEntry->frequency += entry->frequency;
+			pfree(entry->item);
+		}
+		else
+		{
+			distinctCount++;
+			sketch->entries[distinctCount] = *entry;
+		}
+	}
+
+	distinctCount++;
+	sketch->entryCount = distinctCount;
+
+	if (sketch->entryCount > TOPN_SKETCH_SIZE)
+	{
+		int64 thresholdFrequency = 0;
+		int keptCount = 0;
+
+		qsort(sketch->entries, sketch->entryCount, sizeof(TopNEntry),
+			  CompareTopNEntriesByFrequency);
+
+		thresholdFrequency = sketch->entries[TOPN_SKETCH_SIZE].frequency;
+
+		for (entryIndex = 0; entryIndex < sketch->entryCount; entryIndex++)
+		{
+			TopNEntry *entry = &sketch->entries[entryIndex];
+
+			if (entryIndex < TOPN_SKETCH_SIZE && entry->frequency > thresholdFrequency)
+			{
+				entry->frequency -= thresholdFrequency;
+				keptCount++;
+			}
+			else
+			{
+				pfree(entry->item);
+			}
+		}
+
+		sketch->entryCount = keptCount;
+	}
+}
+
+
+/* CompareTopNEntriesByItem orders top-n entries by their values. */
+static int
+CompareTopNEntriesByItem(const void *leftElement, const void *rightElement)
+{
+	const TopNEntry *leftEntry = (const TopNEntry *) leftElement;
+	const TopNEntry *rightEntry = (const TopNEntry *) rightElement;
+
+	return strcmp(leftEntry->item, rightEntry->item);
+}
+
+
+/*
+ * CompareTopNEntriesByFrequency orders top-n entries by descending frequency,
+ * and entries with equal frequencies by their values.
+ */
+static int
+CompareTopNEntriesByFrequency(const void *leftElement, const void *rightElement)
+{
+	const TopNEntry *leftEntry = (const TopNEntry *) leftElement;
+	const TopNEntry *rightEntry = (const TopNEntry *) rightElement;
+
+	if (leftEntry->frequency > rightEntry->frequency)
+	{
+		return -1;
+	}
+	else if (leftEntry->frequency < rightEntry->frequency)
+	{
+		return 1;
+	}
+
+	return strcmp(leftEntry->item, rightEntry->item);
+}
+
+
+/*
+ * AggregateMemoryContext returns the memory context in which the aggregate
+ * calling the given function keeps its transition state, and errors out if
+ * the function isn't called as part of an aggregate.
+ */
+static MemoryContext
+AggregateMemoryContext(FunctionCallInfo fcinfo)
+{
+	MemoryContext aggregateContext = NULL;
+
+	if (!AggCheckCallContext(fcinfo, &aggregateContext))
+	{
+		ereport(ERROR, (errmsg("aggregate function called in non-aggregate context")));
+	}
+
+	return aggregateContext;
+}
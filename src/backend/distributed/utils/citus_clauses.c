@@ -53,6 +53,16 @@ RequiresMasterEvaluation(Query *query)
 	{
 		RangeTblEntry *rte = (RangeTblEntry *) lfirst(rteCell);
 
+		if (rte->rtekind == RTE_VALUES && query->commandType == CMD_INSERT)
+		{
+			if (contain_mutable_functions((Node *) rte->values_lists))
+			{
+				return true;
+			}
+
+			continue;
+		}
+
 		if (rte->rtekind != RTE_SUBQUERY)
 		{
 			continue;
@@ -128,6 +138,15 @@ ExecuteMasterEvaluableFunctions(Query *query)
 	{
 		RangeTblEntry *rte = (RangeTblEntry *) lfirst(rteCell);
 
+		/* rows of multi-row INSERTs are evaluated one by one */
+		if (rte->rtekind == RTE_VALUES && commandType == CMD_INSERT)
+		{
+			modifiedNode = PartiallyEvaluateExpression((Node *) rte->values_lists);
+			rte->values_lists = (List *) modifiedNode;
+
+			continue;
+		}
+
 		if (rte->rtekind != RTE_SUBQUERY)
 		{
 			continue;
@@ -312,6 +312,7 @@ ReadTask(READFUNC_ARGS)
 	READ_CHAR_FIELD(replicationModel);
 	READ_BOOL_FIELD(insertSelectQuery);
 	READ_NODE_FIELD(relationShardList);
+	READ_BOOL_FIELD(parametersInQueryStringResolved);
 
 	READ_DONE();
 }
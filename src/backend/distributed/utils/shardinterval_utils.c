@@ -10,6 +10,7 @@
  */
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "access/nbtree.h"
 #include "catalog/pg_am.h"
 #include "catalog/pg_collation.h"
@@ -19,13 +20,16 @@
 #include "distributed/shardinterval_utils.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/worker_protocol.h"
+#include "utils/builtins.h"
 #include "utils/catcache.h"
+#include "utils/fmgroids.h"
 #include "utils/memutils.h"
 
 
 static int FindShardIntervalIndex(Datum searchedValue, ShardInterval **shardIntervalCache,
 								  int shardCount, char partitionMethod,
 								  FmgrInfo *compareFunction, bool useBinarySearch);
+static inline int UniformHashShardIndex(int32 hashedValue, int shardCount);
 static int SearchCachedShardInterval(Datum partitionColumnValue,
 									 ShardInterval **shardIntervalCache,
 									 int shardCount, FmgrInfo *compareFunction);
@@ -245,7 +249,7 @@ FindShardInterval(Datum partitionColumnValue, ShardInterval **shardIntervalCache
 
 	if (partitionMethod == DISTRIBUTE_BY_HASH)
 	{
-		searchedValue = FunctionCall1(hashFunction, partitionColumnValue);
+		HashPartitionValues(&partitionColumnValue, 1, hashFunction, &searchedValue);
 	}
 
 	shardIndex = FindShardIntervalIndex(searchedValue, shardIntervalCache,
@@ -299,21 +303,7 @@ FindShardIntervalIndex(Datum searchedValue, ShardInterval **shardIntervalCache,
 		}
 		else
 		{
-			int hashedValue = DatumGetInt32(searchedValue);
-			uint64 hashTokenIncrement = HASH_TOKEN_COUNT / shardCount;
-
-			shardIndex = (uint32) (hashedValue - INT32_MIN) / hashTokenIncrement;
-			Assert(shardIndex <= shardCount);
-
-			/*
-			 * If the shard count is not power of 2, the range of the last
-			 * shard becomes larger than others. For that extra piece of range,
-			 * we still need to use the last shard.
-			 */
-			if (shardIndex == shardCount)
-			{
-				shardIndex = shardCount - 1;
-			}
+			shardIndex = UniformHashShardIndex(DatumGetInt32(searchedValue), shardCount);
 		}
 	}
 	else if (partitionMethod == DISTRIBUTE_BY_NONE)
@@ -335,6 +325,165 @@ FindShardIntervalIndex(Datum searchedValue, ShardInterval **shardIntervalCache,
 }
 
 
+/*
+ * FindShardIntervalIndexes is the batched version of FindShardInterval. For
+ * each of the given partition column values, it finds the index of the shard
+ * interval in the cache which contains the value, and writes it to the
+ * corresponding element of shardIndexArray. Hashing all values at once, and
+ * computing the shard indexes of uniformly distributed hash tables in a
+ * single arithmetic pass, avoids most of the per-value overhead.
+ */
+void
+FindShardIntervalIndexes(Datum *partitionValueArray, int valueCount,
+						 ShardInterval **shardIntervalCache, int shardCount,
+						 char partitionMethod, FmgrInfo *compareFunction,
+						 FmgrInfo *hashFunction, bool useBinarySearch,
+						 int *shardIndexArray)
+{
+	Datum *searchedValueArray = partitionValueArray;
+	int valueIndex = 0;
+
+	if (partitionMethod == DISTRIBUTE_BY_HASH)
+	{
+		searchedValueArray = palloc(valueCount * sizeof(Datum));
+		HashPartitionValues(partitionValueArray, valueCount, hashFunction,
+							searchedValueArray);
+
+		if (!useBinarySearch)
+		{
+			for (valueIndex = 0; valueIndex < valueCount; valueIndex++)
+			{
+				int32 hashedValue = DatumGetInt32(searchedValueArray[valueIndex]);
+
+				shardIndexArray[valueIndex] = UniformHashShardIndex(hashedValue,
+																	shardCount);
+			}
+
+			pfree(searchedValueArray);
+			return;
+		}
+	}
+
+	for (valueIndex = 0; valueIndex < valueCount; valueIndex++)
+	{
+		shardIndexArray[valueIndex] =
+			FindShardIntervalIndex(searchedValueArray[valueIndex], shardIntervalCache,
+								   shardCount, partitionMethod, compareFunction,
+								   useBinarySearch);
+	}
+
+	if (searchedValueArray != partitionValueArray)
+	{
+		pfree(searchedValueArray);
+	}
+}
+
+
+/*
+ * HashPartitionValues computes the hashes of the given partition column values
+ * with the given hash function, and writes them to hashValueArray. For the
+ * hash functions of the most common partition column types, the function
+ * computes the hashes inline instead of going through the function manager
+ * for every value. The results are identical to those of the hash functions.
+ */
+void
+HashPartitionValues(Datum *partitionValueArray, int valueCount, FmgrInfo *hashFunction,
+					Datum *hashValueArray)
+{
+	int valueIndex = 0;
+
+	switch (hashFunction->fn_oid)
+	{
+		case F_HASHINT4:
+		{
+			for (valueIndex = 0; valueIndex < valueCount; valueIndex++)
+			{
+				int32 value = DatumGetInt32(partitionValueArray[valueIndex]);
+
+				hashValueArray[valueIndex] = hash_uint32((uint32) value);
+			}
+
+			break;
+		}
+
+		case F_HASHINT8:
+		{
+			for (valueIndex = 0; valueIndex < valueCount; valueIndex++)
+			{
+				int64 value = DatumGetInt64(partitionValueArray[valueIndex]);
+				uint32 lowHalf = (uint32) value;
+				uint32 highHalf = (uint32) (value >> 32);
+
+				/* same as hashint8(), which keeps int4 and int8 hashes compatible */
+				lowHalf ^= (value >= 0) ? highHalf : ~highHalf;
+
+				hashValueArray[valueIndex] = hash_uint32(lowHalf);
+			}
+
+			break;
+		}
+
+		case F_HASHTEXT:
+		{
+			for (valueIndex = 0; valueIndex < valueCount; valueIndex++)
+			{
+				Datum value = partitionValueArray[valueIndex];
+				text *textValue = DatumGetTextPP(value);
+
+				hashValueArray[valueIndex] =
+					hash_any((unsigned char *) VARDATA_ANY(textValue),
+							 VARSIZE_ANY_EXHDR(textValue));
+
+				if ((Pointer) textValue != DatumGetPointer(value))
+				{
+					pfree(textValue);
+				}
+			}
+
+			break;
+		}
+
+		default:
+		{
+			for (valueIndex = 0; valueIndex < valueCount; valueIndex++)
+			{
+				Datum value = partitionValueArray[valueIndex];
+
+				hashValueArray[valueIndex] = FunctionCall1(hashFunction, value);
+			}
+
+			break;
+		}
+	}
+}
+
+
+/*
+ * UniformHashShardIndex returns the index of the shard that contains the given
+ * hash value, for tables whose shards evenly divide the hash token space.
+ */
+static inline int
+UniformHashShardIndex(int32 hashedValue, int shardCount)
+{
+	uint64 hashTokenIncrement = HASH_TOKEN_COUNT / shardCount;
+	int shardIndex = (uint32) (hashedValue - INT32_MIN) / hashTokenIncrement;
+
+	Assert(shardIndex <= shardCount);
+
+	/*
+	 * If the shard count is not power of 2, the range of the last
+	 * shard becomes larger than others. For that extra piece of range,
+	 * we still need to use the last shard.
+	 */
+	if (shardIndex == shardCount)
+	{
+		shardIndex = shardCount - 1;
+	}
+
+	return shardIndex;
+}
+
+
 /*
  * SearchCachedShardInterval performs a binary search for a shard interval
  * matching a given partition column value and returns it's index in the cached
@@ -27,8 +27,10 @@
 
 #include "postgres.h"
 #include "miscadmin.h"
+#include <poll.h>
 #include <unistd.h>
 
+#include "access/hash.h"
 #include "commands/dbcommands.h"
 #include "distributed/multi_client_executor.h"
 #include "distributed/multi_server_executor.h"
@@ -38,8 +40,10 @@
 #include "libpq/hba.h"
 #include "libpq/pqsignal.h"
 #include "lib/stringinfo.h"
+#include "postmaster/autovacuum.h"
 #include "postmaster/bgworker.h"
 #include "postmaster/postmaster.h"
+#include "storage/barrier.h"
 #include "storage/fd.h"
 #include "storage/ipc.h"
 #include "storage/lwlock.h"
@@ -53,8 +57,37 @@
 int TaskTrackerDelay = 200;       /* process sleep interval in millisecs */
 int MaxRunningTasksPerNode = 16;  /* max number of running tasks */
 int MaxTrackedTasksPerNode = 1024; /* max number of tracked tasks */
+int TaskSchedulingPolicy = TASK_SCHEDULING_FIFO; /* policy to pick tasks to run */
+bool PrioritizeMergeTasks = false; /* run merge and map fetch tasks first */
+int TaskSchedulingWeight = 1;     /* weight of jobs assigned by this session */
 WorkerTasksSharedStateData *WorkerTasksSharedState; /* shared memory state */
 
+
+/*
+ * JobShare keeps track of a job's running and newly scheduled tasks, and of the
+ * position of the job's next schedulable task in the priority queue, when the
+ * task tracker picks tasks under the fair-share policy.
+ */
+typedef struct JobShare
+{
+	uint64 jobId; /* hash key */
+	uint32 weight;
+	uint32 taskCount;
+	uint32 nextQueueIndex;
+} JobShare;
+
+
+/*
+ * WorkerTaskKey holds the identifiers of a task in the shared hash, laid out in
+ * the same way as the key fields at the beginning of WorkerTask.
+ */
+typedef struct WorkerTaskKey
+{
+	uint64 jobId;
+	uint32 taskId;
+} WorkerTaskKey;
+
+
 static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
 
 /* Flags set by interrupt handlers for later service in the main loop */
@@ -64,7 +97,11 @@ static volatile sig_atomic_t got_SIGTERM = false;
 /* initialization forward declarations */
 static void TaskTrackerMain(Datum main_arg);
 static Size TaskTrackerShmemSize(void);
+static int TaskStatusWaiterCount(void);
+static Size WorkerTasksSharedStateSize(void);
 static void TaskTrackerShmemInit(void);
+static uint32 WorkerTaskHashCode(const void *key, Size keySize);
+static uint32 JobIdHashCode(uint64 jobId);
 
 /* Signal handler forward declarations */
 static void TrackerSigHupHandler(SIGNAL_ARGS);
@@ -75,16 +112,20 @@ static void TrackerCleanupJobDirectories(void);
 static void TrackerCleanupJobSchemas(void);
 static void TrackerCleanupConnections(HTAB *WorkerTasksHash);
 static void TrackerRegisterShutDown(HTAB *WorkerTasksHash);
-static void TrackerDelayLoop(void);
+static void TrackerWaitForEvents(HTAB *WorkerTasksHash);
 static List * SchedulableTaskList(HTAB *WorkerTasksHash);
-static WorkerTask * SchedulableTaskPriorityQueue(HTAB *WorkerTasksHash);
+static HTAB * JobShareHash(HTAB *WorkerTasksHash, WorkerTask *taskQueue,
+						   uint32 queueSize);
+static bool JobShareTakesPrecedence(JobShare *jobShare, JobShare *otherJobShare,
+									WorkerTask *taskQueue);
 static uint32 CountTasksMatchingCriteria(HTAB *WorkerTasksHash,
 										 bool (*CriteriaFunction)(WorkerTask *));
 static bool RunningTask(WorkerTask *workerTask);
 static bool SchedulableTask(WorkerTask *workerTask);
-static int CompareTasksByTime(const void *first, const void *second);
+static int CompareTasksByPriority(const void *first, const void *second);
 static void ScheduleWorkerTasks(HTAB *WorkerTasksHash, List *schedulableTaskList);
 static void ManageWorkerTasksHash(HTAB *WorkerTasksHash);
+static List * WorkerTaskKeyList(HTAB *WorkerTasksHash);
 static void ManageWorkerTask(WorkerTask *workerTask, HTAB *WorkerTasksHash);
 static void RemoveWorkerTask(WorkerTask *workerTask, HTAB *WorkerTasksHash);
 static void CreateJobDirectoryIfNotExists(uint64 jobId);
@@ -211,17 +252,15 @@ TaskTrackerMain(Datum main_arg)
 		TrackerCleanupJobSchemas();
 	}
 
+	/* let the task tracker protocol functions wake us up through our latch */
+	WorkerTasksSharedState->taskTrackerLatch = MyLatch;
+
 	/* Loop forever */
 	for (;;)
 	{
 		/*
 		 * Emergency bailout if postmaster has died. This is to avoid the
 		 * necessity for manual cleanup of all postmaster children.
-		 *
-		 * XXX: Note that PostgreSQL background processes no longer nap between
-		 * their loops, but instead uses latches to wake up when necessary. We
-		 * should switch to using latches in here too, and have the task tracker
-		 * assign function notify us when there is a new task.
 		 */
 		if (!PostmasterIsAlive())
 		{
@@ -244,6 +283,9 @@ TaskTrackerMain(Datum main_arg)
 			 */
 			ExitOnAnyError = true;
 
+			/* Protocol functions should no longer wake us up */
+			WorkerTasksSharedState->taskTrackerLatch = NULL;
+
 			/* Close open connections to local backends */
 			TrackerCleanupConnections(WorkerTasksSharedState->taskHash);
 
@@ -254,11 +296,17 @@ TaskTrackerMain(Datum main_arg)
 			proc_exit(0);
 		}
 
+		/*
+		 * Reset the latch before looking at the shared hash, so that changes
+		 * made to the hash from here on wake us up from the wait below.
+		 */
+		ResetLatch(MyLatch);
+
 		/* Call the function that does the actual work */
 		ManageWorkerTasksHash(WorkerTasksSharedState->taskHash);
 
-		/* Sleep for the configured time */
-		TrackerDelayLoop();
+		/* Sleep until something changes, or for at most the configured time */
+		TrackerWaitForEvents(WorkerTasksSharedState->taskHash);
 	}
 }
 
@@ -266,7 +314,8 @@ TaskTrackerMain(Datum main_arg)
 /*
  * WorkerTasksHashEnter creates a new worker task in the shared hash, and
  * performs checks for this task. Note that the caller still needs to initialize
- * the worker task's fields, and hold the appopriate locks for the shared hash.
+ * the worker task's fields, and hold the lock of the job's hash partition in
+ * exclusive mode.
  */
 WorkerTask *
 WorkerTasksHashEnter(uint64 jobId, uint32 taskId)
@@ -303,8 +352,8 @@ WorkerTasksHashEnter(uint64 jobId, uint32 taskId)
 
 /*
  * WorkerTasksHashFind looks up the worker task with the given identifiers in
- * the shared hash. Note that the caller still needs to hold the appropriate
- * locks for the shared hash.
+ * the shared hash. Note that the caller still needs to hold the lock of the
+ * job's hash partition.
  */
 WorkerTask *
 WorkerTasksHashFind(uint64 jobId, uint32 taskId)
@@ -366,8 +415,9 @@ TrackerCleanupJobSchemas(void)
 	ListCell *databaseNameCell = NULL;
 	const uint64 jobId = RESERVED_JOB_ID;
 	uint32 taskIndex = 1;
+	LWLock *partitionLock = WorkerTasksHashPartitionLock(jobId);
 
-	LWLockAcquire(&WorkerTasksSharedState->taskHashLock, LW_EXCLUSIVE);
+	LWLockAcquire(partitionLock, LW_EXCLUSIVE);
 
 	foreach(databaseNameCell, databaseNameList)
 	{
@@ -396,11 +446,13 @@ TrackerCleanupJobSchemas(void)
 		/* zero out all other fields */
 		cleanupTask->connectionId = INVALID_CONNECTION_ID;
 		cleanupTask->failureCount = 0;
+		cleanupTask->schedulingWeight = 1;
+		cleanupTask->mergeTask = false;
 
 		taskIndex++;
 	}
 
-	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
+	LWLockRelease(partitionLock);
 
 	if (databaseNameList != NIL)
 	{
@@ -447,41 +499,172 @@ TrackerRegisterShutDown(HTAB *WorkerTasksHash)
 	uint64 jobId = RESERVED_JOB_ID;
 	uint32 taskId = SHUTDOWN_MARKER_TASK_ID;
 	WorkerTask *shutdownMarkerTask = NULL;
+	LWLock *partitionLock = WorkerTasksHashPartitionLock(jobId);
 
-	LWLockAcquire(&WorkerTasksSharedState->taskHashLock, LW_EXCLUSIVE);
+	LWLockAcquire(partitionLock, LW_EXCLUSIVE);
 
 	shutdownMarkerTask = WorkerTasksHashEnter(jobId, taskId);
 	shutdownMarkerTask->taskStatus = TASK_SUCCEEDED;
 	shutdownMarkerTask->connectionId = INVALID_CONNECTION_ID;
 
-	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
+	LWLockRelease(partitionLock);
 }
 
 
-/* Sleeps either for the configured time or until a signal is received. */
+/*
+ * TrackerWaitForEvents waits until the task tracker has new work to do: until a
+ * running task's connection becomes readable, the task tracker protocol
+ * functions set our latch after changing the shared hash, or we receive a
+ * signal. If assigned tasks can be scheduled right away, for example because a
+ * task completed in the last round, the function doesn't wait at all.
+ *
+ * The function never waits longer than citus.task_tracker_delay. This timeout
+ * paces the retries of failed tasks and gives canceled tasks' backends time to
+ * flush their responses, as before. It also covers the small window in which a
+ * latch set right before we start polling the connections' sockets doesn't
+ * interrupt the poll.
+ */
 static void
-TrackerDelayLoop(void)
+TrackerWaitForEvents(HTAB *WorkerTasksHash)
 {
-	const long SignalCheckInterval = 1000000L; /* check signal every second */
+	WaitInfo *waitInfo = NULL;
+	uint32 runningTaskCount = 0;
+	uint32 schedulableTaskCount = 0;
+	HASH_SEQ_STATUS status;
+	WorkerTask *currentTask = NULL;
 
-	/*
-	 * On some platforms, signals do not interrupt the sleep. To ensure we
-	 * respond promptly when someone signals us, we break down the sleep into
-	 * 1-second increments, and check for interrupts after each nap.
-	 */
-	long trackerDelay = TaskTrackerDelay * 1000L;
-	while (trackerDelay > (SignalCheckInterval - 1))
+	LockWorkerTasksHash(LW_SHARED);
+
+	waitInfo = MultiClientCreateWaitInfo(hash_get_num_entries(WorkerTasksHash));
+
+	hash_seq_init(&status, WorkerTasksHash);
+
+	currentTask = (WorkerTask *) hash_seq_search(&status);
+	while (currentTask != NULL)
 	{
-		if (got_SIGHUP || got_SIGTERM)
+		if (RunningTask(currentTask))
 		{
-			break;
+			MultiClientRegisterWait(waitInfo, TASK_STATUS_SOCKET_READ,
+									currentTask->connectionId);
+			runningTaskCount++;
 		}
-		pg_usleep(SignalCheckInterval);
-		trackerDelay -= SignalCheckInterval;
+		else if (SchedulableTask(currentTask))
+		{
+			schedulableTaskCount++;
+		}
+
+		currentTask = (WorkerTask *) hash_seq_search(&status);
 	}
-	if (!(got_SIGHUP || got_SIGTERM))
+
+	UnlockWorkerTasksHash();
+
+	if (schedulableTaskCount > 0 && runningTaskCount < MaxRunningTasksPerNode)
 	{
-		pg_usleep(trackerDelay);
+		/* we have free slots and tasks to run in them, so don't wait */
+	}
+	else if (runningTaskCount == 0)
+	{
+		WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+				  TaskTrackerDelay);
+	}
+	else if (!MyLatch->is_set)
+	{
+		/*
+		 * Another process setting our latch sends us a signal, which like any
+		 * other signal interrupts the poll. We then simply return.
+		 */
+		int pollResult = poll(waitInfo->pollfds, waitInfo->registeredWaiters,
+							  TaskTrackerDelay);
+		if (pollResult < 0 && errno != EINTR && errno != EAGAIN)
+		{
+			ereport(ERROR, (errcode_for_socket_access(),
+							errmsg("poll failed: %m")));
+		}
+	}
+
+	MultiClientFreeWaitInfo(waitInfo);
+}
+
+
+/*
+ * WakeupTaskTracker sets the task tracker's latch. The task tracker protocol
+ * functions call this function after changing the shared hash, so that the task
+ * tracker reacts to the change right away instead of in its next round.
+ */
+void
+WakeupTaskTracker(void)
+{
+	Latch *taskTrackerLatch = WorkerTasksSharedState->taskTrackerLatch;
+
+	if (taskTrackerLatch != NULL)
+	{
+		SetLatch(taskTrackerLatch);
+	}
+}
+
+
+/*
+ * RegisterTaskStatusWaiter registers the current backend's latch, so that the
+ * task tracker wakes the backend up as soon as a task finishes. The function
+ * returns false if the backend can't be registered, in which case the caller
+ * needs to check task statuses periodically.
+ */
+bool
+RegisterTaskStatusWaiter(void)
+{
+	int waiterIndex = MyBackendId - 1;
+
+	if (waiterIndex < 0 || waiterIndex >= WorkerTasksSharedState->taskStatusWaiterCount)
+	{
+		return false;
+	}
+
+	WorkerTasksSharedState->taskStatusWaiterLatches[waiterIndex] = MyLatch;
+
+	/* make sure the task tracker sees our latch before we read task statuses */
+	pg_memory_barrier();
+
+	return true;
+}
+
+
+/* UnregisterTaskStatusWaiter removes the current backend's latch again. */
+void
+UnregisterTaskStatusWaiter(void)
+{
+	int waiterIndex = MyBackendId - 1;
+
+	if (waiterIndex < 0 || waiterIndex >= WorkerTasksSharedState->taskStatusWaiterCount)
+	{
+		return;
+	}
+
+	WorkerTasksSharedState->taskStatusWaiterLatches[waiterIndex] = NULL;
+}
+
+
+/*
+ * WakeupTaskStatusWaiters sets the latches of all backends that wait for tasks
+ * to finish. The task tracker calls this function after tasks finished, and the
+ * waiting backends then check whether one of their tasks is among them.
+ */
+void
+WakeupTaskStatusWaiters(void)
+{
+	int waiterCount = WorkerTasksSharedState->taskStatusWaiterCount;
+	int waiterIndex = 0;
+
+	/* make sure waiters that register from here on see the finished tasks */
+	pg_memory_barrier();
+
+	for (waiterIndex = 0; waiterIndex < waiterCount; waiterIndex++)
+	{
+		Latch *waiterLatch = WorkerTasksSharedState->taskStatusWaiterLatches[waiterIndex];
+
+		if (waiterLatch != NULL)
+		{
+			SetLatch(waiterLatch);
+		}
 	}
 }
 
@@ -530,7 +713,7 @@ TaskTrackerShmemSize(void)
 	Size size = 0;
 	Size hashSize = 0;
 
-	size = add_size(size, sizeof(WorkerTasksSharedStateData));
+	size = add_size(size, WorkerTasksSharedStateSize());
 
 	hashSize = hash_estimate_size(MaxTrackedTasksPerNode, sizeof(WorkerTask));
 	size = add_size(size, hashSize);
@@ -539,6 +722,30 @@ TaskTrackerShmemSize(void)
 }
 
 
+/*
+ * TaskStatusWaiterCount returns the number of backends that may wait for tasks
+ * to finish, which is MaxBackends. Postgres only sets MaxBackends after loading
+ * shared_preload_libraries, and therefore after we request shared memory, so we
+ * compute it the same way postgres does.
+ */
+static int
+TaskStatusWaiterCount(void)
+{
+	return MaxConnections + autovacuum_max_workers + 1 + max_worker_processes;
+}
+
+
+/* Returns the size of the task tracker's shared state, including its waiters. */
+static Size
+WorkerTasksSharedStateSize(void)
+{
+	Size size = offsetof(WorkerTasksSharedStateData, taskStatusWaiterLatches);
+	size = add_size(size, mul_size(TaskStatusWaiterCount(), sizeof(Latch *)));
+
+	return size;
+}
+
+
 /* Initializes the shared memory used for keeping track of tasks. */
 static void
 TaskTrackerShmemInit(void)
@@ -549,19 +756,23 @@ TaskTrackerShmemInit(void)
 	long maxTableSize = 0;
 	long initTableSize = 0;
 
+	/* partitioned hash tables can't grow, so we allocate them at full size */
 	maxTableSize = (long) MaxTrackedTasksPerNode;
-	initTableSize = maxTableSize / 8;
+	initTableSize = maxTableSize;
 
 	/*
 	 * Allocate the control structure for the hash table that maps unique task
 	 * identifiers (uint64:uint32) to general task information, as well as the
-	 * parameters needed to run the task.
+	 * parameters needed to run the task. The hash table is partitioned so that
+	 * the task tracker protocol functions can look up and change tasks of
+	 * different jobs concurrently.
 	 */
 	memset(&info, 0, sizeof(info));
 	info.keysize = sizeof(uint64) + sizeof(uint32);
 	info.entrysize = sizeof(WorkerTask);
-	info.hash = tag_hash;
-	hashFlags = (HASH_ELEM | HASH_FUNCTION);
+	info.hash = WorkerTaskHashCode;
+	info.num_partitions = WORKER_TASKS_HASH_PARTITIONS;
+	hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_PARTITION);
 
 	/*
 	 * Currently the lock isn't required because allocation only happens at
@@ -573,21 +784,36 @@ TaskTrackerShmemInit(void)
 	/* allocate struct containing task tracker related shared state */
 	WorkerTasksSharedState =
 		(WorkerTasksSharedStateData *) ShmemInitStruct("Worker Task Control",
-													   sizeof(WorkerTasksSharedStateData),
+													   WorkerTasksSharedStateSize(),
 													   &alreadyInitialized);
 
 	if (!alreadyInitialized)
 	{
-		/* initialize lwlock protecting the task tracker hash table */
+		/* initialize lwlocks protecting the task tracker hash table partitions */
 		LWLockTranche *tranche = &WorkerTasksSharedState->taskHashLockTranche;
+		int partitionIndex = 0;
+		int waiterIndex = 0;
 
 		WorkerTasksSharedState->taskHashTrancheId = LWLockNewTrancheId();
-		tranche->array_base = &WorkerTasksSharedState->taskHashLock;
-		tranche->array_stride = sizeof(LWLock);
+		tranche->array_base = WorkerTasksSharedState->taskHashLocks;
+		tranche->array_stride = sizeof(LWLockPadded);
 		tranche->name = "Worker Task Hash Tranche";
 		LWLockRegisterTranche(WorkerTasksSharedState->taskHashTrancheId, tranche);
-		LWLockInitialize(&WorkerTasksSharedState->taskHashLock,
-						 WorkerTasksSharedState->taskHashTrancheId);
+
+		for (partitionIndex = 0; partitionIndex < WORKER_TASKS_HASH_PARTITIONS;
+			 partitionIndex++)
+		{
+			LWLockInitialize(&WorkerTasksSharedState->taskHashLocks[partitionIndex].lock,
+							 WorkerTasksSharedState->taskHashTrancheId);
+		}
+
+		WorkerTasksSharedState->taskTrackerLatch = NULL;
+
+		WorkerTasksSharedState->taskStatusWaiterCount = TaskStatusWaiterCount();
+		for (waiterIndex = 0; waiterIndex < TaskStatusWaiterCount(); waiterIndex++)
+		{
+			WorkerTasksSharedState->taskStatusWaiterLatches[waiterIndex] = NULL;
+		}
 	}
 
 	/*  allocate hash table */
@@ -608,6 +834,81 @@ TaskTrackerShmemInit(void)
 }
 
 
+/*
+ * WorkerTaskHashCode computes the hash code of a task in the shared hash. The
+ * lowest bits of the hash code only depend on the task's job id, and pick the
+ * hash partition the task belongs to. All tasks of a job therefore fall into
+ * the same partition and are protected by the same lock. The remaining bits mix
+ * in the task id, so that a job's tasks still spread over the hash buckets.
+ */
+static uint32
+WorkerTaskHashCode(const void *key, Size keySize)
+{
+	const WorkerTaskKey *taskKey = (const WorkerTaskKey *) key;
+	uint32 jobIdHashCode = JobIdHashCode(taskKey->jobId);
+	uint32 taskIdHashCode = DatumGetUInt32(hash_uint32(taskKey->taskId));
+
+	Assert(keySize == sizeof(uint64) + sizeof(uint32));
+
+	return (taskIdHashCode << WORKER_TASKS_HASH_PARTITION_BITS) ^ jobIdHashCode;
+}
+
+
+/* JobIdHashCode computes the hash code of the given job id. */
+static uint32
+JobIdHashCode(uint64 jobId)
+{
+	return DatumGetUInt32(hash_any((unsigned char *) &jobId, sizeof(uint64)));
+}
+
+
+/*
+ * WorkerTasksHashPartitionLock returns the lock that protects the shared hash
+ * partition holding the tasks of the given job. Callers need to hold this lock
+ * to look up, add, change, or remove these tasks.
+ */
+LWLock *
+WorkerTasksHashPartitionLock(uint64 jobId)
+{
+	uint32 partitionIndex = JobIdHashCode(jobId) % WORKER_TASKS_HASH_PARTITIONS;
+
+	return &WorkerTasksSharedState->taskHashLocks[partitionIndex].lock;
+}
+
+
+/*
+ * LockWorkerTasksHash acquires the locks of all shared hash partitions in the
+ * given mode. Callers need to hold all these locks to scan the shared hash.
+ * The locks are always acquired in the same order to avoid deadlocks.
+ */
+void
+LockWorkerTasksHash(LWLockMode lockMode)
+{
+	int partitionIndex = 0;
+
+	for (partitionIndex = 0; partitionIndex < WORKER_TASKS_HASH_PARTITIONS;
+		 partitionIndex++)
+	{
+		LWLockAcquire(&WorkerTasksSharedState->taskHashLocks[partitionIndex].lock,
+					  lockMode);
+	}
+}
+
+
+/* UnlockWorkerTasksHash releases the locks of all shared hash partitions. */
+void
+UnlockWorkerTasksHash(void)
+{
+	int partitionIndex = 0;
+
+	for (partitionIndex = WORKER_TASKS_HASH_PARTITIONS - 1; partitionIndex >= 0;
+		 partitionIndex--)
+	{
+		LWLockRelease(&WorkerTasksSharedState->taskHashLocks[partitionIndex].lock);
+	}
+}
+
+
 /* ------------------------------------------------------------
  * Task scheduling and management functions follow
  * ------------------------------------------------------------
@@ -616,9 +917,11 @@ TaskTrackerShmemInit(void)
 /*
  * SchedulableTaskList calculates the number of tasks to schedule at this given
  * moment, and creates a deep-copied list containing that many tasks. The tasks
- * in the list are sorted according to a priority criteria, currently the task's
- * assignment time. Note that this function expects the caller to hold a read
- * lock over the shared hash.
+ * in the list are sorted according to a priority criteria, see
+ * CompareTasksByPriority(). Under the fair-share policy, the tasks are further
+ * picked such that jobs get running tasks in proportion to their weights. Note
+ * that this function expects the caller to hold read locks over all partitions
+ * of the shared hash.
  */
 static List *
 SchedulableTaskList(HTAB *WorkerTasksHash)
@@ -651,13 +954,22 @@ SchedulableTaskList(HTAB *WorkerTasksHash)
 	/* get all schedulable tasks ordered according to a priority criteria */
 	schedulableTaskQueue = SchedulableTaskPriorityQueue(WorkerTasksHash);
 
-	for (queueIndex = 0; queueIndex < tasksToScheduleCount; queueIndex++)
+	if (TaskSchedulingPolicy == TASK_SCHEDULING_FAIR_SHARE)
 	{
-		WorkerTask *schedulableTask = (WorkerTask *) palloc0(sizeof(WorkerTask));
-		schedulableTask->jobId = schedulableTaskQueue[queueIndex].jobId;
-		schedulableTask->taskId = schedulableTaskQueue[queueIndex].taskId;
+		schedulableTaskList = FairShareTaskList(WorkerTasksHash, schedulableTaskQueue,
+												schedulableTaskCount,
+												tasksToScheduleCount);
+	}
+	else
+	{
+		for (queueIndex = 0; queueIndex < tasksToScheduleCount; queueIndex++)
+		{
+			WorkerTask *schedulableTask = (WorkerTask *) palloc0(sizeof(WorkerTask));
+			schedulableTask->jobId = schedulableTaskQueue[queueIndex].jobId;
+			schedulableTask->taskId = schedulableTaskQueue[queueIndex].taskId;
 
-		schedulableTaskList = lappend(schedulableTaskList, schedulableTask);
+			schedulableTaskList = lappend(schedulableTaskList, schedulableTask);
+		}
 	}
 
 	/* free priority queue */
@@ -672,7 +984,7 @@ SchedulableTaskList(HTAB *WorkerTasksHash)
  * tasks in the shared hash, orders these tasks according to a sorting criteria,
  * and returns the sorted array.
  */
-static WorkerTask *
+WorkerTask *
 SchedulableTaskPriorityQueue(HTAB *WorkerTasksHash)
 {
 	HASH_SEQ_STATUS status;
@@ -699,10 +1011,12 @@ SchedulableTaskPriorityQueue(HTAB *WorkerTasksHash)
 	{
 		if (SchedulableTask(currentTask))
 		{
-			/* tasks in the priority queue only need the first three fields */
+			/* tasks in the priority queue only need their scheduling fields */
 			priorityQueue[queueIndex].jobId = currentTask->jobId;
 			priorityQueue[queueIndex].taskId = currentTask->taskId;
 			priorityQueue[queueIndex].assignedAt = currentTask->assignedAt;
+			priorityQueue[queueIndex].schedulingWeight = currentTask->schedulingWeight;
+			priorityQueue[queueIndex].mergeTask = currentTask->mergeTask;
 
 			queueIndex++;
 		}
@@ -711,12 +1025,188 @@ SchedulableTaskPriorityQueue(HTAB *WorkerTasksHash)
 	}
 
 	/* now order elements in the queue according to our sorting criterion */
-	qsort(priorityQueue, queueSize, sizeof(WorkerTask), CompareTasksByTime);
+	qsort(priorityQueue, queueSize, sizeof(WorkerTask), CompareTasksByPriority);
 
 	return priorityQueue;
 }
 
 
+/*
+ * FairShareTaskList picks tasks to schedule from the given priority queue, one
+ * at a time. Each time, the function picks the next task of the job that has
+ * the fewest running and already picked tasks relative to its weight. This way,
+ * a job with many assigned tasks can't keep other jobs from running. Cleanup
+ * tasks are always picked first.
+ */
+List *
+FairShareTaskList(HTAB *WorkerTasksHash, WorkerTask *taskQueue, uint32 queueSize,
+				  uint32 tasksToScheduleCount)
+{
+	List *schedulableTaskList = NIL;
+	HTAB *jobShareHash = JobShareHash(WorkerTasksHash, taskQueue, queueSize);
+	uint32 scheduledTaskCount = 0;
+
+	for (scheduledTaskCount = 0; scheduledTaskCount < tasksToScheduleCount;
+		 scheduledTaskCount++)
+	{
+		HASH_SEQ_STATUS status;
+		JobShare *jobShare = NULL;
+		JobShare *selectedJobShare = NULL;
+		WorkerTask *selectedTask = NULL;
+		WorkerTask *schedulableTask = NULL;
+		uint32 queueIndex = 0;
+
+		hash_seq_init(&status, jobShareHash);
+
+		jobShare = (JobShare *) hash_seq_search(&status);
+		while (jobShare != NULL)
+		{
+			/* skip jobs without any tasks left to schedule */
+			if (jobShare->nextQueueIndex < queueSize &&
+				(selectedJobShare == NULL ||
+				 JobShareTakesPrecedence(jobShare, selectedJobShare, taskQueue)))
+			{
+				selectedJobShare = jobShare;
+			}
+
+			jobShare = (JobShare *) hash_seq_search(&status);
+		}
+
+		if (selectedJobShare == NULL)
+		{
+			break;
+		}
+
+		selectedTask = &taskQueue[selectedJobShare->nextQueueIndex];
+
+		schedulableTask = (WorkerTask *) palloc0(sizeof(WorkerTask));
+		schedulableTask->jobId = selectedTask->jobId;
+		schedulableTask->taskId = selectedTask->taskId;
+
+		schedulableTaskList = lappend(schedulableTaskList, schedulableTask);
+
+		/* advance to the job's next task in the priority queue */
+		selectedJobShare->taskCount++;
+
+		queueIndex = selectedJobShare->nextQueueIndex + 1;
+		while (queueIndex < queueSize &&
+			   taskQueue[queueIndex].jobId != selectedJobShare->jobId)
+		{
+			queueIndex++;
+		}
+
+		selectedJobShare->nextQueueIndex = queueIndex;
+	}
+
+	hash_destroy(jobShareHash);
+
+	return schedulableTaskList;
+}
+
+
+/*
+ * JobShareHash creates a hash with one entry for each job that has tasks in the
+ * given priority queue. Each entry holds the job's weight, which is the highest
+ * weight among the job's schedulable tasks, the number of the job's running
+ * tasks, and the position of the job's first task in the priority queue.
+ */
+static HTAB *
+JobShareHash(HTAB *WorkerTasksHash, WorkerTask *taskQueue, uint32 queueSize)
+{
+	HTAB *jobShareHash = NULL;
+	HASHCTL info;
+	int hashFlags = 0;
+	uint32 queueIndex = 0;
+	HASH_SEQ_STATUS status;
+	WorkerTask *currentTask = NULL;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(uint64);
+	info.entrysize = sizeof(JobShare);
+	info.hash = tag_hash;
+	info.hcxt = CurrentMemoryContext;
+	hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	jobShareHash = hash_create("Job Share Hash", 32, &info, hashFlags);
+
+	for (queueIndex = 0; queueIndex < queueSize; queueIndex++)
+	{
+		WorkerTask *queuedTask = &taskQueue[queueIndex];
+		uint32 taskWeight = Max(queuedTask->schedulingWeight, 1);
+		bool jobShareFound = false;
+
+		JobShare *jobShare = (JobShare *) hash_search(jobShareHash, &queuedTask->jobId,
+													  HASH_ENTER, &jobShareFound);
+		if (!jobShareFound)
+		{
+			jobShare->weight = taskWeight;
+			jobShare->taskCount = 0;
+			jobShare->nextQueueIndex = queueIndex;
+		}
+		else
+		{
+			jobShare->weight = Max(jobShare->weight, taskWeight);
+		}
+	}
+
+	/* count running tasks of jobs that have tasks to schedule */
+	hash_seq_init(&status, WorkerTasksHash);
+
+	currentTask = (WorkerTask *) hash_seq_search(&status);
+	while (currentTask != NULL)
+	{
+		if (RunningTask(currentTask))
+		{
+			JobShare *jobShare = (JobShare *) hash_search(jobShareHash,
+														  &currentTask->jobId,
+														  HASH_FIND, NULL);
+			if (jobShare != NULL)
+			{
+				jobShare->taskCount++;
+			}
+		}
+
+		currentTask = (WorkerTask *) hash_seq_search(&status);
+	}
+
+	return jobShareHash;
+}
+
+
+/*
+ * JobShareTakesPrecedence returns true if the next task of the given job should
+ * be scheduled before the next task of the other job. Cleanup tasks come first;
+ * otherwise the job with the smaller share of tasks relative to its weight
+ * comes first, and if both shares are equal, the job whose next task comes
+ * first in the priority queue.
+ */
+static bool
+JobShareTakesPrecedence(JobShare *jobShare, JobShare *otherJobShare,
+						WorkerTask *taskQueue)
+{
+	WorkerTask *nextTask = &taskQueue[jobShare->nextQueueIndex];
+	WorkerTask *otherNextTask = &taskQueue[otherJobShare->nextQueueIndex];
+	bool cleanupTask = (nextTask->assignedAt == HIGH_PRIORITY_TASK_TIME);
+	bool otherCleanupTask = (otherNextTask->assignedAt == HIGH_PRIORITY_TASK_TIME);
+
+	/* compare taskCount / weight without dividing */
+	uint64 share = (uint64) jobShare->taskCount * otherJobShare->weight;
+	uint64 otherShare = (uint64) otherJobShare->taskCount * jobShare->weight;
+
+	if (cleanupTask != otherCleanupTask)
+	{
+		return cleanupTask;
+	}
+
+	if (!cleanupTask && share != otherShare)
+	{
+		return share < otherShare;
+	}
+
+	return jobShare->nextQueueIndex < otherJobShare->nextQueueIndex;
+}
+
+
 /* Counts the number of tasks that match the given criteria function. */
 static uint32
 CountTasksMatchingCriteria(HTAB *WorkerTasksHash,
@@ -772,24 +1262,52 @@ SchedulableTask(WorkerTask *workerTask)
 }
 
 
-/* Comparison function to compare two worker tasks by their assignment times. */
+/*
+ * Comparison function to compare two worker tasks by their priorities. Tasks
+ * that are assigned earlier have higher priority. If citus.prioritize_merge_tasks
+ * is enabled, merge and map fetch tasks further come before other tasks that
+ * aren't cleanup tasks: these tasks only get assigned once the map tasks they
+ * depend on completed, and the rest of their job waits for them.
+ */
 static int
-CompareTasksByTime(const void *first, const void *second)
+CompareTasksByPriority(const void *first, const void *second)
 {
 	WorkerTask *firstTask = (WorkerTask *) first;
 	WorkerTask *secondTask = (WorkerTask *) second;
+	bool firstCleanupTask = (firstTask->assignedAt == HIGH_PRIORITY_TASK_TIME);
+	bool secondCleanupTask = (secondTask->assignedAt == HIGH_PRIORITY_TASK_TIME);
+
+	if (PrioritizeMergeTasks && !firstCleanupTask && !secondCleanupTask &&
+		firstTask->mergeTask != secondTask->mergeTask)
+	{
+		return firstTask->mergeTask ? -1 : 1;
+	}
 
 	/* tasks that are assigned earlier have higher priority */
-	int timeDiff = firstTask->assignedAt - secondTask->assignedAt;
-	return timeDiff;
+	if (firstTask->assignedAt != secondTask->assignedAt)
+	{
+		return (firstTask->assignedAt < secondTask->assignedAt) ? -1 : 1;
+	}
+
+	/* break ties deterministically, so tasks of a job run in order */
+	if (firstTask->jobId != secondTask->jobId)
+	{
+		return (firstTask->jobId < secondTask->jobId) ? -1 : 1;
+	}
+
+	if (firstTask->taskId != secondTask->taskId)
+	{
+		return (firstTask->taskId < secondTask->taskId) ? -1 : 1;
+	}
+
+	return 0;
 }
 
 
 /*
  * ScheduleWorkerTasks takes a list of tasks to schedule, and for each task in
  * the list, finds and schedules the corresponding task from the shared hash.
- * Note that this function expects the caller to hold an exclusive lock over the
- * shared hash.
+ * The function locks each task's hash partition while scheduling the task.
  */
 static void
 ScheduleWorkerTasks(HTAB *WorkerTasksHash, List *schedulableTaskList)
@@ -800,28 +1318,21 @@ ScheduleWorkerTasks(HTAB *WorkerTasksHash, List *schedulableTaskList)
 		WorkerTask *schedulableTask = (WorkerTask *) lfirst(schedulableTaskCell);
 		WorkerTask *taskToSchedule = NULL;
 		void *hashKey = (void *) schedulableTask;
+		LWLock *partitionLock = WorkerTasksHashPartitionLock(schedulableTask->jobId);
+
+		LWLockAcquire(partitionLock, LW_EXCLUSIVE);
 
 		taskToSchedule = (WorkerTask *) hash_search(WorkerTasksHash, hashKey,
 													HASH_FIND, NULL);
 
-		/* if task is null, the shared hash is in an incosistent state */
-		if (taskToSchedule == NULL)
-		{
-			ereport(ERROR, (errmsg("could not find the worker task to schedule"),
-							errdetail("Task jobId: " UINT64_FORMAT " and taskId: %u",
-									  schedulableTask->jobId, schedulableTask->taskId)));
-		}
-
 		/*
 		 * After determining the set of tasks to schedule, we release the hash's
-		 * shared lock for a short time period. We then re-acquire the lock in
-		 * exclusive mode. We therefore need to check if this task has been
-		 * canceled in the meantime.
+		 * shared locks for a short time period. We then re-acquire the task's
+		 * partition lock in exclusive mode. We therefore need to check if this
+		 * task has been canceled, or cleaned up altogether, in the meantime.
 		 */
-		if (taskToSchedule->taskStatus != TASK_CANCEL_REQUESTED)
+		if (taskToSchedule != NULL && SchedulableTask(taskToSchedule))
 		{
-			Assert(SchedulableTask(taskToSchedule));
-
 			taskToSchedule->taskStatus = TASK_SCHEDULED;
 		}
 		else
@@ -830,24 +1341,34 @@ ScheduleWorkerTasks(HTAB *WorkerTasksHash, List *schedulableTaskList)
 						   errdetail("Task jobId: " UINT64_FORMAT " and taskId: %u",
 									 schedulableTask->jobId, schedulableTask->taskId)));
 		}
+
+		LWLockRelease(partitionLock);
 	}
 }
 
 
-/* Manages the scheduling and execution of all tasks in the shared hash. */
+/*
+ * ManageWorkerTasksHash manages the scheduling and execution of all tasks in the
+ * shared hash. The function first looks at all tasks while holding the locks of
+ * all hash partitions in shared mode. It then schedules and manages one task at
+ * a time, while holding only the lock of the task's partition in exclusive
+ * mode. This way, the task tracker protocol functions don't need to wait for us
+ * unless we are managing a task in the same partition; and managing a task can
+ * take a while, for example when we connect to a local backend to run it.
+ */
 static void
 ManageWorkerTasksHash(HTAB *WorkerTasksHash)
 {
-	HASH_SEQ_STATUS status;
 	List *schedulableTaskList = NIL;
-	WorkerTask *currentTask = NULL;
+	List *taskKeyList = NIL;
+	ListCell *taskKeyCell = NULL;
+	bool taskFinished = false;
 
-	/* ask the scheduler if we have new tasks to schedule */
-	LWLockAcquire(&WorkerTasksSharedState->taskHashLock, LW_SHARED);
+	/* ask the scheduler if we have new tasks to schedule, and list all tasks */
+	LockWorkerTasksHash(LW_SHARED);
 	schedulableTaskList = SchedulableTaskList(WorkerTasksHash);
-	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
-
-	LWLockAcquire(&WorkerTasksSharedState->taskHashLock, LW_EXCLUSIVE);
+	taskKeyList = WorkerTaskKeyList(WorkerTasksHash);
+	UnlockWorkerTasksHash();
 
 	/* schedule new tasks if we have any */
 	if (schedulableTaskList != NIL)
@@ -857,27 +1378,80 @@ ManageWorkerTasksHash(HTAB *WorkerTasksHash)
 	}
 
 	/* now iterate over all tasks, and manage them */
+	foreach(taskKeyCell, taskKeyList)
+	{
+		WorkerTaskKey *taskKey = (WorkerTaskKey *) lfirst(taskKeyCell);
+		LWLock *partitionLock = WorkerTasksHashPartitionLock(taskKey->jobId);
+		WorkerTask *currentTask = NULL;
+
+		LWLockAcquire(partitionLock, LW_EXCLUSIVE);
+
+		/* the task may have been cleaned up since we listed it */
+		currentTask = WorkerTasksHashFind(taskKey->jobId, taskKey->taskId);
+		if (currentTask != NULL)
+		{
+			TaskStatus previousStatus = currentTask->taskStatus;
+
+			ManageWorkerTask(currentTask, WorkerTasksHash);
+
+			if (currentTask->taskStatus != previousStatus &&
+				(currentTask->taskStatus == TASK_SUCCEEDED ||
+				 currentTask->taskStatus == TASK_PERMANENTLY_FAILED))
+			{
+				taskFinished = true;
+			}
+
+			/*
+			 * Typically, we delete worker tasks in the task tracker protocol
+			 * process. This task however was canceled mid-query, and the
+			 * protocol process asked us to remove it from the shared hash.
+			 */
+			if (currentTask->taskStatus == TASK_TO_REMOVE)
+			{
+				RemoveWorkerTask(currentTask, WorkerTasksHash);
+			}
+		}
+
+		LWLockRelease(partitionLock);
+	}
+
+	list_free_deep(taskKeyList);
+
+	/* let backends waiting in task_tracker_task_statuses know right away */
+	if (taskFinished)
+	{
+		WakeupTaskStatusWaiters();
+	}
+}
+
+
+/*
+ * WorkerTaskKeyList returns a list with the identifiers of all tasks in the
+ * shared hash. Note that this function expects the caller to hold read locks
+ * over all partitions of the shared hash.
+ */
+static List *
+WorkerTaskKeyList(HTAB *WorkerTasksHash)
+{
+	List *taskKeyList = NIL;
+	HASH_SEQ_STATUS status;
+	WorkerTask *currentTask = NULL;
+
 	hash_seq_init(&status, WorkerTasksHash);
 
 	currentTask = (WorkerTask *) hash_seq_search(&status);
 	while (currentTask != NULL)
 	{
-		ManageWorkerTask(currentTask, WorkerTasksHash);
+		WorkerTaskKey *taskKey = (WorkerTaskKey *) palloc0(sizeof(WorkerTaskKey));
+		taskKey->jobId = currentTask->jobId;
+		taskKey->taskId = currentTask->taskId;
 
-		/*
-		 * Typically, we delete worker tasks in the task tracker protocol
-		 * process. This task however was canceled mid-query, and the protocol
-		 * process asked us to remove it from the shared hash.
-		 */
-		if (currentTask->taskStatus == TASK_TO_REMOVE)
-		{
-			RemoveWorkerTask(currentTask, WorkerTasksHash);
-		}
+		taskKeyList = lappend(taskKeyList, taskKey);
 
 		currentTask = (WorkerTask *) hash_seq_search(&status);
 	}
 
-	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
+	return taskKeyList;
 }
 
 
@@ -885,7 +1459,7 @@ ManageWorkerTasksHash(HTAB *WorkerTasksHash)
  * ManageWorkerTask manages the execution of the worker task. More specifically,
  * the function connects to a local backend, sends the query associated with the
  * task, and oversees the query's execution. Note that this function expects the
- * caller to hold an exclusive lock over the shared hash.
+ * caller to hold an exclusive lock over the task's hash partition.
  */
 static void
 ManageWorkerTask(WorkerTask *workerTask, HTAB *WorkerTasksHash)
@@ -31,13 +31,21 @@
 #include "distributed/worker_protocol.h"
 #include "storage/lwlock.h"
 #include "storage/pmsignal.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/timestamp.h"
 
 
 /* Local functions forward declarations */
 static bool TaskTrackerRunning(void);
+static void WaitForFinishedTask(Datum *jobIdArray, Datum *taskIdArray,
+								uint32 *taskStatusArray, int32 taskCount,
+								int32 waitTime);
+static bool ReadTaskStatuses(Datum *jobIdArray, Datum *taskIdArray,
+							 uint32 *taskStatusArray, int32 taskCount);
 static void CreateJobSchema(StringInfo schemaName);
 static void CreateTask(uint64 jobId, uint32 taskId, char *taskCallString);
+static bool MergeTaskCallString(const char *taskCallString);
 static void UpdateTask(WorkerTask *workerTask, char *taskCallString);
 static void CleanupTask(WorkerTask *workerTask);
 
@@ -45,6 +53,7 @@ static void CleanupTask(WorkerTask *workerTask);
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(task_tracker_assign_task);
 PG_FUNCTION_INFO_V1(task_tracker_task_status);
+PG_FUNCTION_INFO_V1(task_tracker_task_statuses);
 PG_FUNCTION_INFO_V1(task_tracker_cleanup_job);
 
 
@@ -66,6 +75,7 @@ task_tracker_assign_task(PG_FUNCTION_ARGS)
 	WorkerTask *workerTask = NULL;
 	char *taskCallString = text_to_cstring(taskCallStringText);
 	uint32 taskCallStringLength = strlen(taskCallString);
+	LWLock *partitionLock = WorkerTasksHashPartitionLock(jobId);
 
 	/* check that we have a running task tracker on this host */
 	bool taskTrackerRunning = TaskTrackerRunning();
@@ -100,7 +110,7 @@ task_tracker_assign_task(PG_FUNCTION_ARGS)
 		UnlockJobResource(jobId, AccessExclusiveLock);
 	}
 
-	LWLockAcquire(&WorkerTasksSharedState->taskHashLock, LW_EXCLUSIVE);
+	LWLockAcquire(partitionLock, LW_EXCLUSIVE);
 
 	/* check if we already have the task in our shared hash */
 	workerTask = WorkerTasksHashFind(jobId, taskId);
@@ -113,7 +123,10 @@ task_tracker_assign_task(PG_FUNCTION_ARGS)
 		UpdateTask(workerTask, taskCallString);
 	}
 
-	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
+	LWLockRelease(partitionLock);
+
+	/* let the task tracker schedule the task without waiting for its next round */
+	WakeupTaskTracker();
 
 	PG_RETURN_VOID();
 }
@@ -128,11 +141,12 @@ task_tracker_task_status(PG_FUNCTION_ARGS)
 
 	WorkerTask *workerTask = NULL;
 	uint32 taskStatus = 0;
+	LWLock *partitionLock = WorkerTasksHashPartitionLock(jobId);
 
 	bool taskTrackerRunning = TaskTrackerRunning();
 	if (taskTrackerRunning)
 	{
-		LWLockAcquire(&WorkerTasksSharedState->taskHashLock, LW_SHARED);
+		LWLockAcquire(partitionLock, LW_SHARED);
 
 		workerTask = WorkerTasksHashFind(jobId, taskId);
 		if (workerTask == NULL)
@@ -144,7 +158,7 @@ task_tracker_task_status(PG_FUNCTION_ARGS)
 
 		taskStatus = (uint32) workerTask->taskStatus;
 
-		LWLockRelease(&WorkerTasksSharedState->taskHashLock);
+		LWLockRelease(partitionLock);
 	}
 	else
 	{
@@ -156,6 +170,77 @@ task_tracker_task_status(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * task_tracker_task_statuses returns the task statuses of the tasks identified by
+ * the given job and task id arrays, in the order of these arrays. Tasks that
+ * can't be found have an invalid (zero) status. If none of the tasks finished
+ * running yet, the function first waits for up to the given number of
+ * milliseconds for one of them to finish. This way, the master node learns
+ * about finished tasks as they finish, without repeatedly sending a status
+ * query for each running task.
+ */
+Datum
+task_tracker_task_statuses(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *functionContext = NULL;
+	uint32 *taskStatusArray = NULL;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		ArrayType *jobIdArrayObject = PG_GETARG_ARRAYTYPE_P(0);
+		ArrayType *taskIdArrayObject = PG_GETARG_ARRAYTYPE_P(1);
+		int32 waitTime = PG_GETARG_INT32(2);
+		int32 taskCount = ArrayObjectCount(jobIdArrayObject);
+		Datum *jobIdArray = NULL;
+		Datum *taskIdArray = NULL;
+		MemoryContext oldContext = NULL;
+
+		bool taskTrackerRunning = TaskTrackerRunning();
+		if (!taskTrackerRunning)
+		{
+			ereport(ERROR, (errcode(ERRCODE_CANNOT_CONNECT_NOW),
+							errmsg("the task tracker has been disabled or shut down")));
+		}
+
+		if (ArrayObjectCount(taskIdArrayObject) != taskCount)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("job id and task id arrays must have the same "
+								   "length")));
+		}
+
+		functionContext = SRF_FIRSTCALL_INIT();
+		oldContext = MemoryContextSwitchTo(functionContext->multi_call_memory_ctx);
+
+		jobIdArray = DeconstructArrayObject(jobIdArrayObject);
+		taskIdArray = DeconstructArrayObject(taskIdArrayObject);
+		taskStatusArray = (uint32 *) palloc0(taskCount * sizeof(uint32));
+
+		WaitForFinishedTask(jobIdArray, taskIdArray, taskStatusArray, taskCount,
+							waitTime);
+
+		functionContext->user_fctx = taskStatusArray;
+		functionContext->max_calls = taskCount;
+
+		MemoryContextSwitchTo(oldContext);
+	}
+
+	functionContext = SRF_PERCALL_SETUP();
+	taskStatusArray = (uint32 *) functionContext->user_fctx;
+
+	if (functionContext->call_cntr < functionContext->max_calls)
+	{
+		uint32 taskStatus = taskStatusArray[functionContext->call_cntr];
+
+		SRF_RETURN_NEXT(functionContext, UInt32GetDatum(taskStatus));
+	}
+	else
+	{
+		SRF_RETURN_DONE(functionContext);
+	}
+}
+
+
 /*
  * task_tracker_cleanup_job finds all tasks for the given job, and cleans up
  * files, connections, and shared hash enties associated with these tasks.
@@ -172,9 +257,10 @@ task_tracker_cleanup_job(PG_FUNCTION_ARGS)
 
 	/*
 	 * We first clean up any open connections, and remove tasks belonging to
-	 * this job from the shared hash.
+	 * this job from the shared hash. To find these tasks, we need to scan the
+	 * shared hash and therefore lock all of its partitions.
 	 */
-	LWLockAcquire(&WorkerTasksSharedState->taskHashLock, LW_EXCLUSIVE);
+	LockWorkerTasksHash(LW_EXCLUSIVE);
 
 	hash_seq_init(&status, WorkerTasksSharedState->taskHash);
 
@@ -189,7 +275,13 @@ task_tracker_cleanup_job(PG_FUNCTION_ARGS)
 		currentTask = (WorkerTask *) hash_seq_search(&status);
 	}
 
-	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
+	UnlockWorkerTasksHash();
+
+	/* let the task tracker cancel the job's running tasks */
+	WakeupTaskTracker();
+
+	/* backends waiting for the job's tasks should report them as removed */
+	WakeupTaskStatusWaiters();
 
 	/*
 	 * We then delete the job directory and schema, if they exist. This cleans
@@ -220,6 +312,7 @@ TaskTrackerRunning(void)
 	WorkerTask *workerTask = NULL;
 	bool postmasterAlive = true;
 	bool taskTrackerRunning = true;
+	LWLock *partitionLock = NULL;
 
 	/* if postmaster shut down, infer task tracker shut down from it */
 	postmasterAlive = PostmasterIsAlive();
@@ -233,7 +326,8 @@ TaskTrackerRunning(void)
 	 * marker task to the shared hash. We need to look up this marker task since
 	 * the postmaster doesn't send a terminate signal to running backends.
 	 */
-	LWLockAcquire(&WorkerTasksSharedState->taskHashLock, LW_SHARED);
+	partitionLock = WorkerTasksHashPartitionLock(RESERVED_JOB_ID);
+	LWLockAcquire(partitionLock, LW_SHARED);
 
 	workerTask = WorkerTasksHashFind(RESERVED_JOB_ID, SHUTDOWN_MARKER_TASK_ID);
 	if (workerTask != NULL)
@@ -241,12 +335,127 @@ TaskTrackerRunning(void)
 		taskTrackerRunning = false;
 	}
 
-	LWLockRelease(&WorkerTasksSharedState->taskHashLock);
+	LWLockRelease(partitionLock);
 
 	return taskTrackerRunning;
 }
 
 
+/*
+ * WaitForFinishedTask reads the statuses of the given tasks into the status
+ * array. If none of the tasks finished running, the function waits until one of
+ * the tasks finishes or the wait time elapses. The task tracker sets our latch
+ * whenever a task finishes, and we then read the task statuses from the shared
+ * hash again. If we can't register our latch with the task tracker, we instead
+ * check the task statuses every citus.remote_task_check_interval.
+ */
+static void
+WaitForFinishedTask(Datum *jobIdArray, Datum *taskIdArray, uint32 *taskStatusArray,
+					int32 taskCount, int32 waitTime)
+{
+	TimestampTz waitStartTime = GetCurrentTimestamp();
+	bool waiterRegistered = RegisterTaskStatusWaiter();
+
+	PG_TRY();
+	{
+		while (true)
+		{
+			long remainingSeconds = 0;
+			int remainingMicroseconds = 0;
+			long timeout = 0;
+			TimestampTz waitEndTime = 0;
+			bool taskFinished = ReadTaskStatuses(jobIdArray, taskIdArray,
+												 taskStatusArray, taskCount);
+			if (taskFinished)
+			{
+				break;
+			}
+
+			waitEndTime = TimestampTzPlusMilliseconds(waitStartTime, waitTime);
+			TimestampDifference(GetCurrentTimestamp(), waitEndTime,
+								&remainingSeconds, &remainingMicroseconds);
+
+			timeout = remainingSeconds * 1000L + remainingMicroseconds / 1000;
+			if (timeout <= 0)
+			{
+				break;
+			}
+
+			if (!waiterRegistered)
+			{
+				timeout = Min(timeout, RemoteTaskCheckInterval);
+			}
+
+			WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					  timeout);
+			ResetLatch(MyLatch);
+
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+	PG_CATCH();
+	{
+		if (waiterRegistered)
+		{
+			UnregisterTaskStatusWaiter();
+		}
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	if (waiterRegistered)
+	{
+		UnregisterTaskStatusWaiter();
+	}
+}
+
+
+/*
+ * ReadTaskStatuses reads the statuses of the given tasks from the shared hash
+ * into the status array, and returns true if one of these tasks is missing or
+ * no longer running. Like the master node, we consider tasks that only failed
+ * once to be still running, since the task tracker retries them. The function
+ * only locks one task's hash partition at a time.
+ */
+static bool
+ReadTaskStatuses(Datum *jobIdArray, Datum *taskIdArray, uint32 *taskStatusArray,
+				 int32 taskCount)
+{
+	bool taskFinished = false;
+	int32 taskIndex = 0;
+
+	for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
+	{
+		uint64 jobId = DatumGetInt64(jobIdArray[taskIndex]);
+		uint32 taskId = DatumGetUInt32(taskIdArray[taskIndex]);
+		TaskStatus taskStatus = TASK_STATUS_INVALID_FIRST;
+		LWLock *partitionLock = WorkerTasksHashPartitionLock(jobId);
+		WorkerTask *workerTask = NULL;
+
+		LWLockAcquire(partitionLock, LW_SHARED);
+
+		workerTask = WorkerTasksHashFind(jobId, taskId);
+		if (workerTask != NULL)
+		{
+			taskStatus = workerTask->taskStatus;
+		}
+
+		LWLockRelease(partitionLock);
+
+		if (taskStatus != TASK_ASSIGNED && taskStatus != TASK_SCHEDULED &&
+			taskStatus != TASK_RUNNING && taskStatus != TASK_FAILED)
+		{
+			taskFinished = true;
+		}
+
+		taskStatusArray[taskIndex] = (uint32) taskStatus;
+	}
+
+	return taskFinished;
+}
+
+
 /*
  * CreateJobSchema creates a job schema with the given schema name. Note that
  * this function ensures that our pg_ prefixed schema names can be created.
@@ -296,7 +505,7 @@ CreateJobSchema(StringInfo schemaName)
 /*
  * CreateTask creates a new task in shared hash, initializes the task, and sets
  * the task to assigned state. Note that this function expects the caller to
- * hold an exclusive lock over the shared hash.
+ * hold an exclusive lock over the job's hash partition.
  */
 static void
 CreateTask(uint64 jobId, uint32 taskId, char *taskCallString)
@@ -323,13 +532,44 @@ CreateTask(uint64 jobId, uint32 taskId, char *taskCallString)
 	workerTask->failureCount = 0;
 	strlcpy(workerTask->databaseName, databaseName, NAMEDATALEN);
 	strlcpy(workerTask->userName, userName, NAMEDATALEN);
+
+	/*
+	 * The assigning user's weight determines the job's share of running tasks
+	 * under the fair-share policy. We also remember if the task merges or fetches
+	 * map outputs, as these tasks can optionally be run before other tasks.
+	 */
+	workerTask->schedulingWeight = (uint32) TaskSchedulingWeight;
+	workerTask->mergeTask = MergeTaskCallString(taskCallString);
+}
+
+
+/*
+ * MergeTaskCallString returns true if the given task call string merges or
+ * fetches the outputs of map tasks.
+ */
+static bool
+MergeTaskCallString(const char *taskCallString)
+{
+	if (strncmp(taskCallString, MERGE_TASK_CALL_PREFIX,
+				strlen(MERGE_TASK_CALL_PREFIX)) == 0)
+	{
+		return true;
+	}
+
+	if (strncmp(taskCallString, MAP_OUTPUT_FETCH_TASK_CALL_PREFIX,
+				strlen(MAP_OUTPUT_FETCH_TASK_CALL_PREFIX)) == 0)
+	{
+		return true;
+	}
+
+	return false;
 }
 
 
 /*
  * UpdateTask updates the call string text for an already existing task. Note
  * that this function expects the caller to hold an exclusive lock over the
- * shared hash.
+ * job's hash partition.
  */
 static void
 UpdateTask(WorkerTask *workerTask, char *taskCallString)
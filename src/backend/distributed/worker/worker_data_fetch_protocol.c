@@ -30,6 +30,7 @@
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_client_executor.h"
 #include "distributed/multi_logical_optimizer.h"
+#include "distributed/multi_result_stream.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/relay_utility.h"
 #include "distributed/resource_lock.h"
@@ -43,8 +44,9 @@
 #include "utils/lsyscache.h"
 
 
-/* Config variable managed via guc.c */
+/* Config variables managed via guc.c */
 bool ExpireCachedShards = false;
+bool StreamPartitionFiles = false;
 
 
 /* Local functions forward declarations */
@@ -54,6 +56,14 @@ static bool ReceiveRegularFile(const char *nodeName, uint32 nodePort,
 							   StringInfo transmitCommand, StringInfo filePath);
 static void ReceiveResourceCleanup(int32 connectionId, const char *filename,
 								   int32 fileDescriptor);
+static void WritePartitionFileLocation(const char *nodeName, uint32 nodePort,
+									   StringInfo remoteFilename,
+									   StringInfo localFilename);
+static void ReadLocationFileLine(FILE *locationFile, const char *locationFilename,
+								 char *line);
+static bool ReceiveRegularFileStream(const char *nodeName, uint32 nodePort,
+									 StringInfo transmitCommand,
+									 TaskResultStream *resultStream);
 static void DeleteFile(const char *filename);
 static void FetchTableCommon(text *tableName, uint64 remoteTableSize,
 							 ArrayType *nodeNameObject, ArrayType *nodePortObject,
@@ -89,6 +99,9 @@ PG_FUNCTION_INFO_V1(worker_append_table_to_shard);
  * worker_fetch_partition_file fetches a partition file from the remote node.
  * The function assumes an upstream compute task depends on this partition file,
  * and therefore directly fetches the file into the upstream task's directory.
+ * If citus.stream_partition_files is enabled, the function only records the
+ * file's location there, and the upstream merge task later streams the file's
+ * contents directly into its merge table.
  */
 Datum
 worker_fetch_partition_file(PG_FUNCTION_ARGS)
@@ -120,7 +133,15 @@ worker_fetch_partition_file(PG_FUNCTION_ARGS)
 	}
 
 	nodeName = text_to_cstring(nodeNameText);
-	FetchRegularFile(nodeName, nodePort, remoteFilename, taskFilename);
+
+	if (StreamPartitionFiles)
+	{
+		WritePartitionFileLocation(nodeName, nodePort, remoteFilename, taskFilename);
+	}
+	else
+	{
+		FetchRegularFile(nodeName, nodePort, remoteFilename, taskFilename);
+	}
 
 	PG_RETURN_VOID();
 }
@@ -386,6 +407,230 @@ ReceiveResourceCleanup(int32 connectionId, const char *filename, int32 fileDescr
 }
 
 
+/*
+ * WritePartitionFileLocation writes the node name, node port, and path of the
+ * given remote partition file into a location file next to the given local
+ * filename. Like FetchRegularFile(), the function first writes an attempt file
+ * and then atomically renames it, so merge tasks never see partial locations.
+ */
+static void
+WritePartitionFileLocation(const char *nodeName, uint32 nodePort,
+						   StringInfo remoteFilename, StringInfo localFilename)
+{
+	StringInfo locationFilename = makeStringInfo();
+	StringInfo attemptFilename = makeStringInfo();
+	uint32 randomId = (uint32) random();
+	FILE *locationFile = NULL;
+	int written = 0;
+	int closed = 0;
+	int renamed = 0;
+
+	appendStringInfo(locationFilename, "%s%s", localFilename->data,
+					 LOCATION_FILE_SUFFIX);
+	appendStringInfo(attemptFilename, "%s_%0*u%s", locationFilename->data,
+					 MIN_TASK_FILENAME_WIDTH, randomId, ATTEMPT_FILE_SUFFIX);
+
+	locationFile = AllocateFile(attemptFilename->data, PG_BINARY_W);
+	if (locationFile == NULL)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\": %m",
+							   attemptFilename->data)));
+	}
+
+	written = fprintf(locationFile, "%s\n%u\n%s\n", nodeName, nodePort,
+					  remoteFilename->data);
+	closed = FreeFile(locationFile);
+	if (written < 0 || closed != 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not write file \"%s\": %m",
+							   attemptFilename->data)));
+	}
+
+	renamed = rename(attemptFilename->data, locationFilename->data);
+	if (renamed != 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not rename file \"%s\" to \"%s\": %m",
+							   attemptFilename->data, locationFilename->data)));
+	}
+}
+
+
+/*
+ * StreamPartitionFileIntoRelation reads the remote partition file location from
+ * the given location file, transmits the remote file, and appends the rows it
+ * contains directly to the given relation, without writing the file locally.
+ * The function returns the number of appended rows. The caller is expected to
+ * hold a lock on the relation that allows for row insertions.
+ */
+uint64
+StreamPartitionFileIntoRelation(const char *locationFilename, Relation relation)
+{
+	FILE *locationFile = NULL;
+	char nodeName[MAXPGPATH];
+	char nodePortString[MAXPGPATH];
+	char remoteFilename[MAXPGPATH];
+	uint32 nodePort = 0;
+	StringInfo transmitCommand = NULL;
+	TaskResultStream *resultStream = NULL;
+	const int64 noRowLimit = -1;
+	bool received = false;
+	uint64 rowCount = 0;
+
+	locationFile = AllocateFile(locationFilename, PG_BINARY_R);
+	if (locationFile == NULL)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\": %m", locationFilename)));
+	}
+
+	ReadLocationFileLine(locationFile, locationFilename, nodeName);
+	ReadLocationFileLine(locationFile, locationFilename, nodePortString);
+	ReadLocationFileLine(locationFile, locationFilename, remoteFilename);
+
+	FreeFile(locationFile);
+
+	nodePort = (uint32) pg_atoi(nodePortString, sizeof(int32), 0);
+
+	transmitCommand = makeStringInfo();
+	appendStringInfo(transmitCommand, TRANSMIT_REGULAR_COMMAND, remoteFilename);
+
+	resultStream = CreateTaskResultStream(relation, BinaryWorkerCopyFormat, noRowLimit);
+
+	received = ReceiveRegularFileStream(nodeName, nodePort, transmitCommand,
+										resultStream);
+
+	/* the file should end with a complete row */
+	if (!received || !TaskResultStreamFileComplete(resultStream))
+	{
+		ereport(ERROR, (errmsg("could not receive file \"%s\" from %s:%u",
+							   remoteFilename, nodeName, nodePort)));
+	}
+
+	rowCount = resultStream->rowCount;
+	FinishTaskResultStream(resultStream);
+
+	ereport(DEBUG2, (errmsg("streamed " UINT64_FORMAT " rows of remote file \"%s\"",
+							rowCount, remoteFilename)));
+
+	return rowCount;
+}
+
+
+/*
+ * ReadLocationFileLine reads the next line of the given location file into the
+ * given buffer of MAXPGPATH bytes, and removes the line's trailing newline.
+ */
+static void
+ReadLocationFileLine(FILE *locationFile, const char *locationFilename, char *line)
+{
+	int lineLength = 0;
+
+	if (fgets(line, MAXPGPATH, locationFile) == NULL)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not read file \"%s\": unexpected end of file",
+							   locationFilename)));
+	}
+
+	lineLength = strlen(line);
+	if (lineLength > 0 && line[lineLength - 1] == '\n')
+	{
+		line[lineLength - 1] = '\0';
+	}
+}
+
+
+/*
+ * ReceiveRegularFileStream connects to the remote node, issues the given
+ * transmit command, and passes the remote file's contents to the given result
+ * stream as they arrive. The function otherwise follows ReceiveRegularFile(),
+ * and returns false if receiving the file failed.
+ */
+static bool
+ReceiveRegularFileStream(const char *nodeName, uint32 nodePort,
+						 StringInfo transmitCommand, TaskResultStream *resultStream)
+{
+	QueryStatus queryStatus = CLIENT_INVALID_QUERY;
+	int32 connectionId = INVALID_CONNECTION_ID;
+	char *nodeDatabase = NULL;
+	bool querySent = false;
+	bool queryReady = false;
+	bool copyDone = false;
+
+	/* we use the same database name on the master and worker nodes */
+	nodeDatabase = get_database_name(MyDatabaseId);
+
+	connectionId = MultiClientConnect(nodeName, nodePort, nodeDatabase, NULL);
+	if (connectionId == INVALID_CONNECTION_ID)
+	{
+		return false;
+	}
+
+	querySent = MultiClientSendQuery(connectionId, transmitCommand->data);
+	if (!querySent)
+	{
+		MultiClientDisconnect(connectionId);
+		return false;
+	}
+
+	/* loop until the remote node acknowledges our transmit request */
+	while (!queryReady)
+	{
+		ResultStatus resultStatus = MultiClientResultStatus(connectionId);
+		if (resultStatus == CLIENT_RESULT_READY)
+		{
+			queryReady = true;
+		}
+		else if (resultStatus == CLIENT_RESULT_BUSY)
+		{
+			/* remote node did not respond; wait for longer */
+			long sleepIntervalPerCycle = RemoteTaskCheckInterval * 1000L;
+			pg_usleep(sleepIntervalPerCycle);
+		}
+		else
+		{
+			MultiClientDisconnect(connectionId);
+			return false;
+		}
+	}
+
+	queryStatus = MultiClientQueryStatus(connectionId);
+	if (queryStatus != CLIENT_QUERY_COPY)
+	{
+		MultiClientDisconnect(connectionId);
+		return false;
+	}
+
+	/* loop until we receive and decode all the data from remote node */
+	while (!copyDone)
+	{
+		CopyStatus copyStatus = MultiClientReceiveCopyData(connectionId,
+														   TaskResultStreamReceiveFileData,
+														   (void *) resultStream);
+		if (copyStatus == CLIENT_COPY_DONE)
+		{
+			copyDone = true;
+		}
+		else if (copyStatus == CLIENT_COPY_MORE)
+		{
+			/* remote node will continue to send more data */
+		}
+		else
+		{
+			MultiClientDisconnect(connectionId);
+			return false;
+		}
+	}
+
+	MultiClientDisconnect(connectionId);
+
+	return true;
+}
+
+
 /* Deletes file with the given filename. */
 static void
 DeleteFile(const char *filename)
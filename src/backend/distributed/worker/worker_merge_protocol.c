@@ -17,13 +17,17 @@
 #include "funcapi.h"
 #include "miscadmin.h"
 
+#include "access/heapam.h"
 #include "access/htup_details.h"
 #include "access/xact.h"
 #include "catalog/dependency.h"
+#include "catalog/pg_class.h"
 #include "catalog/pg_namespace.h"
 #include "commands/copy.h"
+#include "commands/dbcommands.h"
 #include "commands/tablecmds.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/multi_result_stream.h"
 #include "distributed/worker_protocol.h"
 #include "executor/spi.h"
 #include "nodes/makefuncs.h"
@@ -40,8 +44,11 @@
 static List * ArrayObjectToCStringList(ArrayType *arrayObject);
 static void CreateTaskTable(StringInfo schemaName, StringInfo relationName,
 							List *columnNameList, List *columnTypeList);
+static void CreateTemporaryMergeTable(const char *createMergeTableQuery);
 static void CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
 									   StringInfo sourceDirectoryName);
+static bool CompressedFile(const char *filename);
+static uint64 CopyCompressedFileIntoRelation(const char *filename, Relation relation);
 
 
 /* exports for SQL callable functions */
@@ -117,10 +124,15 @@ worker_merge_files_into_table(PG_FUNCTION_ARGS)
 
 
 /*
- * worker_merge_files_and_run_query creates a merge task table within the job's
- * schema, which should have already been created by the task tracker protocol.
- * It copies files in its task directory into this table. Then it runs final
- * query to create result table of the job.
+ * worker_merge_files_and_run_query creates a merge task table, and copies files
+ * in its task directory into this table. Then it runs final query to create
+ * result table of the job within the job's schema, which should have already
+ * been created by the task tracker protocol. The merge table is only read by
+ * the final query, so the function creates it as a temporary table, which
+ * avoids WAL logging and shared buffers, and drops it right afterwards. The
+ * task tracker runs merge tasks as the user who issued the query; that user
+ * therefore needs the TEMP privilege on the worker's database to run
+ * repartition joins.
  *
  * Note that here we followed a different approach to create a task table for merge
  * files than worker_merge_files_into_table(). In future we should unify these
@@ -144,12 +156,14 @@ worker_merge_files_and_run_query(PG_FUNCTION_ARGS)
 	StringInfo jobSchemaName = JobSchemaName(jobId);
 	StringInfo intermediateTableName = TaskTableName(taskId);
 	StringInfo mergeTableName = makeStringInfo();
+	StringInfo mergeTableSchemaName = makeStringInfo();
 	StringInfo setSearchPathString = makeStringInfo();
+	StringInfo dropMergeTableQuery = makeStringInfo();
 	bool schemaExists = false;
 	int connected = 0;
 	int setSearchPathResult = 0;
-	int createMergeTableResult = 0;
 	int createIntermediateTableResult = 0;
+	int dropMergeTableResult = 0;
 	int finished = 0;
 
 	/*
@@ -181,16 +195,13 @@ worker_merge_files_and_run_query(PG_FUNCTION_ARGS)
 							   setSearchPathString->data)));
 	}
 
-	createMergeTableResult = SPI_exec(createMergeTableQuery, 0);
-	if (createMergeTableResult < 0)
-	{
-		ereport(ERROR, (errmsg("execution was not successful \"%s\"",
-							   createMergeTableQuery)));
-	}
+	CreateTemporaryMergeTable(createMergeTableQuery);
 
+	/* the final query finds the merge table through the implicit pg_temp */
+	appendStringInfoString(mergeTableSchemaName, "pg_temp");
 	appendStringInfo(mergeTableName, "%s%s", intermediateTableName->data,
 					 MERGE_TABLE_SUFFIX);
-	CopyTaskFilesFromDirectory(jobSchemaName, mergeTableName, taskDirectoryName);
+	CopyTaskFilesFromDirectory(mergeTableSchemaName, mergeTableName, taskDirectoryName);
 
 	createIntermediateTableResult = SPI_exec(createIntermediateTableQuery, 0);
 	if (createIntermediateTableResult < 0)
@@ -199,6 +210,17 @@ worker_merge_files_and_run_query(PG_FUNCTION_ARGS)
 							   createIntermediateTableQuery)));
 	}
 
+	appendStringInfo(dropMergeTableQuery, "DROP TABLE %s",
+					 quote_qualified_identifier(mergeTableSchemaName->data,
+												mergeTableName->data));
+
+	dropMergeTableResult = SPI_exec(dropMergeTableQuery->data, 0);
+	if (dropMergeTableResult < 0)
+	{
+		ereport(ERROR, (errmsg("execution was not successful \"%s\"",
+							   dropMergeTableQuery->data)));
+	}
+
 	finished = SPI_finish();
 	if (finished != SPI_OK_FINISH)
 	{
@@ -387,6 +409,49 @@ CreateTaskTable(StringInfo schemaName, StringInfo relationName,
 }
 
 
+/*
+ * CreateTemporaryMergeTable parses the given CREATE TABLE statement for a merge
+ * table, and creates the table as a temporary table instead. The function errors
+ * out if the current user may not create temporary tables in the database.
+ */
+static void
+CreateTemporaryMergeTable(const char *createMergeTableQuery)
+{
+	Node *parseTree = ParseTreeNode(createMergeTableQuery);
+	CreateStmt *createStatement = NULL;
+	Oid relationId PG_USED_FOR_ASSERTS_ONLY = InvalidOid;
+	ObjectAddress relationObject;
+	AclResult aclResult = pg_database_aclcheck(MyDatabaseId, GetUserId(),
+											   ACL_CREATE_TEMP);
+
+	if (aclResult != ACLCHECK_OK)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+						errmsg("permission denied to create temporary tables in "
+							   "database \"%s\"", get_database_name(MyDatabaseId)),
+						errhint("Merge tasks of repartition joins store their "
+								"input in temporary tables. Grant TEMP on the "
+								"database to the user who runs the query.")));
+	}
+
+	if (!IsA(parseTree, CreateStmt))
+	{
+		ereport(ERROR, (errmsg("merge table query is not a CREATE TABLE command"),
+						errdetail("Query: \"%s\"", createMergeTableQuery)));
+	}
+
+	createStatement = (CreateStmt *) parseTree;
+	createStatement->relation->schemaname = NULL;
+	createStatement->relation->relpersistence = RELPERSISTENCE_TEMP;
+
+	relationObject = DefineRelation(createStatement, RELKIND_RELATION, InvalidOid, NULL);
+	relationId = relationObject.objectId;
+
+	Assert(relationId != InvalidOid);
+	CommandCounterIncrement();
+}
+
+
 /*
  * ColumnDefinitionList creates and returns a list of column definition objects
  * from two lists of column names and types. As an example, this function takes
@@ -460,7 +525,10 @@ CreateStatement(RangeVar *relation, List *columnDefinitionList)
 /*
  * CopyTaskFilesFromDirectory finds all files in the given directory, except for
  * those having an attempt suffix. The function then copies these files into the
- * database table identified by the given schema and table name.
+ * database table identified by the given schema and table name. For location
+ * files, the function instead streams the remote partition files they point to
+ * directly into the table. Compressed partition files are also decoded by the
+ * function itself, and their rows appended directly to the table.
  */
 static void
 CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
@@ -486,6 +554,7 @@ CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
 		RangeVar *relation = NULL;
 		CopyStmt *copyStatement = NULL;
 		uint64 copiedRowCount = 0;
+		bool isLocationFile = false;
 
 		/* if system file or lingering task file, skip it */
 		if (strncmp(baseFilename, ".", MAXPGPATH) == 0 ||
@@ -498,8 +567,34 @@ CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
 		fullFilename = makeStringInfo();
 		appendStringInfo(fullFilename, "%s/%s", directoryName, baseFilename);
 
-		/* build relation object and copy statement */
 		relation = makeRangeVar(schemaName->data, relationName->data, -1);
+
+		isLocationFile = (strstr(baseFilename, LOCATION_FILE_SUFFIX) != NULL);
+
+		/* COPY can't read these files, so append their rows directly */
+		if (isLocationFile || CompressedFile(fullFilename->data))
+		{
+			Relation taskTable = heap_openrv(relation, RowExclusiveLock);
+
+			if (isLocationFile)
+			{
+				copiedRowCount = StreamPartitionFileIntoRelation(fullFilename->data,
+																 taskTable);
+			}
+			else
+			{
+				copiedRowCount = CopyCompressedFileIntoRelation(fullFilename->data,
+																taskTable);
+			}
+
+			heap_close(taskTable, NoLock);
+
+			copiedRowTotal += copiedRowCount;
+			CommandCounterIncrement();
+			continue;
+		}
+
+		/* build copy statement */
 		copyStatement = CopyStatement(relation, fullFilename->data);
 		if (BinaryWorkerCopyFormat)
 		{
@@ -519,6 +614,90 @@ CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
 }
 
 
+/*
+ * CompressedFile returns true if the file with the given name starts with the
+ * compressed partition file signature.
+ */
+static bool
+CompressedFile(const char *filename)
+{
+	char signature[COMPRESSED_FILE_SIGNATURE_LENGTH];
+	size_t readLength = 0;
+	bool compressedFile = false;
+
+	FILE *file = AllocateFile(filename, PG_BINARY_R);
+	if (file == NULL)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\": %m", filename)));
+	}
+
+	readLength = fread(signature, 1, sizeof(signature), file);
+	if (readLength == sizeof(signature) &&
+		memcmp(signature, COMPRESSED_FILE_SIGNATURE, sizeof(signature)) == 0)
+	{
+		compressedFile = true;
+	}
+
+	FreeFile(file);
+
+	return compressedFile;
+}
+
+
+/*
+ * CopyCompressedFileIntoRelation reads the given compressed partition file, and
+ * appends the rows it contains to the given relation. The function returns the
+ * number of appended rows.
+ */
+static uint64
+CopyCompressedFileIntoRelation(const char *filename, Relation relation)
+{
+	TaskResultStream *resultStream = NULL;
+	const int64 noRowLimit = -1;
+	char *readBuffer = palloc(BLCKSZ * 8);
+	size_t readLength = 0;
+	uint64 rowCount = 0;
+
+	FILE *file = AllocateFile(filename, PG_BINARY_R);
+	if (file == NULL)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\": %m", filename)));
+	}
+
+	resultStream = CreateTaskResultStream(relation, BinaryWorkerCopyFormat, noRowLimit);
+
+	readLength = fread(readBuffer, 1, BLCKSZ * 8, file);
+	while (readLength > 0)
+	{
+		TaskResultStreamReceiveFileData(resultStream, readBuffer, (int) readLength);
+
+		readLength = fread(readBuffer, 1, BLCKSZ * 8, file);
+	}
+
+	if (ferror(file))
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not read file \"%s\": %m", filename)));
+	}
+
+	FreeFile(file);
+
+	if (!TaskResultStreamFileComplete(resultStream))
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("unexpected end of compressed file \"%s\"", filename)));
+	}
+
+	rowCount = resultStream->rowCount;
+	FinishTaskResultStream(resultStream);
+	pfree(readBuffer);
+
+	return rowCount;
+}
+
+
 /*
  * CopyStatement creates and initializes a copy statement to read the given
  * file's contents into the given table, using copy's standard text format.
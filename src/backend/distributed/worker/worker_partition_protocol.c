@@ -28,22 +28,54 @@
 #include "catalog/pg_am.h"
 #include "catalog/pg_collation.h"
 #include "commands/copy.h"
+#include "common/pg_lzcompress.h"
 #include "commands/defrem.h"
 #include "distributed/multi_copy.h"
 #include "distributed/resource_lock.h"
 #include "distributed/transmit.h"
 #include "distributed/worker_protocol.h"
+#include "executor/executor.h"
 #include "executor/spi.h"
 #include "mb/pg_wchar.h"
 #include "storage/lmgr.h"
+#include "tcop/dest.h"
+#include "tcop/tcopprot.h"
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/snapmgr.h"
 
 
 /* Config variables managed via guc.c */
 bool BinaryWorkerCopyFormat = false;   /* binary format for copying between workers */
+bool CompressPartitionFiles = false;   /* compress partition files in blocks */
 int PartitionBufferSize = 16384; /* total partitioning buffer size in KB */
+bool EnableParallelPartitioning = false; /* scan shards with parallel workers */
+
+/*
+ * PartitionFileDestReceiver is a DestReceiver that partitions the filter
+ * query's rows as the executor produces them, and appends each row to its
+ * partition file using the copy command's format.
+ */
+typedef struct PartitionFileDestReceiver
+{
+	DestReceiver pub;           /* publicly-known function pointers */
+
+	/* partitioning function and the files it maps rows to */
+	const char *partitionColumnName;
+	Oid partitionColumnType;
+	uint32 (*PartitionIdFunction)(Datum, const void *);
+	const void *partitionIdContext;
+	FileOutputStream *partitionFileArray;
+	uint32 fileCount;
+
+	/* row serialization state, initialized when the executor starts up */
+	TupleDesc rowDescriptor;
+	int partitionColumnIndex;
+	CopyOutState rowOutputState;
+	FmgrInfo *columnOutputFunctions;
+} PartitionFileDestReceiver;
+
 
 /* Local variables */
 static uint32 FileBufferSizeInBytes = 0; /* file buffer size to init later */
@@ -57,12 +89,31 @@ static void ClosePartitionFiles(FileOutputStream *partitionFileArray, uint32 fil
 static void RenameDirectory(StringInfo oldDirectoryName, StringInfo newDirectoryName);
 static void FileOutputStreamWrite(FileOutputStream file, StringInfo dataToWrite);
 static void FileOutputStreamFlush(FileOutputStream file);
+static StringInfo CompressedBlock(StringInfo rawData);
 static void FilterAndPartitionTable(const char *filterQuery,
 									const char *columnName, Oid columnType,
 									uint32 (*PartitionIdFunction)(Datum, const void *),
 									const void *partitionIdContext,
 									FileOutputStream *partitionFileArray,
 									uint32 fileCount);
+static PlannedStmt * PlanFilterQuery(const char *filterQuery);
+static void FilterQueryErrorCallback(void *arg);
+static DestReceiver * CreatePartitionFileDestReceiver(const char *partitionColumnName,
+													  Oid partitionColumnType,
+													  uint32 (*PartitionIdFunction)(
+														  Datum, const void *),
+													  const void *partitionIdContext,
+													  FileOutputStream *partitionFileArray,
+													  uint32 fileCount);
+static void PartitionFileStartup(DestReceiver *dest, int operation,
+								 TupleDesc rowDescriptor);
+#if (PG_VERSION_NUM >= 90600)
+static bool PartitionFileReceiveSlot(TupleTableSlot *slot, DestReceiver *dest);
+#else
+static void PartitionFileReceiveSlot(TupleTableSlot *slot, DestReceiver *dest);
+#endif
+static void PartitionFileShutdown(DestReceiver *dest);
+static void PartitionFileDestroy(DestReceiver *dest);
 static int ColumnIndex(TupleDesc rowDescriptor, const char *columnName);
 static CopyOutState InitRowOutputState(void);
 static void ClearRowOutputState(CopyOutState copyState);
@@ -412,6 +463,20 @@ OpenPartitionFiles(StringInfo directoryName, uint32 fileCount)
 		partitionFileArray[fileIndex].fileDescriptor = fileDescriptor;
 		partitionFileArray[fileIndex].fileBuffer = makeStringInfo();
 		partitionFileArray[fileIndex].filePath = filePath;
+		partitionFileArray[fileIndex].compressed = CompressPartitionFiles;
+
+		/* readers recognize compressed files by their signature */
+		if (CompressPartitionFiles)
+		{
+			int written = FileWrite(fileDescriptor, COMPRESSED_FILE_SIGNATURE,
+									COMPRESSED_FILE_SIGNATURE_LENGTH);
+			if (written != COMPRESSED_FILE_SIGNATURE_LENGTH)
+			{
+				ereport(ERROR, (errcode_for_file_access(),
+								errmsg("could not write to partition file \"%s\"",
+									   filePath->data)));
+			}
+		}
 	}
 
 	return partitionFileArray;
@@ -728,13 +793,27 @@ FileOutputStreamWrite(FileOutputStream file, StringInfo dataToWrite)
 }
 
 
-/* Flushes data buffered in the file stream object to the underlying file. */
+/*
+ * Flushes data buffered in the file stream object to the underlying file. For
+ * compressed streams, the function writes the data as one compressed block.
+ */
 static void
 FileOutputStreamFlush(FileOutputStream file)
 {
 	StringInfo fileBuffer = file.fileBuffer;
 	int written = 0;
 
+	if (file.compressed)
+	{
+		/* don't write empty blocks */
+		if (fileBuffer->len == 0)
+		{
+			return;
+		}
+
+		fileBuffer = CompressedBlock(fileBuffer);
+	}
+
 	errno = 0;
 	written = FileWrite(file.fileDescriptor, fileBuffer->data, fileBuffer->len);
 	if (written != fileBuffer->len)
@@ -743,6 +822,48 @@ FileOutputStreamFlush(FileOutputStream file)
 						errmsg("could not write %d bytes to partition file \"%s\"",
 							   fileBuffer->len, file.filePath->data)));
 	}
+
+	if (file.compressed)
+	{
+		FreeStringInfo(fileBuffer);
+	}
+}
+
+
+/*
+ * CompressedBlock compresses the given data using PostgreSQL's built-in LZ
+ * compression, and returns a block that holds the raw and the stored data
+ * lengths in network byte order, followed by the stored data. If the data
+ * doesn't compress well, the block stores the data as is; readers recognize
+ * such blocks by their equal raw and stored lengths.
+ */
+static StringInfo
+CompressedBlock(StringInfo rawData)
+{
+	StringInfo block = makeStringInfo();
+	const int headerLength = 2 * sizeof(uint32);
+	int32 storedLength = 0;
+	uint32 networkRawLength = htonl((uint32) rawData->len);
+	uint32 networkStoredLength = 0;
+
+	enlargeStringInfo(block, headerLength + PGLZ_MAX_OUTPUT(rawData->len));
+
+	storedLength = pglz_compress(rawData->data, rawData->len,
+								 block->data + headerLength, PGLZ_strategy_default);
+	if (storedLength < 0 || storedLength >= rawData->len)
+	{
+		memcpy(block->data + headerLength, rawData->data, rawData->len);
+		storedLength = rawData->len;
+	}
+
+	networkStoredLength = htonl((uint32) storedLength);
+	memcpy(block->data, &networkRawLength, sizeof(uint32));
+	memcpy(block->data + sizeof(uint32), &networkStoredLength, sizeof(uint32));
+
+	block->len = headerLength + storedLength;
+	block->data[block->len] = '\0';
+
+	return block;
 }
 
 
@@ -752,6 +873,12 @@ FileOutputStreamFlush(FileOutputStream file)
  * the partitioning function and determines the partition identifier. Then, the
  * function chooses the partition file corresponding to this identifier, and
  * serializes the row into this file using the copy command's text format.
+ *
+ * The function runs the query through the executor to completion instead of
+ * fetching rows from a cursor, and hands each row to a partitioning receiver
+ * as soon as the executor produces it. This way, if parallel partitioning is
+ * enabled, the planner may use parallel workers to scan and filter large shards
+ * in block ranges, and the rows they produce are partitioned in this backend.
  */
 static void
 FilterAndPartitionTable(const char *filterQuery,
@@ -761,135 +888,274 @@ FilterAndPartitionTable(const char *filterQuery,
 						FileOutputStream *partitionFileArray,
 						uint32 fileCount)
 {
-	CopyOutState rowOutputState = NULL;
-	FmgrInfo *columnOutputFunctions = NULL;
-	int partitionColumnIndex = 0;
-	Oid partitionColumnTypeId = InvalidOid;
-	Portal queryPortal = NULL;
-	int connected = 0;
-	int finished = 0;
-	uint32 columnCount = 0;
-	Datum *valueArray = NULL;
-	bool *isNullArray = NULL;
+	PlannedStmt *queryPlan = NULL;
+	QueryDesc *queryDesc = NULL;
+	DestReceiver *partitionDest = NULL;
+
+	queryPlan = PlanFilterQuery(filterQuery);
+
+	partitionDest = CreatePartitionFileDestReceiver(partitionColumnName,
+													partitionColumnType,
+													PartitionIdFunction,
+													partitionIdContext,
+													partitionFileArray, fileCount);
+
+	/* like a read-only SPI query, use the calling query's snapshot */
+	queryDesc = CreateQueryDesc(queryPlan, filterQuery,
+								GetActiveSnapshot(), InvalidSnapshot,
+								partitionDest, NULL, 0);
+
+	ExecutorStart(queryDesc, 0);
+	ExecutorRun(queryDesc, ForwardScanDirection, 0L);
+	ExecutorFinish(queryDesc);
+	ExecutorEnd(queryDesc);
+
+	FreeQueryDesc(queryDesc);
+	(*partitionDest->rDestroy)(partitionDest);
+}
 
-	const char *noPortalName = NULL;
-	const bool readOnly = true;
-	const bool fetchForward = true;
-	const int noCursorOptions = 0;
-	const int prefetchCount = ROW_PREFETCH_COUNT;
 
-	connected = SPI_connect();
-	if (connected != SPI_OK_CONNECT)
+/*
+ * PlanFilterQuery parses, analyzes, and plans the given filter query, and
+ * returns the resulting plan. The function errors out if the query isn't a
+ * single read-only SELECT query. If parallel partitioning is enabled, the
+ * function also allows the planner to choose a parallel plan for the query.
+ */
+static PlannedStmt *
+PlanFilterQuery(const char *filterQuery)
+{
+	List *parseTreeList = NIL;
+	List *queryTreeList = NIL;
+	Node *parseTree = NULL;
+	Query *query = NULL;
+	PlannedStmt *queryPlan = NULL;
+	int cursorOptions = 0;
+	ErrorContextCallback errorCallback;
+
+	/* report parse and analysis errors against the filter query's text */
+	errorCallback.callback = FilterQueryErrorCallback;
+	errorCallback.arg = (void *) filterQuery;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	parseTreeList = pg_parse_query(filterQuery);
+	if (list_length(parseTreeList) != 1)
 	{
-		ereport(ERROR, (errmsg("could not connect to SPI manager")));
+		ereport(ERROR, (errmsg("cannot partition the results of multiple queries")));
 	}
 
-	queryPortal = SPI_cursor_open_with_args(noPortalName, filterQuery,
-											0, NULL, NULL, NULL, /* no arguments */
-											readOnly, noCursorOptions);
-	if (queryPortal == NULL)
+	parseTree = (Node *) linitial(parseTreeList);
+	queryTreeList = pg_analyze_and_rewrite(parseTree, filterQuery, NULL, 0);
+	if (list_length(queryTreeList) != 1)
 	{
-		ereport(ERROR, (errmsg("could not open implicit cursor for query \"%s\"",
-							   filterQuery)));
+		ereport(ERROR, (errmsg("cannot partition the results of multiple queries")));
 	}
 
-	rowOutputState = InitRowOutputState();
+	query = (Query *) linitial(queryTreeList);
+	if (query->commandType != CMD_SELECT || query->hasModifyingCTE ||
+		query->rowMarks != NIL)
+	{
+		ereport(ERROR, (errmsg("cannot partition the results of a query that "
+							   "is not a read-only SELECT query")));
+	}
 
-	SPI_cursor_fetch(queryPortal, fetchForward, prefetchCount);
-	if (SPI_processed > 0)
+#if (PG_VERSION_NUM >= 90600)
+	if (EnableParallelPartitioning)
 	{
-		TupleDesc rowDescriptor = SPI_tuptable->tupdesc;
-		partitionColumnIndex = ColumnIndex(rowDescriptor, partitionColumnName);
+		cursorOptions |= CURSOR_OPT_PARALLEL_OK;
+	}
+#endif
 
-		partitionColumnTypeId = SPI_gettypeid(rowDescriptor, partitionColumnIndex);
-		if (partitionColumnType != partitionColumnTypeId)
-		{
-			ereport(ERROR, (errmsg("partition column types %u and %u do not match",
-								   partitionColumnTypeId, partitionColumnType)));
-		}
+	queryPlan = pg_plan_query(query, cursorOptions, NULL);
 
-		columnOutputFunctions = ColumnOutputFunctions(rowDescriptor,
-													  rowOutputState->binary);
-	}
+	error_context_stack = errorCallback.previous;
 
-	if (BinaryWorkerCopyFormat)
+	return queryPlan;
+}
+
+
+/*
+ * FilterQueryErrorCallback adds the filter query's text to errors raised while
+ * parsing and analyzing the query, in the same way SPI does for its queries.
+ */
+static void
+FilterQueryErrorCallback(void *arg)
+{
+	const char *filterQuery = (const char *) arg;
+	int syntaxErrorPosition = geterrposition();
+
+	if (syntaxErrorPosition > 0)
+	{
+		errposition(0);
+		internalerrposition(syntaxErrorPosition);
+		internalerrquery(filterQuery);
+	}
+	else
 	{
-		OutputBinaryHeaders(partitionFileArray, fileCount);
+		errcontext("SQL statement \"%s\"", filterQuery);
 	}
+}
+
+
+/*
+ * CreatePartitionFileDestReceiver creates a receiver that applies the given
+ * partitioning function to each row it receives, and appends the row to the
+ * corresponding partition file.
+ */
+static DestReceiver *
+CreatePartitionFileDestReceiver(const char *partitionColumnName,
+								Oid partitionColumnType,
+								uint32 (*PartitionIdFunction)(Datum, const void *),
+								const void *partitionIdContext,
+								FileOutputStream *partitionFileArray,
+								uint32 fileCount)
+{
+	PartitionFileDestReceiver *partitionDest =
+		(PartitionFileDestReceiver *) palloc0(sizeof(PartitionFileDestReceiver));
+
+	partitionDest->pub.receiveSlot = PartitionFileReceiveSlot;
+	partitionDest->pub.rStartup = PartitionFileStartup;
+	partitionDest->pub.rShutdown = PartitionFileShutdown;
+	partitionDest->pub.rDestroy = PartitionFileDestroy;
+	partitionDest->pub.mydest = DestCopyOut;
+
+	partitionDest->partitionColumnName = partitionColumnName;
+	partitionDest->partitionColumnType = partitionColumnType;
+	partitionDest->PartitionIdFunction = PartitionIdFunction;
+	partitionDest->partitionIdContext = partitionIdContext;
+	partitionDest->partitionFileArray = partitionFileArray;
+	partitionDest->fileCount = fileCount;
+
+	return (DestReceiver *) partitionDest;
+}
 
-	columnCount = (uint32) SPI_tuptable->tupdesc->natts;
-	valueArray = (Datum *) palloc0(columnCount * sizeof(Datum));
-	isNullArray = (bool *) palloc0(columnCount * sizeof(bool));
 
-	while (SPI_processed > 0)
+/*
+ * PartitionFileStartup checks that the filter query returns the partition
+ * column with the expected type, and initializes the state for serializing
+ * rows. If binary copy format is enabled, the function also writes binary
+ * headers to partition files.
+ */
+static void
+PartitionFileStartup(DestReceiver *dest, int operation, TupleDesc rowDescriptor)
+{
+	PartitionFileDestReceiver *partitionDest = (PartitionFileDestReceiver *) dest;
+	int partitionColumnIndex = 0;
+	Oid partitionColumnTypeId = InvalidOid;
+	CopyOutState rowOutputState = NULL;
+
+	partitionColumnIndex = ColumnIndex(rowDescriptor,
+									   partitionDest->partitionColumnName);
+
+	partitionColumnTypeId = SPI_gettypeid(rowDescriptor, partitionColumnIndex);
+	if (partitionDest->partitionColumnType != partitionColumnTypeId)
 	{
-		int rowIndex = 0;
-		for (rowIndex = 0; rowIndex < SPI_processed; rowIndex++)
-		{
-			HeapTuple row = SPI_tuptable->vals[rowIndex];
-			TupleDesc rowDescriptor = SPI_tuptable->tupdesc;
-			FileOutputStream partitionFile = { 0, 0, 0 };
-			StringInfo rowText = NULL;
-			Datum partitionKey = 0;
-			bool partitionKeyNull = false;
-			uint32 partitionId = 0;
-
-			partitionKey = SPI_getbinval(row, rowDescriptor,
-										 partitionColumnIndex, &partitionKeyNull);
-
-			/*
-			 * If we have a partition key, we compute its bucket. Else if we have
-			 * a null key, we then put this tuple into the 0th bucket. Note that
-			 * the 0th bucket may hold other tuples as well, such as tuples whose
-			 * partition keys hash to the value 0.
-			 */
-			if (!partitionKeyNull)
-			{
-				partitionId = (*PartitionIdFunction)(partitionKey, partitionIdContext);
-			}
-			else
-			{
-				partitionId = 0;
-			}
+		ereport(ERROR, (errmsg("partition column types %u and %u do not match",
+							   partitionColumnTypeId,
+							   partitionDest->partitionColumnType)));
+	}
 
-			/* deconstruct the tuple; this is faster than repeated heap_getattr */
-			heap_deform_tuple(row, rowDescriptor, valueArray, isNullArray);
+	rowOutputState = InitRowOutputState();
 
-			AppendCopyRowData(valueArray, isNullArray, rowDescriptor,
-							  rowOutputState, columnOutputFunctions);
+	partitionDest->rowDescriptor = rowDescriptor;
+	partitionDest->partitionColumnIndex = partitionColumnIndex;
+	partitionDest->rowOutputState = rowOutputState;
+	partitionDest->columnOutputFunctions = ColumnOutputFunctions(rowDescriptor,
+																 rowOutputState->binary);
 
-			rowText = rowOutputState->fe_msgbuf;
+	if (BinaryWorkerCopyFormat)
+	{
+		OutputBinaryHeaders(partitionDest->partitionFileArray,
+							partitionDest->fileCount);
+	}
+}
 
-			partitionFile = partitionFileArray[partitionId];
-			FileOutputStreamWrite(partitionFile, rowText);
 
-			resetStringInfo(rowText);
-			MemoryContextReset(rowOutputState->rowcontext);
-		}
+/*
+ * PartitionFileReceiveSlot determines the partition of the given row, and
+ * serializes the row into the corresponding partition file.
+ */
+#if (PG_VERSION_NUM >= 90600)
+static bool
+#else
+static void
+#endif
+PartitionFileReceiveSlot(TupleTableSlot *slot, DestReceiver *dest)
+{
+	PartitionFileDestReceiver *partitionDest = (PartitionFileDestReceiver *) dest;
+	CopyOutState rowOutputState = partitionDest->rowOutputState;
+	FileOutputStream partitionFile = { 0, 0, 0, false };
+	StringInfo rowText = NULL;
+	Datum *valueArray = NULL;
+	bool *isNullArray = NULL;
+	int partitionColumnOffset = partitionDest->partitionColumnIndex - 1;
+	uint32 partitionId = 0;
 
-		SPI_freetuptable(SPI_tuptable);
+	/* deconstruct the tuple; this is faster than repeated heap_getattr */
+	slot_getallattrs(slot);
+	valueArray = slot->tts_values;
+	isNullArray = slot->tts_isnull;
 
-		SPI_cursor_fetch(queryPortal, fetchForward, prefetchCount);
+	/*
+	 * If we have a partition key, we compute its bucket. Else if we have a null
+	 * key, we then put this tuple into the 0th bucket. Note that the 0th bucket
+	 * may hold other tuples as well, such as tuples whose partition keys hash
+	 * to the value 0.
+	 */
+	if (!isNullArray[partitionColumnOffset])
+	{
+		Datum partitionKey = valueArray[partitionColumnOffset];
+		partitionId = (*partitionDest->PartitionIdFunction)(
+			partitionKey, partitionDest->partitionIdContext);
 	}
+	else
+	{
+		partitionId = 0;
+	}
+
+	AppendCopyRowData(valueArray, isNullArray, partitionDest->rowDescriptor,
+					  rowOutputState, partitionDest->columnOutputFunctions);
 
-	pfree(valueArray);
-	pfree(isNullArray);
+	rowText = rowOutputState->fe_msgbuf;
 
-	SPI_cursor_close(queryPortal);
+	partitionFile = partitionDest->partitionFileArray[partitionId];
+	FileOutputStreamWrite(partitionFile, rowText);
+
+	resetStringInfo(rowText);
+	MemoryContextReset(rowOutputState->rowcontext);
+
+#if (PG_VERSION_NUM >= 90600)
+	return true;
+#endif
+}
+
+
+/*
+ * PartitionFileShutdown writes binary footers to partition files if binary
+ * copy format is enabled, and deletes the row output state.
+ */
+static void
+PartitionFileShutdown(DestReceiver *dest)
+{
+	PartitionFileDestReceiver *partitionDest = (PartitionFileDestReceiver *) dest;
 
 	if (BinaryWorkerCopyFormat)
 	{
-		OutputBinaryFooters(partitionFileArray, fileCount);
+		OutputBinaryFooters(partitionDest->partitionFileArray,
+							partitionDest->fileCount);
 	}
 
 	/* delete row output memory context */
-	ClearRowOutputState(rowOutputState);
+	ClearRowOutputState(partitionDest->rowOutputState);
+	partitionDest->rowOutputState = NULL;
+}
 
-	finished = SPI_finish();
-	if (finished != SPI_OK_FINISH)
-	{
-		ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
-	}
+
+/* PartitionFileDestroy frees the memory allocated for the receiver. */
+static void
+PartitionFileDestroy(DestReceiver *dest)
+{
+	pfree(dest);
 }
 
 
@@ -1008,7 +1274,7 @@ OutputBinaryHeaders(FileOutputStream *partitionFileArray, uint32 fileCount)
 	for (fileIndex = 0; fileIndex < fileCount; fileIndex++)
 	{
 		/* Generate header for a binary copy */
-		FileOutputStream partitionFile = { 0, 0, 0 };
+		FileOutputStream partitionFile = { 0, 0, 0, false };
 		CopyOutStateData headerOutputStateData;
 		CopyOutState headerOutputState = (CopyOutState) & headerOutputStateData;
 
@@ -1034,7 +1300,7 @@ OutputBinaryFooters(FileOutputStream *partitionFileArray, uint32 fileCount)
 	for (fileIndex = 0; fileIndex < fileCount; fileIndex++)
 	{
 		/* Generate footer for a binary copy */
-		FileOutputStream partitionFile = { 0, 0, 0 };
+		FileOutputStream partitionFile = { 0, 0, 0, false };
 		CopyOutStateData footerOutputStateData;
 		CopyOutState footerOutputState = (CopyOutState) & footerOutputStateData;
 
@@ -37,7 +37,10 @@ enum MultiConnectionMode
 
 	FOR_DDL = 1 << 2,
 
-	FOR_DML = 1 << 3
+	FOR_DML = 1 << 3,
+
+	/* caller already reserved the connection in the shared connection pool */
+	SHARED_CONNECTION_RESERVED = 1 << 4
 };
 
 
@@ -75,6 +78,9 @@ typedef struct MultiConnection
 
 	/* list of all placements referenced by this connection */
 	dlist_head referencedPlacements;
+
+	/* statements prepared on this connection, see remote_commands.c */
+	struct PreparedStatementCache *preparedStatementCache;
 } MultiConnection;
 
 
@@ -82,6 +82,15 @@ typedef enum TaskExecutionStatus
 } TaskExecutionStatus;
 
 
+/*
+ * CopyDataReceiver is called for each copy data message received from a remote
+ * node. Worker nodes send one row per copy data message for query results, and
+ * arbitrary chunks of the file for transmitted files.
+ */
+typedef void (*CopyDataReceiver)(void *receiverState, char *copyData,
+								 int copyDataLength);
+
+
 struct pollfd; /* forward declared, to avoid having to include poll.h */
 
 typedef struct WaitInfo
@@ -109,6 +118,9 @@ extern bool MultiClientCancel(int32 connectionId);
 extern ResultStatus MultiClientResultStatus(int32 connectionId);
 extern QueryStatus MultiClientQueryStatus(int32 connectionId);
 extern CopyStatus MultiClientCopyData(int32 connectionId, int32 fileDescriptor);
+extern CopyStatus MultiClientReceiveCopyData(int32 connectionId,
+											 CopyDataReceiver copyDataReceiver,
+											 void *receiverState);
 extern bool MultiClientQueryResult(int32 connectionId, void **queryResult,
 								   int *rowCount, int *columnCount);
 extern BatchQueryStatus MultiClientBatchResult(int32 connectionId, void **queryResult,
@@ -44,6 +44,10 @@ typedef struct NodeAddress
 } NodeAddress;
 
 
+/* Config variable managed via guc.c */
+extern int CopyBatchSize;
+
+
 /* function declarations for copying into a distributed table */
 extern FmgrInfo * ColumnOutputFunctions(TupleDesc rowDescriptor, bool binaryFormat);
 extern void AppendCopyRowData(Datum *valueArray, bool *isNullArray,
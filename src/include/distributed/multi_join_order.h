@@ -70,12 +70,15 @@ typedef struct JoinOrderNode
 	char partitionMethod;
 	List *joinClauseList;       /* not relevant for the first table */
 	List *shardIntervalList;
+	double dataSize;            /* estimated bytes in the join result so far */
+	double transferSize;        /* estimated bytes moved to apply the join rule */
 } JoinOrderNode;
 
 
 /* Config variables managed via guc.c */
 extern int LargeTableShardCount;
 extern bool LogMultiJoinOrder;
+extern bool EnableCostBasedJoinOrder;
 
 
 /* Function declaration for determining table join orders */
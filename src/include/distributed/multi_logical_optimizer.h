@@ -23,6 +23,8 @@
 #define DISABLE_LIMIT_APPROXIMATION -1
 #define DISABLE_DISTINCT_APPROXIMATION 0.0
 #define ARRAY_CAT_AGGREGATE_NAME "array_cat_agg"
+#define WORKER_PARTIAL_AGGREGATE_NAME "worker_partial_agg"
+#define MASTER_COMBINE_AGGREGATE_NAME "master_combine_agg"
 #define WORKER_COLUMN_FORMAT "worker_column_%d"
 
 /* Definitions related to count(distinct) approximations */
@@ -36,6 +38,9 @@
 #define HLL_UNION_AGGREGATE_NAME "hll_union_agg"
 #define HLL_CARDINALITY_FUNC_NAME "hll_cardinality"
 
+/* Definitions related to percentile approximations */
+#define TDIGEST_PERCENTILE_FUNC_NAME "tdigest_percentile"
+
 
 /*
  * AggregateType represents an aggregate function's type, where the function is
@@ -44,7 +49,8 @@
  *
  * Please note that the order of values in this enumeration is tied to the order
  * of elements in the following AggregateNames array. This order needs to be
- * preserved.
+ * preserved. AGGREGATE_COMBINE has no name; it stands for all other aggregates
+ * whose partial transition states we can combine.
  */
 typedef enum
 {
@@ -54,7 +60,13 @@ typedef enum
 	AGGREGATE_MAX = 3,
 	AGGREGATE_SUM = 4,
 	AGGREGATE_COUNT = 5,
-	AGGREGATE_ARRAY_AGG = 6
+	AGGREGATE_ARRAY_AGG = 6,
+	AGGREGATE_TDIGEST_ADD = 7,
+	AGGREGATE_TDIGEST_UNION = 8,
+	AGGREGATE_TOPN_ADD = 9,
+	AGGREGATE_TOPN_UNION = 10,
+	AGGREGATE_PERCENTILE_CONT = 11,
+	AGGREGATE_COMBINE = 12
 } AggregateType;
 
 
@@ -96,13 +108,15 @@ typedef enum
  */
 static const char *const AggregateNames[] = {
 	"invalid", "avg", "min", "max", "sum",
-	"count", "array_agg"
+	"count", "array_agg", "tdigest_add_agg", "tdigest_union_agg",
+	"topn_add_agg", "topn_union_agg", "percentile_cont"
 };
 
 
 /* Config variable managed via guc.c */
 extern int LimitClauseRowFetchCount;
 extern double CountDistinctErrorRate;
+extern bool EnableApproximatePercentiles;
 
 
 /* Function declaration for optimizing logical plans */
@@ -23,6 +23,9 @@
 struct MultiPlan;
 extern CreateStmt * MasterNodeCreateStatement(struct MultiPlan *multiPlan);
 extern List * MasterNodeCopyStatementList(struct MultiPlan *multiPlan);
-extern PlannedStmt * MasterNodeSelectPlan(struct MultiPlan *multiPlan);
+extern PlannedStmt * MasterNodeSelectPlan(struct MultiPlan *multiPlan,
+										  uint64 taskResultSize);
+extern bool MasterNodeMergesTaskResults(struct MultiPlan *multiPlan);
+extern int64 MasterNodeRowLimit(struct MultiPlan *multiPlan);
 
 #endif   /* MULTI_MASTER_PLANNER_H */
@@ -0,0 +1,76 @@
+/*-------------------------------------------------------------------------
+ *
+ * multi_node_load.h
+ *	  Type and function declarations for tracking the load that executors put
+ *	  on worker nodes, and for ordering shard placements by this load.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef MULTI_NODE_LOAD_H
+#define MULTI_NODE_LOAD_H
+
+#include "distributed/worker_manager.h"
+#include "nodes/pg_list.h"
+#include "utils/hsearch.h"
+#include "utils/timestamp.h"
+
+
+/* weight of the most recent task's latency in a node's average task latency */
+#define NODE_LATENCY_SMOOTHING_FACTOR 0.2
+
+/* latency assumed for nodes that haven't completed any tasks yet, in ms */
+#define DEFAULT_NODE_TASK_LATENCY 1.0
+
+/* number of partitions, each with its own lock, of the shared node load hash */
+#define NODE_LOAD_HASH_PARTITIONS 16
+
+/*
+ * The task latency histogram has four buckets per power of two milliseconds,
+ * and keeps roughly the most recent TASK_LATENCY_HISTORY_SIZE task latencies.
+ * We don't estimate percentiles from fewer than TASK_LATENCY_MIN_SAMPLES.
+ */
+#define TASK_LATENCY_BUCKETS_PER_DOUBLING 4
+#define TASK_LATENCY_BUCKET_COUNT 96
+#define TASK_LATENCY_HISTORY_SIZE 1024
+#define TASK_LATENCY_MIN_SAMPLES 32
+
+
+/* NodeLoadKey identifies a worker node in node load hashes. */
+typedef struct NodeLoadKey
+{
+	char nodeName[WORKER_LENGTH];
+	uint32 nodePort;
+} NodeLoadKey;
+
+
+/*
+ * NodeLoad keeps the load statistics of a worker node in shared memory. The
+ * in-flight task count covers tasks that executors in all backends currently
+ * run on the node, and the average task latency is an exponentially weighted
+ * moving average of recently completed tasks' execution times.
+ */
+typedef struct NodeLoad
+{
+	NodeLoadKey key;            /* hash key; must be first */
+	int32 inFlightTaskCount;
+	uint64 completedTaskCount;
+	double averageTaskLatency;  /* in milliseconds */
+} NodeLoad;
+
+
+/* Function declarations for tracking node load */
+extern void InitializeNodeLoadTracking(void);
+extern bool NodeLoadTrackingEnabled(void);
+extern void NodeTaskStarted(const char *nodeName, uint32 nodePort);
+extern void NodeTaskFinished(const char *nodeName, uint32 nodePort,
+							 TimestampTz taskStartTime, bool taskSucceeded);
+extern HTAB * CreateNodeTaskCountHash(void);
+extern List * LoadAwarePlacementList(List *placementList,
+									 HTAB *assignedTaskCountHash);
+extern double TaskLatencyPercentile(int percentile);
+
+
+#endif /* MULTI_NODE_LOAD_H */
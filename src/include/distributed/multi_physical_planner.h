@@ -93,7 +93,8 @@ typedef enum
 	TASK_ASSIGNMENT_INVALID_FIRST = 0,
 	TASK_ASSIGNMENT_GREEDY = 1,
 	TASK_ASSIGNMENT_ROUND_ROBIN = 2,
-	TASK_ASSIGNMENT_FIRST_REPLICA = 3
+	TASK_ASSIGNMENT_FIRST_REPLICA = 3,
+	TASK_ASSIGNMENT_LOAD_AWARE = 4
 } TaskAssignmentPolicyType;
 
 
@@ -180,6 +181,8 @@ typedef struct Task
 
 	bool insertSelectQuery;
 	List *relationShardList;       /* only applies INSERT/SELECT tasks */
+
+	bool parametersInQueryStringResolved; /* query string contains no $n params */
 } Task;
 
 
@@ -268,6 +271,7 @@ extern bool OpExpressionContainsColumn(OpExpr *operatorExpression, Var *partitio
 extern Var * MakeInt4Column(void);
 extern Const * MakeInt4Constant(Datum constantValue);
 extern int CompareShardPlacements(const void *leftElement, const void *rightElement);
+extern int CompareTasksByShardId(const void *leftElement, const void *rightElement);
 extern bool ShardIntervalsOverlap(ShardInterval *firstInterval,
 								  ShardInterval *secondInterval);
 
@@ -57,6 +57,7 @@ extern struct MultiPlan * GetMultiPlan(PlannedStmt *planStatement);
 extern void multi_relation_restriction_hook(PlannerInfo *root, RelOptInfo *relOptInfo,
 											Index index, RangeTblEntry *rte);
 extern bool IsModifyCommand(Query *query);
+extern bool HasUnresolvedExternParamsWalker(Node *expression, ParamListInfo boundParams);
 extern void VerifyMultiPlanValidity(struct MultiPlan *multiPlan);
 
 #endif /* MULTI_PLANNER_H */
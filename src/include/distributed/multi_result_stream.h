@@ -0,0 +1,110 @@
+/*-------------------------------------------------------------------------
+ *
+ * multi_result_stream.h
+ *	  Type and function declarations for streaming task results received over
+ *	  the COPY protocol directly into the master node's result relation.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef MULTI_RESULT_STREAM_H
+#define MULTI_RESULT_STREAM_H
+
+#include "fmgr.h"
+
+#include "access/heapam.h"
+#include "access/tupdesc.h"
+#include "lib/stringinfo.h"
+#include "nodes/pg_list.h"
+#include "utils/relcache.h"
+#include "utils/sortsupport.h"
+#include "utils/tuplestore.h"
+
+
+/*
+ * TaskResultStream keeps the state needed to decode COPY data messages sent
+ * by worker nodes, and to append the decoded rows to the master node's result
+ * relation. Worker nodes send one COPY data message per row, so the stream
+ * doesn't need to keep any per-task state and can be shared by all tasks of a
+ * job. Streams that receive raw file contents instead, which may split rows
+ * across messages, keep the incomplete last row in pendingData. If the file is
+ * compressed, incomplete compressed blocks are kept in compressedData. If
+ * tupleStore is set, decoded rows are put into the tuple store instead of the
+ * relation, which then only provides the row format.
+ *
+ * A stream may also merge the sorted results of several tasks. Each task then
+ * decodes its rows into an input stream of its own, and the merging stream
+ * appends the inputs' rows to the relation in sort order, as far as the rows
+ * that arrived so far allow.
+ */
+typedef struct TaskResultStream
+{
+	Relation relation;
+	TupleDesc tupleDescriptor;
+	bool binary;
+
+	/* column input (or receive) functions and their arguments */
+	FmgrInfo *columnInputFunctions;
+	Oid *columnTypeIOParams;
+
+	/* per-row decoding state */
+	Datum *valueArray;
+	bool *isNullArray;
+	StringInfo fieldBuffer;
+	MemoryContext rowContext;
+
+	/* state for receiving raw file contents */
+	StringInfo pendingData;
+	StringInfo compressedData;
+	StringInfo decompressedBlock;
+	bool fileFormatKnown;
+	bool compressedFile;
+
+	/* state for inserting rows into the result relation */
+	BulkInsertState bulkInsertState;
+	CommandId commandId;
+	uint64 rowCount;
+
+	/* tuple store that receives rows instead of the relation, if set */
+	Tuplestorestate *tupleStore;
+
+	/* number of rows after which the stream stops appending rows, or -1 */
+	int64 rowLimit;
+
+	/* set once all rows of a merge input arrived, unused by other streams */
+	bool inputComplete;
+
+	/* state for merging input streams in sort order, if set */
+	struct TaskResultMerge *merge;
+} TaskResultStream;
+
+
+/* Config variable managed via guc.c */
+extern bool StreamRealTimeResults;
+
+
+/* Function declarations for streaming task results */
+extern TaskResultStream * CreateTaskResultStream(Relation relation, bool binaryFormat,
+												 int64 rowLimit);
+extern TaskResultStream * CreateTaskResultMergeStream(Relation relation,
+													  bool binaryFormat, int64 rowLimit,
+													  int inputCount,
+													  SortSupport sortKeys,
+													  int sortKeyCount);
+extern TaskResultStream * TaskResultStreamInput(TaskResultStream *resultStream,
+												int inputIndex);
+extern void MergeTaskResultStreamInputs(TaskResultStream *resultStream);
+extern bool TaskResultStreamLimitReached(TaskResultStream *resultStream);
+extern void TaskResultStreamReceive(void *streamState, char *copyData, int copyDataLength);
+extern void TaskResultStreamReceiveFileData(void *streamState, char *fileData,
+											int fileDataLength);
+extern bool TaskResultStreamFileComplete(TaskResultStream *resultStream);
+extern void FinishTaskResultStream(TaskResultStream *resultStream);
+extern uint64 MergeTaskResultFiles(Relation relation, bool binaryFormat,
+								   List *fileNameList, SortSupport sortKeys,
+								   int sortKeyCount, int64 rowLimit);
+
+
+#endif /* MULTI_RESULT_STREAM_H */
@@ -0,0 +1,32 @@
+/*-------------------------------------------------------------------------
+ *
+ * multi_router_plan_cache.h
+ *	  Declarations for the coordinator-side cache of router plans for
+ *	  parameterized single shard queries.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef MULTI_ROUTER_PLAN_CACHE_H
+#define MULTI_ROUTER_PLAN_CACHE_H
+
+#include "nodes/params.h"
+#include "nodes/parsenodes.h"
+#include "nodes/plannodes.h"
+
+
+/* Config variable managed via guc.c */
+extern int MaxCachedRouterPlans;
+
+
+/* Function declarations for caching router plans */
+extern char * RouterPlanCacheKey(Query *query, ParamListInfo boundParams);
+extern PlannedStmt * GetCachedRouterPlan(const char *cacheKey,
+										 ParamListInfo boundParams);
+extern void StoreCachedRouterPlan(const char *cacheKey, Query *originalQuery,
+								  ParamListInfo boundParams, PlannedStmt *plan);
+
+
+#endif /* MULTI_ROUTER_PLAN_CACHE_H */
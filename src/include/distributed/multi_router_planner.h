@@ -32,6 +32,7 @@ extern bool EnableRouterExecution;
 extern MultiPlan * CreateRouterPlan(Query *originalQuery, Query *query,
 									RelationRestrictionContext *restrictionContext);
 extern MultiPlan * CreateModifyPlan(Query *originalQuery, Query *query,
+									ParamListInfo boundParams,
 									RelationRestrictionContext *restrictionContext);
 
 extern void AddUninstantiatedPartitionRestriction(Query *originalQuery);
@@ -40,9 +41,11 @@ extern Query * ReorderInsertSelectTargetLists(Query *originalQuery,
 											  RangeTblEntry *insertRte,
 											  RangeTblEntry *subqueryRte);
 extern bool InsertSelectQuery(Query *query);
+extern List * MultiRowInsertTaskList(Query *jobQuery);
 extern Oid ExtractFirstDistributedTableId(Query *query);
 extern RangeTblEntry * ExtractSelectRangeTableEntry(Query *query);
 extern RangeTblEntry * ExtractInsertRangeTableEntry(Query *query);
+extern RangeTblEntry * ExtractValuesRangeTableEntry(Query *query);
 extern void AddShardIntervalRestrictionToSelect(Query *subqery,
 												ShardInterval *shardInterval);
 extern ShardInterval * FastShardPruning(Oid distributedTableId, Datum partitionValue);
@@ -32,7 +32,7 @@
 /* Task tracker executor related defines */
 #define TASK_ASSIGNMENT_QUERY "SELECT task_tracker_assign_task \
  ("UINT64_FORMAT ", %u, %s)"
-#define TASK_STATUS_QUERY "SELECT task_tracker_task_status("UINT64_FORMAT ", %u)"
+#define TASK_STATUSES_QUERY "SELECT task_tracker_task_statuses('%s', '%s', %d)"
 #define JOB_CLEANUP_QUERY "SELECT task_tracker_cleanup_job("UINT64_FORMAT ")"
 #define JOB_CLEANUP_TASK_ID INT_MAX
 
@@ -121,11 +121,17 @@ struct TaskExecution
 	int32 *connectionIdArray;
 	int32 *fileDescriptorArray;
 	TimestampTz connectStartTime;
+	TimestampTz poolWaitStartTime; /* when the task started queueing for the pool */
 	uint32 nodeCount;
 	uint32 currentNodeIndex;
 	uint32 querySourceNodeIndex; /* only applies to map fetch tasks */
 	int32 dataFetchTaskIndex;
 	uint32 failureCount;
+
+	/* only apply to hedged reads in the real-time executor */
+	TaskExecution *hedgeExecution;
+	bool hedged;
+	bool isHedge;
 };
 
 
@@ -160,9 +166,9 @@ typedef struct TaskTracker
 
 	HTAB *taskStateHash;
 	List *assignedTaskList;
-	int32 currentTaskIndex;
 	bool connectionBusy;
 	TrackerTaskState *connectionBusyOnTask;
+	List *connectionBusyOnTaskList;
 } TaskTracker;
 
 
@@ -178,15 +184,20 @@ typedef struct WorkerNodeState
 } WorkerNodeState;
 
 
+/* forward declared, to avoid having to include multi_result_stream.h */
+struct TaskResultStream;
+
+
 /* Config variable managed via guc.c */
 extern int RemoteTaskCheckInterval;
 extern int MaxAssignTaskBatchSize;
 extern int TaskExecutorType;
 extern bool BinaryMasterCopyFormat;
+extern int HedgedReadPercentile;
 
 
 /* Function declarations for distributed execution */
-extern void MultiRealTimeExecute(Job *job);
+extern void MultiRealTimeExecute(Job *job, struct TaskResultStream *resultStream);
 extern void MultiTaskTrackerExecute(Job *job);
 
 /* Function declarations common to more than one executor */
@@ -22,6 +22,9 @@ struct pg_result; /* target of the PGresult typedef */
 /* GUC, determining whether statements sent to remote nodes are logged */
 extern bool LogRemoteCommands;
 
+/* GUC, maximum number of statements prepared on each remote connection */
+extern int MaxCachedStatementsPerConnection;
+
 
 /* simple helpers */
 extern bool IsResponseOK(struct pg_result *result);
@@ -46,6 +49,15 @@ extern int SendRemoteCommandParams(MultiConnection *connection, const char *comm
 								   const char *const *parameterValues);
 extern struct pg_result * GetRemoteCommandResult(MultiConnection *connection,
 												 bool raiseInterrupts);
+extern bool RemoteCommandResultAvailable(MultiConnection *connection);
+extern void WaitForAnyRemoteCommandResult(List *connectionList);
+
+/* prepared statement caching */
+extern int SendRemoteCachedCommandParams(MultiConnection *connection,
+										 const char *command, int parameterCount,
+										 const Oid *parameterTypes,
+										 const char *const *parameterValues);
+extern void FreePreparedStatementCache(MultiConnection *connection);
 
 
 #endif /* REMOTE_COMMAND_H */
@@ -37,6 +37,13 @@ extern ShardInterval * FindShardInterval(Datum partitionColumnValue,
 										 int shardCount, char partitionMethod,
 										 FmgrInfo *compareFunction,
 										 FmgrInfo *hashFunction, bool useBinarySearch);
+extern void FindShardIntervalIndexes(Datum *partitionValueArray, int valueCount,
+									 ShardInterval **shardIntervalCache, int shardCount,
+									 char partitionMethod, FmgrInfo *compareFunction,
+									 FmgrInfo *hashFunction, bool useBinarySearch,
+									 int *shardIndexArray);
+extern void HashPartitionValues(Datum *partitionValueArray, int valueCount,
+								FmgrInfo *hashFunction, Datum *hashValueArray);
 extern bool SingleReplicatedTable(Oid relationId);
 
 #endif /* SHARDINTERVAL_UTILS_H_ */
@@ -0,0 +1,33 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_connection_pool.h
+ *	  Declarations for bounding the number of connections that all backends
+ *	  of a node open to each worker node.
+ *
+ * Copyright (c) 2016, Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARED_CONNECTION_POOL_H
+#define SHARED_CONNECTION_POOL_H
+
+
+/* interval at which backends check for a free shared connection, in ms */
+#define SHARED_CONNECTION_WAIT_INTERVAL 10
+
+
+/* Config variable managed via guc.c */
+extern int MaxSharedPoolSize;
+
+
+/* Function declarations for the shared connection pool */
+extern void InitializeSharedConnectionPool(void);
+extern bool TryReserveSharedConnection(const char *hostname, int32 port);
+extern void WaitForSharedConnection(const char *hostname, int32 port);
+extern void ReportSharedConnectionPoolExhausted(const char *hostname, int32 port);
+extern void ReleaseSharedConnection(const char *hostname, int32 port);
+extern bool SharedConnectionPoolExhausted(const char *hostname, int32 port);
+
+
+#endif /* SHARED_CONNECTION_POOL_H */
@@ -15,6 +15,8 @@
 #ifndef TASK_TRACKER_H
 #define TASK_TRACKER_H
 
+#include "nodes/pg_list.h"
+#include "storage/latch.h"
 #include "storage/lwlock.h"
 #include "utils/hsearch.h"
 
@@ -27,6 +29,12 @@
 #define TASK_CALL_STRING_SIZE 12288 /* max length of task call string */
 #define TEMPLATE0_NAME "template0"  /* skip job schema cleanup for template0 */
 #define JOB_SCHEMA_CLEANUP "SELECT worker_cleanup_job_schema_cache()"
+#define MERGE_TASK_CALL_PREFIX "SELECT worker_merge_files_"
+#define MAP_OUTPUT_FETCH_TASK_CALL_PREFIX "SELECT worker_fetch_partition_file"
+
+/* the shared task hash is partitioned by job id; each partition has a lock */
+#define WORKER_TASKS_HASH_PARTITION_BITS 4
+#define WORKER_TASKS_HASH_PARTITIONS (1 << WORKER_TASKS_HASH_PARTITION_BITS)
 
 
 /*
@@ -66,6 +74,17 @@ typedef enum
 } TaskStatus;
 
 
+/*
+ * TaskSchedulingPolicyType enumerates the policies the task tracker can use to
+ * pick the next tasks to run among the tasks assigned to it.
+ */
+typedef enum
+{
+	TASK_SCHEDULING_FIFO = 0,
+	TASK_SCHEDULING_FAIR_SHARE = 1
+} TaskSchedulingPolicyType;
+
+
 /*
  * WorkerTask keeps shared memory state for tasks. At a high level, each worker
  * task holds onto three different types of state: (a) state assigned by the
@@ -85,6 +104,8 @@ typedef struct WorkerTask
 	char userName[NAMEDATALEN]; /* user to use for local backend connection */
 	int32 connectionId;     /* connection id to local backend */
 	uint32 failureCount;    /* number of task failures */
+	uint32 schedulingWeight; /* job's relative share of running tasks */
+	bool mergeTask;         /* fetches or merges outputs of completed map tasks */
 } WorkerTask;
 
 
@@ -97,10 +118,23 @@ typedef struct WorkerTasksSharedStateData
 	/* Hash table shared by the task tracker and task tracker protocol functions */
 	HTAB *taskHash;
 
-	/* Lock protecting workerNodesHash */
+	/*
+	 * Locks protecting the partitions of taskHash. All tasks of a job fall into
+	 * the same partition; see WorkerTasksHashPartitionLock().
+	 */
 	int taskHashTrancheId;
 	LWLockTranche taskHashLockTranche;
-	LWLock taskHashLock;
+	LWLockPadded taskHashLocks[WORKER_TASKS_HASH_PARTITIONS];
+
+	/* Latch of the task tracker process; set to wake the process up */
+	Latch *taskTrackerLatch;
+
+	/*
+	 * Latches of backends that wait for tasks to finish, indexed by backend id.
+	 * The task tracker sets these latches whenever a task finishes.
+	 */
+	int taskStatusWaiterCount;
+	Latch *taskStatusWaiterLatches[FLEXIBLE_ARRAY_MEMBER];
 } WorkerTasksSharedStateData;
 
 
@@ -108,6 +142,9 @@ typedef struct WorkerTasksSharedStateData
 extern int TaskTrackerDelay;
 extern int MaxTrackedTasksPerNode;
 extern int MaxRunningTasksPerNode;
+extern int TaskSchedulingPolicy;
+extern bool PrioritizeMergeTasks;
+extern int TaskSchedulingWeight;
 
 /* State shared by the task tracker and task tracker protocol functions */
 extern WorkerTasksSharedStateData *WorkerTasksSharedState;
@@ -116,6 +153,16 @@ extern WorkerTasksSharedStateData *WorkerTasksSharedState;
 /* Function declarations local to the worker module */
 extern WorkerTask * WorkerTasksHashEnter(uint64 jobId, uint32 taskId);
 extern WorkerTask * WorkerTasksHashFind(uint64 jobId, uint32 taskId);
+extern LWLock * WorkerTasksHashPartitionLock(uint64 jobId);
+extern void LockWorkerTasksHash(LWLockMode lockMode);
+extern void UnlockWorkerTasksHash(void);
+extern void WakeupTaskTracker(void);
+extern bool RegisterTaskStatusWaiter(void);
+extern void UnregisterTaskStatusWaiter(void);
+extern void WakeupTaskStatusWaiters(void);
+extern WorkerTask * SchedulableTaskPriorityQueue(HTAB *WorkerTasksHash);
+extern List * FairShareTaskList(HTAB *WorkerTasksHash, WorkerTask *taskQueue,
+								uint32 queueSize, uint32 tasksToScheduleCount);
 
 /* Function declarations for starting up and running the task tracker */
 extern void TaskTrackerRegister(void);
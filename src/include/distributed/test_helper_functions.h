@@ -70,7 +70,12 @@ extern Datum prune_using_no_values(PG_FUNCTION_ARGS);
 extern Datum prune_using_single_value(PG_FUNCTION_ARGS);
 extern Datum prune_using_either_value(PG_FUNCTION_ARGS);
 extern Datum prune_using_both_values(PG_FUNCTION_ARGS);
+extern Datum route_partition_values(PG_FUNCTION_ARGS);
+extern Datum benchmark_shard_routing(PG_FUNCTION_ARGS);
 extern Datum debug_equality_expression(PG_FUNCTION_ARGS);
 
+/* function declarations for exercising task tracker scheduling functions */
+extern Datum fair_share_task_list(PG_FUNCTION_ARGS);
+
 
 #endif /* CITUS_TEST_HELPER_FUNCTIONS_H */
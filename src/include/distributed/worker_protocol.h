@@ -19,6 +19,7 @@
 #include "nodes/parsenodes.h"
 #include "storage/fd.h"
 #include "utils/array.h"
+#include "utils/relcache.h"
 
 
 /* Number of rows to prefetch when reading data with a cursor */
@@ -34,6 +35,7 @@
 #define TABLE_FILE_PREFIX "table_"
 #define PARTITION_FILE_PREFIX "p_"
 #define ATTEMPT_FILE_SUFFIX ".attempt"
+#define LOCATION_FILE_SUFFIX ".location"
 #define MERGE_TABLE_SUFFIX "_merge"
 #define MIN_JOB_DIRNAME_WIDTH 4
 #define MIN_TASK_FILENAME_WIDTH 6
@@ -41,6 +43,14 @@
 #define FOREIGN_FILENAME_OPTION "filename"
 #define CSTORE_TABLE_SIZE_FUNCTION_NAME "cstore_table_size"
 
+/*
+ * Compressed partition files start with this signature, which includes the
+ * terminating zero byte. Like the binary COPY signature, it can't be confused
+ * with data in COPY's text format.
+ */
+#define COMPRESSED_FILE_SIGNATURE "CITUSLZ\n\377\r\n"
+#define COMPRESSED_FILE_SIGNATURE_LENGTH sizeof(COMPRESSED_FILE_SIGNATURE)
+
 /* Defines used for fetching files and tables */
 /* the tablename in the overloaded COPY statement is the to-be-transferred file */
 #define TRANSMIT_REGULAR_COMMAND "COPY \"%s\" TO STDOUT WITH (format 'transmit')"
@@ -87,13 +97,15 @@ typedef struct HashPartitionContext
  * FileOutputStream helps buffer write operations to a file; these writes are
  * then regularly flushed to the underlying file. This structure differs from
  * standard file output streams in that it keeps a larger buffer, and only
- * supports appending data to virtual file descriptors.
+ * supports appending data to virtual file descriptors. If the stream is
+ * compressed, each flush writes the buffered data as one compressed block.
  */
 typedef struct FileOutputStream
 {
 	File fileDescriptor;
 	StringInfo fileBuffer;
 	StringInfo filePath;
+	bool compressed;
 } FileOutputStream;
 
 
@@ -101,6 +113,9 @@ typedef struct FileOutputStream
 extern int PartitionBufferSize;
 extern bool ExpireCachedShards;
 extern bool BinaryWorkerCopyFormat;
+extern bool StreamPartitionFiles;
+extern bool CompressPartitionFiles;
+extern bool EnableParallelPartitioning;
 
 
 /* Function declarations local to the worker module */
@@ -124,6 +139,9 @@ extern FmgrInfo * GetFunctionInfo(Oid typeId, Oid accessMethodId, int16 procedur
 extern List * TableDDLCommandList(const char *nodeName, uint32 nodePort,
 								  const char *tableName);
 
+extern uint64 StreamPartitionFileIntoRelation(const char *locationFilename,
+											  Relation relation);
+
 /* Function declarations shared with the master planner */
 extern StringInfo TaskFilename(StringInfo directoryName, uint32 taskId);
 extern List * ExecuteRemoteQuery(const char *nodeName, uint32 nodePort, char *runAsUser,
@@ -0,0 +1,48 @@
+setup
+{
+    CREATE TABLE shared_pool_table (key integer, value integer);
+    SELECT master_create_distributed_table('shared_pool_table', 'key', 'hash');
+    SELECT master_create_worker_shards('shared_pool_table', 1, 1);
+    INSERT INTO shared_pool_table VALUES (1, 1);
+}
+
+setup
+{
+    ALTER SYSTEM SET citus.max_shared_pool_size TO 1;
+}
+
+setup
+{
+    SELECT pg_reload_conf();
+    SELECT pg_sleep(0.5);
+}
+
+teardown
+{
+    DROP TABLE shared_pool_table;
+    ALTER SYSTEM RESET citus.max_shared_pool_size;
+    SELECT pg_reload_conf();
+}
+
+session "s1"
+
+step "s1-select"
+{
+    SELECT count(*) FROM shared_pool_table WHERE key = 1;
+}
+
+session "s2"
+
+setup
+{
+    SET citus.node_connection_timeout TO 1000;
+}
+
+step "s2-select"
+{
+    SELECT count(*) FROM shared_pool_table WHERE key = 1;
+}
+
+# s1 stays idle after its query, but doesn't keep the only connection to the
+# worker node; so s2 gets a connection without waiting for s1 to exit
+permutation "s1-select" "s2-select"
@@ -0,0 +1,102 @@
+--
+-- MULTI_AGG_COMBINE
+--
+
+
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART 530000;
+ALTER SEQUENCE pg_catalog.pg_dist_jobid_seq RESTART 530000;
+
+-- Check aggregates that we compute by combining partial states from workers
+
+SELECT round(stddev(l_quantity), 4) AS stddev, round(variance(l_quantity), 4) AS variance
+	FROM lineitem;
+
+SELECT bool_and(l_quantity > 0), bool_or(l_quantity > 49), bit_or(l_linenumber),
+	bit_and(l_linenumber) FROM lineitem;
+
+SELECT l_returnflag, round(stddev_samp(l_extendedprice), 2) AS stddev_samp,
+	round(stddev_pop(l_extendedprice), 2) AS stddev_pop
+	FROM lineitem GROUP BY l_returnflag ORDER BY l_returnflag;
+
+-- Check that we don't support distinct and order by with these aggregates
+
+SELECT stddev(DISTINCT l_quantity) FROM lineitem;
+
+SELECT bool_and(l_quantity > 0 ORDER BY l_orderkey) FROM lineitem;
+
+-- Check that we don't support aggregates with multiple arguments
+
+SELECT corr(l_quantity, l_discount) FROM lineitem;
+
+-- Check a user-defined aggregate with a combine function. Its oid differs
+-- between the master and worker nodes, and its schema isn't on the search
+-- path, so worker nodes need to look it up by its qualified name.
+
+CREATE SCHEMA agg_combine;
+CREATE FUNCTION agg_combine.sum_squares_sfunc(bigint, bigint) RETURNS bigint
+	AS 'SELECT $1 + $2 * $2' LANGUAGE SQL IMMUTABLE STRICT;
+CREATE AGGREGATE agg_combine.sum_squares(bigint) (
+	sfunc = agg_combine.sum_squares_sfunc, stype = bigint, combinefunc = int8pl,
+	initcond = '0');
+
+\c - - - :worker_1_port
+CREATE SCHEMA agg_combine;
+CREATE FUNCTION agg_combine.sum_squares_sfunc(bigint, bigint) RETURNS bigint
+	AS 'SELECT $1 + $2 * $2' LANGUAGE SQL IMMUTABLE STRICT;
+CREATE AGGREGATE agg_combine.sum_squares(bigint) (
+	sfunc = agg_combine.sum_squares_sfunc, stype = bigint, combinefunc = int8pl,
+	initcond = '0');
+
+\c - - - :worker_2_port
+CREATE SCHEMA agg_combine;
+CREATE FUNCTION agg_combine.sum_squares_sfunc(bigint, bigint) RETURNS bigint
+	AS 'SELECT $1 + $2 * $2' LANGUAGE SQL IMMUTABLE STRICT;
+CREATE AGGREGATE agg_combine.sum_squares(bigint) (
+	sfunc = agg_combine.sum_squares_sfunc, stype = bigint, combinefunc = int8pl,
+	initcond = '0');
+
+\c - - - :master_port
+
+SELECT agg_combine.sum_squares(l_linenumber) = sum(l_linenumber * l_linenumber)
+	AS sum_squares_matches FROM lineitem;
+
+-- Check that worker_partial_agg() and master_combine_agg() only accept the
+-- argument and result types of the given aggregate, and that they check the
+-- user's permission to execute the aggregate
+
+SELECT worker_partial_agg('max(text)'::regprocedure, 1);
+
+SELECT master_combine_agg('sum(bigint)'::regprocedure, NULL::bytea, NULL::text);
+
+SELECT 'agg_combine.sum_squares(bigint)'::regprocedure::oid AS sum_squares_oid \gset
+REVOKE EXECUTE ON FUNCTION agg_combine.sum_squares(bigint) FROM PUBLIC;
+
+CREATE USER agg_combine_user;
+SET ROLE agg_combine_user;
+SELECT worker_partial_agg(:sum_squares_oid, 1::bigint);
+RESET ROLE;
+DROP USER agg_combine_user;
+
+-- Check that floating point transition states keep their precision
+
+SELECT master_combine_agg('variance(float8)'::regprocedure, partial_state, NULL::float8) =
+	(SELECT variance(x) FROM (VALUES (1.0::float8 / 3), (2.0::float8 / 7)) AS v(x))
+	AS variance_matches
+	FROM (SELECT worker_partial_agg('variance(float8)'::regprocedure, x) AS partial_state
+		  FROM (VALUES (1.0::float8 / 3), (2.0::float8 / 7)) AS v(x)) AS partial_states;
+
+DROP AGGREGATE agg_combine.sum_squares(bigint);
+DROP FUNCTION agg_combine.sum_squares_sfunc(bigint, bigint);
+DROP SCHEMA agg_combine;
+
+\c - - - :worker_1_port
+DROP AGGREGATE agg_combine.sum_squares(bigint);
+DROP FUNCTION agg_combine.sum_squares_sfunc(bigint, bigint);
+DROP SCHEMA agg_combine;
+
+\c - - - :worker_2_port
+DROP AGGREGATE agg_combine.sum_squares(bigint);
+DROP FUNCTION agg_combine.sum_squares_sfunc(bigint, bigint);
+DROP SCHEMA agg_combine;
+
+\c - - - :master_port
@@ -0,0 +1,35 @@
+--
+-- MULTI_AGG_HIGH_CARDINALITY
+--
+
+
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART 550000;
+ALTER SEQUENCE pg_catalog.pg_dist_jobid_seq RESTART 550000;
+
+
+-- Aggregate groups in a hash table when task results fit into work_mem
+
+SELECT l_partkey, count(*) AS line_count, sum(l_quantity) AS total_quantity
+	FROM lineitem
+	GROUP BY l_partkey
+	ORDER BY line_count DESC, l_partkey LIMIT 5;
+
+-- Otherwise, check that we sort task results and aggregate sorted groups, and
+-- that results stay the same
+
+SET work_mem TO '64kB';
+SET client_min_messages TO DEBUG1;
+
+SELECT l_partkey, count(*) AS line_count, sum(l_quantity) AS total_quantity
+	FROM lineitem
+	GROUP BY l_partkey
+	ORDER BY line_count DESC, l_partkey LIMIT 5;
+
+SELECT count(*) FROM lineitem GROUP BY l_returnflag ORDER BY 1;
+
+-- Group by columns that can't be hashed are always aggregated in sort order
+
+SELECT l_linenumber::bit(3) AS line_bits FROM lineitem GROUP BY 1 ORDER BY 1;
+
+RESET client_min_messages;
+RESET work_mem;
@@ -0,0 +1,118 @@
+--
+-- MULTI_AGG_SKETCHES
+--
+
+
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART 540000;
+ALTER SEQUENCE pg_catalog.pg_dist_jobid_seq RESTART 540000;
+
+CREATE TABLE latencies (
+	id integer not null,
+	latency double precision not null,
+	url text not null
+);
+SELECT master_create_distributed_table('latencies', 'id', 'hash');
+SELECT master_create_worker_shards('latencies', 4, 2);
+
+\copy latencies FROM STDIN with delimiter '|';
+1|1|url1
+2|2|url2
+3|3|url0
+4|4|url1
+5|5|url2
+6|6|url0
+7|7|url1
+8|8|url2
+9|9|url0
+10|10|url1
+\.
+
+-- Check that percentiles are only approximated when enabled
+
+SELECT percentile_cont(0.5) WITHIN GROUP (ORDER BY latency) FROM latencies;
+
+SET citus.enable_approximate_percentiles TO on;
+
+SELECT percentile_cont(0.5) WITHIN GROUP (ORDER BY latency) AS p50,
+	percentile_cont(0.9) WITHIN GROUP (ORDER BY latency) AS p90,
+	percentile_cont(0.99) WITHIN GROUP (ORDER BY latency) AS p99
+	FROM latencies;
+
+SELECT url, percentile_cont(0.5) WITHIN GROUP (ORDER BY latency) FROM latencies
+	GROUP BY url ORDER BY url;
+
+SELECT percentile_cont(ARRAY[0.5, 0.9]) WITHIN GROUP (ORDER BY latency) FROM latencies;
+
+SELECT percentile_cont(0.9) WITHIN GROUP (ORDER BY latency DESC) AS p90_desc,
+	percentile_cont(0.9) WITHIN GROUP (ORDER BY latency USING >) AS p90_using
+	FROM latencies;
+
+RESET citus.enable_approximate_percentiles;
+
+-- Check that t-digests and top-n summaries are merged across shards
+
+SELECT tdigest_percentile(tdigest_add_agg(latency), 0.25) FROM latencies;
+
+SELECT topn_add_agg(url) FROM latencies;
+
+SELECT * FROM topn('{{url1,4},{url0,3},{url2,3}}', 2);
+
+-- Check that digests only take finite values and positive weights
+
+SELECT tdigest_add_agg(x) FROM (VALUES (1.0::float8), ('Infinity')) AS v(x);
+
+SELECT tdigest_union_agg(ARRAY[[i::float8, 0]]) FROM generate_series(1, 1000) i;
+
+SELECT tdigest_percentile('{{1,1},{2,NaN}}', 0.5);
+
+DROP TABLE latencies;
+
+-- Check summaries over inputs that are large enough for t-digests to get
+-- compressed, and for top-n summaries to drop infrequent values on each shard.
+-- Latencies are spread evenly from 1 to 100000. Two URLs occur 25000 and 12500
+-- times, and 12500 other URLs occur 5 times each.
+
+CREATE TABLE large_latencies (
+	id integer not null,
+	latency double precision not null,
+	url text not null
+);
+SELECT master_create_distributed_table('large_latencies', 'id', 'hash');
+SELECT master_create_worker_shards('large_latencies', 4, 1);
+
+SELECT current_setting('data_directory') || '/large_latencies.data'
+	AS large_latencies_file \gset
+
+COPY (SELECT i, i, CASE WHEN i % 4 = 0 THEN 'hot1' WHEN i % 8 = 1 THEN 'hot2'
+						ELSE 'url' || (i % 20000) END
+	  FROM generate_series(1, 100000) AS i) TO :'large_latencies_file';
+COPY large_latencies FROM :'large_latencies_file';
+
+SELECT abs(tdigest_percentile(tdigest_add_agg(latency), 0.5) - 50000) < 1000
+	AS p50_accurate,
+	abs(tdigest_percentile(tdigest_add_agg(latency), 0.99) - 99000) < 500
+	AS p99_accurate
+	FROM large_latencies;
+
+SET citus.enable_approximate_percentiles TO on;
+
+SELECT abs(percentile_cont(0.01) WITHIN GROUP (ORDER BY latency) - 1000) < 500
+	AS p1_accurate,
+	abs(percentile_cont(0.5) WITHIN GROUP (ORDER BY latency) - 50000) < 1000
+	AS p50_accurate
+	FROM large_latencies;
+
+RESET citus.enable_approximate_percentiles;
+
+-- Frequencies in top-n summaries are lower bounds
+
+SELECT topn_add_agg(url) AS url_summary FROM large_latencies \gset
+
+SELECT array_length(:'url_summary'::text[], 1) <= 1000 AS summary_bounded;
+
+SELECT item, CASE item WHEN 'hot1' THEN frequency BETWEEN 24000 AND 25000
+					   WHEN 'hot2' THEN frequency BETWEEN 11500 AND 12500 END
+	AS frequency_accurate
+	FROM topn(:'url_summary', 2);
+
+DROP TABLE large_latencies;
@@ -19,3 +19,22 @@ SET citus.task_executor_type TO 'real-time';
 
 SELECT count(*) FROM lineitem;
 SELECT l_shipmode FROM lineitem WHERE l_partkey = 67310 OR l_partkey = 155190;
+
+-- Try streaming real-time executor results in binary and text format
+
+SET citus.stream_real_time_results TO 'on';
+
+SELECT count(*) FROM lineitem;
+SELECT l_shipmode FROM lineitem WHERE l_partkey = 67310 OR l_partkey = 155190;
+
+SET citus.binary_master_copy_format TO 'off';
+
+SELECT count(*) FROM lineitem;
+SELECT l_shipmode FROM lineitem WHERE l_partkey = 67310 OR l_partkey = 155190;
+
+-- Queries with a limit stop streaming once enough rows arrived
+SELECT l_quantity > 0 AS positive FROM lineitem LIMIT 3;
+SELECT l_quantity > 0 AS positive FROM lineitem LIMIT 2 OFFSET 1;
+SELECT l_shipmode FROM lineitem WHERE l_partkey = 67310 OR l_partkey = 155190 LIMIT 0;
+
+RESET citus.stream_real_time_results;
@@ -102,3 +102,15 @@ SELECT count(*)
 	WHERE orders1.o_orderkey = orders2.o_orderkey
 	AND orders1.o_orderkey = 1
 	AND orders2.o_orderkey is NULL;
+
+-- Check that point queries find their shard through fast path pruning, and
+-- that other restrictions on the partition column fall back to constraint
+-- exclusion.
+
+SET client_min_messages TO DEBUG3;
+
+SELECT count(*) FROM orders_hash_partitioned WHERE o_orderkey = 1;
+SELECT count(*) FROM orders_hash_partitioned
+	WHERE o_orderkey = 1 AND o_orderkey > 0;
+
+RESET client_min_messages;
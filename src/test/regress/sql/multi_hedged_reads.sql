@@ -0,0 +1,104 @@
+--
+-- MULTI_HEDGED_READS
+--
+
+
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART 1390000;
+ALTER SEQUENCE pg_catalog.pg_dist_jobid_seq RESTART 1390000;
+
+
+-- Check that a task which is slow to answer on its first placement also runs on
+-- its second placement, and that the slow execution gets cancelled. The delay
+-- function below sleeps once per shard query on the given port, or on all ports
+-- if no port is given. We define it as stable so that workers evaluate it as a
+-- one-time filter.
+
+CREATE FUNCTION hedged_reads_delay(slow_port integer, seconds float8)
+RETURNS boolean AS $$
+BEGIN
+	IF slow_port IS NULL OR current_setting('port')::integer = slow_port THEN
+		PERFORM pg_sleep(seconds);
+	END IF;
+	RETURN true;
+END;
+$$ LANGUAGE plpgsql STABLE;
+
+\c - - - :worker_1_port
+CREATE FUNCTION hedged_reads_delay(slow_port integer, seconds float8)
+RETURNS boolean AS $$
+BEGIN
+	IF slow_port IS NULL OR current_setting('port')::integer = slow_port THEN
+		PERFORM pg_sleep(seconds);
+	END IF;
+	RETURN true;
+END;
+$$ LANGUAGE plpgsql STABLE;
+
+\c - - - :worker_2_port
+CREATE FUNCTION hedged_reads_delay(slow_port integer, seconds float8)
+RETURNS boolean AS $$
+BEGIN
+	IF slow_port IS NULL OR current_setting('port')::integer = slow_port THEN
+		PERFORM pg_sleep(seconds);
+	END IF;
+	RETURN true;
+END;
+$$ LANGUAGE plpgsql STABLE;
+
+\c - - - :master_port
+
+-- Each shard has its first placement on a different worker node
+
+CREATE TABLE hedged_reads_table (key integer, value integer);
+SELECT master_create_distributed_table('hedged_reads_table', 'key', 'hash');
+SELECT master_create_worker_shards('hedged_reads_table', 2, 2);
+
+INSERT INTO hedged_reads_table VALUES (1, 1);
+INSERT INTO hedged_reads_table VALUES (2, 2);
+INSERT INTO hedged_reads_table VALUES (3, 3);
+INSERT INTO hedged_reads_table VALUES (4, 4);
+
+-- Fill the latency histogram with tasks that take about 100 ms each. Hedging
+-- only starts once the histogram holds 32 samples, so none of these queries
+-- are hedged themselves.
+
+SET citus.task_assignment_policy TO 'first-replica';
+SET citus.hedged_read_percentile TO 1;
+
+DO $$
+BEGIN
+	FOR i IN 1..16 LOOP
+		PERFORM count(*) FROM hedged_reads_table WHERE hedged_reads_delay(NULL, 0.1);
+	END LOOP;
+END;
+$$;
+
+-- Now make the first worker node slow. Its task gets hedged after about 100 ms
+-- and answers from the second worker node instead, so the query returns well
+-- before the slow placement would have answered.
+
+SELECT clock_timestamp() AS hedged_reads_start \gset
+
+SELECT count(*), sum(value) FROM hedged_reads_table
+	WHERE hedged_reads_delay(:worker_1_port, 10);
+
+SELECT clock_timestamp() - :'hedged_reads_start'::timestamptz < interval '5 seconds'
+	AS answered_early;
+
+RESET citus.hedged_read_percentile;
+RESET citus.task_assignment_policy;
+
+-- The execution on the slow placement should have been cancelled
+
+\c - - - :worker_1_port
+SELECT count(*) FROM pg_stat_activity
+	WHERE state = 'active' AND query LIKE '%hedged_reads_delay%' AND
+		  pid <> pg_backend_pid();
+DROP FUNCTION hedged_reads_delay(integer, float8);
+
+\c - - - :worker_2_port
+DROP FUNCTION hedged_reads_delay(integer, float8);
+
+\c - - - :master_port
+DROP TABLE hedged_reads_table;
+DROP FUNCTION hedged_reads_delay(integer, float8);
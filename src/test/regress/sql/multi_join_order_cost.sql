@@ -0,0 +1,84 @@
+--
+-- MULTI_JOIN_ORDER_COST
+--
+
+
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART 1020000;
+ALTER SEQUENCE pg_catalog.pg_dist_jobid_seq RESTART 1020000;
+
+
+-- Set configuration to print table join order
+
+SET citus.explain_distributed_queries TO off;
+SET citus.log_multi_join_order TO TRUE;
+
+-- Create a large table with many shards, and a table with few but large shards
+
+CREATE TABLE events_cost (
+	event_id bigint not null,
+	user_id bigint not null,
+	event_type integer not null);
+SELECT master_create_distributed_table('events_cost', 'event_id', 'hash');
+SELECT master_create_worker_shards('events_cost', 8, 1);
+
+CREATE TABLE users_cost (
+	user_id bigint not null,
+	user_name text not null);
+SELECT master_create_distributed_table('users_cost', 'user_id', 'hash');
+SELECT master_create_worker_shards('users_cost', 2, 1);
+
+-- Record shard sizes of 8MB in total for events and 200GB in total for users
+
+UPDATE pg_dist_shard_placement SET shardlength = 1000000
+	WHERE shardid IN (SELECT shardid FROM pg_dist_shard
+					  WHERE logicalrelid = 'events_cost'::regclass);
+UPDATE pg_dist_shard_placement SET shardlength = 100000000000
+	WHERE shardid IN (SELECT shardid FROM pg_dist_shard
+					  WHERE logicalrelid = 'users_cost'::regclass);
+
+SET client_min_messages TO LOG;
+
+-- Users has fewer shards than the large table shard count, so rule-based join
+-- ordering broadcasts it regardless of its size
+
+EXPLAIN SELECT count(*) FROM events_cost e, users_cost u
+	WHERE e.user_id = u.user_id;
+
+-- Only the task-tracker executor runs repartition joins, so join rules are
+-- still ranked by type for the real-time executor
+
+SET citus.enable_cost_based_join_order TO on;
+
+EXPLAIN SELECT count(*) FROM events_cost e, users_cost u
+	WHERE e.user_id = u.user_id;
+
+-- With the task-tracker executor, cost based join ordering repartitions both
+-- tables instead, since that moves fewer bytes than sending 200GB to each
+-- worker node
+
+SET citus.task_executor_type TO 'task-tracker';
+
+EXPLAIN SELECT count(*) FROM events_cost e, users_cost u
+	WHERE e.user_id = u.user_id;
+
+SELECT count(*) FROM events_cost e, users_cost u
+	WHERE e.user_id = u.user_id;
+
+-- Once users is small, broadcasting it is again the cheapest join rule
+
+UPDATE pg_dist_shard_placement SET shardlength = 1000
+	WHERE shardid IN (SELECT shardid FROM pg_dist_shard
+					  WHERE logicalrelid = 'users_cost'::regclass);
+
+EXPLAIN SELECT count(*) FROM events_cost e, users_cost u
+	WHERE e.user_id = u.user_id;
+
+RESET citus.task_executor_type;
+RESET citus.enable_cost_based_join_order;
+
+-- Reset client logging level to its previous value
+
+SET client_min_messages TO NOTICE;
+
+DROP TABLE events_cost;
+DROP TABLE users_cost;
@@ -64,3 +64,67 @@ SELECT l_quantity, l_discount, avg(l_partkey) FROM lineitem
 	ORDER BY l_quantity, l_discount LIMIT 1;
 
 SET client_min_messages TO NOTICE;
+
+-- Check that we push down limits on aggregates exactly when each group lies
+-- within one shard, and that the master node merges sorted task results.
+
+CREATE TABLE limit_orders (
+	id integer not null,
+	customer_id integer not null,
+	amount integer not null
+);
+SELECT master_create_distributed_table('limit_orders', 'customer_id', 'hash');
+SELECT master_create_worker_shards('limit_orders', 4, 1);
+
+\copy limit_orders FROM STDIN with delimiter '|';
+1|1|10
+2|1|20
+3|2|5
+4|3|50
+5|4|15
+6|4|25
+7|5|40
+8|6|1
+9|7|30
+10|8|35
+\.
+
+SET client_min_messages TO DEBUG1;
+
+SELECT customer_id, sum(amount) AS total FROM limit_orders
+	GROUP BY customer_id
+	ORDER BY total DESC, customer_id LIMIT 3;
+
+-- Having clauses are evaluated on the master node, so we don't push down limits
+
+SELECT customer_id, count(*) AS order_count FROM limit_orders
+	GROUP BY customer_id
+	HAVING sum(amount) > 10
+	ORDER BY order_count DESC, customer_id LIMIT 2;
+
+SELECT id, amount FROM limit_orders ORDER BY amount DESC LIMIT 4;
+
+SELECT id, amount FROM limit_orders ORDER BY amount LIMIT 3 OFFSET 2;
+
+-- When streaming real-time results, the master node merges sorted task results
+-- as they arrive instead of merging task files. Worker nodes only sort results
+-- of queries with a limit, and not on aggregates computed on the master node.
+-- The master node sorts the streamed results of other queries.
+
+SET citus.stream_real_time_results TO on;
+
+SELECT id, amount FROM limit_orders ORDER BY amount DESC LIMIT 4;
+
+SELECT id, amount FROM limit_orders ORDER BY amount LIMIT 3 OFFSET 2;
+
+SELECT id FROM limit_orders ORDER BY id;
+
+SELECT amount >= 30 AS large, count(*) FROM limit_orders
+	GROUP BY amount >= 30
+	ORDER BY count(*) DESC LIMIT 1;
+
+RESET citus.stream_real_time_results;
+
+SET client_min_messages TO NOTICE;
+
+DROP TABLE limit_orders;
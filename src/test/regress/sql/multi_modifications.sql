@@ -147,9 +147,20 @@ DELETE FROM limit_orders WHERE id = 246 AND bidder_id = (random() * 1000);
 -- (the cast to timestamp is because the timestamp_eq_timestamptz operator is stable)
 DELETE FROM limit_orders WHERE id = 246 AND placed_at = current_timestamp::timestamp;
 
--- commands with multiple rows are unsupported
+-- multi-row INSERTs need a partition column value in every row
 INSERT INTO limit_orders VALUES (DEFAULT), (DEFAULT);
 
+-- multi-row INSERTs are split into one command per shard
+INSERT INTO limit_orders VALUES (22037, 'GM', 30, '2007-08-27 12:41:03', 'buy', 0.58),
+								(22038, 'GM', 30, '2007-08-27 12:41:03', 'buy', 0.59),
+								(22039, 'GM', 30, '2007-08-27 12:41:03', 'buy', 0.60);
+SELECT COUNT(*) FROM limit_orders WHERE id BETWEEN 22037 AND 22039;
+
+-- STABLE functions in multi-row INSERTs are evaluated on the master
+INSERT INTO limit_orders VALUES (22040, 'GM', 30, now(), 'buy', 0.58),
+								(22041, 'GM', 30, now(), 'buy', 0.59);
+SELECT COUNT(*) FROM limit_orders WHERE id BETWEEN 22040 AND 22041;
+
 -- Who says that? :)
 -- INSERT ... SELECT ... FROM commands are unsupported
 -- INSERT INTO limit_orders SELECT * FROM limit_orders;
@@ -418,3 +429,15 @@ SELECT master_create_worker_shards('app_analytics_events', 4, 1);
 INSERT INTO app_analytics_events VALUES (DEFAULT, 101, 'Fauxkemon Geaux') RETURNING id;
 INSERT INTO app_analytics_events (app_id, name) VALUES (102, 'Wayz') RETURNING id;
 INSERT INTO app_analytics_events (app_id, name) VALUES (103, 'Mynt') RETURNING *;
+
+-- multi-row INSERTs evaluate omitted defaults on the master, once per row
+INSERT INTO app_analytics_events (app_id, name)
+VALUES (104, 'Wayz'), (105, 'Mynt'), (106, 'Lyft'), (107, 'Yelp'), (108, 'Etsy');
+SELECT * FROM app_analytics_events WHERE app_id > 103 ORDER BY id;
+
+-- and send each row to the shard its partition column value hashes to
+SELECT shardminvalue, result AS app_ids
+FROM run_command_on_shards('app_analytics_events',
+	$$SELECT string_agg(app_id::text, ',' ORDER BY app_id) FROM %s WHERE app_id > 103$$)
+	JOIN pg_dist_shard USING (shardid)
+ORDER BY shardminvalue::int;
@@ -77,7 +77,7 @@ DELETE FROM limit_orders_mx WHERE id = 246 AND bidder_id = (random() * 1000);
 -- (the cast to timestamp is because the timestamp_eq_timestamptz operator is stable)
 DELETE FROM limit_orders_mx WHERE id = 246 AND placed_at = current_timestamp::timestamp;
 
--- commands with multiple rows are unsupported
+-- multi-row INSERTs need a partition column value in every row
 INSERT INTO limit_orders_mx VALUES (DEFAULT), (DEFAULT);
 
 -- INSERT ... SELECT ... FROM commands are unsupported from workers
@@ -193,6 +193,25 @@ EXECUTE prepared_select(4, 40);
 EXECUTE prepared_select(5, 50);
 EXECUTE prepared_select(6, 60);
 
+-- test parameterized selects with statements cached on worker connections
+SET citus.max_cached_statements_per_connection TO 1;
+SET client_min_messages TO DEBUG1;
+
+-- the second execution reuses the statement prepared by the first
+EXECUTE prepared_select(1, 10);
+EXECUTE prepared_select(2, 20);
+
+-- a different statement on the same connection evicts the cached one
+PREPARE prepared_select_other(integer, integer) AS
+	SELECT count(*) FROM router_executor_table
+		WHERE id = 1 AND stats <> ROW($1, $2)::test_composite_type;
+
+EXECUTE prepared_select_other(1, 10);
+EXECUTE prepared_select(7, 70);
+
+RESET client_min_messages;
+RESET citus.max_cached_statements_per_connection;
+
 -- Test that parameterized partition column for an insert is supported
 
 PREPARE prepared_partition_column_insert(bigint) AS
@@ -283,6 +302,25 @@ EXECUTE prepared_router_partition_column_select(4);
 EXECUTE prepared_router_partition_column_select(5);
 EXECUTE prepared_router_partition_column_select(6);
 
+-- check router executor select with cached router plans
+SET citus.max_cached_router_plans TO 1;
+SET client_min_messages TO DEBUG1;
+
+-- the second execution for each shard uses the plan cached by the first
+EXECUTE prepared_router_partition_column_select(1);
+EXECUTE prepared_router_partition_column_select(2);
+EXECUTE prepared_router_partition_column_select(1);
+EXECUTE prepared_router_partition_column_select(2);
+
+-- metadata changes on the table invalidate its cached plans
+UPDATE pg_dist_shard_placement SET shardstate = shardstate WHERE shardid = 790002;
+
+EXECUTE prepared_router_partition_column_select(1);
+EXECUTE prepared_router_partition_column_select(1);
+
+RESET client_min_messages;
+RESET citus.max_cached_router_plans;
+
 PREPARE prepared_router_non_partition_column_select(int) AS
 	SELECT
 		prepare_table.key,
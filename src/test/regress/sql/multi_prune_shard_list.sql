@@ -37,6 +37,16 @@ CREATE FUNCTION print_sorted_shard_intervals(regclass)
 	AS 'citus'
 	LANGUAGE C STRICT;
 
+CREATE FUNCTION route_partition_values(regclass, anyarray)
+	RETURNS bigint[]
+	AS 'citus'
+	LANGUAGE C STRICT;
+
+CREATE FUNCTION benchmark_shard_routing(regclass, anyarray, integer, bool)
+	RETURNS float8
+	AS 'citus'
+	LANGUAGE C STRICT;
+
 -- ===================================================================
 -- test shard pruning functionality
 -- ===================================================================
@@ -122,3 +132,55 @@ SELECT print_sorted_shard_intervals('pruning_range');
 -- all shard placements are uninitialized
 UPDATE pg_dist_shard set shardminvalue = NULL, shardmaxvalue = NULL WHERE shardid = 103077;
 SELECT print_sorted_shard_intervals('pruning_range');
+
+-- ===================================================================
+-- test batched routing of partition values to shards
+-- ===================================================================
+
+-- routing a batch of values agrees with single value pruning
+SELECT route_partition_values('pruning', ARRAY['tomato', 'petunia', 'rose']);
+
+-- values must have the type of the partition column
+SELECT route_partition_values('pruning', ARRAY[1, 2]);
+
+-- text values are routed to the shards covering their hashes
+SELECT route_partition_values('pruning', array_agg(species ORDER BY species)) =
+	array_agg(shardid ORDER BY species) AS routed_correctly
+FROM (SELECT md5(i::text) AS species, shardid
+	  FROM generate_series(1, 1000) i, pg_dist_shard
+	  WHERE logicalrelid = 'pruning'::regclass AND
+			worker_hash(md5(i::text)) BETWEEN shardminvalue::int AND shardmaxvalue::int) routed;
+
+-- as are bigint values, including ones outside of the integer range
+CREATE TABLE pruning_int8 ( plant_id bigint, species text );
+SELECT master_create_distributed_table('pruning_int8', 'plant_id', 'hash');
+SELECT master_create_worker_shards('pruning_int8', 4, 1);
+
+SELECT route_partition_values('pruning_int8', array_agg(plant_id ORDER BY plant_id)) =
+	array_agg(shardid ORDER BY plant_id) AS routed_correctly
+FROM (SELECT i * 12345678901 AS plant_id, shardid
+	  FROM generate_series(-500, 500) i, pg_dist_shard
+	  WHERE logicalrelid = 'pruning_int8'::regclass AND
+			worker_hash(i * 12345678901) BETWEEN shardminvalue::int AND shardmaxvalue::int) routed;
+
+-- COPY routes rows in batches, and each row lands in the shard covering its hash
+COPY pruning_int8 (plant_id) FROM PROGRAM 'seq -1000 1000';
+
+SELECT count(*) AS shard_count, bool_and(result::int = expected_count) AS copied_correctly
+FROM run_command_on_shards('pruning_int8', 'SELECT count(*) FROM %s') copied
+	 JOIN (SELECT shardid, count(*) AS expected_count
+		   FROM generate_series(-1000, 1000) i, pg_dist_shard
+		   WHERE logicalrelid = 'pruning_int8'::regclass AND
+				 worker_hash(i::bigint) BETWEEN shardminvalue::int AND shardmaxvalue::int
+		   GROUP BY shardid) expected USING (shardid);
+
+-- micro-benchmark routing int8 and text values one at a time and in batches
+SELECT benchmark_shard_routing('pruning_int8', array_agg(i::bigint), 10, false) >= 0 AS per_row,
+	   benchmark_shard_routing('pruning_int8', array_agg(i::bigint), 10, true) >= 0 AS batched
+FROM generate_series(1, 10000) i;
+
+SELECT benchmark_shard_routing('pruning', array_agg(md5(i::text)), 10, false) >= 0 AS per_row,
+	   benchmark_shard_routing('pruning', array_agg(md5(i::text)), 10, true) >= 0 AS batched
+FROM generate_series(1, 10000) i;
+
+DROP TABLE pruning_int8;
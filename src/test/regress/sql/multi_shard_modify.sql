@@ -96,6 +96,28 @@ SET citus.multi_shard_commit_protocol TO '2pc';
 SELECT master_modify_multiple_shards('DELETE FROM multi_shard_modify_test WHERE t_key > 100');
 SELECT count(*) FROM multi_shard_modify_test;
 
+-- Check that limiting concurrent commands per worker still modifies all shards
+SELECT sum(t_value) AS value_sum FROM multi_shard_modify_test
+\gset
+SET citus.max_concurrent_modify_tasks_per_node TO 1;
+SELECT master_modify_multiple_shards('UPDATE multi_shard_modify_test SET t_value = t_value + 1');
+SELECT sum(t_value) - :value_sum AS value_increase FROM multi_shard_modify_test;
+SET citus.max_concurrent_modify_tasks_per_node TO 2;
+SELECT master_modify_multiple_shards('UPDATE multi_shard_modify_test SET t_value = t_value - 1');
+SELECT sum(t_value) - :value_sum AS value_increase FROM multi_shard_modify_test;
+
+-- Check that errors are reported when commands wait for the node, and that
+-- the modification is rolled back on all shards without marking placements
+SET citus.max_concurrent_modify_tasks_per_node TO 1;
+\set VERBOSITY terse
+SELECT master_modify_multiple_shards('UPDATE multi_shard_modify_test SET t_value = t_value / (t_key - 7)');
+\set VERBOSITY default
+SELECT sum(t_value) - :value_sum AS value_increase FROM multi_shard_modify_test;
+SELECT count(*) AS unhealthy_placements
+FROM pg_dist_shard_placement JOIN pg_dist_shard USING (shardid)
+WHERE logicalrelid = 'multi_shard_modify_test'::regclass AND shardstate != 1;
+RESET citus.max_concurrent_modify_tasks_per_node;
+
 -- Check that shard pruning works
 SET client_min_messages TO DEBUG2;
 SELECT master_modify_multiple_shards('DELETE FROM multi_shard_modify_test WHERE t_key = 15');
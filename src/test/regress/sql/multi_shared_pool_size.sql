@@ -0,0 +1,68 @@
+--
+-- MULTI_SHARED_POOL_SIZE
+--
+
+
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART 1400000;
+ALTER SEQUENCE pg_catalog.pg_dist_jobid_seq RESTART 1400000;
+
+
+-- Each worker node has two shards of this table
+
+CREATE TABLE shared_pool_table (key integer, value integer);
+SELECT master_create_distributed_table('shared_pool_table', 'key', 'hash');
+SELECT master_create_worker_shards('shared_pool_table', 4, 1);
+
+INSERT INTO shared_pool_table VALUES (1, 1);
+INSERT INTO shared_pool_table VALUES (2, 2);
+INSERT INTO shared_pool_table VALUES (3, 3);
+INSERT INTO shared_pool_table VALUES (4, 4);
+
+-- The single shard of this table is on the first worker node
+
+CREATE TABLE shared_pool_single_shard (key integer, value integer);
+SELECT master_create_distributed_table('shared_pool_single_shard', 'key', 'hash');
+SELECT master_create_worker_shards('shared_pool_single_shard', 1, 1);
+
+-- Allow only one connection from the master node to each worker node
+
+ALTER SYSTEM SET citus.max_shared_pool_size TO 1;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.5);
+SHOW citus.max_shared_pool_size;
+
+-- Tasks on the same worker node take turns using the connection
+
+SELECT count(*), sum(value) FROM shared_pool_table;
+
+-- Each modification gives its connection back at commit
+
+INSERT INTO shared_pool_table VALUES (5, 5);
+INSERT INTO shared_pool_table VALUES (6, 6);
+
+SELECT count(*), sum(value) FROM shared_pool_table;
+
+-- A transaction that holds the only connection to the first worker node can't
+-- open another one, not even as a query's first connection to the node. The
+-- query errors out after the connection timeout.
+
+SET citus.node_connection_timeout TO 1000;
+
+BEGIN;
+SELECT count(*) FROM shared_pool_single_shard WHERE key = 1;
+SELECT count(*) FROM shared_pool_table;
+ROLLBACK;
+
+-- The connection was given back at the end of the transaction
+
+SELECT count(*), sum(value) FROM shared_pool_table;
+
+RESET citus.node_connection_timeout;
+
+ALTER SYSTEM RESET citus.max_shared_pool_size;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.5);
+SHOW citus.max_shared_pool_size;
+
+DROP TABLE shared_pool_table;
+DROP TABLE shared_pool_single_shard;
@@ -85,7 +85,7 @@ SELECT case when (currval('pg_dist_jobid_seq') % 2) = 0
        	    then nextval('pg_dist_jobid_seq') % 2
 	    else 1 end;
 
--- Finally test the round-robin task assignment policy
+-- Next test the round-robin task assignment policy
 
 SET citus.task_assignment_policy TO 'round-robin';
 
@@ -95,6 +95,17 @@ EXPLAIN SELECT count(*) FROM task_assignment_test_table;
 
 EXPLAIN SELECT count(*) FROM task_assignment_test_table;
 
+-- Finally test the load-aware task assignment policy. Node loads are only
+-- tracked while this policy or hedged reads are in use, and earlier tests used
+-- neither, so all nodes start out idle. Each task assigned to a node then adds
+-- to that node's load, which spreads tasks over the replicas.
+
+SET citus.task_assignment_policy TO 'load-aware';
+
+EXPLAIN SELECT count(*) FROM task_assignment_test_table;
+
+EXPLAIN SELECT count(*) FROM task_assignment_test_table;
+
 RESET citus.task_assignment_policy;
 RESET client_min_messages;
 
@@ -10,6 +10,7 @@ ALTER SEQUENCE pg_catalog.pg_dist_jobid_seq RESTART 1050000;
 \set JobId 401010
 \set SimpleTaskId 101101
 \set RecoverableTaskId 801102
+\set SleepingTaskId 801103
 
 \set SimpleTaskTable lineitem_simple_task
 \set BadQueryString '\'SELECT COUNT(*) FROM bad_table_name\''
@@ -52,3 +53,23 @@ SELECT task_tracker_assign_task(:JobId, :RecoverableTaskId, :GoodQueryString);
 SELECT pg_sleep(2.0);
 
 SELECT task_tracker_task_status(:JobId, :RecoverableTaskId);
+
+-- We check both tasks' statuses at once. As the tasks already finished, the
+-- status function doesn't wait. Unknown tasks have an invalid status.
+
+SELECT task_tracker_task_statuses(ARRAY[:JobId, :JobId, :JobId],
+				  ARRAY[:SimpleTaskId, :RecoverableTaskId, 1], 60000);
+
+-- A task that is still running makes the status function wait. The task tracker
+-- wakes the function up as soon as the task finishes, long before the wait time
+-- elapses.
+
+SELECT task_tracker_assign_task(:JobId, :SleepingTaskId, 'SELECT pg_sleep(1.0)');
+
+SELECT clock_timestamp() AS wait_start
+\gset
+
+SELECT task_tracker_task_statuses(ARRAY[:JobId], ARRAY[:SleepingTaskId], 60000);
+
+SELECT clock_timestamp() - :'wait_start'::timestamptz < interval '30 seconds'
+	AS woken_up;
@@ -0,0 +1,48 @@
+--
+-- TASK_TRACKER_FAIR_SHARE
+--
+
+
+CREATE FUNCTION fair_share_task_list(bigint[], integer[], integer[], boolean[], integer)
+	RETURNS integer[]
+	AS 'citus'
+	LANGUAGE C STRICT;
+
+-- Each call takes the job id, task id, scheduling weight, and running flag of
+-- every task, and returns the tasks picked to fill the free slots. Tasks that
+-- aren't running are assigned in the given order.
+
+-- Jobs with equal weights take turns, even though all tasks of the first job
+-- were assigned before those of the second job
+
+SELECT fair_share_task_list(ARRAY[1, 1, 1, 1, 2, 2, 2, 2],
+							ARRAY[11, 12, 13, 14, 21, 22, 23, 24],
+							ARRAY[1, 1, 1, 1, 1, 1, 1, 1],
+							ARRAY[false, false, false, false, false, false, false, false],
+							4);
+
+-- Running tasks count towards their job's share
+
+SELECT fair_share_task_list(ARRAY[1, 1, 1, 1, 2, 2, 2, 2],
+							ARRAY[11, 12, 13, 14, 21, 22, 23, 24],
+							ARRAY[1, 1, 1, 1, 1, 1, 1, 1],
+							ARRAY[true, true, false, false, false, false, false, false],
+							3);
+
+-- A job with three times the weight gets three times as many tasks
+
+SELECT fair_share_task_list(ARRAY[1, 1, 1, 1, 2, 2, 2, 2],
+							ARRAY[11, 12, 13, 14, 21, 22, 23, 24],
+							ARRAY[1, 1, 1, 1, 3, 3, 3, 3],
+							ARRAY[false, false, false, false, false, false, false, false],
+							5);
+
+-- Once a job runs out of tasks, the other job gets the remaining slots
+
+SELECT fair_share_task_list(ARRAY[1, 2, 2, 2],
+							ARRAY[11, 21, 22, 23],
+							ARRAY[1, 1, 1, 1],
+							ARRAY[false, false, false, false],
+							8);
+
+DROP FUNCTION fair_share_task_list(bigint[], integer[], integer[], boolean[], integer);
@@ -0,0 +1,47 @@
+--
+-- WORKER_COMPRESS_PARTITION_FILES
+--
+
+
+\set JobId 201010
+\set TaskId 101111
+\set Task_Table_Name public.task_101111
+\set Select_All 'SELECT *'
+
+-- Hash partition the lineitem table again, this time writing compressed
+-- partition files
+
+SET citus.compress_partition_files TO on;
+
+SELECT worker_hash_partition_table(:JobId, :TaskId, 'SELECT * FROM lineitem',
+       				   'l_orderkey', 'int8'::regtype, 4);
+
+RESET citus.compress_partition_files;
+
+-- Compressed files start with their signature, and take up less space than the
+-- files written without compression
+
+SELECT convert_from(pg_read_binary_file(
+       'base/pgsql_job_cache/job_201010/task_101111/p_00000', 0, 7), 'UTF8') AS signature;
+
+SELECT (pg_stat_file('base/pgsql_job_cache/job_201010/task_101111/p_00000')).size <
+       (pg_stat_file('base/pgsql_job_cache/job_201010/task_101103/p_00000')).size AS smaller;
+
+-- Merge tasks decode compressed files themselves, so the merged table should
+-- match the table we hash partitioned
+
+SELECT worker_merge_files_into_table(:JobId, :TaskId,
+       ARRAY['orderkey', 'partkey', 'suppkey', 'linenumber', 'quantity', 'extendedprice',
+             'discount', 'tax', 'returnflag', 'linestatus', 'shipdate', 'commitdate',
+	     'receiptdate', 'shipinstruct', 'shipmode', 'comment']::_text,
+       ARRAY['bigint', 'integer', 'integer', 'integer', 'decimal(15, 2)', 'decimal(15, 2)',
+             'decimal(15, 2)', 'decimal(15, 2)', 'char(1)', 'char(1)', 'date', 'date',
+	     'date', 'char(25)', 'char(10)', 'varchar(44)']::_text);
+
+SELECT COUNT(*) FROM :Task_Table_Name;
+
+SELECT COUNT(*) AS diff_lhs FROM ( :Select_All FROM :Task_Table_Name EXCEPT ALL
+       		   	    	   :Select_All FROM lineitem ) diff;
+
+SELECT COUNT(*) AS diff_rhs FROM ( :Select_All FROM lineitem EXCEPT ALL
+       		   	    	   :Select_All FROM :Task_Table_Name ) diff;
@@ -0,0 +1,42 @@
+--
+-- WORKER_MERGE_FILES_AND_RUN_QUERY
+--
+
+
+\set JobId 201010
+\set TaskId 101103
+\set Merge_Table_Query '\'CREATE TABLE task_101103_merge (orderkey bigint, partkey integer, suppkey integer, linenumber integer, quantity decimal(15, 2), extendedprice decimal(15, 2), discount decimal(15, 2), tax decimal(15, 2), returnflag char(1), linestatus char(1), shipdate date, commitdate date, receiptdate date, shipinstruct char(25), shipmode char(10), comment varchar(44))\''
+
+-- The final query checks that the merge table it reads from is temporary
+
+\set Result_Table_Query '\'CREATE TABLE merge_query_result AS SELECT count(*) AS row_count, sum(orderkey) AS orderkey_sum, (SELECT relpersistence FROM pg_class WHERE oid = \'\'task_101103_merge\'\'::regclass) AS merge_table_persistence FROM task_101103_merge\''
+
+-- TaskId determines our dependency on hash partitioned files. We merge these
+-- files into a temporary table, and run the final query on that table.
+
+SELECT worker_merge_files_and_run_query(:JobId, :TaskId, :Merge_Table_Query,
+										:Result_Table_Query);
+
+SELECT row_count = (SELECT count(*) FROM lineitem) AS row_count_matches,
+	   orderkey_sum = (SELECT sum(l_orderkey) FROM lineitem) AS orderkey_sum_matches,
+	   merge_table_persistence
+	FROM merge_query_result;
+
+-- The merge table is gone once the function returns
+
+SELECT count(*) FROM pg_class WHERE relname = 'task_101103_merge';
+
+DROP TABLE merge_query_result;
+
+-- Users without the TEMP privilege on the database can't run merge tasks
+
+CREATE USER merge_user;
+REVOKE TEMP ON DATABASE :"DBNAME" FROM PUBLIC;
+
+SET ROLE merge_user;
+SELECT worker_merge_files_and_run_query(:JobId, :TaskId, :Merge_Table_Query,
+										:Result_Table_Query);
+RESET ROLE;
+
+GRANT TEMP ON DATABASE :"DBNAME" TO PUBLIC;
+DROP USER merge_user;
@@ -0,0 +1,76 @@
+--
+-- WORKER_PARALLEL_HASH_PARTITION
+--
+
+
+\set JobId 201010
+\set TaskId 101112
+\set Select_All 'SELECT *'
+
+\set Table_Part_00 parallel_hash_part_00
+\set Table_Part_01 parallel_hash_part_01
+\set Table_Part_02 parallel_hash_part_02
+\set Table_Part_03 parallel_hash_part_03
+
+-- Hash partition the lineitem table again, this time allowing the filter query
+-- to scan the table with parallel workers. PostgreSQL 9.5 has no parallel
+-- query, so we only make parallel plans cheap on later versions.
+
+SET citus.enable_parallel_partitioning TO on;
+
+DO $$
+BEGIN
+	IF current_setting('server_version_num')::int >= 90600 THEN
+		PERFORM set_config('max_parallel_workers_per_gather', '2', false);
+		PERFORM set_config('parallel_setup_cost', '0', false);
+		PERFORM set_config('parallel_tuple_cost', '0', false);
+		PERFORM set_config('min_parallel_relation_size', '0', false);
+	END IF;
+END;
+$$;
+
+SELECT worker_hash_partition_table(:JobId, :TaskId, 'SELECT * FROM lineitem',
+       				   'l_orderkey', 'int8'::regtype, 4);
+
+RESET citus.enable_parallel_partitioning;
+
+CREATE TABLE :Table_Part_00 ( LIKE lineitem );
+CREATE TABLE :Table_Part_01 ( LIKE lineitem );
+CREATE TABLE :Table_Part_02 ( LIKE lineitem );
+CREATE TABLE :Table_Part_03 ( LIKE lineitem );
+
+COPY :Table_Part_00 FROM 'base/pgsql_job_cache/job_201010/task_101112/p_00000';
+COPY :Table_Part_01 FROM 'base/pgsql_job_cache/job_201010/task_101112/p_00001';
+COPY :Table_Part_02 FROM 'base/pgsql_job_cache/job_201010/task_101112/p_00002';
+COPY :Table_Part_03 FROM 'base/pgsql_job_cache/job_201010/task_101112/p_00003';
+
+-- Rows may reach the partition files in a different order, but each file should
+-- hold the same rows as the file written without parallel workers
+
+SELECT COUNT(*) AS diff_lhs_00 FROM (
+       :Select_All FROM :Table_Part_00 EXCEPT ALL
+       :Select_All FROM lineitem_hash_part_00 ) diff;
+SELECT COUNT(*) AS diff_lhs_01 FROM (
+       :Select_All FROM :Table_Part_01 EXCEPT ALL
+       :Select_All FROM lineitem_hash_part_01 ) diff;
+SELECT COUNT(*) AS diff_lhs_02 FROM (
+       :Select_All FROM :Table_Part_02 EXCEPT ALL
+       :Select_All FROM lineitem_hash_part_02 ) diff;
+SELECT COUNT(*) AS diff_lhs_03 FROM (
+       :Select_All FROM :Table_Part_03 EXCEPT ALL
+       :Select_All FROM lineitem_hash_part_03 ) diff;
+
+SELECT COUNT(*) AS diff_rhs_00 FROM (
+       :Select_All FROM lineitem_hash_part_00 EXCEPT ALL
+       :Select_All FROM :Table_Part_00 ) diff;
+SELECT COUNT(*) AS diff_rhs_01 FROM (
+       :Select_All FROM lineitem_hash_part_01 EXCEPT ALL
+       :Select_All FROM :Table_Part_01 ) diff;
+SELECT COUNT(*) AS diff_rhs_02 FROM (
+       :Select_All FROM lineitem_hash_part_02 EXCEPT ALL
+       :Select_All FROM :Table_Part_02 ) diff;
+SELECT COUNT(*) AS diff_rhs_03 FROM (
+       :Select_All FROM lineitem_hash_part_03 EXCEPT ALL
+       :Select_All FROM :Table_Part_03 ) diff;
+
+DROP TABLE :Table_Part_00, :Table_Part_01, :Table_Part_02, :Table_Part_03;
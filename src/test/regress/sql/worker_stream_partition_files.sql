@@ -0,0 +1,42 @@
+--
+-- WORKER_STREAM_PARTITION_FILES
+--
+
+
+\set JobId 201010
+\set PartitionTaskId 101103
+\set TaskId 101110
+\set Task_Table_Name public.task_101110
+\set Table_Part_00 lineitem_hash_part_00
+\set Select_All 'SELECT *'
+
+-- When partition files are streamed, fetching a partition file only records its
+-- location in the upstream task's directory. The merge then reads the file's
+-- rows from the node that holds it.
+
+SET citus.stream_partition_files TO on;
+
+SELECT worker_fetch_partition_file(:JobId, :PartitionTaskId, 0, :TaskId,
+       'localhost', current_setting('port')::int);
+
+SELECT pg_ls_dir('base/pgsql_job_cache/job_201010/task_101110') AS task_file;
+
+SELECT worker_merge_files_into_table(:JobId, :TaskId,
+       ARRAY['orderkey', 'partkey', 'suppkey', 'linenumber', 'quantity', 'extendedprice',
+             'discount', 'tax', 'returnflag', 'linestatus', 'shipdate', 'commitdate',
+	     'receiptdate', 'shipinstruct', 'shipmode', 'comment']::_text,
+       ARRAY['bigint', 'integer', 'integer', 'integer', 'decimal(15, 2)', 'decimal(15, 2)',
+             'decimal(15, 2)', 'decimal(15, 2)', 'char(1)', 'char(1)', 'date', 'date',
+	     'date', 'char(25)', 'char(10)', 'varchar(44)']::_text);
+
+RESET citus.stream_partition_files;
+
+-- The merged table should match the partition we copied from the same file
+
+SELECT COUNT(*) FROM :Task_Table_Name;
+
+SELECT COUNT(*) AS diff_lhs FROM ( :Select_All FROM :Task_Table_Name EXCEPT ALL
+       		   	    	   :Select_All FROM :Table_Part_00 ) diff;
+
+SELECT COUNT(*) AS diff_rhs FROM ( :Select_All FROM :Table_Part_00 EXCEPT ALL
+       		   	    	   :Select_All FROM :Task_Table_Name ) diff;